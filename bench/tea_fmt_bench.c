@@ -0,0 +1,130 @@
+// Formats the same numbers with tea_fmt and with snprintf and prints the
+// time each takes. Built with -DTEA_BUILD_BENCH=ON, run as
+// tea_fmt_bench [count]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tea_fmt.h"
+
+typedef size_t (*tea_bench_fn_t)(char *buf, const void *values, size_t i);
+
+static size_t tea_bench_fmt_i64(char *buf, const void *values, const size_t i)
+{
+  return tea_fmt_i64(buf, ((const long long *)values)[i]);
+}
+
+static size_t tea_bench_printf_i64(char *buf, const void *values,
+                                   const size_t i)
+{
+  return (size_t)snprintf(buf, TEA_FMT_SIZE, "%lld",
+                          ((const long long *)values)[i]);
+}
+
+static size_t tea_bench_fmt_shortest(char *buf, const void *values,
+                                     const size_t i)
+{
+  return tea_fmt_f64(buf, ((const double *)values)[i], TEA_FMT_SHORTEST);
+}
+
+// The shortest text printf is sure to read back the same
+static size_t tea_bench_printf_g17(char *buf, const void *values,
+                                   const size_t i)
+{
+  return (size_t)snprintf(buf, TEA_FMT_SIZE, "%.17g",
+                          ((const double *)values)[i]);
+}
+
+static size_t tea_bench_fmt_fixed(char *buf, const void *values,
+                                  const size_t i)
+{
+  return tea_fmt_f64(buf, ((const double *)values)[i], 6);
+}
+
+static size_t tea_bench_printf_fixed(char *buf, const void *values,
+                                     const size_t i)
+{
+  return (size_t)snprintf(buf, TEA_FMT_SIZE, "%f",
+                          ((const double *)values)[i]);
+}
+
+static size_t tea_bench_fmt_f32(char *buf, const void *values, const size_t i)
+{
+  return tea_fmt_f32(buf, ((const float *)values)[i], TEA_FMT_SHORTEST);
+}
+
+static size_t tea_bench_printf_f32(char *buf, const void *values,
+                                   const size_t i)
+{
+  return (size_t)snprintf(buf, TEA_FMT_SIZE, "%.9g",
+                          (double)((const float *)values)[i]);
+}
+
+static void tea_bench_run(const char *name, const tea_bench_fn_t fn,
+                          const void *values, const size_t count)
+{
+  char buf[TEA_FMT_SIZE];
+  size_t bytes = 0;
+  const clock_t start = clock();
+  for (size_t i = 0; i < count; i++) {
+    bytes += fn(buf, values, i);
+  }
+  const double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("%-16s %8.1f ns/number %10zu bytes\n", name,
+         seconds * 1e9 / (double)count, bytes);
+}
+
+static uint64_t tea_bench_random(uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+int main(const int argc, char *argv[])
+{
+  const size_t count = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+  long long *integers = malloc(count * sizeof(*integers));
+  double *doubles = malloc(count * sizeof(*doubles));
+  double *prices = malloc(count * sizeof(*prices));
+  float *floats = malloc(count * sizeof(*floats));
+  if (!count || !integers || !doubles || !prices || !floats) {
+    fprintf(stderr, "Failed to allocate %zu numbers\n", count);
+    return 1;
+  }
+
+  // Integers of all lengths, doubles from random bits, and values like the
+  // columns of a CSV file
+  uint64_t state = 88172645463325252ull;
+  for (size_t i = 0; i < count; i++) {
+    const uint64_t bits = tea_bench_random(&state);
+    integers[i] = (long long)(bits >> (bits % 64));
+    memcpy(&doubles[i], &bits, sizeof(doubles[i]));
+    if (doubles[i] != doubles[i]) {
+      doubles[i] = 0.5;
+    }
+    prices[i] = (double)(bits % 10000000) / 100.0;
+    floats[i] = (float)prices[i];
+  }
+
+  tea_bench_run("fmt i64", tea_bench_fmt_i64, integers, count);
+  tea_bench_run("printf %lld", tea_bench_printf_i64, integers, count);
+  tea_bench_run("fmt shortest", tea_bench_fmt_shortest, doubles, count);
+  tea_bench_run("printf %.17g", tea_bench_printf_g17, doubles, count);
+  tea_bench_run("fmt csv", tea_bench_fmt_shortest, prices, count);
+  tea_bench_run("printf csv", tea_bench_printf_g17, prices, count);
+  tea_bench_run("fmt 6 decimals", tea_bench_fmt_fixed, prices, count);
+  tea_bench_run("printf %f", tea_bench_printf_fixed, prices, count);
+  tea_bench_run("fmt f32", tea_bench_fmt_f32, floats, count);
+  tea_bench_run("printf %.9g", tea_bench_printf_f32, floats, count);
+
+  free(integers);
+  free(doubles);
+  free(prices);
+  free(floats);
+  return 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "tea_fn.h"
+#include "tea_program.h"
+#include "tea_scope.h"
+
+// Type name of the instances that hold an actor
+#define TEA_ACTOR_TYPE "actor"
+
+// Messages an actor handles before its thread moves on to the next actor
+#ifndef TEA_ACTOR_BATCH
+#define TEA_ACTOR_BATCH 64
+#endif
+
+// Values nested deeper than this in a message can't be copied, which also
+// stops the copy of a dictionary that holds itself
+#ifndef TEA_ACTOR_MAX_NESTING
+#define TEA_ACTOR_MAX_NESTING 64
+#endif
+
+typedef struct tea_msg_t {
+  struct tea_msg_t *volatile next;
+  tea_val_t val;
+} tea_msg_t;
+
+// Queue of messages with many senders and the actor as the only receiver.
+// Senders link a message with one atomic exchange, without locks
+typedef struct {
+  tea_msg_t *volatile head; // last message sent
+  tea_msg_t *tail; // next message to receive, owned by the receiver
+  tea_msg_t stub;
+} tea_mailbox_t;
+
+// Isolated worker with a context and a scope of its own. Its state is
+// passed to the handler with each message and replaced by the result, and
+// it runs on one thread at a time, whichever thread of the pool that is
+typedef struct tea_actor_t {
+  tea_list_entry_t link;
+  struct tea_actors_t *sys;
+  const tea_fn_t *fn;
+  tea_ctx_t ctx;
+  tea_scope_t scp;
+  tea_val_t state;
+  tea_mailbox_t mailbox;
+  struct tea_actor_t *next_ready; // in the run queue of the pool
+  volatile long scheduled; // 1 while in the run queue or running
+  bool failed; // the handler failed, later messages are dropped
+} tea_actor_t;
+
+/**
+ * @brief Sets the number of threads that run the actors of a run.
+ * @param count The number of threads, 0 for one per processor.
+ */
+void tea_actors_set_threads(int count);
+
+// Returns the actor held by the value, NULL if it holds none
+tea_actor_t *tea_val_actor(const tea_val_t *value);
+
+// Copies a value to be sent to another actor. Strings, frozen instances
+// and actors are shared, dictionaries and other instances are copied.
+// Returns false if the value can't be sent
+bool tea_actor_copy(const tea_program_t *prog, const tea_val_t *value,
+                    tea_val_t *copy);
+
+// Waits until no actor of the context has messages left and stops its
+// threads
+void tea_actors_cleanup(const tea_ctx_t *ctx);
+
+/**
+ * @brief Binds the natives of actors.
+ *
+ * spawn('fn', state) starts an actor that calls fn(state, message) for each
+ * message it gets and keeps the result as its new state. send(actor,
+ * message) copies the message to the mailbox of the actor. self() returns
+ * the actor running the handler. wait_actors() waits until every actor has
+ * handled its messages and returns the number of messages handled so far,
+ * state_of(actor) waits the same way and returns a copy of the state.
+ * freeze(instance) makes the fields of an instance and of the instances it
+ * holds read only, so messages share it rather than copy it.
+ *
+ * @param prog The program, not loaded yet.
+ */
+void tea_bind_actors(tea_program_t *prog);
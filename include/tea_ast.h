@@ -23,6 +23,7 @@ typedef enum {
   TEA_N_FN_CALL,
   TEA_N_FN_ARGS,
   TEA_N_RET,
+  TEA_N_YIELD,
   TEA_N_BREAK,
   TEA_N_CONT,
   TEA_N_IF,
@@ -31,6 +32,10 @@ typedef enum {
   TEA_N_WHILE,
   TEA_N_WHILE_COND,
   TEA_N_WHILE_BODY,
+  TEA_N_FOR,
+  TEA_N_FOR_RANGE,
+  TEA_N_FOR_ITER,
+  TEA_N_FOR_BODY,
   TEA_N_STRUCT,
   TEA_N_STRUCT_FIELD,
   TEA_N_STRUCT_INST,
@@ -41,12 +46,20 @@ typedef enum {
   TEA_N_NULL,
   TEA_N_ARRAY_INST,
   TEA_N_DICT_INST,
+  TEA_N_IMPORT,
 } tea_node_type_t;
 
+// Slot of a call node whose method name isn't looked up yet, the name is
+// looked up on each call then
+#define TEA_SLOT_UNRESOLVED (-2)
+// Slot of a call node whose method name no type has
+#define TEA_SLOT_NONE (-1)
+
 typedef struct tea_node {
   tea_list_entry_t link;
   tea_node_type_t type;
   tea_tok_t *tok;
+  long slot; // method slot of a call, resolved when the program is loaded
 
   union {
     tea_list_entry_t children;
@@ -82,6 +95,11 @@ void tea_node_set_binop(tea_node_t *parent, tea_node_t *lhs, tea_node_t *rhs);
 void tea_node_set_field_acc(tea_node_t *parent, tea_node_t *obj,
                             tea_node_t *field);
 void tea_node_free(tea_node_t *node);
+// Deep copy of the node, the tokens are shared with the original
+tea_node_t *tea_node_clone(const tea_node_t *node);
+// Moves the contents of 'with' into 'node' and frees 'with', the node keeps
+// its place in the tree
+void tea_node_replace(tea_node_t *node, tea_node_t *with);
 void tea_node_print(tea_node_t *node, int depth);
 
 const char *tea_node_type_name(tea_node_type_t type);
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tea_value.h"
+
+/**
+ * @brief Kind of a dictionary key.
+ */
+typedef enum {
+  TEA_KEY_NONE, /**< Removed entry (tombstone) */
+  TEA_KEY_STR,  /**< String key, by pointer if interned, else by content */
+  TEA_KEY_INT,  /**< Integer key */
+} tea_key_type_t;
+
+/**
+ * @brief Dictionary key with a cached hash.
+ */
+typedef struct {
+  tea_key_type_t type;
+  uint32_t hash;
+  int size;         /**< Length of the string key in bytes */
+  bool is_interned; /**< The string comes from tea_dict_intern */
+
+  union {
+    const char *str;
+    int64_t i64;
+  };
+} tea_dict_key_t;
+
+typedef struct {
+  tea_dict_key_t key;
+  tea_val_t val;
+} tea_dict_entry_t;
+
+/**
+ * @brief Open-addressing hash table with SwissTable-style control bytes.
+ *        Entries are kept in a dense array in insertion order, the control
+ *        bytes and slots only index into that array.
+ */
+typedef struct tea_dict_t {
+  tea_dict_entry_t *entries;
+  unsigned long entry_count; /**< Used entries including tombstones */
+  unsigned long entry_capacity;
+  unsigned long size; /**< Live entries */
+  unsigned char *ctrl;
+  uint32_t *slots;
+  unsigned long slot_mask;
+  unsigned long growth_left;
+} tea_dict_t;
+
+/**
+ * @brief Hashes a byte string, used for string keys and identifier tokens.
+ * @param str The bytes to hash.
+ * @param size The number of bytes.
+ * @return The hash value.
+ */
+uint32_t tea_dict_hash_str(const char *str, int size);
+
+/**
+ * @brief Hashes an integer key.
+ * @param value The integer to hash.
+ * @return The hash value.
+ */
+uint32_t tea_dict_hash_int(int64_t value);
+
+/**
+ * @brief Returns the interned copy of a string. Equal strings get the same
+ *        pointer, it stays valid until tea_dict_intern_cleanup.
+ * @param str The bytes of the string.
+ * @param size The number of bytes.
+ * @param hash The hash of the string, from tea_dict_hash_str.
+ * @return The terminated interned string, or NULL on allocation failure.
+ */
+const char *tea_dict_intern(const char *str, int size, uint32_t hash);
+
+void tea_dict_intern_init(void);
+void tea_dict_intern_cleanup(void);
+
+/**
+ * @brief Builds a string key, the string is not copied.
+ */
+tea_dict_key_t tea_dict_key_str(const char *str, int size);
+
+/**
+ * @brief Builds a string key from a token with an already computed hash and
+ *        the interned string of the lexer.
+ */
+tea_dict_key_t tea_dict_key_tok(const tea_tok_t *tok);
+
+/**
+ * @brief Builds an integer key.
+ */
+tea_dict_key_t tea_dict_key_int(int64_t value);
+
+/**
+ * @brief Creates an empty dictionary.
+ * @param capacity Number of entries to reserve space for (0 for default).
+ * @return The new dictionary, or NULL on allocation failure.
+ */
+tea_dict_t *tea_dict_create(unsigned long capacity);
+
+/**
+ * @brief Frees the dictionary and the keys it copied.
+ */
+void tea_dict_free(tea_dict_t *dict);
+
+/**
+ * @brief Makes sure that capacity entries fit without rehashing.
+ * @return false on allocation failure.
+ */
+bool tea_dict_reserve(tea_dict_t *dict, unsigned long capacity);
+
+/**
+ * @brief Finds the value stored under the key.
+ * @return Pointer to the value, or NULL if the key is absent.
+ */
+tea_val_t *tea_dict_find(const tea_dict_t *dict, const tea_dict_key_t *key);
+
+/**
+ * @brief Inserts or updates a value. Interned string keys are stored as they
+ *        are, other string keys are copied on insertion.
+ * @return Pointer to the stored value, or NULL on allocation failure.
+ */
+tea_val_t *tea_dict_set(tea_dict_t *dict, const tea_dict_key_t *key,
+                        tea_val_t val);
+
+/**
+ * @brief Removes the key from the dictionary.
+ * @return true if the key was present.
+ */
+bool tea_dict_remove(tea_dict_t *dict, const tea_dict_key_t *key);
+
+/**
+ * @brief Iterates over the live entries in insertion order.
+ * @param dict The dictionary.
+ * @param it Iterator state, must be 0 before the first call.
+ * @return The next entry, or NULL when the iteration is complete.
+ */
+tea_dict_entry_t *tea_dict_next(const tea_dict_t *dict, unsigned long *it);
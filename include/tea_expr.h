@@ -6,6 +6,21 @@
 tea_val_t tea_eval_expr(tea_ctx_t *ctx, tea_scope_t *scp,
                         const tea_node_t *node);
 
+// Evaluates the expression for a target of the given type, the value is
+// widened to that type when possible
+tea_val_t tea_eval_expr_as(tea_ctx_t *ctx, tea_scope_t *scp,
+                           const tea_node_t *node, tea_val_type_t type);
+
+// Returns the predefined type of a type field or a parameter, TEA_V_UNDEF
+// if the type is a user type
+tea_val_type_t tea_decl_val_type(const tea_node_t *node);
+
+// Evaluates the expression as a condition, logical operators short-circuit
+// and comparisons are tested without building a value. Returns false if the
+// evaluation failed
+bool tea_eval_cond(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
+                   bool *result);
+
 tea_val_t tea_eval_int(tea_tok_t *tok);
 tea_val_t tea_eval_float(tea_tok_t *tok);
 tea_val_t tea_eval_binop(tea_ctx_t *ctx, tea_scope_t *scp,
@@ -14,3 +29,5 @@ tea_val_t tea_eval_unary(tea_ctx_t *ctx, tea_scope_t *scp,
                          const tea_node_t *node);
 tea_val_t tea_eval_ident(const tea_scope_t *scp, const tea_node_t *node);
 tea_val_t tea_eval_str(const tea_node_t *node);
+tea_val_t tea_eval_dict(tea_ctx_t *ctx, tea_scope_t *scp,
+                        const tea_node_t *node);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+
+// Shortest digits that read back as the same number, for the precision of
+// the float functions
+#define TEA_FMT_SHORTEST -1
+
+// Largest precision, a larger one is cut to it
+#define TEA_FMT_MAX_PRECISION 20
+
+// Room for any number formatted by these functions, with the terminator
+#define TEA_FMT_SIZE 400
+
+/**
+ * @brief Formats an integer as "%lld" does, two digits at a time.
+ * @param buf Buffer of at least TEA_FMT_SIZE bytes.
+ * @param value The integer.
+ * @return The length of the text, which is terminated.
+ */
+size_t tea_fmt_i64(char *buf, long long value);
+
+size_t tea_fmt_u64(char *buf, unsigned long long value);
+
+/**
+ * @brief Formats a floating-point number.
+ *
+ * With TEA_FMT_SHORTEST the text is the shortest that reads back as the
+ * same double, found without trial and error (Ryu), as in 0.1, 2.0 or
+ * 1e+16: numbers from 1e-4 up to 1e16 are written without an exponent.
+ * With a precision of zero or more, it is written with that many decimals
+ * as "%.*f" does.
+ *
+ * @param buf Buffer of at least TEA_FMT_SIZE bytes.
+ * @param value The number.
+ * @param precision The number of decimals, or TEA_FMT_SHORTEST.
+ * @return The length of the text, which is terminated.
+ */
+size_t tea_fmt_f64(char *buf, double value, int precision);
+
+// Same as tea_fmt_f64, the shortest text reads back as the same float
+size_t tea_fmt_f32(char *buf, float value, int precision);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "tea_memo.h"
 #include "tea_scope.h"
 #include "tea_value.h"
 
@@ -9,9 +10,49 @@ typedef struct {
   const tea_tok_t *ret_type;
   const tea_node_t *body;
   const tea_node_t *params;
+  const char *ns; // module of the function, NULL for the program file
+  unsigned long order; // see tea_program_t.decl_order
   unsigned char mut : 1;
+  unsigned char gen : 1; // has a yield statement, a call creates a generator
+  long memo_index; // cache of a @memo function in ctx->memos, -1 otherwise
 } tea_fn_t;
 
+// Default limit for nested calls, 0 for none: calls then nest until the
+// native stack is nearly used up. Tail calls do not count since they reuse
+// the frame of the caller
+#ifndef TEA_MAX_CALL_DEPTH
+#define TEA_MAX_CALL_DEPTH 0
+#endif
+
+// Native stack a call leaves for the natives and the evaluator when it
+// would nest deeper
+#ifndef TEA_STACK_RESERVE
+#define TEA_STACK_RESERVE (256 * 1024)
+#endif
+
+// Frame of a running script function, frames are linked from ctx->frame
+// down to the outermost call
+typedef struct tea_frame_t {
+  struct tea_frame_t *prev;
+  const tea_fn_t *fn;
+  const tea_node_t *call;
+  tea_scope_t *caller_scp;
+  // A tail call binds its arguments into the scope that is not in use,
+  // then the current one is released and the two are swapped
+  tea_scope_t scps[2];
+  int scp_index;
+  // Variables the functions that made tail calls could see, which the
+  // function they called still sees as a nested call would
+  tea_scope_t tail_scp;
+  struct tea_gen_t *gen; // generator being resumed, NULL for a plain call
+} tea_frame_t;
+
+typedef enum {
+  TEA_CALL_ERR,
+  TEA_CALL_NATIVE,
+  TEA_CALL_FN,
+} tea_call_kind_t;
+
 typedef struct {
   tea_list_entry_t args;
   tea_list_entry_t popped_args;
@@ -19,33 +60,111 @@ typedef struct {
 
 typedef tea_val_t (*tea_native_fn_cb_t)(tea_fn_args_t *args);
 
+// Natives bound with a signature get the arguments as an array on the stack
+// and the context of the call, for example to call script functions
+typedef tea_val_t (*tea_native_span_cb_t)(tea_ctx_t *ctx, const tea_val_t *args,
+                                          int argc);
+
+// Arguments of a native function bound with a signature, more are an error
+#ifndef TEA_NATIVE_MAX_ARGS
+#define TEA_NATIVE_MAX_ARGS 16
+#endif
+
+// Parsed from a string such as "f32 (f32, f32)" or "void (string, ...)",
+// 'any' and the extra arguments of a variadic function aren't converted
+typedef struct {
+  tea_val_type_t ret; // TEA_V_UNDEF for void or any, the result isn't checked
+  bool has_ret; // not void, an undefined result fails the call
+  int argc;
+  bool variadic;
+  tea_val_type_t params[TEA_NATIVE_MAX_ARGS]; // TEA_V_UNDEF for any
+  unsigned int str_params; // bit i is set if parameter i is a string
+} tea_native_sig_t;
+
 typedef struct {
   tea_list_entry_t link;
   const char *owner_name;
   const char *fn_name;
   tea_native_fn_cb_t cb;
+  tea_native_span_cb_t span_cb; // set instead of cb if bound with a signature
+  tea_native_sig_t sig;
+  unsigned char pure : 1; // can be called from @memo functions
 } tea_native_fn_t;
 
-typedef struct {
-  tea_val_t ret_val;
-  bool is_set;
-} tea_ret_ctx_t;
-
 tea_var_t *tea_fn_args_pop(tea_fn_args_t *args);
 
 const tea_native_fn_t *tea_ctx_find_native_fn(const tea_list_entry_t *functions,
                                               const char *owner_name,
                                               const char *fn_name);
+// Finds a function of the program file, or of a module if the name is
+// qualified as in "module.fn"
 const tea_fn_t *tea_ctx_find_fn(const tea_list_entry_t *functions,
                                 const char *name);
+// Finds a function of the namespace, NULL for the program file
+const tea_fn_t *tea_find_fn(const tea_list_entry_t *functions, const char *ns,
+                            const char *name);
+
+// Declares the function in the program in the namespace of its module, NULL
+// for the program file. Methods go to the table of their type which must be
+// declared before
+bool tea_decl_fn(tea_program_t *prog, const tea_node_t *node, const char *ns);
+
+// Returns the result cache of the @memo function in this run, NULL if the
+// function has none or it wasn't called yet
+tea_memo_t *tea_ctx_find_memo(const tea_ctx_t *ctx, const tea_fn_t *fn);
+
+#define TEA_PURE_QUIET      1 << 0 // don't log why the function isn't pure
+#define TEA_PURE_NO_NATIVES 1 << 1 // calls of pure natives aren't allowed
+#define TEA_PURE_NO_ALLOC   1 << 2 // strings and instances aren't allowed
+
+// Checks that the function has no effects besides its result and that the
+// result depends only on the arguments
+bool tea_is_pure_fn(const tea_ctx_t *ctx, const tea_fn_t *fn,
+                    unsigned int flags);
 
-bool tea_exec_fn_decl(tea_ctx_t *ctx, const tea_node_t *node);
+// Checks that one more call can nest, logs why it can't. The name is the
+// function called, the token where the call is, if any
+bool tea_can_nest(const tea_ctx_t *ctx, const char *name,
+                  const tea_tok_t *token);
 
+// Resolves the function of the call node and binds 'self' and the arguments,
+// evaluated in scp, into frame_scp. Native functions are called right away
+// and their result is stored in native_result
+tea_call_kind_t tea_bind_call(tea_ctx_t *ctx, tea_scope_t *scp,
+                              const tea_node_t *node, tea_scope_t *frame_scp,
+                              const tea_fn_t **fn, tea_val_t *native_result);
+// Calls the function, returns false if the call failed. A function without
+// a return statement leaves the result undefined
+bool tea_call_fn(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
+                 tea_val_t *result);
+// Calls the script function with the arguments tea_bind_call bound into
+// args_scp as a nested call, the variables are moved out of args_scp
+bool tea_call_bound_fn(tea_ctx_t *ctx, tea_scope_t *scp, const tea_fn_t *fn,
+                       const tea_node_t *node, tea_scope_t *args_scp,
+                       tea_val_t *result);
+// Calls the script function with the argument values, as native code does.
+// The values are widened to the declared parameter types
+bool tea_call_fn_vals(tea_ctx_t *ctx, tea_scope_t *scp, const tea_fn_t *fn,
+                      const tea_val_t *args, int argc, tea_val_t *result);
 tea_val_t tea_eval_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
                            const tea_node_t *node);
 tea_val_t tea_eval_native_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
                                   const tea_native_fn_t *nat_fn,
                                   const tea_node_t *args);
 
-void tea_bind_native_fn(tea_ctx_t *ctx, const char *owner_name,
+// Natives are bound to the program before it is loaded
+void tea_bind_native_fn(tea_program_t *prog, const char *owner_name,
                         const char *fn_name, tea_native_fn_cb_t cb);
+// Binds a native function without side effects, the result depends only on
+// the arguments
+void tea_bind_pure_native_fn(tea_program_t *prog, const char *owner_name,
+                             const char *fn_name, tea_native_fn_cb_t cb);
+// Binds a native function that takes its arguments as an array, each one
+// converted to the parameter type of the signature before the call. Returns
+// false if the signature can't be parsed
+bool tea_bind_native_sig(tea_program_t *prog, const char *owner_name,
+                         const char *fn_name, const char *sig,
+                         tea_native_span_cb_t cb);
+bool tea_bind_pure_native_sig(tea_program_t *prog, const char *owner_name,
+                              const char *fn_name, const char *sig,
+                              tea_native_span_cb_t cb);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "tea_fn.h"
+#include "tea_scope.h"
+#include "tea_stmt.h"
+
+// Type name of the instances that hold a generator
+#define TEA_GEN_TYPE "gen"
+
+// State of a statement left by a yield. A suspended generator keeps one for
+// each statement around the yield, the innermost first, so resuming it
+// walks back down to the yield without any C stack kept in between
+typedef struct {
+  const tea_node_t *node;
+  const tea_node_t *child; // statement of a block or branch of an if
+  unsigned long var_count; // variables of the scope the statement opened
+
+  union {
+    struct {
+      int64_t next;
+      int64_t end;
+      int64_t step;
+      bool is_wide;
+    } range; // for loop over a range
+
+    struct {
+      struct tea_gen_t *gen;
+      tea_val_t item;
+    } iter; // for loop over a generator
+  };
+} tea_resume_t;
+
+typedef enum {
+  TEA_GEN_READY,
+  TEA_GEN_RUNNING,
+  TEA_GEN_DONE,
+} tea_gen_state_t;
+
+// Makes the next value of a generator written in C, or an undefined one
+// once it is done. Returns false if it failed
+typedef bool (*tea_gen_native_t)(tea_ctx_t *ctx, void *data,
+                                 tea_val_t *value);
+
+// Releases what a native generator holds when a loop leaves it before it
+// is done, it won't be resumed anymore
+typedef void (*tea_gen_close_t)(tea_ctx_t *ctx, void *data);
+
+// Suspended call of a function with yield statements, kept on the heap. A
+// generator must be resumed by one thread at a time
+typedef struct tea_gen_t {
+  const tea_fn_t *fn; // NULL for a native generator
+  tea_gen_native_t native;
+  tea_gen_close_t close; // NULL if the native generator holds nothing
+  void *data; // of the native generator
+  tea_list_entry_t vars; // parameters and locals of the function
+  tea_list_entry_t saved_vars; // locals of the statements, by resume point
+  tea_resume_t *points;
+  int point_count;
+  int point_capacity;
+  tea_val_t value; // the last yielded value
+  tea_gen_state_t state;
+} tea_gen_t;
+
+// Creates a generator that runs the function from the start when it is
+// first resumed, the variables of the scope are moved to it
+tea_val_t tea_gen_create(const tea_fn_t *fn, tea_scope_t *scp);
+
+// Creates a generator that calls the native for each value, so a native
+// can be iterated by a for loop like a function with yield statements. The
+// close function, if any, is called by a loop that leaves it early
+tea_val_t tea_gen_create_native(tea_gen_native_t native,
+                                tea_gen_close_t close, void *data);
+
+// Returns the generator held by the value, NULL if it holds none
+tea_gen_t *tea_val_gen(const tea_val_t *value);
+
+// Runs the generator until its next yield, the function sees the variables
+// of scp as a call from there would. Returns false if the run failed, the
+// value is undefined once the function has returned
+bool tea_gen_next(tea_ctx_t *ctx, tea_scope_t *scp, tea_gen_t *gen,
+                  tea_val_t *value);
+
+// Ends a native generator that a loop left by break, return or an error,
+// its close function releases what it holds. Generators of functions stay
+// suspended, so a later loop goes on from there
+void tea_gen_close(tea_ctx_t *ctx, tea_gen_t *gen);
+
+// Saves the state of the statement that a yield left, the variables of scp
+// are moved to the generator. Returns TEA_EXEC_YIELD, or TEA_EXEC_ERR if
+// the state couldn't be saved
+tea_exec_status_t tea_gen_suspend(tea_ctx_t *ctx, tea_resume_t *point,
+                                  tea_scope_t *scp);
+
+// Takes the saved state of the statement when its generator is resumed and
+// moves its variables back to scp. Returns false if nothing is resumed
+bool tea_gen_resume(tea_ctx_t *ctx, const tea_node_t *node, tea_scope_t *scp,
+                    tea_resume_t *point);
@@ -2,5 +2,6 @@
 
 #include "tea_scope.h"
 
-void tea_interp_init(tea_ctx_t *ctx, const char *fname);
-void tea_interp_cleanup(const tea_ctx_t *ctx);
+// Prepares a run of the loaded program, allocates nothing
+void tea_interp_init(tea_ctx_t *ctx, const tea_program_t *prog);
+void tea_interp_cleanup(tea_ctx_t *ctx);
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "tea_program.h"
+#include "tea_scope.h"
+
+// Type name of the instances that hold a future
+#define TEA_FUTURE_TYPE "future"
+
+// Requests a context can have on the io_uring queue at once, more wait for
+// a completion before they are submitted
+#ifndef TEA_IO_QUEUE_DEPTH
+#define TEA_IO_QUEUE_DEPTH 64
+#endif
+
+// Threads of the fallback backend of each context that does file I/O
+#ifndef TEA_IO_THREADS
+#define TEA_IO_THREADS 2
+#endif
+
+typedef enum {
+  TEA_IO_AUTO, // io_uring where the kernel has it, the thread pool otherwise
+  TEA_IO_POOL,
+} tea_io_backend_t;
+
+typedef enum {
+  TEA_FUTURE_PENDING,
+  TEA_FUTURE_DONE,
+  TEA_FUTURE_FAILED,
+} tea_future_state_t;
+
+typedef enum {
+  TEA_IO_NONE, // resolved by the native that created it
+  TEA_IO_READ,
+  TEA_IO_WRITE,
+} tea_io_op_t;
+
+// Result of a native that completes after the native has returned, kept in
+// an instance of type "future". A future belongs to the context that
+// created it and must be awaited there
+typedef struct tea_future_t {
+  struct tea_io_t *io;
+  struct tea_future_t *next; // queued for the pool or in flight on io_uring
+  tea_io_op_t op;
+  tea_future_state_t state; // changed under the lock of the engine
+  unsigned char on_ring : 1; // completed by reaping the io_uring queue
+  int error; // errno of a failed request
+  int fd; // file of a request on the io_uring queue
+  tea_inst_t *data; // string read or written
+  unsigned long size;
+  unsigned long done; // bytes transferred so far
+  tea_val_t result;
+  char path[];
+} tea_future_t;
+
+/**
+ * @brief Sets the backend of the file natives, before any program runs.
+ * @param backend TEA_IO_POOL to use the thread pool even where io_uring
+ *        is available.
+ */
+void tea_io_set_backend(tea_io_backend_t backend);
+
+/**
+ * @brief Creates a pending future, for natives that return at once and
+ *        finish their work on another thread.
+ * @param ctx The context the native is called from.
+ * @param future Set to the future, to resolve later.
+ * @return The value to return from the native, undefined on failure.
+ */
+tea_val_t tea_future_create(tea_ctx_t *ctx, tea_future_t **future);
+
+/**
+ * @brief Resolves a pending future created by tea_future_create, from any
+ *        thread. Every future must be resolved before its run ends.
+ * @param future The future.
+ * @param value The result, null if the work failed.
+ */
+void tea_future_resolve(tea_future_t *future, tea_val_t value);
+
+// Returns the future held by the value, NULL if it holds none
+tea_future_t *tea_val_future(const tea_val_t *value);
+
+// Returns true once the future is resolved, without waiting for it
+bool tea_future_ready(tea_ctx_t *ctx, tea_future_t *future);
+
+// Waits for the future and sets its result, null if the request failed.
+// Returns false if it can't be waited for
+bool tea_future_await(tea_ctx_t *ctx, tea_future_t *future,
+                      tea_val_t *result);
+
+// Waits for the requests of the context and stops its I/O engine
+void tea_io_cleanup(const tea_ctx_t *ctx);
+
+/**
+ * @brief Binds the natives of asynchronous file I/O.
+ *
+ * read_file_async(path) and write_file_async(path, text) start the request
+ * and return a future at once, so the script runs on while the file is
+ * read or written. await(future) waits for it and returns the text read or
+ * the number of bytes written, or null if the request failed. ready(future)
+ * returns 1 once await won't wait.
+ *
+ * @param prog The program, not loaded yet.
+ */
+void tea_bind_io(tea_program_t *prog);
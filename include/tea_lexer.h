@@ -1,6 +1,7 @@
 #pragma once
 
 #include "tea_list.h"
+#include "tea_token.h"
 
 typedef struct {
   int pos;
@@ -12,3 +13,9 @@ typedef struct {
 void tea_lexer_init(tea_lexer_t *lex);
 void tea_lexer_cleanup(const tea_lexer_t *lex);
 void tea_lexer_tokenize(tea_lexer_t *lex, const char *input);
+
+// Adds a token that is not in the source, for example a literal computed by
+// the optimizer. It takes the position of the origin token and is released
+// with the other tokens of the lexer
+tea_tok_t *tea_lexer_add_tok(tea_lexer_t *lex, int type, const char *buf,
+                             int size, const tea_tok_t *origin);
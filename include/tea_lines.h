@@ -0,0 +1,37 @@
+#pragma once
+
+#include "tea_program.h"
+#include "tea_scope.h"
+
+// Type name of the instances that point to a line of a file read by
+// lines() instead of holding a copy of it
+#define TEA_VIEW_TYPE "view"
+
+// Pages of a file that lines() has gone past are dropped from the memory of
+// the process each time it has gone this far
+#ifndef TEA_LINES_WINDOW
+#define TEA_LINES_WINDOW (64 * 1024 * 1024)
+#endif
+
+// Text of a view, which isn't terminated. Its length is the size of the
+// instance
+typedef struct {
+  const char *data;
+} tea_view_t;
+
+/**
+ * @brief Binds the native lines(path), which maps the file into memory and
+ * is iterated by a for loop like a generator. Each line comes without its
+ * line break as a view into the mapping, valid until the loop moves on to
+ * the next line: the same view then points to the next one. The file is
+ * unmapped as soon as the loop ends, also by break, return or an error, and
+ * a later loop over the same generator gets no more lines. The loop fails
+ * if the file can't be opened.
+ *
+ * @param prog The program, not loaded yet.
+ */
+void tea_bind_lines(tea_program_t *prog);
+
+// Unmaps the files of the lines() generators that no loop has finished or
+// left, and frees their views
+void tea_lines_cleanup(tea_ctx_t *ctx);
@@ -95,6 +95,14 @@ void tea_list_add_tail(tea_list_entry_t *head, tea_list_entry_t *entry);
  */
 void tea_list_remove(const tea_list_entry_t *entry);
 
+/**
+ * @brief Moves all entries of a list to the back of another one.
+ * @param head Pointer to the list head entry to add the entries to.
+ * @param list Pointer to the list head entry to take them from, the list is
+ *        empty afterwards.
+ */
+void tea_list_splice_tail(tea_list_entry_t *head, tea_list_entry_t *list);
+
 /**
  * @brief Gets the first entry in the list.
  * @param head Pointer to the list head entry.
@@ -4,13 +4,20 @@
 #include <string.h>
 #include <time.h>
 
-// Time stamp functionality
-static const char *tea_get_time_stamp(void)
+#include "tea_thread.h"
+
+// Time stamp functionality, the buffer is owned by the caller so several
+// threads can log at once
+static const char *tea_get_time_stamp(char *stamp, const size_t size)
 {
-  static char stamp[16];
   const time_t now = time(NULL);
-  const struct tm *tm_info = localtime(&now);
-  strftime(stamp, sizeof(stamp), "%H:%M:%S", tm_info);
+  struct tm tm_info;
+#ifdef _WIN32
+  localtime_s(&tm_info, &now);
+#else
+  localtime_r(&now, &tm_info);
+#endif
+  strftime(stamp, size, "%H:%M:%S", &tm_info);
   return stamp;
 }
 
@@ -47,16 +54,93 @@ static const char *tea_filename(const char *filename)
 // Common log format string
 #define TEA_LOG_FORMAT "[%-s|%-s] [%-16s:%5u] (%s) "
 
+// Logging is muted while it is greater than zero, for example while the
+// optimizer evaluates code that is allowed to fail. Each thread has its own
+extern TEA_THREAD_LOCAL int tea_log_muted;
+
+// Where the messages of a thread go, stdout while it is NULL
+extern TEA_THREAD_LOCAL FILE *tea_log_file;
+
+// Output of the context running on the thread, NULL outside of a run. What
+// it buffered for the stream a message goes to is written first, so the
+// two keep their order
+extern TEA_THREAD_LOCAL struct tea_out_t *tea_log_out;
+void tea_log_flush_out(FILE *file);
+
+// Levels of the messages, a message is logged if its level is at most the
+// level the library is built with and at most tea_log_level
+#define TEA_LOG_ERR 1
+#define TEA_LOG_WRN 2
+#define TEA_LOG_DBG 3
+#define TEA_LOG_INF 4
+
+// Records of a thread kept until the formatter takes them, a power of two
+#ifndef TEA_LOG_RING_SLOTS
+#define TEA_LOG_RING_SLOTS 512
+#endif
+
+// Longest message of a record, longer ones are cut
+#ifndef TEA_LOG_TEXT
+#define TEA_LOG_TEXT 240
+#endif
+
+// Level filter of all threads, changed while no other thread logs
+extern int tea_log_level;
+
+// Set while the asynchronous sink runs
+extern int tea_log_async;
+
+/**
+ * @brief Starts the asynchronous sink: the messages of threads without a
+ *        tea_log_file go to a ring buffer of the thread, and a background
+ *        thread formats them and writes them to stdout.
+ *
+ * Logging doesn't wait for the formatter. A message that doesn't fit in the
+ * ring of its thread is dropped and counted. Threads started with
+ * tea_thread_start give their ring back when they return. Call it while no
+ * other thread logs.
+ *
+ * @return False if the background thread couldn't be started.
+ */
+bool tea_log_start(void);
+
+// Writes the records left and stops the background thread, called by
+// tea_cleanup. Call it while no other thread logs
+void tea_log_stop(void);
+
+// Gives the ring of the calling thread back to the sink
+void tea_log_thread_exit(void);
+
+// Messages dropped because a ring was full
+long tea_log_dropped(void);
+
+// Formats the message into the ring of the calling thread
+void tea_log_write(int level, const char *file, unsigned line,
+                   const char *func, const char *fmt, ...);
+
 // Unified fprintf-based logging macro for colored format
-#define _tea_printf_color(color, lvl, file, line, func, fmt, ...)              \
-  fprintf(stdout, "%s" TEA_LOG_FORMAT "%s" fmt "\n", color, lvl,               \
-          tea_get_time_stamp(), file, line, func, TEA_COLOR_RESET,             \
-          ##__VA_ARGS__)
+#define _tea_printf_color(color, lvl, level, file, line, func, fmt, ...)       \
+  do {                                                                         \
+    if (!tea_log_muted && (level) <= tea_log_level) {                          \
+      FILE *_tea_file = tea_log_file ? tea_log_file : stdout;                  \
+      if (tea_log_out) {                                                       \
+        tea_log_flush_out(_tea_file);                                          \
+      }                                                                        \
+      if (tea_log_async && !tea_log_file) {                                    \
+        tea_log_write(level, file, line, func, fmt, ##__VA_ARGS__);            \
+      } else {                                                                 \
+        char _tea_stamp[16];                                                   \
+        fprintf(_tea_file, "%s" TEA_LOG_FORMAT "%s" fmt "\n", color, lvl,      \
+                tea_get_time_stamp(_tea_stamp, sizeof(_tea_stamp)), file,      \
+                line, func, TEA_COLOR_RESET, ##__VA_ARGS__);                   \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
 
 #if TEA_DEBUG_LEVEL >= 4
 #define tea_log_inf(_fmt, ...)                                                 \
-  _tea_printf_color(TEA_COLOR_WHITE, "INF", TEA_FILENAME, __LINE__,            \
-                    __FUNCTION__, _fmt, ##__VA_ARGS__)
+  _tea_printf_color(TEA_COLOR_WHITE, "INF", TEA_LOG_INF, TEA_FILENAME,        \
+                    __LINE__, __FUNCTION__, _fmt, ##__VA_ARGS__)
 #else
 #define tea_log_inf(_fmt, ...)                                                 \
   do {                                                                         \
@@ -65,8 +149,8 @@ static const char *tea_filename(const char *filename)
 
 #if TEA_DEBUG_LEVEL >= 3
 #define tea_log_dbg(_fmt, ...)                                                 \
-  _tea_printf_color(TEA_COLOR_GREEN, "DBG", TEA_FILENAME, __LINE__,            \
-                    __FUNCTION__, _fmt, ##__VA_ARGS__)
+  _tea_printf_color(TEA_COLOR_GREEN, "DBG", TEA_LOG_DBG, TEA_FILENAME,        \
+                    __LINE__, __FUNCTION__, _fmt, ##__VA_ARGS__)
 #else
 #define tea_log_dbg(_fmt, ...)                                                 \
   do {                                                                         \
@@ -75,8 +159,8 @@ static const char *tea_filename(const char *filename)
 
 #if TEA_DEBUG_LEVEL >= 2
 #define tea_log_wrn(_fmt, ...)                                                 \
-  _tea_printf_color(TEA_COLOR_YELLOW, "WRN", TEA_FILENAME, __LINE__,           \
-                    __FUNCTION__, _fmt, ##__VA_ARGS__)
+  _tea_printf_color(TEA_COLOR_YELLOW, "WRN", TEA_LOG_WRN, TEA_FILENAME,       \
+                    __LINE__, __FUNCTION__, _fmt, ##__VA_ARGS__)
 #else
 #define tea_log_wrn(_fmt, ...)                                                 \
   do {                                                                         \
@@ -85,8 +169,8 @@ static const char *tea_filename(const char *filename)
 
 #if TEA_DEBUG_LEVEL >= 1
 #define tea_log_err(_fmt, ...)                                                 \
-  _tea_printf_color(TEA_COLOR_RED, "ERR", TEA_FILENAME, __LINE__,              \
-                    __FUNCTION__, _fmt, ##__VA_ARGS__)
+  _tea_printf_color(TEA_COLOR_RED, "ERR", TEA_LOG_ERR, TEA_FILENAME,          \
+                    __LINE__, __FUNCTION__, _fmt, ##__VA_ARGS__)
 #else
 #define tea_log_err(_fmt, ...)                                                 \
   do {                                                                         \
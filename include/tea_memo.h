@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tea_list.h"
+#include "tea_value.h"
+
+// Number of results kept for each @memo function
+#ifndef TEA_MEMO_CAPACITY
+#define TEA_MEMO_CAPACITY 256
+#endif
+
+// Calls with more arguments are not cached
+#define TEA_MEMO_MAX_ARGS 8
+
+/**
+ * @brief Cached result of a call, the arguments are the key.
+ */
+typedef struct tea_memo_entry_t {
+  tea_list_entry_t link; /**< Recency order, the most recent first */
+  struct tea_memo_entry_t *next; /**< Next entry in the bucket */
+  uint32_t hash;
+  tea_val_t result;
+  int argc;
+  tea_val_t args[TEA_MEMO_MAX_ARGS];
+} tea_memo_entry_t;
+
+typedef enum {
+  TEA_MEMO_UNCHECKED, /**< Purity is checked on the first call */
+  TEA_MEMO_PURE,
+  TEA_MEMO_IMPURE,
+} tea_memo_state_t;
+
+/**
+ * @brief Bounded result cache of a pure function, the least recently used
+ *        entry is evicted when the cache is full.
+ */
+typedef struct tea_memo_t {
+  tea_memo_state_t state;
+  tea_list_entry_t entries;
+  tea_memo_entry_t **buckets;
+  unsigned long bucket_mask;
+  unsigned long size;
+  unsigned long capacity;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+} tea_memo_t;
+
+/**
+ * @brief Creates an empty cache.
+ * @param capacity The maximum number of cached results.
+ * @return The cache or NULL if the allocation failed.
+ */
+tea_memo_t *tea_memo_create(unsigned long capacity);
+
+/**
+ * @brief Frees the cache and all its entries.
+ * @param memo The cache, may be NULL.
+ */
+void tea_memo_free(tea_memo_t *memo);
+
+/**
+ * @brief Checks whether the value can be a part of a key or a cached result.
+ *        Numbers, null and strings can, objects are mutable and can't.
+ * @param value The value to check.
+ * @return True if the value can be cached.
+ */
+bool tea_memo_is_cacheable(const tea_val_t *value);
+
+/**
+ * @brief Looks up the result for the arguments and counts a hit or a miss.
+ * @param memo The cache.
+ * @param args The argument values, all cacheable.
+ * @param argc The number of arguments.
+ * @return The cached result or NULL if there is none.
+ */
+const tea_val_t *tea_memo_find(tea_memo_t *memo, const tea_val_t *args,
+                               int argc);
+
+/**
+ * @brief Stores the result for the arguments, evicting the least recently
+ *        used entry if the cache is full.
+ * @param memo The cache.
+ * @param args The argument values, all cacheable.
+ * @param argc The number of arguments.
+ * @param result The result to cache.
+ * @return False if the entry couldn't be allocated.
+ */
+bool tea_memo_store(tea_memo_t *memo, const tea_val_t *args, int argc,
+                    tea_val_t result);
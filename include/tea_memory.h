@@ -70,7 +70,8 @@ void tea_free(void *data);
 
 /**
  * @brief Initializes the tea memory management subsystem.
- *        Must be called before any tea_malloc() or tea_free() calls.
+ *        Must be called before any tea_malloc() or tea_free() calls and
+ *        before any thread that runs a context is started.
  *        In debug builds, initializes the allocation tracking list.
  * @param malloc_func Custom malloc function (NULL to use standard malloc)
  * @param free_func Custom free function (NULL to use standard free)
@@ -79,7 +80,8 @@ void tea_memory_init(tea_malloc_func_t malloc_func, tea_free_func_t free_func);
 
 /**
  * @brief Cleans up the tea memory management subsystem.
- *        Should be called at program termination.
+ *        Should be called at program termination, after all threads that
+ *        run contexts are joined.
  *        In debug builds, checks for memory leaks and reports them to stderr.
  */
 void tea_memory_cleanup();
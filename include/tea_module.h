@@ -0,0 +1,85 @@
+#pragma once
+
+#include "tea_ast.h"
+#include "tea_lexer.h"
+#include "tea_list.h"
+#include "tea_program.h"
+#include "tea_scope.h"
+#include "tea_stmt.h"
+
+typedef enum {
+  TEA_MODULE_PENDING, // waiting for a thread to parse it
+  TEA_MODULE_PARSING,
+  TEA_MODULE_PARSED,
+  TEA_MODULE_FAILED,
+} tea_module_state_t;
+
+// Source file imported by programs. It is parsed once per process, the
+// first time a program imports it, and is not changed afterwards, so the
+// programs that import it share its tokens and its AST
+typedef struct tea_module_t {
+  tea_list_entry_t link;
+  const char *path; // absolute path, the key of the module in the cache
+  const char *name; // namespace, the file name without its extension
+  tea_module_state_t state; // changed under the lock of the cache
+  tea_lexer_t lexer;
+  tea_node_t *ast;
+  struct tea_module_t **imports; // modules of its import items, in order
+  unsigned long import_count;
+} tea_module_t;
+
+// Import item of a program or of one of its modules, resolved when the
+// program is loaded
+typedef struct {
+  tea_list_entry_t link;
+  const tea_node_t *node;
+  tea_module_t *module;
+  bool runs; // first import of the module, it runs its statements
+} tea_import_t;
+
+// Variables of a module in one run, made by its first import. The functions
+// of the module see them instead of the variables of their callers
+typedef struct {
+  tea_list_entry_t link;
+  const char *ns; // name of the module, the namespace of its functions
+  tea_scope_t scp;
+} tea_module_scope_t;
+
+// Sets up the cache of modules, called by tea_init
+void tea_modules_init(void);
+
+// Frees the modules, called by tea_cleanup once no program uses them
+void tea_modules_cleanup(void);
+
+/**
+ * @brief Parses the modules the program imports and declares their types
+ *        and functions in the program.
+ *
+ * The modules that aren't in the cache yet are parsed on a pool of threads,
+ * the modules they import as soon as they are found. A module is declared
+ * once per program in the namespace of its name, after the modules it
+ * imports, and the function names in it resolve in that namespace.
+ *
+ * @param prog The parsed program, before its own declarations.
+ * @return False if a module can't be found, read or declared.
+ */
+bool tea_program_import(tea_program_t *prog);
+
+// Runs the top-level statements of the imported module in a scope of its
+// own, if this is its first import in the program
+tea_exec_status_t tea_exec_import(tea_ctx_t *ctx, const tea_node_t *node);
+
+// Returns the scope the variables of a call to the function are nested in:
+// the scope of the caller for a function of the program file, the scope of
+// its module for a module function, NULL with an error if the module didn't
+// run in the context
+tea_scope_t *tea_fn_outer_scope(const tea_ctx_t *ctx, const tea_fn_t *fn,
+                                tea_scope_t *caller_scp);
+
+// Gives a context started by another one, such as a parallel worker or an
+// actor, the module variables of that context as they are now. The module
+// functions it runs read them, what they change stays in the new context
+bool tea_module_scopes_copy(tea_ctx_t *ctx, const tea_ctx_t *from);
+
+// Frees the variables of the modules that ran in the context
+void tea_module_scopes_cleanup(tea_ctx_t *ctx);
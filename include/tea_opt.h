@@ -0,0 +1,44 @@
+#pragma once
+
+#include "tea_program.h"
+
+// Upper bound for the number of nodes in an inlined expression
+#ifndef TEA_INLINE_MAX_NODES
+#define TEA_INLINE_MAX_NODES 16
+#endif
+
+/**
+ * @brief Replaces calls of small functions and methods with their bodies.
+ *
+ * A function is inlined when its body is a single return of an expression
+ * without calls. Methods are inlined only when the type of the receiver is
+ * known before the program runs. Must be called after the native functions
+ * are bound since they take precedence over the declared functions, and
+ * before the program is loaded.
+ *
+ * @param prog The parsed program with the bound native functions, its AST
+ *             is modified in place.
+ * @return The number of inlined call sites.
+ */
+unsigned long tea_inline(tea_program_t *prog);
+
+// Loop iterations and calls allowed for a call evaluated before the run
+#ifndef TEA_FOLD_STEP_BUDGET
+#define TEA_FOLD_STEP_BUDGET 10000
+#endif
+
+/**
+ * @brief Evaluates calls of pure functions with constant arguments before
+ *        the program runs and replaces them with the resulting literal.
+ *
+ * The callee must pass the purity check of @memo functions and must not
+ * call natives or allocate. A call that fails or exceeds the step budget is
+ * left as it is. Must be called after the native functions are bound and
+ * before the program is loaded.
+ *
+ * @param prog The parsed program with the bound native functions, its AST
+ *             is modified in place and its lexer owns the new literals.
+ * @param max_depth The limit for nested calls of the evaluated calls.
+ * @return The number of folded calls.
+ */
+unsigned long tea_fold_calls(tea_program_t *prog, int max_depth);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "tea_fmt.h"
+#include "tea_value.h"
+
+// Bytes a context keeps before it writes them to its stream
+#ifndef TEA_OUT_SIZE
+#define TEA_OUT_SIZE 65536
+#endif
+
+// When the buffered output is written to the stream
+typedef enum {
+  TEA_OUT_LINE, // at the end of each line, the default for terminals
+  TEA_OUT_FULL, // when the buffer is full
+  TEA_OUT_EXIT, // when the run ends or calls flush(), the buffer grows
+} tea_out_mode_t;
+
+// Output of a context. The buffer is allocated by the first write, so a
+// context that doesn't print doesn't pay for it
+typedef struct tea_out_t {
+  FILE *file;
+  tea_out_mode_t mode;
+  int precision; // decimals of floats, or TEA_FMT_SHORTEST
+  char *data;
+  size_t size;
+  size_t capacity;
+} tea_out_t;
+
+/**
+ * @brief Initializes the output of a context, which prints floats with the
+ * shortest digits that read back as the same number.
+ * @param out The output.
+ * @param file The stream it writes to.
+ * @param mode When it writes to the stream.
+ */
+void tea_out_init(tea_out_t *out, FILE *file, tea_out_mode_t mode);
+
+// Writes what is left and frees the buffer
+void tea_out_cleanup(tea_out_t *out);
+
+// Line mode for terminals, full mode for files and pipes, like stdio
+tea_out_mode_t tea_out_default_mode(FILE *file);
+
+/**
+ * @brief Writes the buffered output to the stream and flushes the stream.
+ * @param out The output.
+ * @return False if the stream failed.
+ */
+bool tea_out_flush(tea_out_t *out);
+
+// Flushes the output and switches it to another stream
+bool tea_out_set_file(tea_out_t *out, FILE *file);
+
+bool tea_out_write(tea_out_t *out, const char *data, size_t size);
+bool tea_out_str(tea_out_t *out, const char *str);
+
+// Formats the integer as "%lld" does, without printf
+bool tea_out_i64(tea_out_t *out, long long value);
+
+// Formats the number with the precision of the output, see tea_fmt_f64
+bool tea_out_f64(tea_out_t *out, double value);
+bool tea_out_f32(tea_out_t *out, float value);
+
+// Prints the value as print() does
+bool tea_out_val(tea_out_t *out, const tea_val_t *value);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "tea_program.h"
+
+// Number of chunks a range is split into, the chunks don't depend on the
+// number of workers so the results of a reduction don't either
+#ifndef TEA_PARALLEL_CHUNKS
+#define TEA_PARALLEL_CHUNKS 256
+#endif
+
+// Largest range the natives take, the dictionary of parallel_for indexes
+// its entries with 32 bits
+#ifndef TEA_PARALLEL_MAX_ITEMS
+#define TEA_PARALLEL_MAX_ITEMS 0x7FFFFFFFL
+#endif
+
+/**
+ * @brief Sets the number of workers of the parallel natives.
+ * @param count The number of workers, 0 for one per processor.
+ */
+void tea_parallel_set_workers(int count);
+
+/**
+ * @brief Binds the natives that run a script function over a range of
+ *        integers on a pool of workers.
+ *
+ * parallel_for(start, end, 'fn') returns a dictionary of fn(i) by i for i
+ * in [start, end), in the order of i. parallel_reduce(start, end, 'fn',
+ * 'combine', init) folds fn(i) with combine, which must be associative, and
+ * returns init if the range is empty.
+ *
+ * The functions are passed by name. Each worker runs them in a context of
+ * its own, so they don't see the variables of the caller and must not be
+ * mutable.
+ *
+ * @param prog The program, not loaded yet.
+ */
+void tea_bind_parallel(tea_program_t *prog);
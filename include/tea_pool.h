@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Upper bound for the number of workers of a pool
+#ifndef TEA_POOL_MAX_WORKERS
+#define TEA_POOL_MAX_WORKERS 64
+#endif
+
+// Upper bound for the number of chunks of a run
+#define TEA_POOL_MAX_CHUNKS 0x7fffffffL
+
+/**
+ * @brief Runs one chunk of the work.
+ * @param data The data passed to tea_pool_run().
+ * @param worker The index of the worker running the chunk, 0 is the thread
+ *               that called tea_pool_run().
+ * @param chunk The index of the chunk.
+ * @return False to stop the other workers too.
+ */
+typedef bool (*tea_pool_task_fn_t)(void *data, int worker, long chunk);
+
+// Sets up the pool of the process, called by tea_init
+void tea_pool_init(void);
+
+// Stops the workers of the pool, called by tea_cleanup
+void tea_pool_cleanup(void);
+
+/**
+ * @brief Runs the chunks [0, chunk_count) on the pool of worker threads.
+ *
+ * Each worker starts with an even share of the chunks and takes them from
+ * the front of its queue. A worker that runs out steals single chunks from
+ * the back of the queues of the others, so uneven chunks are balanced. The
+ * queues take chunks without locks. The calling thread is worker 0, the
+ * others are started by the first run that needs them and wait for the next
+ * run afterwards. A run started while another one has the workers, for
+ * example from one of its chunks, runs on the calling thread alone.
+ *
+ * @param worker_count The number of workers, capped to the chunk count.
+ * @param chunk_count The number of chunks.
+ * @param fn The function that runs a chunk.
+ * @param data The data passed to fn.
+ * @return False if a chunk failed or a worker couldn't be started.
+ */
+bool tea_pool_run(int worker_count, long chunk_count, tea_pool_task_fn_t fn,
+                  void *data);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "tea_ast.h"
+#include "tea_lexer.h"
+#include "tea_list.h"
+
+/**
+ * @brief A parsed program with its declared types and functions.
+ *
+ * Natives are bound and the optimizer runs before the program is loaded.
+ * Once loaded, the program is not changed anymore, so any number of
+ * contexts on any number of threads can run it at the same time, each with
+ * its own variables and result caches.
+ */
+typedef struct tea_program_t {
+  const char *file_name;
+  tea_lexer_t lexer; // owns the tokens the AST and the declarations point to
+  tea_node_t *ast;
+  tea_list_entry_t funcs;
+  tea_list_entry_t native_funcs;
+  tea_list_entry_t structs;
+  tea_list_entry_t imports; // tea_import_t of the program and its modules
+  struct tea_dict_t *slots; // method name -> slot in the method tables
+  unsigned long slot_count;
+  // Number of the declaration being made among those of the program file,
+  // counted from 1. A run sees it once its top-level statements reach it,
+  // the declarations of modules have 0 and are always seen
+  unsigned long decl_order;
+  unsigned long memo_count; // @memo functions, their caches are per context
+} tea_program_t;
+
+/**
+ * @brief Initializes an empty program.
+ * @param prog The program to initialize.
+ * @param file_name The source file, used for parsing and in messages.
+ */
+void tea_program_init(tea_program_t *prog, const char *file_name);
+
+/**
+ * @brief Parses the source file into the AST of the program.
+ * @param prog The program.
+ * @return False if the file couldn't be read or parsed, or is empty.
+ */
+bool tea_program_parse(tea_program_t *prog);
+
+/**
+ * @brief Declares the types and functions of a parsed file in file order.
+ * @param prog The program to declare them in.
+ * @param ast The AST of the program file or of a module.
+ * @param ns The namespace of the functions, NULL for the program file.
+ * @return False if a declaration failed.
+ */
+bool tea_program_decl(tea_program_t *prog, const tea_node_t *ast,
+                      const char *ns);
+
+/**
+ * @brief Imports the modules of the program, then declares the types and
+ *        functions of the AST in program order.
+ * @param prog The parsed program, it must not be changed afterwards. An
+ *             empty program loads fine and runs nothing.
+ * @return False if a declaration failed.
+ */
+bool tea_program_load(tea_program_t *prog);
+
+/**
+ * @brief Frees the declarations, the AST and the tokens of the program.
+ *        All contexts running it must be cleaned up before.
+ * @param prog The program.
+ */
+void tea_program_cleanup(tea_program_t *prog);
@@ -1,16 +1,51 @@
 #pragma once
 
+#include <stdio.h>
+
 #include "tea_ast.h"
+#include "tea_log.h"
+#include "tea_out.h"
+#include "tea_program.h"
 #include "tea_value.h"
 
+// State of one run of a program, cheap to create since the declarations
+// live in the shared program
 typedef struct {
-  const char *file_name;
-  tea_list_entry_t funcs;
-  tea_list_entry_t native_funcs;
-  tea_list_entry_t structs;
+  const tea_program_t *prog;
   tea_list_entry_t vars;
+  struct tea_memo_t **memos; // result caches of @memo functions by index
+  unsigned long memo_count;
+  tea_val_t ret_val; // value of the last executed return statement
+  struct tea_frame_t *frame; // innermost function call
+  struct tea_gen_t *resume; // generator walking back down to its yield
+  const char *ns; // module whose top-level statements run, NULL outside
+  tea_list_entry_t modules; // tea_module_scope_t of the modules that ran
+  struct tea_io_t *io; // file I/O, started by the first request
+  struct tea_actors_t *actors; // started by the first spawn, shared by actors
+  struct tea_lines_t *lines; // files mapped by lines(), in a list
+  tea_out_t out; // where the run prints, stdout unless the host redirects it
+  int depth;
+  int max_depth; // calls nested deeper than this fail with an error
+  // Declarations of the program file its top-level statements reached, all
+  // of them in contexts which don't run the program file
+  unsigned long declared;
+  bool is_budgeted; // steps are counted only when set by tea_ctx_set_budget
+  long step_budget; // loop iterations and calls left
 } tea_ctx_t;
 
+// Functions and types are known from their declaration on
+#define tea_ctx_sees(ctx, decl) ((decl)->order <= (ctx)->declared)
+
+void tea_ctx_set_budget(tea_ctx_t *ctx, long steps);
+bool tea_ctx_use_step(tea_ctx_t *ctx);
+
+// Counts a loop iteration or a call against the step budget, returns false
+// once the budget is used up. Runs without a budget only test the flag
+static inline bool tea_ctx_step(tea_ctx_t *ctx)
+{
+  return !ctx->is_budgeted || tea_ctx_use_step(ctx);
+}
+
 #define TEA_VAR_MUT 1 << 0
 #define TEA_VAR_OPT 1 << 1
 
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "tea_program.h"
+
+#define TEA_SERVE_SOCKET "tea.sock"
+#define TEA_SERVE_TIMEOUT_MS 30000
+
+// Longest request line, with the name of the function and its arguments
+#ifndef TEA_SERVE_LINE
+#define TEA_SERVE_LINE 4096
+#endif
+
+#ifndef TEA_SERVE_MAX_ARGS
+#define TEA_SERVE_MAX_ARGS 16
+#endif
+
+// Buckets of the latency histogram, bucket i counts the requests that took
+// less than 2^i microseconds
+#define TEA_SERVE_BUCKETS 32
+
+typedef struct {
+  const char *socket_path;
+  int worker_count;
+  long timeout_ms; // a request running longer kills its worker, 0 for none
+  long max_requests; // requests a worker handles before it is replaced
+  int max_call_depth;
+  int precision; // decimals of floats in the results, or TEA_FMT_SHORTEST
+} tea_serve_options_t;
+
+/**
+ * @brief Serves calls of the functions of a loaded program on a Unix socket.
+ *
+ * The workers are forked from the calling process, so they share the
+ * parsed and declared program through copy-on-write pages. Each one runs
+ * the top-level statements once and then calls the functions it is asked
+ * to. A request is a line with the name of a function and its arguments,
+ * integers, floats, 'strings' or null, separated by spaces. The reply is
+ * "ok <size>" or "err <size>", a newline and the printed result or the log
+ * of the failure. The line ":stats" gets the latency histogram.
+ *
+ * Workers that exit or time out are replaced. Serving stops on SIGINT or
+ * SIGTERM. Only available where fork is.
+ *
+ * @param program The loaded program.
+ * @param options The options of the server.
+ * @return The exit code of the server.
+ */
+int tea_serve(const tea_program_t *program, const tea_serve_options_t *options);
@@ -3,30 +3,40 @@
 #include "tea_fn.h"
 #include "tea_scope.h"
 
-typedef struct {
-  unsigned char is_break_set : 1;
-  unsigned char is_cont_set : 1;
-} tea_loop_ctx_t;
-
-bool tea_exec(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
-              tea_ret_ctx_t *ret_ctx, tea_loop_ctx_t *loop_ctx);
-
-bool tea_exec_stmt(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
-                   tea_ret_ctx_t *ret_ctx, tea_loop_ctx_t *loop_ctx);
+// Result of executing a statement, anything but TEA_EXEC_OK stops the
+// enclosing block and is passed up until a loop or a function call
+// handles it
+typedef enum {
+  TEA_EXEC_ERR,
+  TEA_EXEC_OK,
+  TEA_EXEC_RET, // the return value is in ctx->ret_val
+  TEA_EXEC_BREAK,
+  TEA_EXEC_CONT,
+  TEA_EXEC_TAIL, // the next function of the frame is bound, see tea_call_fn
+  TEA_EXEC_YIELD, // the generator of the frame is suspended, see tea_gen_t
+} tea_exec_status_t;
+
+tea_exec_status_t tea_exec(tea_ctx_t *ctx, tea_scope_t *scp,
+                           const tea_node_t *node);
+
+tea_exec_status_t tea_exec_stmt(tea_ctx_t *ctx, tea_scope_t *scp,
+                                const tea_node_t *node);
 
 bool tea_exec_let(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node);
 
 bool tea_exec_assign(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node);
 
-bool tea_exec_if(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
-                 tea_ret_ctx_t *ret_ctx, tea_loop_ctx_t *loop_ctx);
+tea_exec_status_t tea_exec_if(tea_ctx_t *ctx, tea_scope_t *scp,
+                              const tea_node_t *node);
 
-bool tea_exec_while(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
-                    tea_ret_ctx_t *ret_ctx);
+tea_exec_status_t tea_exec_while(tea_ctx_t *ctx, tea_scope_t *scp,
+                                 const tea_node_t *node);
 
-bool tea_exec_return(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
-                     tea_ret_ctx_t *ret_ctx);
+tea_exec_status_t tea_exec_for(tea_ctx_t *ctx, tea_scope_t *scp,
+                               const tea_node_t *node);
 
-bool tea_exec_break(tea_loop_ctx_t *loop_ctx);
+tea_exec_status_t tea_exec_return(tea_ctx_t *ctx, tea_scope_t *scp,
+                                  const tea_node_t *node);
 
-bool tea_exec_continue(tea_loop_ctx_t *loop_ctx);
+tea_exec_status_t tea_exec_yield(tea_ctx_t *ctx, tea_scope_t *scp,
+                                 const tea_node_t *node);
@@ -1,18 +1,54 @@
 #pragma once
 
 #include "tea.h"
+#include "tea_fn.h"
 #include "tea_scope.h"
 #include "tea_value.h"
 
+// Entry of a method table, a native method takes precedence over a script
+// one with the same name
 typedef struct {
+  const tea_fn_t *fn;
+  const tea_native_fn_t *native;
+} tea_method_t;
+
+typedef struct tea_struct_decl_t {
   tea_list_entry_t link;
   const tea_node_t *node;
+  const char *ns; // module of the type, NULL for the program file
+  unsigned long order; // see tea_program_t.decl_order
   unsigned long field_count;
   tea_list_entry_t funcs;
+  // Indexed by the slot of the method name, slots are shared by all types
+  // and the table ends at the highest slot the type uses
+  tea_method_t *methods;
+  unsigned long method_count;
 } tea_struct_decl_t;
 
-bool tea_exec_struct_decl(tea_ctx_t *ctx, const tea_node_t *node);
-tea_struct_decl_t *tea_find_struct_decl(const tea_ctx_t *ctx, const char *name);
+bool tea_decl_struct(tea_program_t *prog, const tea_node_t *node,
+                     const char *ns);
+// Finds the type of the name in the module, NULL for the program file.
+// Types of the same name in other modules are not seen
+tea_struct_decl_t *tea_find_struct_decl(const tea_program_t *prog,
+                                        const char *ns, const char *name);
+
+// Returns the slot of the method name, a new name gets the next free slot.
+// Returns -1 if the allocation failed
+long tea_method_slot(tea_program_t *prog, const char *name);
+// Puts the method into the table of the type, a script method doesn't
+// replace one declared before it
+bool tea_struct_add_method(tea_program_t *prog, tea_struct_decl_t *decl,
+                           const char *name, const tea_fn_t *fn,
+                           const tea_native_fn_t *native);
+// Finds the method by the slot of its name, NULL if the type has none. The
+// slot cached on the call node is used if it is resolved
+const tea_method_t *tea_struct_find_method(const tea_program_t *prog,
+                                           const tea_struct_decl_t *decl,
+                                           const tea_node_t *call,
+                                           const tea_tok_t *name);
+// Caches the slots of the method calls in the AST on their nodes, once all
+// the methods of the program are declared
+void tea_resolve_slots(const tea_program_t *prog, tea_node_t *node);
 
 tea_val_t tea_eval_new(tea_ctx_t *ctx, tea_scope_t *scp,
                        const tea_node_t *node);
@@ -21,3 +57,6 @@ tea_val_t tea_eval_field_access(const tea_ctx_t *ctx, const tea_scope_t *scp,
                                 const tea_node_t *node);
 tea_val_t *tea_get_field_ptr(const tea_ctx_t *ctx, const tea_scope_t *scp,
                              const tea_node_t *node);
+tea_val_t *tea_val_field_ptr(const tea_ctx_t *ctx, const tea_val_t *value,
+                             const tea_tok_t *object_name,
+                             const tea_tok_t *field_name);
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/**
+ * @brief Storage class of variables that have a separate copy per thread.
+ */
+#if defined(_MSC_VER)
+#define TEA_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define TEA_THREAD_LOCAL __thread
+#else
+#define TEA_THREAD_LOCAL _Thread_local
+#endif
+
+/**
+ * @brief Mutex of the platform, not recursive.
+ */
+typedef struct {
+#ifdef _WIN32
+  CRITICAL_SECTION section;
+#else
+  pthread_mutex_t mutex;
+#endif
+} tea_mutex_t;
+
+/**
+ * @brief Condition variable of the platform, used with a tea_mutex_t.
+ */
+typedef struct {
+#ifdef _WIN32
+  CONDITION_VARIABLE cond;
+#else
+  pthread_cond_t cond;
+#endif
+} tea_cond_t;
+
+// Atomic operations, all sequentially consistent
+#if defined(_MSC_VER)
+static inline void *tea_atomic_xchg_ptr(void *volatile *ptr, void *value)
+{
+  return InterlockedExchangePointer(ptr, value);
+}
+
+static inline void *tea_atomic_load_ptr(void *volatile *ptr)
+{
+  return InterlockedCompareExchangePointer(ptr, NULL, NULL);
+}
+
+static inline void tea_atomic_store_ptr(void *volatile *ptr, void *value)
+{
+  InterlockedExchangePointer(ptr, value);
+}
+
+static inline bool tea_atomic_cas_long(volatile long *ptr, long expected,
+                                       long desired)
+{
+  return InterlockedCompareExchange(ptr, desired, expected) == expected;
+}
+
+static inline void tea_atomic_store_long(volatile long *ptr, long value)
+{
+  InterlockedExchange(ptr, value);
+}
+
+static inline long tea_atomic_load_long(volatile long *ptr)
+{
+  return InterlockedCompareExchange(ptr, 0, 0);
+}
+
+static inline bool tea_atomic_cas_i64(volatile int64_t *ptr, int64_t expected,
+                                      int64_t desired)
+{
+  return InterlockedCompareExchange64(ptr, desired, expected) == expected;
+}
+
+static inline int64_t tea_atomic_load_i64(volatile int64_t *ptr)
+{
+  return InterlockedCompareExchange64(ptr, 0, 0);
+}
+#else
+static inline void *tea_atomic_xchg_ptr(void *volatile *ptr, void *value)
+{
+  return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline void *tea_atomic_load_ptr(void *volatile *ptr)
+{
+  return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline void tea_atomic_store_ptr(void *volatile *ptr, void *value)
+{
+  __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline bool tea_atomic_cas_long(volatile long *ptr, long expected,
+                                       long desired)
+{
+  return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline void tea_atomic_store_long(volatile long *ptr, long value)
+{
+  __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline long tea_atomic_load_long(volatile long *ptr)
+{
+  return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline bool tea_atomic_cas_i64(volatile int64_t *ptr, int64_t expected,
+                                      int64_t desired)
+{
+  return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline int64_t tea_atomic_load_i64(volatile int64_t *ptr)
+{
+  return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+#endif
+
+// Native stack of the threads started by tea_thread_start
+#ifndef TEA_THREAD_STACK_SIZE
+#define TEA_THREAD_STACK_SIZE (8 * 1024 * 1024)
+#endif
+
+/**
+ * @brief Function run by a thread.
+ * @param arg The argument passed to tea_thread_start().
+ */
+typedef void (*tea_thread_fn_t)(void *arg);
+
+/**
+ * @brief Thread of the platform, must stay valid until it is joined.
+ */
+typedef struct {
+#ifdef _WIN32
+  HANDLE handle;
+#else
+  pthread_t handle;
+#endif
+  tea_thread_fn_t fn;
+  void *arg;
+  FILE *log_file; // tea_log_file of the thread that started it
+} tea_thread_t;
+
+/**
+ * @brief Initializes the mutex.
+ * @param mutex The mutex to initialize.
+ * @return False if the mutex couldn't be created.
+ */
+bool tea_mutex_init(tea_mutex_t *mutex);
+
+/**
+ * @brief Destroys the mutex, it must not be locked.
+ * @param mutex The mutex to destroy.
+ */
+void tea_mutex_destroy(tea_mutex_t *mutex);
+
+void tea_mutex_lock(tea_mutex_t *mutex);
+void tea_mutex_unlock(tea_mutex_t *mutex);
+
+bool tea_cond_init(tea_cond_t *cond);
+void tea_cond_destroy(tea_cond_t *cond);
+
+/**
+ * @brief Unlocks the mutex, waits until the condition is signaled and locks
+ *        the mutex again. Wakeups can be spurious, so check in a loop.
+ * @param cond The condition to wait for.
+ * @param mutex The mutex, locked by the calling thread.
+ */
+void tea_cond_wait(tea_cond_t *cond, tea_mutex_t *mutex);
+
+/**
+ * @brief Wakes up all the threads waiting for the condition.
+ * @param cond The condition.
+ */
+void tea_cond_broadcast(tea_cond_t *cond);
+
+/**
+ * @brief Wakes up one of the threads waiting for the condition.
+ * @param cond The condition.
+ */
+void tea_cond_signal(tea_cond_t *cond);
+
+/**
+ * @brief Starts a thread that calls fn(arg). The thread logs where the
+ *        calling thread logs, see tea_log_file.
+ * @param thread The thread, filled in by this call.
+ * @param fn The function to run.
+ * @param arg The argument of the function.
+ * @return False if the thread couldn't be started.
+ */
+bool tea_thread_start(tea_thread_t *thread, tea_thread_fn_t fn, void *arg);
+
+/**
+ * @brief Waits until the thread returns and releases it.
+ * @param thread A started thread.
+ */
+void tea_thread_join(tea_thread_t *thread);
+
+/**
+ * @brief Returns how much of its native stack the calling thread has left.
+ *
+ * A thread started by tea_thread_start has TEA_THREAD_STACK_SIZE bytes,
+ * counted from its start. Other threads have the stack limit of the
+ * process, counted from the outermost point they asked from, which should
+ * be close to where their stack starts.
+ *
+ * @return The number of bytes left, 0 if the stack is used up.
+ */
+size_t tea_stack_left(void);
+
+/**
+ * @brief Returns the number of processors available to the process.
+ * @return The number of processors, at least 1.
+ */
+int tea_cpu_count(void);
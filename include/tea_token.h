@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "tea_list.h"
 
 typedef struct {
@@ -14,8 +16,15 @@ typedef struct {
   int col;
   int pos;
   int size;
+  unsigned int hash;
+  const char *str; // interned text of identifiers and strings, else NULL
   char buf[0];
 } tea_tok_t;
 
 int tea_get_ident_type(const char *ident, int length);
 const char *tea_tok_name(int token_type);
+
+// Integer literals keep their value as int64_t and float literals as double,
+// the evaluator narrows them to the type of the literal
+int64_t tea_tok_int(const tea_tok_t *tok);
+double tea_tok_float(const tea_tok_t *tok);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "tea_token.h"
@@ -8,13 +9,24 @@ typedef enum {
   TEA_V_UNDEF,
   TEA_V_NULL,
   TEA_V_I32,
+  TEA_V_I64,
   TEA_V_F32,
+  TEA_V_F64,
   TEA_V_INST,
+  TEA_V_DICT,
 } tea_val_type_t;
 
+// The fields of a frozen instance can't be assigned, so threads can share it
+#define TEA_INST_FROZEN 1 << 0
+
 typedef struct {
   const char *type;
+  // Declaration of a script type, NULL for the built-in ones like strings
+  const struct tea_struct_decl_t *decl;
   unsigned long size;
+  // A whole word, so the buffer is aligned for the views and futures kept
+  // in it
+  unsigned long flags;
   char buf[0];
 } tea_inst_t;
 
@@ -23,8 +35,11 @@ typedef struct {
 
   union {
     float f32;
+    double f64;
     int32_t i32;
+    int64_t i64;
     tea_inst_t *obj;
+    struct tea_dict_t *dict;
     // if the type is TEA_V_NULL,
     // we need to know the exact type of the null
     tea_val_type_t null_type;
@@ -37,4 +52,18 @@ tea_val_type_t tea_val_type_by_str(const char *name);
 tea_val_t tea_val_undef();
 tea_val_t tea_val_null();
 
+// Returns the type both operands of a mixed numeric operation are converted
+// to, or TEA_V_UNDEF if the types are not numeric
+tea_val_type_t tea_val_common_type(tea_val_type_t lhs, tea_val_type_t rhs);
+// Converts the value to a wider type of the same kind (i32 to i64 or f64,
+// f32 to f64), returns false if the conversion would be narrowing
+bool tea_val_widen(tea_val_t *value, tea_val_type_t type);
+
 tea_val_t tea_val_binop(tea_val_t lhs, tea_val_t rhs, const tea_tok_t *op);
+// Compares two values without building a result value, returns false if
+// the types cannot be compared
+bool tea_val_cmp(tea_val_t lhs, tea_val_t rhs, const tea_tok_t *op,
+                 bool *result);
+// Numbers are true if not zero, null is false and objects are always true
+bool tea_val_truthy(tea_val_t value);
+bool tea_val_compound(tea_val_t *target, tea_val_t rhs, const tea_tok_t *op);
@@ -3,66 +3,498 @@
 
 #include <string.h>
 
+#include "tea_actor.h"
 #include "tea_ast.h"
+#include "tea_dict.h"
 #include "tea_fn.h"
 #include "tea_interp.h"
-#include "tea_parser.h"
+#include "tea_io.h"
+#include "tea_lines.h"
+#include "tea_opt.h"
+#include "tea_out.h"
+#include "tea_parallel.h"
+#include "tea_program.h"
+#include "tea_serve.h"
 #include "tea_stmt.h"
+#include "tea_thread.h"
 
 void print_usage(const char *program_name)
 {
   tea_log_inf("Usage: %s [options] <tea_file>", program_name);
+  tea_log_inf("       %s [options] --batch <tea_file>...", program_name);
+  tea_log_inf("       %s [options] --serve <tea_file>", program_name);
   tea_log_inf("Options:");
   tea_log_inf("  -h, --help     Show this help message");
+  tea_log_inf("  --max-call-depth <n>");
+  tea_log_inf("                 Limit for nested function calls (default: as");
+  tea_log_inf("                 deep as the native stack allows)");
+  tea_log_inf("  --no-inline    Don't inline calls of small functions");
+  tea_log_inf("  --no-fold      Don't evaluate constant calls before the run");
+  tea_log_inf("  --memo-stats   Print the cache stats of @memo functions");
+  tea_log_inf("  --threads <n>  Run the program n times at once, each run on");
+  tea_log_inf("                 its own thread with its own context");
+  tea_log_inf("  --workers <n>  Workers of parallel_for and parallel_reduce,");
+  tea_log_inf("                 threads of actors (default one per processor),");
+  tea_log_inf("                 processes of --serve");
+  tea_log_inf("  --no-io-uring  Do file I/O on a thread pool, not io_uring");
+  tea_log_inf("  --batch        Run all the files given, several at once, each");
+  tea_log_inf("                 with its output printed as one block");
+  tea_log_inf("  --manifest <file>");
+  tea_log_inf("                 Run the files listed in the file as a batch");
+  tea_log_inf("  --jobs <n>     Scripts of a batch run at once (default one per");
+  tea_log_inf("                 processor)");
+  tea_log_inf("  --serve        Fork workers that call the functions of the");
+  tea_log_inf("                 program on requests from a Unix socket");
+  tea_log_inf("  --socket <path>");
+  tea_log_inf("                 Socket of --serve (default %s)",
+              TEA_SERVE_SOCKET);
+  tea_log_inf("  --timeout <ms> Time a request of --serve may take before its");
+  tea_log_inf("                 worker is replaced, 0 for none (default %d)",
+              TEA_SERVE_TIMEOUT_MS);
+  tea_log_inf("  --max-requests <n>");
+  tea_log_inf("                 Requests a worker of --serve handles before");
+  tea_log_inf("                 it is replaced, 0 for no limit (default 0)");
+  tea_log_inf("  --flush <mode> When printed output is written: line, at the");
+  tea_log_inf("                 end of each line, full, when the buffer is");
+  tea_log_inf("                 full, or exit, at the end of the run (default");
+  tea_log_inf("                 line for terminals, full otherwise)");
+  tea_log_inf("  --precision <n>");
+  tea_log_inf("                 Print floats with n decimals, not with the");
+  tea_log_inf("                 shortest digits that read back the same");
+  tea_log_inf("  --log-async    Write the log from a background thread, not");
+  tea_log_inf("                 from the threads that log");
+  tea_log_inf("  --log-level <n>");
+  tea_log_inf("                 Log only messages up to the level, 1 errors,");
+  tea_log_inf("                 2 warnings, 3 debug, 4 info (default %d)",
+              TEA_LOG_INF);
   tea_log_inf("");
   tea_log_inf("Examples:");
   tea_log_inf("  %s example.tea", program_name);
 }
 
-static tea_val_t tea_print(tea_fn_args_t *args)
+static tea_val_t tea_print(tea_ctx_t *ctx, const tea_val_t *args,
+                           const int argc)
 {
-  for (;;) {
-    tea_var_t *arg = tea_fn_args_pop(args);
-    if (!arg) {
-      break;
+  for (int i = 0; i < argc; i++) {
+    tea_out_val(&ctx->out, &args[i]);
+  }
+
+  return tea_val_undef();
+}
+
+static tea_val_t tea_println(tea_ctx_t *ctx, const tea_val_t *args,
+                             const int argc)
+{
+  const tea_val_t value = tea_print(ctx, args, argc);
+  tea_out_write(&ctx->out, "\n", 1);
+  return value;
+}
+
+static tea_val_t tea_flush(tea_ctx_t *ctx, const tea_val_t *args,
+                           const int argc)
+{
+  (void)args;
+  (void)argc;
+  tea_out_flush(&ctx->out);
+  return tea_val_undef();
+}
+
+static tea_val_t tea_set_precision(tea_ctx_t *ctx, const tea_val_t *args,
+                                   const int argc)
+{
+  (void)argc;
+  // A negative precision goes back to the shortest digits
+  const int precision = args[0].i32;
+  ctx->out.precision = precision < 0 ? TEA_FMT_SHORTEST
+                       : precision > TEA_FMT_MAX_PRECISION
+                         ? TEA_FMT_MAX_PRECISION
+                         : precision;
+  return tea_val_undef();
+}
+
+static tea_val_t tea_lerp(tea_ctx_t *ctx, const tea_val_t *args,
+                          const int argc)
+{
+  (void)ctx;
+  (void)argc;
+  tea_val_t result;
+  result.type = TEA_V_F64;
+  result.f64 = args[0].f64 + (args[1].f64 - args[0].f64) * args[2].f64;
+  return result;
+}
+
+static void tea_print_memo_stats(const tea_ctx_t *ctx)
+{
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &ctx->prog->funcs)
+  {
+    const tea_fn_t *function = tea_list_record(entry, tea_fn_t, link);
+    const tea_memo_t *memo = tea_ctx_find_memo(ctx, function);
+    if (memo) {
+      fprintf(stderr, "memo %s: %lu hits, %lu misses, %lu evictions\n",
+              function->name->buf, memo->hits, memo->misses, memo->evictions);
     }
+  }
+}
 
-    const tea_val_t value = arg->val;
-    switch (value.type) {
-    case TEA_V_NULL:
-      printf("null");
-    case TEA_V_I32:
-      printf("%d", value.i32);
-      break;
-    case TEA_V_F32:
-      printf("%f", value.f32);
-      break;
-    case TEA_V_INST:
-      if (!strcmp(value.obj->type, "string")) {
-        printf("%s", (char *)value.obj->buf);
-      }
-      break;
-    case TEA_V_UNDEF:
+typedef struct {
+  const char *filename;
+  int max_call_depth;
+  bool inline_calls;
+  bool fold_calls;
+  bool memo_stats;
+  int out_mode; // a tea_out_mode_t, or -1 for the default of the stream
+  int precision; // decimals of printed floats, or TEA_FMT_SHORTEST
+} tea_options_t;
+
+// Parses the file, binds the natives, optimizes and loads the program. The
+// loaded program is shared by all runs
+static bool tea_build_program(tea_program_t *program,
+                              const tea_options_t *options)
+{
+  const char *filename = options->filename;
+  tea_log_inf("Parsing file: %s", filename);
+
+  tea_program_init(program, filename);
+  tea_program_parse(program);
+
+  tea_log_dbg("Parsing summary:");
+  tea_log_dbg("File: %s", filename);
+  tea_log_dbg("Status: successfully parsed");
+
+  if (!program->ast) {
+    // Nothing to run, as for a file with only comments
+    return true;
+  }
+
+  tea_node_print(program->ast, 0);
+  tea_log_dbg("Root node type: %s",
+              program->ast->type == TEA_N_PROG ? "PROGRAM" : "OTHER");
+  tea_log_dbg("Parsing completed successfully!");
+
+  tea_bind_native_sig(program, NULL, "print", "void (...)", tea_print);
+  tea_bind_native_sig(program, NULL, "println", "void (...)", tea_println);
+  tea_bind_native_sig(program, NULL, "flush", "void ()", tea_flush);
+  tea_bind_native_sig(program, NULL, "set_precision", "void (i32)",
+                      tea_set_precision);
+  tea_bind_pure_native_sig(program, NULL, "lerp", "f64 (f64, f64, f64)",
+                           tea_lerp);
+  tea_bind_parallel(program);
+  tea_bind_io(program);
+  tea_bind_lines(program);
+  tea_bind_actors(program);
+
+  if (options->fold_calls) {
+    tea_fold_calls(program, options->max_call_depth);
+  }
+  if (options->inline_calls) {
+    tea_inline(program);
+  }
+
+  return tea_program_load(program);
+}
+
+// Runs the loaded program in a context of its own, so several runs can go
+// on at once. Returns the exit code of the run
+static int tea_run_program(const tea_program_t *program,
+                           const tea_options_t *options, FILE *out)
+{
+  if (!program->ast) {
+    return 0;
+  }
+
+  tea_ctx_t context;
+  tea_interp_init(&context, program);
+  context.max_depth = options->max_call_depth;
+  tea_out_init(&context.out, out,
+               options->out_mode < 0 ? tea_out_default_mode(out)
+                                     : (tea_out_mode_t)options->out_mode);
+  context.out.precision = options->precision;
+
+  struct tea_out_t *const log_out = tea_log_out;
+  tea_log_out = &context.out;
+
+  int ret_code = 0;
+  tea_scope_t global_scope;
+  tea_scope_init(&global_scope, NULL);
+  context.declared = 0;
+  const tea_exec_status_t status =
+    tea_exec(&context, &global_scope, program->ast);
+  if (status == TEA_EXEC_BREAK || status == TEA_EXEC_CONT) {
+    tea_log_err("Runtime error: '%s' statement can only be used inside loops",
+                status == TEA_EXEC_BREAK ? "break" : "continue");
+    ret_code = 1;
+  } else if (status == TEA_EXEC_ERR) {
+    ret_code = 1;
+  }
+
+  if (options->memo_stats) {
+    tea_print_memo_stats(&context);
+  }
+
+  tea_scope_cleanup(&context, &global_scope);
+  tea_interp_cleanup(&context);
+  tea_log_out = log_out;
+
+  return ret_code;
+}
+
+typedef struct {
+  tea_thread_t thread;
+  const tea_program_t *program;
+  const tea_options_t *options;
+  int ret_code;
+} tea_worker_t;
+
+static void tea_run_worker(void *arg)
+{
+  tea_worker_t *worker = arg;
+  worker->ret_code =
+    tea_run_program(worker->program, worker->options, stdout);
+}
+
+// Runs the program on several threads at once, fails if any of the runs
+// fails
+static int tea_run_threads(const tea_program_t *program,
+                           const tea_options_t *options, const int count)
+{
+  tea_worker_t *workers = tea_malloc(count * sizeof(*workers));
+  if (!workers) {
+    tea_log_err("Memory error: Failed to allocate %d workers", count);
+    return 1;
+  }
+
+  int started = 0;
+  int ret_code = 0;
+  for (; started < count; started++) {
+    tea_worker_t *worker = &workers[started];
+    worker->program = program;
+    worker->options = options;
+    worker->ret_code = 0;
+    if (!tea_thread_start(&worker->thread, tea_run_worker, worker)) {
+      tea_log_err("Error: Failed to start thread %d", started);
+      ret_code = 1;
       break;
     }
   }
 
-  return tea_val_undef();
+  for (int i = 0; i < started; i++) {
+    tea_thread_join(&workers[i].thread);
+    if (workers[i].ret_code) {
+      ret_code = workers[i].ret_code;
+    }
+  }
+
+  tea_free(workers);
+  return ret_code;
 }
 
-static tea_val_t tea_println(tea_fn_args_t *args)
+// Scripts of a batch, from the command line and the manifest
+typedef struct {
+  const char **names;
+  long count;
+  long capacity;
+  long owned; // names read from the manifest, copied, at the end
+} tea_batch_files_t;
+
+typedef struct {
+  const tea_options_t *options;
+  const tea_batch_files_t *files;
+  long next; // next script to run
+  long failed;
+  tea_mutex_t lock;
+} tea_batch_t;
+
+static bool tea_batch_add(tea_batch_files_t *files, const char *name)
 {
-  const tea_val_t value = tea_print(args);
+  if (files->count == files->capacity) {
+    const long capacity = files->capacity ? files->capacity * 2 : 16;
+    const char **names = tea_malloc(capacity * sizeof(*names));
+    if (!names) {
+      tea_log_err("Memory error: Failed to allocate a batch of %ld scripts",
+                  capacity);
+      return false;
+    }
+    if (files->count) {
+      memcpy(names, files->names, files->count * sizeof(*names));
+    }
+    tea_free(files->names);
+    files->names = names;
+    files->capacity = capacity;
+  }
 
-  static const char newline = '\n';
-  fwrite(&newline, 1, 1, stdout);
+  files->names[files->count++] = name;
+  return true;
+}
 
-  return value;
+// Reads the scripts listed in the manifest, one path per line. Blank lines
+// and lines starting with '#' are skipped
+static bool tea_batch_read_manifest(tea_batch_files_t *files, const char *path)
+{
+  FILE *manifest = fopen(path, "r");
+  if (!manifest) {
+    tea_log_err("Error: Cannot open manifest '%s'", path);
+    return false;
+  }
+
+  char line[4096];
+  bool is_ok = true;
+  while (is_ok && fgets(line, sizeof(line), manifest)) {
+    size_t size = strlen(line);
+    while (size > 0 && (line[size - 1] == '\n' || line[size - 1] == '\r' ||
+                        line[size - 1] == ' ' || line[size - 1] == '\t')) {
+      line[--size] = 0;
+    }
+    if (size == 0 || line[0] == '#') {
+      continue;
+    }
+
+    char *name = tea_strdup(line);
+    is_ok = name && tea_batch_add(files, name);
+    if (is_ok) {
+      files->owned++;
+    } else {
+      tea_free(name);
+    }
+  }
+
+  fclose(manifest);
+  return is_ok;
+}
+
+// Parses and runs one script, its output and log go to a temporary file
+// so the scripts running at the same time don't mix their output
+static int tea_batch_run_script(const tea_options_t *batch_options,
+                                const char *filename, FILE *out)
+{
+  tea_options_t options = *batch_options;
+  options.filename = filename;
+  tea_log_file = out;
+
+  int ret_code = 1;
+  FILE *file = fopen(filename, "r");
+  if (file) {
+    fclose(file);
+    tea_program_t program;
+    if (tea_build_program(&program, &options)) {
+      ret_code = tea_run_program(&program, &options, out);
+    }
+    tea_program_cleanup(&program);
+  } else {
+    tea_log_err("Error: Cannot open file '%s'", filename);
+  }
+
+  tea_log_file = NULL;
+  return ret_code;
+}
+
+static void tea_batch_worker(void *arg)
+{
+  tea_batch_t *batch = arg;
+  for (;;) {
+    tea_mutex_lock(&batch->lock);
+    const long index = batch->next++;
+    tea_mutex_unlock(&batch->lock);
+    if (index >= batch->files->count) {
+      return;
+    }
+
+    const char *filename = batch->files->names[index];
+    FILE *out = tmpfile();
+    const int ret_code =
+      tea_batch_run_script(batch->options, filename, out ? out : stdout);
+
+    // Each script is printed as one block once it is done, in the order the
+    // scripts finish
+    tea_mutex_lock(&batch->lock);
+    printf("==> %s: exit %d <==\n", filename, ret_code);
+    if (out) {
+      char buffer[4096];
+      size_t size;
+      rewind(out);
+      while ((size = fread(buffer, 1, sizeof(buffer), out)) > 0) {
+        fwrite(buffer, 1, size, stdout);
+      }
+    }
+    if (ret_code) {
+      batch->failed++;
+    }
+    tea_mutex_unlock(&batch->lock);
+
+    if (out) {
+      fclose(out);
+    }
+  }
+}
+
+// Runs the scripts on a pool of threads, each script parsed and run in a
+// program and a context of its own. Fails if any of the scripts fails
+static int tea_run_batch(const tea_options_t *options,
+                         const tea_batch_files_t *files, int job_count)
+{
+  if (job_count > files->count) {
+    job_count = (int)files->count;
+  }
+  if (job_count == 0) {
+    return 0;
+  }
+
+  tea_batch_t batch;
+  batch.options = options;
+  batch.files = files;
+  batch.next = 0;
+  batch.failed = 0;
+  tea_thread_t *threads = tea_malloc(job_count * sizeof(*threads));
+  if (!threads || !tea_mutex_init(&batch.lock)) {
+    tea_log_err("Error: Failed to start a batch of %ld scripts", files->count);
+    tea_free(threads);
+    return 1;
+  }
+
+  int started = 0;
+  for (; started < job_count; started++) {
+    if (!tea_thread_start(&threads[started], tea_batch_worker, &batch)) {
+      break;
+    }
+  }
+  if (started == 0) {
+    // Without threads the scripts run one after another on this one
+    tea_batch_worker(&batch);
+  }
+  for (int i = 0; i < started; i++) {
+    tea_thread_join(&threads[i]);
+  }
+
+  tea_mutex_destroy(&batch.lock);
+  tea_free(threads);
+
+  fprintf(stderr, "batch: %ld scripts, %ld failed\n", files->count,
+          batch.failed);
+  return batch.failed ? 1 : 0;
 }
 
 int main(const int argc, char *argv[])
 {
-  const char *filename = NULL;
+  tea_options_t options;
+  options.filename = NULL;
+  options.max_call_depth = TEA_MAX_CALL_DEPTH;
+  options.inline_calls = true;
+  options.fold_calls = true;
+  options.memo_stats = false;
+  options.out_mode = -1;
+  options.precision = TEA_FMT_SHORTEST;
+  int thread_count = 0;
+  bool batch = false;
+  const char *manifest = NULL;
+  int job_count = 0;
+  bool serve = false;
+  bool log_async = false;
+  int worker_count = 0;
+  tea_serve_options_t serve_options;
+  serve_options.socket_path = TEA_SERVE_SOCKET;
+  serve_options.timeout_ms = TEA_SERVE_TIMEOUT_MS;
+  serve_options.max_requests = 0;
+  tea_batch_files_t files = { NULL, 0, 0, 0 };
 
   tea_init(NULL, NULL);
 
@@ -72,8 +504,130 @@ int main(const int argc, char *argv[])
       print_usage(argv[0]);
       return 0;
     }
+    if (strcmp(argv[i], "--max-call-depth") == 0 && i + 1 < argc) {
+      options.max_call_depth = atoi(argv[++i]);
+      if (options.max_call_depth <= 0) {
+        tea_log_err("Error: Invalid call depth '%s'", argv[i]);
+        return 1;
+      }
+      continue;
+    }
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      thread_count = atoi(argv[++i]);
+      if (thread_count <= 0) {
+        tea_log_err("Error: Invalid thread count '%s'", argv[i]);
+        return 1;
+      }
+      continue;
+    }
+    if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+      worker_count = atoi(argv[++i]);
+      if (worker_count <= 0) {
+        tea_log_err("Error: Invalid worker count '%s'", argv[i]);
+        return 1;
+      }
+      tea_parallel_set_workers(worker_count);
+      tea_actors_set_threads(worker_count);
+      continue;
+    }
+    if (strcmp(argv[i], "--batch") == 0) {
+      batch = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+      batch = true;
+      manifest = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+      job_count = atoi(argv[++i]);
+      if (job_count <= 0) {
+        tea_log_err("Error: Invalid job count '%s'", argv[i]);
+        return 1;
+      }
+      continue;
+    }
+    if (strcmp(argv[i], "--serve") == 0) {
+      serve = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      serve_options.socket_path = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+      serve_options.timeout_ms = atol(argv[++i]);
+      if (serve_options.timeout_ms < 0) {
+        tea_log_err("Error: Invalid timeout '%s'", argv[i]);
+        return 1;
+      }
+      continue;
+    }
+    if (strcmp(argv[i], "--max-requests") == 0 && i + 1 < argc) {
+      serve_options.max_requests = atol(argv[++i]);
+      if (serve_options.max_requests < 0) {
+        tea_log_err("Error: Invalid request limit '%s'", argv[i]);
+        return 1;
+      }
+      continue;
+    }
+    if (strcmp(argv[i], "--flush") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "line") == 0) {
+        options.out_mode = TEA_OUT_LINE;
+      } else if (strcmp(argv[i], "full") == 0) {
+        options.out_mode = TEA_OUT_FULL;
+      } else if (strcmp(argv[i], "exit") == 0) {
+        options.out_mode = TEA_OUT_EXIT;
+      } else {
+        tea_log_err("Error: Invalid flush mode '%s'", argv[i]);
+        return 1;
+      }
+      continue;
+    }
+    if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+      options.precision = atoi(argv[++i]);
+      if (options.precision < 0 ||
+          options.precision > TEA_FMT_MAX_PRECISION) {
+        tea_log_err("Error: Invalid precision '%s'", argv[i]);
+        return 1;
+      }
+      continue;
+    }
+    if (strcmp(argv[i], "--log-async") == 0) {
+      log_async = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+      const int level = atoi(argv[++i]);
+      if (level < 0 || level > TEA_LOG_INF) {
+        tea_log_err("Error: Invalid log level '%s'", argv[i]);
+        return 1;
+      }
+      tea_log_level = level;
+      continue;
+    }
+    if (strcmp(argv[i], "--no-io-uring") == 0) {
+      tea_io_set_backend(TEA_IO_POOL);
+      continue;
+    }
+    if (strcmp(argv[i], "--no-inline") == 0) {
+      options.inline_calls = false;
+      continue;
+    }
+    if (strcmp(argv[i], "--no-fold") == 0) {
+      options.fold_calls = false;
+      continue;
+    }
+    if (strcmp(argv[i], "--memo-stats") == 0) {
+      options.memo_stats = true;
+      continue;
+    }
     if (argv[i][0] != '-') {
-      filename = argv[i];
+      options.filename = argv[i];
+      if (!tea_batch_add(&files, argv[i])) {
+        return 1;
+      }
     } else {
       tea_log_err("Unknown option: %s", argv[i]);
       print_usage(argv[0]);
@@ -81,60 +635,60 @@ int main(const int argc, char *argv[])
     }
   }
 
+  // The forked workers of --serve wouldn't have the background thread
+  if (log_async && !serve && !tea_log_start()) {
+    tea_log_err("Error: Failed to start the log thread");
+    return 1;
+  }
+
+  if (batch) {
+    int ret_code = 1;
+    if (!manifest || tea_batch_read_manifest(&files, manifest)) {
+      ret_code = tea_run_batch(&options, &files,
+                               job_count ? job_count : tea_cpu_count());
+    }
+    for (long i = files.count - files.owned; i < files.count; i++) {
+      tea_free((void *)files.names[i]);
+    }
+    tea_free(files.names);
+    tea_cleanup();
+    return ret_code;
+  }
+  tea_free(files.names);
+
   // Check if filename was provided
-  if (!filename) {
+  if (!options.filename) {
     tea_log_err("Error: No input file specified");
     print_usage(argv[0]);
     return 1;
   }
 
   // Check if file exists
-  FILE *test_file = fopen(filename, "r");
+  FILE *test_file = fopen(options.filename, "r");
   if (!test_file) {
-    tea_log_err("Error: Cannot open file '%s'", filename);
+    tea_log_err("Error: Cannot open file '%s'", options.filename);
     return 1;
   }
   fclose(test_file);
 
-  tea_log_inf("Parsing file: %s", filename);
-
-  tea_lexer_t lexer;
-  tea_lexer_init(&lexer);
-  tea_node_t *ast = tea_parse_file(&lexer, filename);
-
-  tea_log_dbg("Parsing summary:");
-  tea_log_dbg("File: %s", filename);
-  tea_log_dbg("Status: successfully parsed");
-
-  if (ast) {
-    tea_node_print(ast, 0);
-    tea_log_dbg("Root node type: %s",
-                ast->type == TEA_N_PROG ? "PROGRAM" : "OTHER");
-  }
-
-  tea_log_dbg("Parsing completed successfully!");
-
-  int ret_code = 0;
-  if (ast) {
-    tea_ctx_t context;
-    tea_interp_init(&context, filename);
-
-    tea_bind_native_fn(&context, NULL, "print", tea_print);
-    tea_bind_native_fn(&context, NULL, "println", tea_println);
-
-    tea_scope_t global_scope;
-    tea_scope_init(&global_scope, NULL);
-    if (!tea_exec(&context, &global_scope, ast, NULL, NULL)) {
-      ret_code = 1;
+  int ret_code = 1;
+  tea_program_t program;
+  if (tea_build_program(&program, &options)) {
+    if (serve) {
+      // Built once here, the forked workers share it
+      serve_options.worker_count = worker_count ? worker_count
+                                                : tea_cpu_count();
+      serve_options.max_call_depth = options.max_call_depth;
+      serve_options.precision = options.precision;
+      ret_code = tea_serve(&program, &serve_options);
+    } else {
+      ret_code = thread_count
+                   ? tea_run_threads(&program, &options, thread_count)
+                   : tea_run_program(&program, &options, stdout);
     }
-
-    tea_scope_cleanup(&context, &global_scope);
-    tea_interp_cleanup(&context);
-
-    tea_node_free(ast);
   }
+  tea_program_cleanup(&program);
 
-  tea_lexer_cleanup(&lexer);
   tea_cleanup();
 
   return ret_code;
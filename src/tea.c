@@ -1,13 +1,29 @@
 #include "tea.h"
 
+#include "tea_dict.h"
+#include "tea_module.h"
+#include "tea_pool.h"
+
+#include "tea_log.h"
 #include "tea_memory.h"
 
+TEA_THREAD_LOCAL int tea_log_muted = 0;
+TEA_THREAD_LOCAL FILE *tea_log_file = NULL;
+TEA_THREAD_LOCAL struct tea_out_t *tea_log_out = NULL;
+
 void tea_init(tea_malloc_func_t malloc_func, tea_free_func_t free_func)
 {
   tea_memory_init(malloc_func, free_func);
+  tea_dict_intern_init();
+  tea_modules_init();
+  tea_pool_init();
 }
 
 void tea_cleanup()
 {
+  tea_log_stop();
+  tea_pool_cleanup();
+  tea_modules_cleanup();
+  tea_dict_intern_cleanup();
   tea_memory_cleanup();
 }
@@ -0,0 +1,684 @@
+#include "tea_actor.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "tea_dict.h"
+#include "tea_interp.h"
+#include "tea_module.h"
+#include "tea_struct.h"
+#include "tea_thread.h"
+
+#include "tea_log.h"
+#include "tea_memory.h"
+
+// Set before any program runs, read when a context spawns its first actor
+static int tea_actors_threads = 0;
+
+// Actors of one run and the threads that run them, shared by the context
+// of the run and the contexts of its actors
+typedef struct tea_actors_t {
+  const tea_ctx_t *owner;
+  tea_mutex_t lock;
+  tea_cond_t work; // signaled when an actor is put in the run queue
+  tea_cond_t idle; // signaled when no actor is left to run
+  tea_actor_t *ready_head;
+  tea_actor_t *ready_tail;
+  long busy; // actors in the run queue or running
+  unsigned long handled; // messages handled by all the actors
+  unsigned long failures;
+  bool stop;
+  tea_list_entry_t actors;
+  tea_thread_t *threads;
+  int thread_count;
+} tea_actors_t;
+
+void tea_actors_set_threads(const int count)
+{
+  tea_actors_threads = count > 0 ? count : 0;
+}
+
+static void tea_mailbox_init(tea_mailbox_t *mailbox)
+{
+  mailbox->stub.next = NULL;
+  mailbox->head = &mailbox->stub;
+  mailbox->tail = &mailbox->stub;
+}
+
+static void tea_mailbox_push(tea_mailbox_t *mailbox, tea_msg_t *msg)
+{
+  msg->next = NULL;
+  tea_msg_t *prev = tea_atomic_xchg_ptr((void *volatile *)&mailbox->head, msg);
+  // Until this store the message can't be received, the receiver sees the
+  // mailbox as not empty and tries again later
+  tea_atomic_store_ptr((void *volatile *)&prev->next, msg);
+}
+
+static tea_msg_t *tea_mailbox_pop(tea_mailbox_t *mailbox)
+{
+  tea_msg_t *tail = mailbox->tail;
+  tea_msg_t *next = tea_atomic_load_ptr((void *volatile *)&tail->next);
+  if (tail == &mailbox->stub) {
+    if (!next) {
+      return NULL;
+    }
+    mailbox->tail = next;
+    tail = next;
+    next = tea_atomic_load_ptr((void *volatile *)&next->next);
+  }
+
+  if (next) {
+    mailbox->tail = next;
+    return tail;
+  }
+
+  if (tail != tea_atomic_load_ptr((void *volatile *)&mailbox->head)) {
+    // A sender is linking the next message
+    return NULL;
+  }
+
+  // The last message is taken by putting the stub back behind it
+  tea_mailbox_push(mailbox, &mailbox->stub);
+  next = tea_atomic_load_ptr((void *volatile *)&tail->next);
+  if (next) {
+    mailbox->tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
+
+tea_actor_t *tea_val_actor(const tea_val_t *value)
+{
+  if (value->type != TEA_V_INST || strcmp(value->obj->type, TEA_ACTOR_TYPE)) {
+    return NULL;
+  }
+
+  return (tea_actor_t *)value->obj->buf;
+}
+
+static bool tea_actor_copy_val(const tea_program_t *prog,
+                               const tea_val_t *value, tea_val_t *copy,
+                               const int depth)
+{
+  *copy = *value;
+  if (value->type != TEA_V_DICT && value->type != TEA_V_INST) {
+    return true;
+  }
+
+  if (depth >= TEA_ACTOR_MAX_NESTING) {
+    tea_log_err(
+      "Runtime error: Values nested deeper than %d levels can't be sent",
+      TEA_ACTOR_MAX_NESTING);
+    return false;
+  }
+
+  if (value->type == TEA_V_DICT) {
+    tea_dict_t *dict = tea_dict_create(value->dict->size);
+    if (!dict) {
+      tea_log_err("Memory error: Failed to copy a dictionary of %lu entries",
+                  value->dict->size);
+      return false;
+    }
+
+    unsigned long it = 0;
+    const tea_dict_entry_t *entry;
+    while ((entry = tea_dict_next(value->dict, &it))) {
+      tea_val_t item;
+      if (!tea_actor_copy_val(prog, &entry->val, &item, depth + 1)) {
+        tea_dict_free(dict);
+        return false;
+      }
+      if (!tea_dict_set(dict, &entry->key, item)) {
+        tea_log_err("Memory error: Failed to copy a dictionary entry");
+        tea_dict_free(dict);
+        return false;
+      }
+    }
+
+    copy->dict = dict;
+    return true;
+  }
+
+  // Nothing can change these, so the receiver gets the same instance
+  const tea_inst_t *object = value->obj;
+  if (object->flags & TEA_INST_FROZEN || !strcmp(object->type, "string") ||
+      !strcmp(object->type, TEA_ACTOR_TYPE)) {
+    return true;
+  }
+
+  const tea_struct_decl_t *decl = object->decl;
+  if (!decl) {
+    tea_log_err("Runtime error: Values of type '%s' can't be sent",
+                object->type);
+    return false;
+  }
+
+  tea_inst_t *clone =
+    tea_malloc(sizeof(tea_inst_t) + decl->field_count * sizeof(tea_val_t));
+  if (!clone) {
+    tea_log_err("Memory error: Failed to copy an instance of type '%s'",
+                object->type);
+    return false;
+  }
+
+  clone->type = object->type;
+  clone->decl = decl;
+  clone->size = decl->field_count * sizeof(tea_val_t);
+  clone->flags = 0;
+  const tea_val_t *fields = (const tea_val_t *)object->buf;
+  tea_val_t *clone_fields = (tea_val_t *)clone->buf;
+  for (unsigned long i = 0; i < decl->field_count; i++) {
+    if (!tea_actor_copy_val(prog, &fields[i], &clone_fields[i], depth + 1)) {
+      tea_free(clone);
+      return false;
+    }
+  }
+
+  copy->obj = clone;
+  return true;
+}
+
+bool tea_actor_copy(const tea_program_t *prog, const tea_val_t *value,
+                    tea_val_t *copy)
+{
+  return tea_actor_copy_val(prog, value, copy, 0);
+}
+
+// Handles a batch of messages, returns the number handled. Sets has_failed
+// if a handler failed in this batch
+static unsigned long tea_actor_run(tea_actor_t *actor, bool *has_failed)
+{
+  *has_failed = false;
+  unsigned long handled = 0;
+  struct tea_out_t *const log_out = tea_log_out;
+  tea_log_out = &actor->ctx.out;
+  for (int i = 0; i < TEA_ACTOR_BATCH; i++) {
+    tea_msg_t *msg = tea_mailbox_pop(&actor->mailbox);
+    if (!msg) {
+      break;
+    }
+
+    if (!actor->failed) {
+      const tea_val_t args[2] = { actor->state, msg->val };
+      tea_val_t result;
+      if (tea_call_fn_vals(&actor->ctx, &actor->scp, actor->fn, args, 2,
+                           &result)) {
+        // A handler without a result keeps the state
+        if (result.type != TEA_V_UNDEF) {
+          actor->state = result;
+        }
+        handled++;
+      } else {
+        tea_log_err("Runtime error: Actor '%s' failed to handle a message",
+                    actor->fn->name->buf);
+        actor->failed = true;
+        *has_failed = true;
+      }
+    }
+
+    tea_free(msg);
+  }
+  tea_log_out = log_out;
+
+  return handled;
+}
+
+// Puts the actor in the run queue, the lock must be held
+static void tea_actors_push(tea_actors_t *sys, tea_actor_t *actor)
+{
+  actor->next_ready = NULL;
+  if (sys->ready_tail) {
+    sys->ready_tail->next_ready = actor;
+  } else {
+    sys->ready_head = actor;
+  }
+  sys->ready_tail = actor;
+  tea_cond_signal(&sys->work);
+}
+
+static void tea_actors_worker(void *arg)
+{
+  tea_actors_t *sys = arg;
+  for (;;) {
+    tea_mutex_lock(&sys->lock);
+    while (!sys->ready_head && !sys->stop) {
+      tea_cond_wait(&sys->work, &sys->lock);
+    }
+    tea_actor_t *actor = sys->ready_head;
+    if (!actor) {
+      tea_mutex_unlock(&sys->lock);
+      return;
+    }
+    sys->ready_head = actor->next_ready;
+    if (!sys->ready_head) {
+      sys->ready_tail = NULL;
+    }
+    tea_mutex_unlock(&sys->lock);
+
+    bool has_failed;
+    const unsigned long handled = tea_actor_run(actor, &has_failed);
+    tea_out_flush(&actor->ctx.out);
+    // Only the receiver may look at the tail, so check it before the actor
+    // can be scheduled on another thread
+    tea_mailbox_t *mailbox = &actor->mailbox;
+    const bool was_drained = mailbox->tail == &mailbox->stub;
+    tea_atomic_store_long(&actor->scheduled, 0);
+
+    // A message sent during the run found the actor still scheduled, so it
+    // is scheduled again here
+    const bool has_more =
+      !was_drained ||
+      tea_atomic_load_ptr((void *volatile *)&mailbox->head) != &mailbox->stub;
+    const bool again =
+      has_more && tea_atomic_cas_long(&actor->scheduled, 0, 1);
+
+    tea_mutex_lock(&sys->lock);
+    sys->handled += handled;
+    sys->failures += has_failed;
+    if (again) {
+      tea_actors_push(sys, actor);
+    } else if (--sys->busy == 0) {
+      tea_cond_broadcast(&sys->idle);
+    }
+    tea_mutex_unlock(&sys->lock);
+  }
+}
+
+static tea_actors_t *tea_actors_create(const tea_ctx_t *owner)
+{
+  tea_actors_t *sys = tea_malloc(sizeof(tea_actors_t));
+  if (!sys) {
+    return NULL;
+  }
+
+  int thread_count = tea_actors_threads ? tea_actors_threads : tea_cpu_count();
+  sys->threads = tea_malloc(thread_count * sizeof(*sys->threads));
+  if (!sys->threads) {
+    tea_free(sys);
+    return NULL;
+  }
+
+  if (!tea_mutex_init(&sys->lock)) {
+    tea_free(sys->threads);
+    tea_free(sys);
+    return NULL;
+  }
+  if (!tea_cond_init(&sys->work)) {
+    tea_mutex_destroy(&sys->lock);
+    tea_free(sys->threads);
+    tea_free(sys);
+    return NULL;
+  }
+  if (!tea_cond_init(&sys->idle)) {
+    tea_cond_destroy(&sys->work);
+    tea_mutex_destroy(&sys->lock);
+    tea_free(sys->threads);
+    tea_free(sys);
+    return NULL;
+  }
+
+  sys->owner = owner;
+  sys->ready_head = NULL;
+  sys->ready_tail = NULL;
+  sys->busy = 0;
+  sys->handled = 0;
+  sys->failures = 0;
+  sys->stop = false;
+  tea_list_init(&sys->actors);
+  sys->thread_count = 0;
+
+  for (int i = 0; i < thread_count; i++) {
+    if (!tea_thread_start(&sys->threads[i], tea_actors_worker, sys)) {
+      break;
+    }
+    sys->thread_count++;
+  }
+
+  if (sys->thread_count == 0) {
+    tea_cond_destroy(&sys->idle);
+    tea_cond_destroy(&sys->work);
+    tea_mutex_destroy(&sys->lock);
+    tea_free(sys->threads);
+    tea_free(sys);
+    return NULL;
+  }
+
+  tea_log_dbg("Actors run on %d threads", sys->thread_count);
+  return sys;
+}
+
+// Returns the actor whose handler runs in the context, NULL for the context
+// of the run itself
+static tea_actor_t *tea_ctx_actor(const tea_ctx_t *ctx)
+{
+  if (!ctx->actors || ctx->actors->owner == ctx) {
+    return NULL;
+  }
+
+  return tea_list_record(ctx, tea_actor_t, ctx);
+}
+
+// Waits until no actor is left to run, fails if an actor failed
+static bool tea_actors_wait(const tea_ctx_t *ctx, const char *native_name,
+                            unsigned long *handled)
+{
+  *handled = 0;
+  if (tea_ctx_actor(ctx)) {
+    tea_log_err("Runtime error: '%s' can't be called by an actor",
+                native_name);
+    return false;
+  }
+
+  tea_actors_t *sys = ctx->actors;
+  if (!sys) {
+    return true;
+  }
+
+  tea_mutex_lock(&sys->lock);
+  while (sys->busy) {
+    tea_cond_wait(&sys->idle, &sys->lock);
+  }
+  const unsigned long failures = sys->failures;
+  *handled = sys->handled;
+  tea_mutex_unlock(&sys->lock);
+
+  if (failures) {
+    tea_log_err("Runtime error: %lu actors failed to handle their messages",
+                failures);
+    return false;
+  }
+
+  return true;
+}
+
+void tea_actors_cleanup(const tea_ctx_t *ctx)
+{
+  tea_actors_t *sys = ctx->actors;
+  if (!sys || sys->owner != ctx) {
+    return;
+  }
+
+  tea_mutex_lock(&sys->lock);
+  while (sys->busy) {
+    tea_cond_wait(&sys->idle, &sys->lock);
+  }
+  sys->stop = true;
+  tea_cond_broadcast(&sys->work);
+  tea_mutex_unlock(&sys->lock);
+
+  for (int i = 0; i < sys->thread_count; i++) {
+    tea_thread_join(&sys->threads[i]);
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &sys->actors)
+  {
+    tea_actor_t *actor = tea_list_record(entry, tea_actor_t, link);
+    tea_scope_cleanup(&actor->ctx, &actor->scp);
+    tea_interp_cleanup(&actor->ctx);
+  }
+
+  tea_log_dbg("Actors handled %lu messages", sys->handled);
+  tea_cond_destroy(&sys->idle);
+  tea_cond_destroy(&sys->work);
+  tea_mutex_destroy(&sys->lock);
+  tea_free(sys->threads);
+  tea_free(sys);
+}
+
+static const tea_fn_t *tea_actor_find_fn(const tea_ctx_t *ctx,
+                                         const tea_val_t *name)
+{
+  if (name->type != TEA_V_INST || strcmp(name->obj->type, "string") != 0) {
+    tea_log_err("Runtime error: 'spawn' expects a function name as a string");
+    return NULL;
+  }
+
+  const char *fn_name = name->obj->buf;
+  const tea_fn_t *fn = tea_ctx_find_fn(&ctx->prog->funcs, fn_name);
+  if (!fn || !tea_ctx_sees(ctx, fn)) {
+    tea_log_err("Runtime error: Function '%s' passed to 'spawn' not found",
+                fn_name);
+    return NULL;
+  }
+
+  if (fn->mut || fn->gen) {
+    tea_log_err(
+      "Runtime error: Function '%s' can't handle messages, it is %s", fn_name,
+      fn->mut ? "mutable" : "a generator");
+    return NULL;
+  }
+
+  return fn;
+}
+
+static tea_val_t tea_spawn(tea_ctx_t *ctx, const tea_val_t *args,
+                           const int argc)
+{
+  (void)argc;
+  const tea_fn_t *fn = tea_actor_find_fn(ctx, &args[0]);
+  if (!fn) {
+    return tea_val_undef();
+  }
+
+  tea_val_t state;
+  if (!tea_actor_copy(ctx->prog, &args[1], &state)) {
+    return tea_val_undef();
+  }
+
+  if (!ctx->actors) {
+    ctx->actors = tea_actors_create(ctx);
+    if (!ctx->actors) {
+      tea_log_err("Runtime error: Failed to start the threads of actors");
+      return tea_val_undef();
+    }
+  }
+
+  tea_inst_t *object = tea_malloc(sizeof(tea_inst_t) + sizeof(tea_actor_t));
+  if (!object) {
+    tea_log_err("Memory error: Failed to allocate the actor '%s'",
+                fn->name->buf);
+    return tea_val_undef();
+  }
+
+  object->type = TEA_ACTOR_TYPE;
+  object->decl = NULL;
+  object->size = sizeof(tea_actor_t);
+  object->flags = 0;
+
+  tea_actor_t *actor = (tea_actor_t *)object->buf;
+  tea_actors_t *sys = ctx->actors;
+  actor->sys = sys;
+  actor->fn = fn;
+  tea_interp_init(&actor->ctx, ctx->prog);
+  actor->ctx.max_depth = ctx->max_depth;
+  // The handler sees the module variables as they are at the spawn
+  if (!tea_module_scopes_copy(&actor->ctx, ctx)) {
+    tea_interp_cleanup(&actor->ctx);
+    tea_free(object);
+    return tea_val_undef();
+  }
+  actor->ctx.actors = sys;
+  // What the spawner printed so far comes before what the actor prints
+  tea_out_flush(&ctx->out);
+  tea_out_init(&actor->ctx.out, ctx->out.file, ctx->out.mode);
+  actor->ctx.out.precision = ctx->out.precision;
+  tea_scope_init(&actor->scp, NULL);
+  actor->state = state;
+  tea_mailbox_init(&actor->mailbox);
+  actor->next_ready = NULL;
+  actor->scheduled = 0;
+  actor->failed = false;
+
+  tea_mutex_lock(&sys->lock);
+  tea_list_add_tail(&sys->actors, &actor->link);
+  tea_mutex_unlock(&sys->lock);
+
+  const tea_val_t result = { .type = TEA_V_INST, .obj = object };
+  return result;
+}
+
+static tea_actor_t *tea_actor_arg(const tea_ctx_t *ctx, const char *native_name,
+                                  const tea_val_t *value)
+{
+  tea_actor_t *actor = tea_val_actor(value);
+  if (!actor) {
+    tea_log_err("Runtime error: '%s' expects an actor, got %s", native_name,
+                tea_val_type_str(value->type));
+    return NULL;
+  }
+
+  if (actor->sys != ctx->actors) {
+    tea_log_err("Runtime error: '%s' got an actor of another run",
+                native_name);
+    return NULL;
+  }
+
+  return actor;
+}
+
+static tea_val_t tea_send(tea_ctx_t *ctx, const tea_val_t *args,
+                          const int argc)
+{
+  (void)argc;
+  tea_actor_t *actor = tea_actor_arg(ctx, "send", &args[0]);
+  if (!actor) {
+    return tea_val_undef();
+  }
+
+  tea_msg_t *msg = tea_malloc(sizeof(tea_msg_t));
+  if (!msg) {
+    tea_log_err("Memory error: Failed to allocate a message");
+    return tea_val_undef();
+  }
+
+  if (!tea_actor_copy(ctx->prog, &args[1], &msg->val)) {
+    tea_free(msg);
+    return tea_val_undef();
+  }
+
+  tea_mailbox_push(&actor->mailbox, msg);
+  // Whoever takes the actor from idle to scheduled puts it in the queue
+  if (tea_atomic_cas_long(&actor->scheduled, 0, 1)) {
+    tea_actors_t *sys = actor->sys;
+    tea_mutex_lock(&sys->lock);
+    sys->busy++;
+    tea_actors_push(sys, actor);
+    tea_mutex_unlock(&sys->lock);
+  }
+
+  return tea_val_null();
+}
+
+static tea_val_t tea_self(tea_ctx_t *ctx, const tea_val_t *args,
+                          const int argc)
+{
+  (void)args;
+  (void)argc;
+  tea_actor_t *actor = tea_ctx_actor(ctx);
+  if (!actor) {
+    tea_log_err("Runtime error: 'self' can only be called by an actor");
+    return tea_val_undef();
+  }
+
+  const tea_val_t result = {
+    .type = TEA_V_INST,
+    .obj = tea_list_record(actor, tea_inst_t, buf),
+  };
+  return result;
+}
+
+static tea_val_t tea_wait_actors(tea_ctx_t *ctx, const tea_val_t *args,
+                                 const int argc)
+{
+  (void)args;
+  (void)argc;
+  unsigned long handled;
+  if (!tea_actors_wait(ctx, "wait_actors", &handled)) {
+    return tea_val_undef();
+  }
+
+  const tea_val_t result = { .type = TEA_V_I64, .i64 = (int64_t)handled };
+  return result;
+}
+
+static tea_val_t tea_state_of(tea_ctx_t *ctx, const tea_val_t *args,
+                              const int argc)
+{
+  (void)argc;
+  const tea_actor_t *actor = tea_actor_arg(ctx, "state_of", &args[0]);
+  unsigned long handled;
+  if (!actor || !tea_actors_wait(ctx, "state_of", &handled)) {
+    return tea_val_undef();
+  }
+
+  // The actor may change its state again after the next send
+  tea_val_t state;
+  if (!tea_actor_copy(ctx->prog, &actor->state, &state)) {
+    return tea_val_undef();
+  }
+  return state;
+}
+
+static bool tea_freeze_val(const tea_program_t *prog, const tea_val_t *value,
+                           const int depth)
+{
+  if (value->type == TEA_V_DICT) {
+    tea_log_err("Runtime error: Dictionaries can't be frozen");
+    return false;
+  }
+  if (value->type != TEA_V_INST) {
+    return true;
+  }
+
+  tea_inst_t *object = value->obj;
+  if (object->flags & TEA_INST_FROZEN || !strcmp(object->type, "string") ||
+      !strcmp(object->type, TEA_ACTOR_TYPE)) {
+    return true;
+  }
+
+  const tea_struct_decl_t *decl = object->decl;
+  if (!decl) {
+    tea_log_err("Runtime error: Values of type '%s' can't be frozen",
+                object->type);
+    return false;
+  }
+
+  if (depth >= TEA_ACTOR_MAX_NESTING) {
+    tea_log_err(
+      "Runtime error: Instances nested deeper than %d levels can't be frozen",
+      TEA_ACTOR_MAX_NESTING);
+    return false;
+  }
+
+  const tea_val_t *fields = (const tea_val_t *)object->buf;
+  for (unsigned long i = 0; i < decl->field_count; i++) {
+    if (!tea_freeze_val(prog, &fields[i], depth + 1)) {
+      return false;
+    }
+  }
+
+  object->flags |= TEA_INST_FROZEN;
+  return true;
+}
+
+static tea_val_t tea_freeze(tea_ctx_t *ctx, const tea_val_t *args,
+                            const int argc)
+{
+  (void)argc;
+  if (!tea_freeze_val(ctx->prog, &args[0], 0)) {
+    return tea_val_undef();
+  }
+  return args[0];
+}
+
+void tea_bind_actors(tea_program_t *prog)
+{
+  tea_bind_native_sig(prog, NULL, "spawn", "any (string, any)", tea_spawn);
+  tea_bind_native_sig(prog, NULL, "send", "void (any, any)", tea_send);
+  tea_bind_native_sig(prog, NULL, "self", "any ()", tea_self);
+  tea_bind_native_sig(prog, NULL, "wait_actors", "i64 ()", tea_wait_actors);
+  tea_bind_native_sig(prog, NULL, "state_of", "any (any)", tea_state_of);
+  tea_bind_native_sig(prog, NULL, "freeze", "any (any)", tea_freeze);
+}
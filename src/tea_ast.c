@@ -16,6 +16,7 @@ tea_node_t *_tea_node_create(const char *file, const unsigned long line,
 
   node->type = type;
   node->tok = token;
+  node->slot = TEA_SLOT_UNRESOLVED;
 
   if (type == TEA_N_BINOP || type == TEA_N_ASSIGN) {
     node->binop.lhs = NULL;
@@ -83,6 +84,91 @@ void tea_node_free(tea_node_t *node)
   tea_free(node);
 }
 
+static bool tea_node_has_children(const tea_node_t *node)
+{
+  return node->type != TEA_N_BINOP && node->type != TEA_N_ASSIGN &&
+         node->type != TEA_N_FIELD_ACC;
+}
+
+tea_node_t *tea_node_clone(const tea_node_t *node)
+{
+  if (!node) {
+    return NULL;
+  }
+
+  tea_node_t *clone = tea_node_create(node->type, node->tok);
+  if (!clone) {
+    return NULL;
+  }
+
+  if (!tea_node_has_children(node)) {
+    // binop and field_acc share the layout
+    tea_node_t *first = tea_node_clone(node->binop.lhs);
+    tea_node_t *second = tea_node_clone(node->binop.rhs);
+    clone->binop.lhs = first;
+    clone->binop.rhs = second;
+    if ((node->binop.lhs && !first) || (node->binop.rhs && !second)) {
+      tea_node_free(clone);
+      return NULL;
+    }
+    return clone;
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    tea_node_t *child_clone = tea_node_clone(child);
+    if (!child_clone) {
+      tea_node_free(clone);
+      return NULL;
+    }
+    tea_node_add_child(clone, child_clone);
+  }
+
+  return clone;
+}
+
+void tea_node_replace(tea_node_t *node, tea_node_t *with)
+{
+  // Release the old contents but not the node itself
+  const tea_list_entry_t link = node->link;
+  node->tok = NULL;
+  if (tea_node_has_children(node)) {
+    tea_list_entry_t *entry;
+    tea_list_entry_t *safe;
+    tea_list_for_each_safe(entry, safe, &node->children)
+    {
+      tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      tea_list_remove(entry);
+      tea_node_free(child);
+    }
+  } else {
+    tea_node_t *first = node->binop.lhs;
+    tea_node_t *second = node->binop.rhs;
+    tea_node_free(first);
+    tea_node_free(second);
+  }
+
+  node->type = with->type;
+  node->tok = with->tok;
+  node->slot = with->slot;
+  node->link = link;
+
+  // The list head can't be copied, the children are moved one by one
+  if (tea_node_has_children(with)) {
+    tea_list_init(&node->children);
+    tea_node_add_children(node, &with->children);
+  } else {
+    node->binop.lhs = with->binop.lhs;
+    node->binop.rhs = with->binop.rhs;
+    with->binop.lhs = NULL;
+    with->binop.rhs = NULL;
+  }
+
+  tea_node_free(with);
+}
+
 const char *tea_node_type_name(const tea_node_type_t type)
 {
   switch (type) {
@@ -124,6 +210,8 @@ const char *tea_node_type_name(const tea_node_type_t type)
     return "FUNCTION_CALL_ARGS";
   case TEA_N_RET:
     return "RETURN";
+  case TEA_N_YIELD:
+    return "YIELD";
   case TEA_N_BREAK:
     return "BREAK";
   case TEA_N_CONT:
@@ -140,6 +228,14 @@ const char *tea_node_type_name(const tea_node_type_t type)
     return "WHILE_COND";
   case TEA_N_WHILE_BODY:
     return "WHILE_BODY";
+  case TEA_N_FOR:
+    return "FOR";
+  case TEA_N_FOR_RANGE:
+    return "FOR_RANGE";
+  case TEA_N_FOR_ITER:
+    return "FOR_ITER";
+  case TEA_N_FOR_BODY:
+    return "FOR_BODY";
   case TEA_N_STRUCT:
     return "STRUCT";
   case TEA_N_STRUCT_FIELD:
@@ -160,6 +256,8 @@ const char *tea_node_type_name(const tea_node_type_t type)
     return "TEA_N_ARRAY_INST";
   case TEA_N_DICT_INST:
     return "TEA_N_DICT_INST";
+  case TEA_N_IMPORT:
+    return "IMPORT";
   default:
     return "UNKNOWN";
   }
@@ -190,9 +288,9 @@ static void tea_node_print_tree_recursive(tea_node_t *node, const int depth)
   const tea_tok_t *token = node->tok;
   if (token && node->type != TEA_N_STR) {
     if (node->type == TEA_N_INT) {
-      printf(": %d", *(int *)token->buf);
+      printf(": %lld", (long long)tea_tok_int(token));
     } else if (node->type == TEA_N_FLOAT) {
-      printf(": %f", *(float *)token->buf);
+      printf(": %f", tea_tok_float(token));
     } else {
       printf(": %.*s", token->size, token->buf);
     }
@@ -0,0 +1,524 @@
+#include "tea_dict.h"
+
+#include <string.h>
+
+#include "tea_log.h"
+#include "tea_memory.h"
+#include "tea_thread.h"
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEA_DICT_SSE2 1
+#include <emmintrin.h>
+#else
+#define TEA_DICT_SSE2 0
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define TEA_DICT_GROUP_WIDTH  16
+#define TEA_DICT_MIN_SLOTS    16
+#define TEA_DICT_CTRL_EMPTY   0x80
+#define TEA_DICT_CTRL_DELETED 0xFE
+
+// Control byte layout: 0x80 is empty, 0xFE is deleted and 0b0xxxxxxx is a
+// full slot with the 7 low bits of the hash (H2). The rest of the hash (H1)
+// selects the group where probing starts.
+#define TEA_DICT_H1(hash) ((hash) >> 7)
+#define TEA_DICT_H2(hash) ((unsigned char)((hash) & 0x7F))
+
+uint32_t tea_dict_hash_str(const char *str, const int size)
+{
+  // FNV-1a with a murmur3 finalizer, so the low 7 bits used as H2 are mixed
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < size; ++i) {
+    hash ^= (unsigned char)str[i];
+    hash *= 16777619u;
+  }
+
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6Bu;
+  hash ^= hash >> 13;
+  hash *= 0xC2B2AE35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+uint32_t tea_dict_hash_int(const int64_t value)
+{
+  uint64_t hash = (uint64_t)value;
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDull;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ull;
+  hash ^= hash >> 33;
+  return (uint32_t)hash;
+}
+
+tea_dict_key_t tea_dict_key_str(const char *str, const int size)
+{
+  tea_dict_key_t key;
+  key.type = TEA_KEY_STR;
+  key.hash = tea_dict_hash_str(str, size);
+  key.size = size;
+  key.is_interned = false;
+  key.str = str;
+  return key;
+}
+
+tea_dict_key_t tea_dict_key_tok(const tea_tok_t *tok)
+{
+  tea_dict_key_t key;
+  key.type = TEA_KEY_STR;
+  key.hash = tok->hash;
+  key.size = tok->size;
+  key.is_interned = tok->str != NULL;
+  key.str = tok->str ? tok->str : tok->buf;
+  return key;
+}
+
+tea_dict_key_t tea_dict_key_int(const int64_t value)
+{
+  tea_dict_key_t key;
+  key.type = TEA_KEY_INT;
+  key.hash = tea_dict_hash_int(value);
+  key.size = 0;
+  key.is_interned = false;
+  key.i64 = value;
+  return key;
+}
+
+static unsigned int tea_dict_ctz(const unsigned int mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+/**
+ * @internal
+ * @brief Returns a bit mask of the bytes in the group equal to the value.
+ */
+static unsigned int tea_dict_group_match(const unsigned char *group,
+                                         const unsigned char value)
+{
+#if TEA_DICT_SSE2
+  const __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  const __m128i match = _mm_set1_epi8((char)value);
+  return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, match));
+#else
+  unsigned int mask = 0;
+  for (int i = 0; i < TEA_DICT_GROUP_WIDTH; ++i) {
+    if (group[i] == value) {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+#endif
+}
+
+/**
+ * @internal
+ * @brief Returns a bit mask of the empty or deleted bytes in the group.
+ */
+static unsigned int tea_dict_group_match_free(const unsigned char *group)
+{
+#if TEA_DICT_SSE2
+  const __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  return (unsigned int)_mm_movemask_epi8(ctrl);
+#else
+  unsigned int mask = 0;
+  for (int i = 0; i < TEA_DICT_GROUP_WIDTH; ++i) {
+    if (group[i] & 0x80) {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+#endif
+}
+
+static void tea_dict_set_ctrl(tea_dict_t *dict, const unsigned long slot,
+                              const unsigned char value)
+{
+  dict->ctrl[slot] = value;
+  // The first group is mirrored after the end of the table, so a group can be
+  // loaded from any position without wrapping around
+  if (slot < TEA_DICT_GROUP_WIDTH) {
+    dict->ctrl[dict->slot_mask + 1 + slot] = value;
+  }
+}
+
+static bool tea_dict_key_equals(const tea_dict_key_t *a,
+                                const tea_dict_key_t *b)
+{
+  if (a->type != b->type || a->hash != b->hash) {
+    return false;
+  }
+
+  if (a->type == TEA_KEY_INT) {
+    return a->i64 == b->i64;
+  }
+
+  if (a->is_interned && b->is_interned) {
+    return a->str == b->str;
+  }
+
+  return a->size == b->size && !memcmp(a->str, b->str, a->size);
+}
+
+/**
+ * @internal
+ * @brief Finds the slot that refers to the key.
+ * @return true if the key was found, the slot index is stored in 'slot'.
+ */
+static bool tea_dict_find_slot(const tea_dict_t *dict,
+                               const tea_dict_key_t *key, unsigned long *slot)
+{
+  if (!dict->ctrl) {
+    return false;
+  }
+
+  const unsigned char h2 = TEA_DICT_H2(key->hash);
+  unsigned long pos = TEA_DICT_H1(key->hash) & dict->slot_mask;
+  unsigned long step = 0;
+
+  while (true) {
+    const unsigned char *group = &dict->ctrl[pos];
+
+    unsigned int mask = tea_dict_group_match(group, h2);
+    while (mask) {
+      const unsigned long index =
+        (pos + tea_dict_ctz(mask)) & dict->slot_mask;
+      const tea_dict_entry_t *entry = &dict->entries[dict->slots[index]];
+      if (tea_dict_key_equals(&entry->key, key)) {
+        *slot = index;
+        return true;
+      }
+      mask &= mask - 1;
+    }
+
+    if (tea_dict_group_match(group, TEA_DICT_CTRL_EMPTY)) {
+      return false;
+    }
+
+    // Triangular probing visits every group when the table size is a power
+    // of two
+    step += TEA_DICT_GROUP_WIDTH;
+    if (step > dict->slot_mask) {
+      return false;
+    }
+    pos = (pos + step) & dict->slot_mask;
+  }
+}
+
+static unsigned long tea_dict_find_free_slot(const tea_dict_t *dict,
+                                             const uint32_t hash)
+{
+  unsigned long pos = TEA_DICT_H1(hash) & dict->slot_mask;
+  unsigned long step = 0;
+
+  while (true) {
+    const unsigned int mask = tea_dict_group_match_free(&dict->ctrl[pos]);
+    if (mask) {
+      return (pos + tea_dict_ctz(mask)) & dict->slot_mask;
+    }
+
+    step += TEA_DICT_GROUP_WIDTH;
+    pos = (pos + step) & dict->slot_mask;
+  }
+}
+
+/**
+ * @internal
+ * @brief Rebuilds the index for the given number of slots and drops the
+ *        tombstones from the entry array.
+ */
+static bool tea_dict_rehash(tea_dict_t *dict, const unsigned long slot_count)
+{
+  unsigned char *ctrl = tea_malloc(slot_count + TEA_DICT_GROUP_WIDTH);
+  uint32_t *slots = tea_malloc(slot_count * sizeof(*slots));
+  if (!ctrl || !slots) {
+    tea_log_err("Memory error: Failed to allocate dictionary index");
+    tea_free(ctrl);
+    tea_free(slots);
+    return false;
+  }
+
+  tea_free(dict->ctrl);
+  tea_free(dict->slots);
+
+  memset(ctrl, TEA_DICT_CTRL_EMPTY, slot_count + TEA_DICT_GROUP_WIDTH);
+  dict->ctrl = ctrl;
+  dict->slots = slots;
+  dict->slot_mask = slot_count - 1;
+
+  unsigned long live_count = 0;
+  for (unsigned long i = 0; i < dict->entry_count; ++i) {
+    const tea_dict_entry_t *entry = &dict->entries[i];
+    if (entry->key.type == TEA_KEY_NONE) {
+      continue;
+    }
+
+    dict->entries[live_count] = *entry;
+
+    const unsigned long slot = tea_dict_find_free_slot(dict, entry->key.hash);
+    tea_dict_set_ctrl(dict, slot, TEA_DICT_H2(entry->key.hash));
+    dict->slots[slot] = (uint32_t)live_count;
+    live_count++;
+  }
+
+  dict->entry_count = live_count;
+  dict->growth_left = slot_count - slot_count / 8 - live_count;
+
+  return true;
+}
+
+static unsigned long tea_dict_slots_for(const unsigned long capacity)
+{
+  // Keep the load factor at or below 7/8
+  unsigned long slot_count = TEA_DICT_MIN_SLOTS;
+  while (slot_count - slot_count / 8 < capacity) {
+    slot_count *= 2;
+  }
+  return slot_count;
+}
+
+static bool tea_dict_reserve_entries(tea_dict_t *dict,
+                                     const unsigned long capacity)
+{
+  if (capacity <= dict->entry_capacity) {
+    return true;
+  }
+
+  tea_dict_entry_t *entries = tea_malloc(capacity * sizeof(*entries));
+  if (!entries) {
+    tea_log_err("Memory error: Failed to allocate dictionary entries");
+    return false;
+  }
+
+  if (dict->entries) {
+    memcpy(entries, dict->entries, dict->entry_count * sizeof(*entries));
+    tea_free(dict->entries);
+  }
+
+  dict->entries = entries;
+  dict->entry_capacity = capacity;
+
+  return true;
+}
+
+tea_dict_t *tea_dict_create(const unsigned long capacity)
+{
+  tea_dict_t *dict = tea_malloc(sizeof(*dict));
+  if (!dict) {
+    tea_log_err("Memory error: Failed to allocate dictionary");
+    return NULL;
+  }
+
+  memset(dict, 0, sizeof(*dict));
+  if (capacity > 0 && !tea_dict_reserve(dict, capacity)) {
+    tea_dict_free(dict);
+    return NULL;
+  }
+
+  return dict;
+}
+
+void tea_dict_free(tea_dict_t *dict)
+{
+  if (!dict) {
+    return;
+  }
+
+  for (unsigned long i = 0; i < dict->entry_count; ++i) {
+    if (dict->entries[i].key.type == TEA_KEY_STR &&
+        !dict->entries[i].key.is_interned) {
+      tea_free((void *)dict->entries[i].key.str);
+    }
+  }
+
+  tea_free(dict->entries);
+  tea_free(dict->ctrl);
+  tea_free(dict->slots);
+  tea_free(dict);
+}
+
+bool tea_dict_reserve(tea_dict_t *dict, const unsigned long capacity)
+{
+  if (!tea_dict_reserve_entries(dict, capacity)) {
+    return false;
+  }
+
+  const unsigned long slot_count = tea_dict_slots_for(capacity);
+  if (dict->ctrl && slot_count <= dict->slot_mask + 1) {
+    return true;
+  }
+
+  return tea_dict_rehash(dict, slot_count);
+}
+
+tea_val_t *tea_dict_find(const tea_dict_t *dict, const tea_dict_key_t *key)
+{
+  unsigned long slot;
+  if (!tea_dict_find_slot(dict, key, &slot)) {
+    return NULL;
+  }
+
+  return &dict->entries[dict->slots[slot]].val;
+}
+
+tea_val_t *tea_dict_set(tea_dict_t *dict, const tea_dict_key_t *key,
+                        const tea_val_t val)
+{
+  unsigned long slot;
+  if (tea_dict_find_slot(dict, key, &slot)) {
+    tea_dict_entry_t *entry = &dict->entries[dict->slots[slot]];
+    entry->val = val;
+    return &entry->val;
+  }
+
+  if (!dict->ctrl && !tea_dict_rehash(dict, TEA_DICT_MIN_SLOTS)) {
+    return NULL;
+  }
+
+  if (dict->entry_count == dict->entry_capacity) {
+    if (dict->entry_count - dict->size > dict->size) {
+      // Mostly tombstones, compacting is enough
+      if (!tea_dict_rehash(dict, dict->slot_mask + 1)) {
+        return NULL;
+      }
+    } else {
+      const unsigned long capacity =
+        dict->entry_capacity ? dict->entry_capacity * 2 : 8;
+      if (!tea_dict_reserve_entries(dict, capacity)) {
+        return NULL;
+      }
+    }
+  }
+
+  slot = tea_dict_find_free_slot(dict, key->hash);
+  if (dict->growth_left == 0 && dict->ctrl[slot] == TEA_DICT_CTRL_EMPTY) {
+    // Only grow when the table is really full, otherwise it is enough to
+    // clean up the tombstones
+    const unsigned long slot_count = dict->slot_mask + 1;
+    const unsigned long new_slot_count =
+      dict->size > slot_count * 7 / 16 ? slot_count * 2 : slot_count;
+    if (!tea_dict_rehash(dict, new_slot_count)) {
+      return NULL;
+    }
+    slot = tea_dict_find_free_slot(dict, key->hash);
+  }
+
+  tea_dict_entry_t *entry = &dict->entries[dict->entry_count];
+  entry->key = *key;
+  entry->val = val;
+
+  if (key->type == TEA_KEY_STR && !key->is_interned) {
+    char *str = tea_malloc(key->size + 1);
+    if (!str) {
+      tea_log_err("Memory error: Failed to allocate dictionary key");
+      return NULL;
+    }
+    memcpy(str, key->str, key->size);
+    str[key->size] = 0;
+    entry->key.str = str;
+  }
+
+  if (dict->ctrl[slot] == TEA_DICT_CTRL_EMPTY) {
+    dict->growth_left--;
+  }
+
+  tea_dict_set_ctrl(dict, slot, TEA_DICT_H2(key->hash));
+  dict->slots[slot] = (uint32_t)dict->entry_count;
+  dict->entry_count++;
+  dict->size++;
+
+  return &entry->val;
+}
+
+bool tea_dict_remove(tea_dict_t *dict, const tea_dict_key_t *key)
+{
+  unsigned long slot;
+  if (!tea_dict_find_slot(dict, key, &slot)) {
+    return false;
+  }
+
+  tea_dict_entry_t *entry = &dict->entries[dict->slots[slot]];
+  if (entry->key.type == TEA_KEY_STR && !entry->key.is_interned) {
+    tea_free((void *)entry->key.str);
+  }
+  entry->key.type = TEA_KEY_NONE;
+
+  tea_dict_set_ctrl(dict, slot, TEA_DICT_CTRL_DELETED);
+  dict->size--;
+
+  return true;
+}
+
+tea_dict_entry_t *tea_dict_next(const tea_dict_t *dict, unsigned long *it)
+{
+  while (*it < dict->entry_count) {
+    tea_dict_entry_t *entry = &dict->entries[(*it)++];
+    if (entry->key.type != TEA_KEY_NONE) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+// The strings of all programs and modules of the process, the keys of the
+// table are its own copies and are handed out as the interned strings
+static tea_dict_t *tea_dict_strings = NULL;
+static tea_mutex_t tea_dict_strings_lock;
+
+void tea_dict_intern_init(void)
+{
+  tea_mutex_init(&tea_dict_strings_lock);
+}
+
+void tea_dict_intern_cleanup(void)
+{
+  tea_dict_free(tea_dict_strings);
+  tea_dict_strings = NULL;
+  tea_mutex_destroy(&tea_dict_strings_lock);
+}
+
+const char *tea_dict_intern(const char *str, const int size,
+                            const uint32_t hash)
+{
+  tea_dict_key_t key = tea_dict_key_str(str, size);
+  key.hash = hash;
+
+  const char *interned = NULL;
+
+  // Modules are tokenized on the pool, so the table is shared between threads
+  tea_mutex_lock(&tea_dict_strings_lock);
+  if (!tea_dict_strings) {
+    tea_dict_strings = tea_dict_create(0);
+  }
+
+  unsigned long slot;
+  if (tea_dict_strings && tea_dict_find_slot(tea_dict_strings, &key, &slot)) {
+    interned = tea_dict_strings->entries[tea_dict_strings->slots[slot]].key.str;
+  } else if (tea_dict_strings) {
+    tea_val_t none;
+    none.type = TEA_V_UNDEF;
+    if (tea_dict_set(tea_dict_strings, &key, none)) {
+      const unsigned long last = tea_dict_strings->entry_count - 1;
+      interned = tea_dict_strings->entries[last].key.str;
+    }
+  }
+  tea_mutex_unlock(&tea_dict_strings_lock);
+
+  return interned;
+}
+
+#undef TEA_DICT_H1
+#undef TEA_DICT_H2
@@ -1,5 +1,6 @@
 #include "tea_expr.h"
 
+#include "tea_dict.h"
 #include "tea_fn.h"
 #include "tea_struct.h"
 
@@ -13,8 +14,13 @@
 tea_val_t tea_eval_int(tea_tok_t *token)
 {
   tea_val_t value;
-  value.type = TEA_V_I32;
-  value.i32 = *(int *)&token->buf;
+  if (token->type == TEA_TOKEN_I64_NUMBER) {
+    value.type = TEA_V_I64;
+    value.i64 = tea_tok_int(token);
+  } else {
+    value.type = TEA_V_I32;
+    value.i32 = (int32_t)tea_tok_int(token);
+  }
 
   return value;
 }
@@ -22,17 +28,177 @@ tea_val_t tea_eval_int(tea_tok_t *token)
 tea_val_t tea_eval_float(tea_tok_t *token)
 {
   tea_val_t value;
-  value.type = TEA_V_F32;
-  value.f32 = *(float *)&token->buf;
+  if (token->type == TEA_TOKEN_F64_NUMBER) {
+    value.type = TEA_V_F64;
+    value.f64 = tea_tok_float(token);
+  } else {
+    value.type = TEA_V_F32;
+    value.f32 = (float)tea_tok_float(token);
+  }
 
   return value;
 }
 
+// Returns the number literal without a type suffix, possibly negated, that
+// the node consists of
+static const tea_node_t *tea_untyped_literal(const tea_node_t *node)
+{
+  if (node->type == TEA_N_UNARY && node->tok->type == TEA_TOKEN_MINUS) {
+    tea_list_entry_t *entry = tea_list_first(&node->children);
+    return tea_untyped_literal(tea_list_record(entry, tea_node_t, link));
+  }
+
+  if ((node->type == TEA_N_INT &&
+       node->tok->type == TEA_TOKEN_INTEGER_NUMBER) ||
+      (node->type == TEA_N_FLOAT &&
+       node->tok->type == TEA_TOKEN_FLOAT_NUMBER)) {
+    return node;
+  }
+
+  return NULL;
+}
+
+static tea_val_t tea_eval_literal_as(const tea_node_t *node,
+                                     const tea_val_type_t type)
+{
+  tea_val_t value;
+  value.type = type;
+
+  if (node->type == TEA_N_UNARY) {
+    tea_list_entry_t *entry = tea_list_first(&node->children);
+    value = tea_eval_literal_as(tea_list_record(entry, tea_node_t, link), type);
+    switch (type) {
+    case TEA_V_I64:
+      value.i64 = -value.i64;
+      break;
+    case TEA_V_F64:
+      value.f64 = -value.f64;
+      break;
+    default:
+      break;
+    }
+    return value;
+  }
+
+  if (type == TEA_V_I64) {
+    value.i64 = tea_tok_int(node->tok);
+  } else {
+    value.f64 = node->type == TEA_N_INT ? (double)tea_tok_int(node->tok)
+                                        : tea_tok_float(node->tok);
+  }
+
+  return value;
+}
+
+tea_val_type_t tea_decl_val_type(const tea_node_t *node)
+{
+  tea_list_entry_t *entry = tea_list_first(&node->children);
+  if (!entry) {
+    return TEA_V_UNDEF;
+  }
+
+  const tea_node_t *type_spec = tea_list_record(entry, tea_node_t, link);
+  return type_spec->tok ? tea_val_type_by_str(type_spec->tok->buf)
+                        : TEA_V_UNDEF;
+}
+
+tea_val_t tea_eval_expr_as(tea_ctx_t *ctx, tea_scope_t *scp,
+                           const tea_node_t *node, const tea_val_type_t type)
+{
+  // Literals without a suffix take the declared type directly, so
+  // 'let x: f64 = 0.1;' is not rounded to f32 on the way
+  const tea_node_t *literal = tea_untyped_literal(node);
+  if (literal && (type == TEA_V_F64 ||
+                  (type == TEA_V_I64 && literal->type == TEA_N_INT))) {
+    return tea_eval_literal_as(node, type);
+  }
+
+  tea_val_t value = tea_eval_expr(ctx, scp, node);
+  tea_val_widen(&value, type);
+  return value;
+}
+
+bool tea_eval_cond(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
+                   bool *result)
+{
+  if (node->type == TEA_N_BINOP) {
+    switch (node->tok->type) {
+    case TEA_TOKEN_AND:
+      // The right operand is skipped when the left one decides the result
+      if (!tea_eval_cond(ctx, scp, node->binop.lhs, result)) {
+        return false;
+      }
+      return !*result || tea_eval_cond(ctx, scp, node->binop.rhs, result);
+    case TEA_TOKEN_OR:
+      if (!tea_eval_cond(ctx, scp, node->binop.lhs, result)) {
+        return false;
+      }
+      return *result || tea_eval_cond(ctx, scp, node->binop.rhs, result);
+    case TEA_TOKEN_EQ:
+    case TEA_TOKEN_NE:
+    case TEA_TOKEN_GT:
+    case TEA_TOKEN_GE:
+    case TEA_TOKEN_LT:
+    case TEA_TOKEN_LE: {
+      // Branch on the comparison directly, no i32 value is built for it
+      const tea_val_t lhs_val = tea_eval_expr(ctx, scp, node->binop.lhs);
+      if (lhs_val.type == TEA_V_UNDEF) {
+        return false;
+      }
+      const tea_val_t rhs_val = tea_eval_expr(ctx, scp, node->binop.rhs);
+      if (rhs_val.type == TEA_V_UNDEF) {
+        return false;
+      }
+      return tea_val_cmp(lhs_val, rhs_val, node->tok, result);
+    }
+    default:
+      break;
+    }
+  } else if (node->type == TEA_N_UNARY &&
+             node->tok->type == TEA_TOKEN_EXCLAMATION_MARK) {
+    tea_list_entry_t *entry = tea_list_first(&node->children);
+    if (!tea_eval_cond(ctx, scp, tea_list_record(entry, tea_node_t, link),
+                       result)) {
+      return false;
+    }
+    *result = !*result;
+    return true;
+  }
+
+  const tea_val_t value = tea_eval_expr(ctx, scp, node);
+  if (value.type == TEA_V_UNDEF) {
+    return false;
+  }
+
+  *result = tea_val_truthy(value);
+  return true;
+}
+
 tea_val_t tea_eval_binop(tea_ctx_t *ctx, tea_scope_t *scp,
                          const tea_node_t *node)
 {
+  const tea_tok_t *op = node->tok;
+  if (op->type == TEA_TOKEN_AND || op->type == TEA_TOKEN_OR) {
+    bool is_true;
+    if (!tea_eval_cond(ctx, scp, node, &is_true)) {
+      return tea_val_undef();
+    }
+
+    tea_val_t result;
+    result.type = TEA_V_I32;
+    result.i32 = is_true;
+    return result;
+  }
+
+  // A failed operand has already been reported
   const tea_val_t lhs_val = tea_eval_expr(ctx, scp, node->binop.lhs);
+  if (lhs_val.type == TEA_V_UNDEF) {
+    return lhs_val;
+  }
   const tea_val_t rhs_val = tea_eval_expr(ctx, scp, node->binop.rhs);
+  if (rhs_val.type == TEA_V_UNDEF) {
+    return rhs_val;
+  }
 
   return tea_val_binop(lhs_val, rhs_val, node->tok);
 }
@@ -53,20 +219,24 @@ tea_val_t tea_eval_unary(tea_ctx_t *ctx, tea_scope_t *scp,
     case TEA_V_I32:
       operand_val.i32 = -operand_val.i32;
       break;
+    case TEA_V_I64:
+      operand_val.i64 = -operand_val.i64;
+      break;
     case TEA_V_F32:
       operand_val.f32 = -operand_val.f32;
       break;
+    case TEA_V_F64:
+      operand_val.f64 = -operand_val.f64;
+      break;
     default:
       break;
     }
     break;
   case TEA_TOKEN_EXCLAMATION_MARK:
-    switch (operand_val.type) {
-    case TEA_V_I32:
-      operand_val.i32 = !operand_val.i32;
-      break;
-    default:
-      break;
+    if (operand_val.type != TEA_V_UNDEF) {
+      const bool is_true = tea_val_truthy(operand_val);
+      operand_val.type = TEA_V_I32;
+      operand_val.i32 = !is_true;
     }
     break;
   default:
@@ -118,12 +288,59 @@ tea_val_t tea_eval_str(const tea_node_t *node)
   }
 
   object->type = "string";
+  object->decl = NULL;
+  object->size = token->size;
+  object->flags = 0;
   memcpy(object->buf, token->buf, token->size + 1);
 
   const tea_val_t result = { .type = TEA_V_INST, .obj = object };
   return result;
 }
 
+tea_val_t tea_eval_dict(tea_ctx_t *ctx, tea_scope_t *scp,
+                        const tea_node_t *node)
+{
+  tea_dict_t *dict = tea_dict_create(tea_list_length(&node->children));
+  if (!dict) {
+    return tea_val_undef();
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    const tea_node_t *init_node = tea_list_record(entry, tea_node_t, link);
+    const tea_tok_t *key_token = init_node->tok;
+    if (!key_token) {
+      tea_log_err("Runtime error: Dictionary entry is missing its key");
+      tea_dict_free(dict);
+      return tea_val_undef();
+    }
+
+    // '{ x }' is a shorthand for '{ x: x }' like for type instantiation
+    const tea_node_t *value_node = init_node;
+    tea_list_entry_t *value_entry = tea_list_first(&init_node->children);
+    if (value_entry) {
+      value_node = tea_list_record(value_entry, tea_node_t, link);
+    }
+
+    const tea_val_t value = value_entry ? tea_eval_expr(ctx, scp, value_node)
+                                        : tea_eval_ident(scp, value_node);
+    if (value.type == TEA_V_UNDEF) {
+      tea_dict_free(dict);
+      return tea_val_undef();
+    }
+
+    const tea_dict_key_t key = tea_dict_key_tok(key_token);
+    if (!tea_dict_set(dict, &key, value)) {
+      tea_dict_free(dict);
+      return tea_val_undef();
+    }
+  }
+
+  const tea_val_t result = { .type = TEA_V_DICT, .dict = dict };
+  return result;
+}
+
 tea_val_t tea_eval_expr(tea_ctx_t *ctx, tea_scope_t *scp,
                         const tea_node_t *node)
 {
@@ -149,6 +366,8 @@ tea_val_t tea_eval_expr(tea_ctx_t *ctx, tea_scope_t *scp,
     return tea_eval_fn_call(ctx, scp, node);
   case TEA_N_STRUCT_INST:
     return tea_eval_new(ctx, scp, node);
+  case TEA_N_DICT_INST:
+    return tea_eval_dict(ctx, scp, node);
   case TEA_N_FIELD_ACC:
     return tea_eval_field_access(ctx, scp, node);
   case TEA_N_NULL:
@@ -1,9 +1,14 @@
 #include "tea_fn.h"
 
 #include "tea_expr.h"
+#include "tea_gen.h"
+#include "tea_lines.h"
+#include "tea_module.h"
 #include "tea_stmt.h"
 #include "tea_struct.h"
+#include "tea_thread.h"
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -33,8 +38,11 @@ const tea_native_fn_t *tea_ctx_find_native_fn(const tea_list_entry_t *functions,
     const tea_native_fn_t *function =
       tea_list_record(entry, tea_native_fn_t, link);
     if (!strcmp(function->fn_name, fn_name)) {
-      if (!owner_name && !function->owner_name) {
-        return function;
+      if (!owner_name || !function->owner_name) {
+        if (owner_name == function->owner_name) {
+          return function;
+        }
+        continue;
       }
       if (!strcmp(function->owner_name, owner_name)) {
         return function;
@@ -45,18 +53,24 @@ const tea_native_fn_t *tea_ctx_find_native_fn(const tea_list_entry_t *functions,
   return NULL;
 }
 
-const tea_fn_t *tea_ctx_find_fn(const tea_list_entry_t *functions,
-                                const char *name)
+// The namespace is the first ns_size characters of ns, none if ns is NULL
+static const tea_fn_t *tea_find_fn_in(const tea_list_entry_t *functions,
+                                      const char *ns, const size_t ns_size,
+                                      const char *name)
 {
   tea_list_entry_t *entry;
   tea_list_for_each(entry, functions)
   {
     const tea_fn_t *function = tea_list_record(entry, tea_fn_t, link);
     const tea_tok_t *function_name = function->name;
-    if (!function_name) {
+    if (!function_name || strcmp(function_name->buf, name) != 0) {
       continue;
     }
-    if (!strcmp(function_name->buf, name)) {
+    const bool is_in_ns = ns ? function->ns &&
+                                 !strncmp(function->ns, ns, ns_size) &&
+                                 !function->ns[ns_size]
+                             : !function->ns;
+    if (is_in_ns) {
       return function;
     }
   }
@@ -64,7 +78,98 @@ const tea_fn_t *tea_ctx_find_fn(const tea_list_entry_t *functions,
   return NULL;
 }
 
-bool tea_exec_fn_decl(tea_ctx_t *ctx, const tea_node_t *node)
+const tea_fn_t *tea_ctx_find_fn(const tea_list_entry_t *functions,
+                                const char *name)
+{
+  const char *dot = strchr(name, '.');
+  if (!dot) {
+    return tea_find_fn_in(functions, NULL, 0, name);
+  }
+
+  return tea_find_fn_in(functions, name, (size_t)(dot - name), dot + 1);
+}
+
+const tea_fn_t *tea_find_fn(const tea_list_entry_t *functions, const char *ns,
+                            const char *name)
+{
+  return tea_find_fn_in(functions, ns, ns ? strlen(ns) : 0, name);
+}
+
+static bool tea_apply_fn_attrs(tea_program_t *prog, tea_fn_t *fn,
+                               const tea_node_t *node,
+                               const tea_node_t *fn_owner)
+{
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    if (child->type != TEA_N_ATTR) {
+      continue;
+    }
+
+    const tea_tok_t *attr_name = child->tok;
+    if (strcmp(attr_name->buf, "memo") != 0) {
+      tea_log_err(
+        "Runtime error: Unknown attribute '@%s' on function '%s' at line %d, column %d",
+        attr_name->buf, fn->name->buf, attr_name->line, attr_name->col);
+      return false;
+    }
+
+    // Results can only be reused if the call has no effects besides them
+    if (fn->mut || fn_owner || fn->gen) {
+      tea_log_err(
+        "Runtime error: @memo function '%s' at line %d, column %d can't be %s",
+        fn->name->buf, attr_name->line, attr_name->col,
+        fn->mut ? "mutable" : fn->gen ? "a generator" : "a method");
+      return false;
+    }
+
+    // Each context creates the cache on the first call
+    if (fn->memo_index < 0) {
+      fn->memo_index = (long)prog->memo_count++;
+    }
+  }
+
+  return true;
+}
+
+// Yield statements can be nested in other statements but not in
+// expressions
+static bool tea_has_yield(const tea_node_t *node)
+{
+  if (!node) {
+    return false;
+  }
+
+  switch (node->type) {
+  case TEA_N_YIELD:
+    return true;
+  case TEA_N_STMT:
+  case TEA_N_IF:
+  case TEA_N_THEN:
+  case TEA_N_ELSE:
+  case TEA_N_WHILE:
+  case TEA_N_WHILE_BODY:
+  case TEA_N_FOR:
+  case TEA_N_FOR_BODY:
+    break;
+  default:
+    return false;
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    if (tea_has_yield(child)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool tea_decl_fn(tea_program_t *prog, const tea_node_t *node, const char *ns)
 {
   const tea_tok_t *fn_name = node->tok;
   if (!fn_name) {
@@ -91,6 +196,9 @@ bool tea_exec_fn_decl(tea_ctx_t *ctx, const tea_node_t *node)
       break;
     case TEA_N_OWNER:
       fn_owner = child;
+      break;
+    case TEA_N_ATTR:
+      break;
     case TEA_N_MUT:
       is_mutable = true;
       break;
@@ -108,7 +216,16 @@ bool tea_exec_fn_decl(tea_ctx_t *ctx, const tea_node_t *node)
   fn->name = fn_name;
   fn->body = fn_body;
   fn->mut = is_mutable;
+  fn->gen = tea_has_yield(fn_body);
   fn->params = fn_params;
+  fn->ns = ns;
+  fn->order = prog->decl_order;
+  fn->memo_index = -1;
+  if (!tea_apply_fn_attrs(prog, fn, node, fn_owner)) {
+    tea_free(fn);
+    return false;
+  }
+
   if (fn_ret_type) {
     fn->ret_type = fn_ret_type->tok;
   } else {
@@ -118,7 +235,7 @@ bool tea_exec_fn_decl(tea_ctx_t *ctx, const tea_node_t *node)
   if (fn_owner) {
     const tea_tok_t *owner_name = fn_owner->tok;
     tea_struct_decl_t *struct_declaration =
-      tea_find_struct_decl(ctx, owner_name->buf);
+      tea_find_struct_decl(prog, ns, owner_name->buf);
     if (!struct_declaration) {
       tea_log_err(
         "Runtime error: Cannot implement methods for undeclared type '%s'",
@@ -126,8 +243,12 @@ bool tea_exec_fn_decl(tea_ctx_t *ctx, const tea_node_t *node)
       return false;
     }
     tea_list_add_tail(&struct_declaration->funcs, &fn->link);
+    if (!tea_struct_add_method(prog, struct_declaration, fn_name->buf, fn,
+                               NULL)) {
+      return false;
+    }
   } else {
-    tea_list_add_tail(&ctx->funcs, &fn->link);
+    tea_list_add_tail(&prog->funcs, &fn->link);
   }
 
   if (fn->ret_type) {
@@ -163,10 +284,114 @@ static void tea_cleanup_fn_args(tea_ctx_t *ctx, const tea_fn_args_t *fn_args)
   }
 }
 
-tea_val_t tea_eval_native_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
-                                  const tea_native_fn_t *nat_fn,
-                                  const tea_node_t *args)
+// A string parameter takes strings only. A line of lines() is passed as a
+// copy, since the view points to the next line once the loop moves on
+static bool tea_native_str_arg(const tea_native_fn_t *nat_fn, const int index,
+                               tea_val_t *value)
+{
+  const tea_inst_t *object = value->obj;
+  if (!strcmp(object->type, "string")) {
+    return true;
+  }
+  if (strcmp(object->type, TEA_VIEW_TYPE) != 0) {
+    tea_log_err("Runtime error: Argument %d of native function '%s' must be "
+                "'string', got '%s'",
+                index + 1, nat_fn->fn_name, object->type);
+    return false;
+  }
+
+  tea_inst_t *copy = tea_malloc(sizeof(tea_inst_t) + object->size + 1);
+  if (!copy) {
+    tea_log_err("Memory error: Failed to copy a line for native function '%s'",
+                nat_fn->fn_name);
+    return false;
+  }
+  copy->type = "string";
+  copy->decl = NULL;
+  copy->size = object->size;
+  copy->flags = 0;
+  memcpy(copy->buf, ((const tea_view_t *)object->buf)->data, object->size);
+  copy->buf[object->size] = 0;
+  value->obj = copy;
+  return true;
+}
+
+// Evaluates the arguments into an array on the stack, no variables are
+// allocated for them
+static bool tea_call_native_span(tea_ctx_t *ctx, tea_scope_t *scp,
+                                 const tea_native_fn_t *nat_fn,
+                                 const tea_node_t *args, tea_val_t *result)
+{
+  const tea_native_sig_t *sig = &nat_fn->sig;
+  tea_val_t values[TEA_NATIVE_MAX_ARGS];
+  int argc = 0;
+
+  // A call without arguments has no argument list
+  tea_list_entry_t *arg_entry = args ? tea_list_first(&args->children) : NULL;
+  for (; arg_entry; arg_entry = tea_list_next(arg_entry, &args->children)) {
+    if (argc == TEA_NATIVE_MAX_ARGS || (argc == sig->argc && !sig->variadic)) {
+      tea_log_err("Runtime error: Too many arguments for native function '%s'",
+                  nat_fn->fn_name);
+      return false;
+    }
+
+    const tea_node_t *arg_expr = tea_list_record(arg_entry, tea_node_t, link);
+    const tea_val_type_t type =
+      argc < sig->argc ? sig->params[argc] : TEA_V_UNDEF;
+    tea_val_t *value = &values[argc];
+    if (type == TEA_V_UNDEF) {
+      *value = tea_eval_expr(ctx, scp, arg_expr);
+    } else {
+      *value = tea_eval_expr_as(ctx, scp, arg_expr, type);
+    }
+    if (value->type == TEA_V_UNDEF) {
+      return false;
+    }
+    if (type != TEA_V_UNDEF && value->type != type) {
+      tea_log_err("Runtime error: Argument %d of native function '%s' must be "
+                  "'%s', got '%s'",
+                  argc + 1, nat_fn->fn_name, tea_val_type_str(type),
+                  tea_val_type_str(value->type));
+      return false;
+    }
+    if (argc < sig->argc && (sig->str_params >> argc & 1) &&
+        !tea_native_str_arg(nat_fn, argc, value)) {
+      return false;
+    }
+    argc++;
+  }
+
+  if (argc < sig->argc) {
+    tea_log_err(
+      "Runtime error: Native function '%s' expects %d arguments, got %d",
+      nat_fn->fn_name, sig->argc, argc);
+    return false;
+  }
+
+  *result = nat_fn->span_cb(ctx, values, argc);
+  if (sig->has_ret && result->type == TEA_V_UNDEF) {
+    // The native has logged why it failed
+    return false;
+  }
+  if (sig->ret != TEA_V_UNDEF && !tea_val_widen(result, sig->ret)) {
+    tea_log_err("Runtime error: Native function '%s' returned '%s' instead of "
+                "'%s'",
+                nat_fn->fn_name, tea_val_type_str(result->type),
+                tea_val_type_str(sig->ret));
+    return false;
+  }
+
+  return true;
+}
+
+static bool tea_call_native_fn(tea_ctx_t *ctx, tea_scope_t *scp,
+                               const tea_native_fn_t *nat_fn,
+                               const tea_node_t *args, tea_val_t *result)
 {
+  if (nat_fn->span_cb) {
+    return tea_call_native_span(ctx, scp, nat_fn, args, result);
+  }
+
   tea_fn_args_t fn_args;
   tea_list_init(&fn_args.args);
   tea_list_init(&fn_args.popped_args);
@@ -180,13 +405,13 @@ tea_val_t tea_eval_native_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
       tea_log_err(
         "Memory error: Failed to allocate variable for function argument");
       tea_cleanup_fn_args(ctx, &fn_args);
-      return tea_val_undef();
+      return false;
     }
     arg->val = tea_eval_expr(ctx, scp, arg_expr);
     if (arg->val.type == TEA_V_UNDEF) {
       tea_free_var(ctx, arg);
       tea_cleanup_fn_args(ctx, &fn_args);
-      return tea_val_undef();
+      return false;
     }
 
     // TODO: Check mutability and optionality
@@ -197,14 +422,27 @@ tea_val_t tea_eval_native_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
     tea_list_add_tail(&fn_args.args, &arg->link);
   }
 
-  const tea_val_t result = nat_fn->cb(&fn_args);
+  *result = nat_fn->cb(&fn_args);
   tea_cleanup_fn_args(ctx, &fn_args);
 
+  return true;
+}
+
+tea_val_t tea_eval_native_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
+                                  const tea_native_fn_t *nat_fn,
+                                  const tea_node_t *args)
+{
+  tea_val_t result;
+  if (!tea_call_native_fn(ctx, scp, nat_fn, args, &result)) {
+    return tea_val_undef();
+  }
+
   return result;
 }
 
-tea_val_t tea_eval_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
-                           const tea_node_t *node)
+tea_call_kind_t tea_bind_call(tea_ctx_t *ctx, tea_scope_t *scp,
+                              const tea_node_t *node, tea_scope_t *frame_scp,
+                              const tea_fn_t **fn, tea_val_t *native_result)
 {
   const tea_node_t *args = NULL;
   const tea_node_t *field_access = NULL;
@@ -225,13 +463,6 @@ tea_val_t tea_eval_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
   }
 
   const tea_fn_t *func = NULL;
-  const char *func_name = NULL;
-
-  tea_ret_ctx_t return_context = { 0 };
-  return_context.is_set = false;
-
-  tea_scope_t inner_scope;
-  tea_scope_init(&inner_scope, scp);
 
   if (field_access) {
     const tea_node_t *object_node = field_access->field_acc.obj;
@@ -239,8 +470,7 @@ tea_val_t tea_eval_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
     if (!field_node || !object_node) {
       tea_log_err(
         "Internal error: Missing field or object node in method call - AST structure corrupted");
-      tea_scope_cleanup(ctx, &inner_scope);
-      return tea_val_undef();
+      return TEA_CALL_ERR;
     }
 
     const tea_tok_t *object_token = object_node->tok;
@@ -248,88 +478,101 @@ tea_val_t tea_eval_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
     if (!field_token || !object_token) {
       tea_log_err(
         "Internal error: Missing field or object token in method call - AST structure corrupted");
-      tea_scope_cleanup(ctx, &inner_scope);
-      return tea_val_undef();
+      return TEA_CALL_ERR;
     }
 
     tea_var_t *variable = tea_scope_find(scp, object_token->buf);
     if (!variable) {
-      tea_log_err(
-        "Runtime error: Undefined variable '%s' used in method call at line %d, column %d",
-        object_token->buf, object_token->line, object_token->col);
-      tea_scope_cleanup(ctx, &inner_scope);
-      return tea_val_undef();
-    }
-
-    if (variable->val.type != TEA_V_INST) {
-      tea_log_err(
-        "Runtime error: Methods can only be called on object instances, not on primitive types");
-      tea_scope_cleanup(ctx, &inner_scope);
-      return tea_val_undef();
-    }
+      // Not a variable, so the name of an imported module
+      func = tea_find_fn(&ctx->prog->funcs, object_token->buf,
+                         field_token->buf);
+      if (!func || !tea_ctx_sees(ctx, func)) {
+        tea_log_err(
+          "Runtime error: Undefined variable '%s' or function '%s.%s' called at line %d, column %d",
+          object_token->buf, object_token->buf, field_token->buf,
+          object_token->line, object_token->col);
+        return TEA_CALL_ERR;
+      }
+    } else {
+      if (variable->val.type != TEA_V_INST) {
+        tea_log_err(
+          "Runtime error: Methods can only be called on object instances, not on primitive types");
+        return TEA_CALL_ERR;
+      }
 
-    tea_struct_decl_t *struct_decl =
-      tea_find_struct_decl(ctx, variable->val.obj->type);
-    if (!struct_decl) {
-      tea_log_err(
-        "Runtime error: Cannot find type declaration for type '%s' when calling method",
-        variable->val.obj->type);
-      tea_scope_cleanup(ctx, &inner_scope);
-      return tea_val_undef();
-    }
+      const tea_struct_decl_t *struct_decl = variable->val.obj->decl;
+      if (!struct_decl) {
+        tea_log_err(
+          "Runtime error: Cannot find type declaration for type '%s' when calling method",
+          variable->val.obj->type);
+        return TEA_CALL_ERR;
+      }
 
-    unsigned int flags = 0;
+      const tea_method_t *method =
+        tea_struct_find_method(ctx->prog, struct_decl, node, field_token);
+      if (method && method->native) {
+        // TODO: Pass 'self'
+        return tea_call_native_fn(ctx, scp, method->native, args,
+                                  native_result)
+                 ? TEA_CALL_NATIVE
+                 : TEA_CALL_ERR;
+      }
 
-    const tea_native_fn_t *native_func = tea_ctx_find_native_fn(
-      &ctx->native_funcs, variable->val.obj->type, field_token->buf);
-    if (native_func) {
-      // TODO: Pass 'self'
-      return tea_eval_native_fn_call(ctx, scp, native_func, args);
-    }
+      func = method && method->fn && tea_ctx_sees(ctx, method->fn)
+               ? method->fn
+               : NULL;
 
-    func_name = field_token->buf;
-    func = tea_ctx_find_fn(&struct_decl->funcs, func_name);
+      if (func) {
+        // declare 'self' for the frame, the object is looked up in the scope
+        // of the call which is not always the parent of the frame
+        tea_var_t *self = tea_alloc_var(ctx);
+        if (!self) {
+          tea_log_err(
+            "Memory error: Failed to allocate memory for variable '%s'", "self");
+          return TEA_CALL_ERR;
+        }
 
-    if (func && func->mut) {
-      flags |= TEA_VAR_MUT;
+        self->name = "self";
+        self->flags = func->mut ? TEA_VAR_MUT : 0;
+        self->val = variable->val;
+        tea_list_add_tail(&frame_scp->vars, &self->link);
+      }
     }
-
-    // declare 'self' for the scope
-    tea_decl_var(ctx, &inner_scope, "self", flags, NULL, object_node);
   } else {
     const tea_tok_t *token = node->tok;
     if (token) {
       const tea_native_fn_t *native_func =
-        tea_ctx_find_native_fn(&ctx->native_funcs, NULL, token->buf);
+        tea_ctx_find_native_fn(&ctx->prog->native_funcs, NULL, token->buf);
       if (native_func) {
-        return tea_eval_native_fn_call(ctx, scp, native_func, args);
+        return tea_call_native_fn(ctx, scp, native_func, args, native_result)
+                 ? TEA_CALL_NATIVE
+                 : TEA_CALL_ERR;
       }
 
-      func_name = token->buf;
-      func = tea_ctx_find_fn(&ctx->funcs, token->buf);
+      // Calls without a module name stay in the module of the caller
+      const char *ns = ctx->frame ? ctx->frame->fn->ns : ctx->ns;
+      func = tea_find_fn(&ctx->prog->funcs, ns, token->buf);
+      if (func && !tea_ctx_sees(ctx, func)) {
+        func = NULL;
+      }
     }
   }
 
   if (!func) {
-    if (field_access) {
-      const tea_tok_t *field_token = field_access->field_acc.field->tok;
+    // The name is the field of a method call, else the called name
+    const tea_tok_t *token =
+      field_access ? field_access->field_acc.field->tok : node->tok;
+    if (token) {
       tea_log_err(
-        "Runtime error: Undefined method '%s' called at line %d, column %d",
-        func_name, field_token->line, field_token->col);
+        "Runtime error: Undefined %s '%s' called at line %d, column %d",
+        field_access ? "method" : "function", token->buf, token->line,
+        token->col);
     } else {
-      const tea_tok_t *token = node->tok;
-      if (token) {
-        tea_log_err(
-          "Runtime error: Undefined function '%s' called at line %d, column %d",
-          func_name, token->line, token->col);
-      } else {
-        tea_log_err(
-          "Runtime error: Undefined function '%s' called (no position information available)",
-          func_name);
-      }
+      tea_log_err(
+        "Runtime error: Undefined function called (no position information available)");
     }
 
-    return tea_val_undef();
+    return TEA_CALL_ERR;
   }
 
   const tea_node_t *function_params = func->params;
@@ -364,30 +607,44 @@ tea_val_t tea_eval_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
           "column %d",
           param_name_token->size, param_name_token->buf, param_name_token->line,
           param_name_token->col);
-        exit(1);
+        return TEA_CALL_ERR;
       }
 
       variable->name = param_name_token->buf;
       /* TODO: Currently all function arguments are not mutable by default and I don't check the
-       * types */
+       * types, only the numbers are widened to the declared type */
       variable->flags = 0;
-      variable->val = tea_eval_expr(ctx, scp, param_expr);
+      variable->val = tea_eval_expr_as(ctx, scp, param_expr,
+                                       tea_decl_val_type(param_name));
+      if (variable->val.type == TEA_V_UNDEF) {
+        tea_free_var(ctx, variable);
+        return TEA_CALL_ERR;
+      }
 
       switch (variable->val.type) {
       case TEA_V_I32:
         tea_log_dbg("Declare param %s : %s = %d", param_name_token->buf,
                     tea_val_type_str(variable->val.type), variable->val.i32);
         break;
+      case TEA_V_I64:
+        tea_log_dbg("Declare param %s : %s = %lld", param_name_token->buf,
+                    tea_val_type_str(variable->val.type),
+                    (long long)variable->val.i64);
+        break;
       case TEA_V_F32:
         tea_log_dbg("Declare param %s : %s = %f", param_name_token->buf,
                     tea_val_type_str(variable->val.type), variable->val.f32);
         break;
+      case TEA_V_F64:
+        tea_log_dbg("Declare param %s : %s = %f", param_name_token->buf,
+                    tea_val_type_str(variable->val.type), variable->val.f64);
+        break;
       default:
         break;
       }
 
       // TODO: Check if the param already exists
-      tea_list_add_tail(&inner_scope.vars, &variable->link);
+      tea_list_add_tail(&frame_scp->vars, &variable->link);
 
       param_name_entry =
         tea_list_next(param_name_entry, &function_params->children);
@@ -395,29 +652,725 @@ tea_val_t tea_eval_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
     }
   }
 
-  const bool result =
-    tea_exec(ctx, &inner_scope, func->body, &return_context, NULL);
-  tea_scope_cleanup(ctx, &inner_scope);
+  *fn = func;
+  return TEA_CALL_FN;
+}
+
+// Limits of the purity check of @memo functions
+#define TEA_PURE_MAX_NAMES 64
+#define TEA_PURE_MAX_DEPTH 16
+
+typedef struct {
+  const tea_ctx_t *ctx;
+  unsigned int flags;
+  const tea_fn_t *root;
+  // Functions being checked, a call to one of them is a recursive call
+  const tea_fn_t *fns[TEA_PURE_MAX_DEPTH];
+  int depth;
+} tea_pure_check_t;
+
+// Variables declared by the function so far, in scope order
+typedef struct {
+  const char *names[TEA_PURE_MAX_NAMES];
+  int count;
+} tea_pure_names_t;
 
-  if (result && return_context.is_set) {
-    return return_context.ret_val;
+static bool tea_pure_fail(const tea_pure_check_t *check, const char *reason,
+                          const tea_tok_t *tok)
+{
+  if (check->flags & TEA_PURE_QUIET) {
+    return false;
   }
 
-  if (!result) {
-    exit(-1);
+  if (!tok) {
+    tea_log_err("Runtime error: @memo function '%s' is not pure, it %s",
+                check->root->name->buf, reason);
+    return false;
   }
 
-  return tea_val_undef();
+  tea_log_err(
+    "Runtime error: @memo function '%s' is not pure, it %s '%s' at line %d, column %d",
+    check->root->name->buf, reason, tok->buf, tok->line, tok->col);
+  return false;
 }
 
-void tea_bind_native_fn(tea_ctx_t *ctx, const char *owner_name,
-                        const char *fn_name, const tea_native_fn_cb_t cb)
+static bool tea_pure_is_local(const tea_pure_names_t *names, const char *name)
+{
+  for (int i = names->count - 1; i >= 0; i--) {
+    if (!strcmp(names->names[i], name)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool tea_pure_declare(const tea_pure_check_t *check,
+                             tea_pure_names_t *names, const tea_tok_t *tok)
+{
+  if (names->count == TEA_PURE_MAX_NAMES) {
+    return tea_pure_fail(check, "declares too many variables to be checked, up to",
+                         tok);
+  }
+
+  names->names[names->count++] = tok->buf;
+  return true;
+}
+
+static bool tea_check_pure_fn(tea_pure_check_t *check, const tea_fn_t *fn);
+
+static bool tea_check_pure_call(tea_pure_check_t *check, const tea_node_t *node)
+{
+  const tea_tok_t *token = node->tok;
+  if (!token) {
+    // Methods can change the object they are called on
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      if (child->type == TEA_N_FIELD_ACC) {
+        return tea_pure_fail(check, "calls the method",
+                             child->field_acc.field->tok);
+      }
+    }
+    return false;
+  }
+
+  const tea_native_fn_t *native_func =
+    tea_ctx_find_native_fn(&check->ctx->prog->native_funcs, NULL, token->buf);
+  if (native_func) {
+    return (native_func->pure && !(check->flags & TEA_PURE_NO_NATIVES)) ||
+           tea_pure_fail(check, "calls the native function", token);
+  }
+
+  const tea_fn_t *func = tea_find_fn(&check->ctx->prog->funcs,
+                                     check->fns[check->depth - 1]->ns,
+                                     token->buf);
+  if (!func) {
+    return tea_pure_fail(check, "calls the undeclared function", token);
+  }
+  if (func->mut) {
+    return tea_pure_fail(check, "calls the mutable function", token);
+  }
+  if (func->gen) {
+    return tea_pure_fail(check, "calls the generator function", token);
+  }
+  const tea_memo_t *memo = tea_ctx_find_memo(check->ctx, func);
+  if (memo && memo->state == TEA_MEMO_PURE) {
+    return true;
+  }
+
+  for (int i = 0; i < check->depth; i++) {
+    if (check->fns[i] == func) {
+      return true;
+    }
+  }
+
+  if (check->depth == TEA_PURE_MAX_DEPTH) {
+    return tea_pure_fail(check, "nests calls too deep to be checked at", token);
+  }
+
+  return tea_check_pure_fn(check, func);
+}
+
+static bool tea_check_pure(tea_pure_check_t *check, tea_pure_names_t *names,
+                           const tea_node_t *node)
+{
+  if (!node) {
+    return true;
+  }
+
+  switch (node->type) {
+  case TEA_N_IDENT:
+    // Scoping is dynamic, a variable of the caller can change between calls
+    return tea_pure_is_local(names, node->tok->buf) ||
+           tea_pure_fail(check, "reads the outer variable", node->tok);
+  case TEA_N_FIELD_ACC:
+    return tea_check_pure(check, names, node->field_acc.obj);
+  case TEA_N_BINOP:
+    return tea_check_pure(check, names, node->binop.lhs) &&
+           tea_check_pure(check, names, node->binop.rhs);
+  case TEA_N_ASSIGN: {
+    const tea_node_t *lhs = node->binop.lhs;
+    if (lhs->type == TEA_N_FIELD_ACC) {
+      return tea_pure_fail(check, "assigns a field of",
+                           lhs->field_acc.obj->tok);
+    }
+    if (!tea_pure_is_local(names, lhs->tok->buf)) {
+      return tea_pure_fail(check, "assigns the outer variable", lhs->tok);
+    }
+    return tea_check_pure(check, names, node->binop.rhs);
+  }
+  case TEA_N_TYPE_ANNOT:
+    return true;
+  case TEA_N_FOR_ITER:
+    // Each value taken changes the generator
+    return tea_pure_fail(check, "takes values from a generator", NULL);
+  case TEA_N_STR:
+  case TEA_N_STRUCT_INST:
+  case TEA_N_DICT_INST:
+  case TEA_N_ARRAY_INST:
+    if (check->flags & TEA_PURE_NO_ALLOC) {
+      return tea_pure_fail(check, "allocates", node->tok);
+    }
+    break;
+  case TEA_N_STRUCT_INIT:
+    // '{ x }' reads the variable 'x'
+    if (tea_list_empty(&node->children) &&
+        !tea_pure_is_local(names, node->tok->buf)) {
+      return tea_pure_fail(check, "reads the outer variable", node->tok);
+    }
+    break;
+  case TEA_N_FN_CALL:
+    if (!tea_check_pure_call(check, node)) {
+      return false;
+    }
+    break;
+  case TEA_N_LET: {
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      if (!tea_check_pure(check, names, child)) {
+        return false;
+      }
+    }
+    return tea_pure_declare(check, names, node->tok);
+  }
+  case TEA_N_FOR:
+  case TEA_N_IF:
+  case TEA_N_WHILE:
+  case TEA_N_STMT: {
+    // Variables declared inside are gone after the statement
+    const int count = names->count;
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      if (child->type == TEA_N_FOR_BODY &&
+          !tea_pure_declare(check, names, node->tok)) {
+        return false;
+      }
+      if (!tea_check_pure(check, names, child)) {
+        return false;
+      }
+    }
+    names->count = count;
+    return true;
+  }
+  default:
+    break;
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    if (!tea_check_pure(check, names, child)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool tea_check_pure_fn(tea_pure_check_t *check, const tea_fn_t *fn)
+{
+  tea_pure_names_t names;
+  names.count = 0;
+
+  if (fn->params) {
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &fn->params->children)
+    {
+      const tea_node_t *param = tea_list_record(entry, tea_node_t, link);
+      if (!tea_pure_declare(check, &names, param->tok)) {
+        return false;
+      }
+    }
+  }
+
+  check->fns[check->depth++] = fn;
+  const bool is_pure = tea_check_pure(check, &names, fn->body);
+  check->depth--;
+
+  return is_pure;
+}
+
+bool tea_is_pure_fn(const tea_ctx_t *ctx, const tea_fn_t *fn,
+                    const unsigned int flags)
+{
+  if (fn->mut || fn->gen) {
+    return false;
+  }
+
+  tea_pure_check_t check;
+  check.ctx = ctx;
+  check.flags = flags;
+  check.root = fn;
+  check.depth = 0;
+
+  return tea_check_pure_fn(&check, fn);
+}
+
+tea_memo_t *tea_ctx_find_memo(const tea_ctx_t *ctx, const tea_fn_t *fn)
+{
+  if (fn->memo_index < 0 || (unsigned long)fn->memo_index >= ctx->memo_count) {
+    return NULL;
+  }
+
+  return ctx->memos[fn->memo_index];
+}
+
+// Returns the result cache of the @memo function, the caches of a context
+// are created on the first call so starting a run allocates nothing
+static tea_memo_t *tea_ctx_memo(tea_ctx_t *ctx, const tea_fn_t *fn)
+{
+  tea_memo_t *memo = tea_ctx_find_memo(ctx, fn);
+  if (memo) {
+    return memo;
+  }
+
+  const unsigned long index = (unsigned long)fn->memo_index;
+  if (index >= ctx->memo_count) {
+    // Functions may still be declared while a sandbox context runs
+    const unsigned long memo_count = ctx->prog->memo_count > index
+                                       ? ctx->prog->memo_count
+                                       : index + 1;
+    tea_memo_t **memos = tea_malloc(memo_count * sizeof(*memos));
+    if (!memos) {
+      tea_log_err("Memory error: Failed to allocate the result caches");
+      return NULL;
+    }
+    memset(memos, 0, memo_count * sizeof(*memos));
+    if (ctx->memos) {
+      memcpy(memos, ctx->memos, ctx->memo_count * sizeof(*memos));
+      tea_free(ctx->memos);
+    }
+    ctx->memos = memos;
+    ctx->memo_count = memo_count;
+  }
+
+  memo = tea_memo_create(TEA_MEMO_CAPACITY);
+  if (!memo) {
+    tea_log_err("Memory error: Failed to allocate the result cache of '%s'",
+                fn->name->buf);
+    return NULL;
+  }
+  ctx->memos[index] = memo;
+
+  return memo;
+}
+
+// Collects the arguments of a @memo call as the cache key, returns -1 if
+// they can't be a key
+static int tea_memo_args(const tea_scope_t *frame_scp, tea_val_t *args)
+{
+  int argc = 0;
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &frame_scp->vars)
+  {
+    const tea_var_t *variable = tea_list_record(entry, tea_var_t, link);
+    if (argc == TEA_MEMO_MAX_ARGS || !tea_memo_is_cacheable(&variable->val)) {
+      return -1;
+    }
+    args[argc++] = variable->val;
+  }
+
+  return argc;
+}
+
+bool tea_can_nest(const tea_ctx_t *ctx, const char *name,
+                  const tea_tok_t *token)
+{
+  if (ctx->max_depth > 0 && ctx->depth >= ctx->max_depth) {
+    tea_log_err(
+      "Runtime error: Maximum call depth of %d exceeded when calling '%s' at line %d, column %d",
+      ctx->max_depth, name, token ? token->line : 0, token ? token->col : 0);
+    return false;
+  }
+  if (tea_stack_left() < TEA_STACK_RESERVE) {
+    tea_log_err(
+      "Runtime error: Native stack used up at call depth %d when calling '%s' at line %d, column %d",
+      ctx->depth, name, token ? token->line : 0, token ? token->col : 0);
+    return false;
+  }
+
+  return true;
+}
+
+// Runs the function in the frame whose first scope holds the arguments, the
+// call node is NULL for calls made by native code
+static bool tea_run_frame(tea_ctx_t *ctx, tea_frame_t *frame,
+                          const tea_fn_t *func, const tea_node_t *node,
+                          tea_val_t *result)
+{
+  tea_scope_t *outer_scp = tea_fn_outer_scope(ctx, func, frame->caller_scp);
+  if (func->ns && !outer_scp) {
+    tea_scope_cleanup(ctx, &frame->scps[0]);
+    return false;
+  }
+  frame->scps[0].parent = outer_scp;
+  frame->tail_scp.parent = outer_scp;
+
+  if (func->gen) {
+    // The body runs when the generator is resumed
+    *result = tea_gen_create(func, &frame->scps[0]);
+    tea_scope_cleanup(ctx, &frame->scps[0]);
+    return result->type != TEA_V_UNDEF;
+  }
+
+  tea_memo_t *memo = NULL;
+  tea_val_t memo_args[TEA_MEMO_MAX_ARGS];
+  int memo_argc = -1;
+  if (func->memo_index >= 0) {
+    memo = tea_ctx_memo(ctx, func);
+    if (!memo) {
+      tea_scope_cleanup(ctx, &frame->scps[0]);
+      return false;
+    }
+
+    if (memo->state == TEA_MEMO_UNCHECKED) {
+      memo->state =
+        tea_is_pure_fn(ctx, func, 0) ? TEA_MEMO_PURE : TEA_MEMO_IMPURE;
+    }
+
+    if (memo->state == TEA_MEMO_IMPURE) {
+      tea_log_err("Runtime error: Cannot call the impure @memo function '%s'",
+                  func->name->buf);
+      tea_scope_cleanup(ctx, &frame->scps[0]);
+      return false;
+    }
+
+    memo_argc = tea_memo_args(&frame->scps[0], memo_args);
+    if (memo_argc >= 0) {
+      const tea_val_t *cached = tea_memo_find(memo, memo_args, memo_argc);
+      if (cached) {
+        *result = *cached;
+        tea_scope_cleanup(ctx, &frame->scps[0]);
+        return true;
+      }
+    }
+  }
+
+  if (!tea_can_nest(ctx, func->name->buf,
+                    node && node->tok ? node->tok : func->name)) {
+    tea_scope_cleanup(ctx, &frame->scps[0]);
+    return false;
+  }
+
+  frame->fn = func;
+  frame->call = node;
+  frame->prev = ctx->frame;
+  ctx->frame = frame;
+  ctx->depth++;
+
+  // Tail calls replace the function of the frame and prepare the other
+  // scope of the pair, so they run here instead of nesting on the C stack
+  tea_exec_status_t status;
+  for (;;) {
+    tea_scope_t *frame_scp = &frame->scps[frame->scp_index];
+    if (!tea_ctx_step(ctx)) {
+      tea_scope_cleanup(ctx, frame_scp);
+      status = TEA_EXEC_ERR;
+      break;
+    }
+    status = tea_exec(ctx, frame_scp, frame->fn->body);
+    tea_scope_cleanup(ctx, frame_scp);
+    if (status != TEA_EXEC_TAIL) {
+      break;
+    }
+    frame->scp_index = !frame->scp_index;
+  }
+
+  tea_scope_cleanup(ctx, &frame->tail_scp);
+  ctx->frame = frame->prev;
+  ctx->depth--;
+
+  switch (status) {
+  case TEA_EXEC_OK:
+    return true;
+  case TEA_EXEC_RET:
+    *result = ctx->ret_val;
+    if (memo_argc >= 0 && tea_memo_is_cacheable(result) &&
+        !tea_memo_store(memo, memo_args, memo_argc, *result)) {
+      tea_log_wrn("Failed to cache the result of '%s'", func->name->buf);
+    }
+    return true;
+  case TEA_EXEC_BREAK:
+  case TEA_EXEC_CONT:
+    tea_log_err(
+      "Runtime error: '%s' statement can only be used inside loops (function '%s')",
+      status == TEA_EXEC_BREAK ? "break" : "continue", frame->fn->name->buf);
+    break;
+  default:
+    break;
+  }
+
+  return false;
+}
+
+bool tea_call_fn(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
+                 tea_val_t *result)
+{
+  *result = tea_val_undef();
+
+  tea_frame_t frame;
+  frame.caller_scp = scp;
+  frame.scp_index = 0;
+  frame.gen = NULL;
+  tea_scope_init(&frame.scps[0], scp);
+  tea_scope_init(&frame.tail_scp, scp);
+
+  const tea_fn_t *func = NULL;
+  switch (tea_bind_call(ctx, scp, node, &frame.scps[0], &func, result)) {
+  case TEA_CALL_NATIVE:
+    tea_scope_cleanup(ctx, &frame.scps[0]);
+    return true;
+  case TEA_CALL_FN:
+    break;
+  default:
+    tea_scope_cleanup(ctx, &frame.scps[0]);
+    return false;
+  }
+
+  return tea_run_frame(ctx, &frame, func, node, result);
+}
+
+bool tea_call_bound_fn(tea_ctx_t *ctx, tea_scope_t *scp, const tea_fn_t *fn,
+                       const tea_node_t *node, tea_scope_t *args_scp,
+                       tea_val_t *result)
+{
+  *result = tea_val_undef();
+
+  tea_frame_t frame;
+  frame.caller_scp = scp;
+  frame.scp_index = 0;
+  frame.gen = NULL;
+  tea_scope_init(&frame.scps[0], scp);
+  tea_scope_init(&frame.tail_scp, scp);
+  tea_list_splice_tail(&frame.scps[0].vars, &args_scp->vars);
+
+  return tea_run_frame(ctx, &frame, fn, node, result);
+}
+
+bool tea_call_fn_vals(tea_ctx_t *ctx, tea_scope_t *scp, const tea_fn_t *fn,
+                      const tea_val_t *args, const int argc, tea_val_t *result)
+{
+  *result = tea_val_undef();
+
+  const unsigned long param_count =
+    fn->params ? tea_list_length(&fn->params->children) : 0;
+  if (param_count != (unsigned long)argc) {
+    tea_log_err("Runtime error: Function '%s' expects %lu arguments, got %d",
+                fn->name->buf, param_count, argc);
+    return false;
+  }
+
+  tea_frame_t frame;
+  frame.caller_scp = scp;
+  frame.scp_index = 0;
+  frame.gen = NULL;
+  tea_scope_init(&frame.scps[0], scp);
+  tea_scope_init(&frame.tail_scp, scp);
+
+  int i = 0;
+  tea_list_entry_t *entry;
+  if (fn->params) {
+    tea_list_for_each(entry, &fn->params->children)
+    {
+      const tea_node_t *param = tea_list_record(entry, tea_node_t, link);
+      tea_var_t *variable = tea_alloc_var(ctx);
+      if (!variable) {
+        tea_log_err(
+          "Memory error: Failed to allocate memory for function parameter '%s'",
+          param->tok->buf);
+        tea_scope_cleanup(ctx, &frame.scps[0]);
+        return false;
+      }
+
+      variable->name = param->tok->buf;
+      variable->flags = 0;
+      variable->val = args[i++];
+      tea_val_widen(&variable->val, tea_decl_val_type(param));
+      tea_list_add_tail(&frame.scps[0].vars, &variable->link);
+    }
+  }
+
+  return tea_run_frame(ctx, &frame, fn, NULL, result);
+}
+
+tea_val_t tea_eval_fn_call(tea_ctx_t *ctx, tea_scope_t *scp,
+                           const tea_node_t *node)
+{
+  tea_val_t result;
+  if (!tea_call_fn(ctx, scp, node, &result)) {
+    return tea_val_undef();
+  }
+
+  return result;
+}
+
+static tea_native_fn_t *tea_add_native_fn(tea_program_t *prog,
+                                          const char *owner_name,
+                                          const char *fn_name,
+                                          const tea_native_fn_cb_t cb,
+                                          const tea_native_span_cb_t span_cb,
+                                          const tea_native_sig_t *sig,
+                                          const bool pure)
 {
   tea_native_fn_t *function = tea_malloc(sizeof(*function));
   if (function) {
     function->owner_name = owner_name;
     function->fn_name = fn_name;
     function->cb = cb;
-    tea_list_add_tail(&ctx->native_funcs, &function->link);
+    function->span_cb = span_cb;
+    if (sig) {
+      function->sig = *sig;
+    } else {
+      memset(&function->sig, 0, sizeof(function->sig));
+    }
+    function->pure = pure;
+    tea_list_add_tail(&prog->native_funcs, &function->link);
+
+    // A type declared before the binding gets the method right away
+    if (owner_name) {
+      tea_struct_decl_t *struct_decl =
+        tea_find_struct_decl(prog, NULL, owner_name);
+      if (struct_decl) {
+        tea_struct_add_method(prog, struct_decl, fn_name, NULL, function);
+      }
+    }
   }
+
+  return function;
+}
+
+void tea_bind_native_fn(tea_program_t *prog, const char *owner_name,
+                        const char *fn_name, const tea_native_fn_cb_t cb)
+{
+  tea_add_native_fn(prog, owner_name, fn_name, cb, NULL, NULL, false);
+}
+
+void tea_bind_pure_native_fn(tea_program_t *prog, const char *owner_name,
+                             const char *fn_name, const tea_native_fn_cb_t cb)
+{
+  tea_add_native_fn(prog, owner_name, fn_name, cb, NULL, NULL, true);
+}
+
+static const char *tea_sig_skip_spaces(const char *str)
+{
+  while (*str == ' ') {
+    str++;
+  }
+
+  return str;
+}
+
+// Reads a type name, 'any' and 'void' are read as TEA_V_UNDEF
+static const char *tea_sig_read_type(const char *str, tea_val_type_t *type)
+{
+  char name[16];
+  size_t size = 0;
+  while (isalnum((unsigned char)str[size]) || str[size] == '_') {
+    if (size + 1 == sizeof(name)) {
+      return NULL;
+    }
+    name[size] = str[size];
+    size++;
+  }
+  name[size] = 0;
+
+  if (!strcmp(name, "any") || !strcmp(name, "void")) {
+    *type = TEA_V_UNDEF;
+  } else {
+    *type = tea_val_type_by_str(name);
+    if (*type == TEA_V_UNDEF) {
+      return NULL;
+    }
+  }
+
+  return str + size;
+}
+
+static bool tea_parse_native_sig(const char *str, tea_native_sig_t *sig)
+{
+  sig->argc = 0;
+  sig->variadic = false;
+  sig->str_params = 0;
+
+  str = tea_sig_skip_spaces(str);
+  sig->has_ret = strncmp(str, "void", 4) != 0;
+  str = tea_sig_read_type(str, &sig->ret);
+  if (!str) {
+    return false;
+  }
+  str = tea_sig_skip_spaces(str);
+  if (*str != '(') {
+    return false;
+  }
+
+  str = tea_sig_skip_spaces(str + 1);
+  while (*str != ')') {
+    if (!strncmp(str, "...", 3)) {
+      // Only the last parameter can be variadic
+      sig->variadic = true;
+      str = tea_sig_skip_spaces(str + 3);
+      if (*str != ')') {
+        return false;
+      }
+      break;
+    }
+    if (sig->argc == TEA_NATIVE_MAX_ARGS) {
+      return false;
+    }
+    // Other instances are TEA_V_INST as well
+    if (!strncmp(str, "string", 6) && !isalnum((unsigned char)str[6]) &&
+        str[6] != '_') {
+      sig->str_params |= 1u << sig->argc;
+    }
+    str = tea_sig_read_type(str, &sig->params[sig->argc]);
+    if (!str) {
+      return false;
+    }
+    sig->argc++;
+    str = tea_sig_skip_spaces(str);
+    if (*str == ',') {
+      str = tea_sig_skip_spaces(str + 1);
+    } else if (*str != ')') {
+      return false;
+    }
+  }
+
+  return !*tea_sig_skip_spaces(str + 1);
+}
+
+static bool tea_add_native_sig(tea_program_t *prog, const char *owner_name,
+                               const char *fn_name, const char *sig,
+                               const tea_native_span_cb_t cb, const bool pure)
+{
+  tea_native_sig_t parsed_sig;
+  if (!tea_parse_native_sig(sig, &parsed_sig)) {
+    tea_log_err("Error: Invalid signature '%s' of native function '%s'", sig,
+                fn_name);
+    return false;
+  }
+
+  return tea_add_native_fn(prog, owner_name, fn_name, NULL, cb, &parsed_sig,
+                           pure) != NULL;
+}
+
+bool tea_bind_native_sig(tea_program_t *prog, const char *owner_name,
+                         const char *fn_name, const char *sig,
+                         const tea_native_span_cb_t cb)
+{
+  return tea_add_native_sig(prog, owner_name, fn_name, sig, cb, false);
+}
+
+bool tea_bind_pure_native_sig(tea_program_t *prog, const char *owner_name,
+                              const char *fn_name, const char *sig,
+                              const tea_native_span_cb_t cb)
+{
+  return tea_add_native_sig(prog, owner_name, fn_name, sig, cb, true);
 }
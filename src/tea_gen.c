@@ -0,0 +1,255 @@
+#include "tea_gen.h"
+
+#include "tea_module.h"
+
+#include <string.h>
+
+#include "tea_log.h"
+#include "tea_memory.h"
+
+#define TEA_GEN_MIN_POINTS 4
+
+tea_val_t tea_gen_create(const tea_fn_t *fn, tea_scope_t *scp)
+{
+  tea_inst_t *object = tea_malloc(sizeof(tea_inst_t) + sizeof(tea_gen_t));
+  if (!object) {
+    tea_log_err("Memory error: Failed to allocate the generator of '%s'",
+                fn->name->buf);
+    return tea_val_undef();
+  }
+
+  object->type = TEA_GEN_TYPE;
+  object->decl = NULL;
+  object->size = sizeof(tea_gen_t);
+  object->flags = 0;
+
+  tea_gen_t *gen = (tea_gen_t *)object->buf;
+  gen->fn = fn;
+  gen->native = NULL;
+  gen->close = NULL;
+  gen->data = NULL;
+  tea_list_init(&gen->vars);
+  tea_list_init(&gen->saved_vars);
+  tea_list_splice_tail(&gen->vars, &scp->vars);
+  gen->points = NULL;
+  gen->point_count = 0;
+  gen->point_capacity = 0;
+  gen->value = tea_val_undef();
+  gen->state = TEA_GEN_READY;
+
+  const tea_val_t result = { .type = TEA_V_INST, .obj = object };
+  return result;
+}
+
+tea_val_t tea_gen_create_native(const tea_gen_native_t native,
+                                const tea_gen_close_t close, void *data)
+{
+  tea_inst_t *object = tea_malloc(sizeof(tea_inst_t) + sizeof(tea_gen_t));
+  if (!object) {
+    tea_log_err("Memory error: Failed to allocate a native generator");
+    return tea_val_undef();
+  }
+
+  object->type = TEA_GEN_TYPE;
+  object->decl = NULL;
+  object->size = sizeof(tea_gen_t);
+  object->flags = 0;
+
+  tea_gen_t *gen = (tea_gen_t *)object->buf;
+  gen->fn = NULL;
+  gen->native = native;
+  gen->close = close;
+  gen->data = data;
+  tea_list_init(&gen->vars);
+  tea_list_init(&gen->saved_vars);
+  gen->points = NULL;
+  gen->point_count = 0;
+  gen->point_capacity = 0;
+  gen->value = tea_val_undef();
+  gen->state = TEA_GEN_READY;
+
+  const tea_val_t result = { .type = TEA_V_INST, .obj = object };
+  return result;
+}
+
+tea_gen_t *tea_val_gen(const tea_val_t *value)
+{
+  if (value->type != TEA_V_INST || strcmp(value->obj->type, TEA_GEN_TYPE)) {
+    return NULL;
+  }
+
+  return (tea_gen_t *)value->obj->buf;
+}
+
+// Drops the state of a generator that won't be resumed anymore
+static void tea_gen_finish(tea_ctx_t *ctx, tea_gen_t *gen)
+{
+  tea_list_entry_t *entry;
+  tea_list_entry_t *safe;
+  tea_list_for_each_safe(entry, safe, &gen->saved_vars)
+  {
+    tea_var_t *variable = tea_list_record(entry, tea_var_t, link);
+    tea_list_remove(entry);
+    tea_free_var(ctx, variable);
+  }
+
+  tea_free(gen->points);
+  gen->points = NULL;
+  gen->point_count = 0;
+  gen->point_capacity = 0;
+  gen->state = TEA_GEN_DONE;
+}
+
+void tea_gen_close(tea_ctx_t *ctx, tea_gen_t *gen)
+{
+  if (!gen->native || gen->state == TEA_GEN_DONE) {
+    return;
+  }
+
+  if (gen->close) {
+    gen->close(ctx, gen->data);
+  }
+  gen->state = TEA_GEN_DONE;
+}
+
+bool tea_gen_next(tea_ctx_t *ctx, tea_scope_t *scp, tea_gen_t *gen,
+                  tea_val_t *value)
+{
+  *value = tea_val_undef();
+
+  const tea_fn_t *func = gen->fn;
+  if (gen->state == TEA_GEN_DONE) {
+    return true;
+  }
+  if (gen->native) {
+    // Nothing of the script runs in between, so there are no frames
+    if (!gen->native(ctx, gen->data, value)) {
+      gen->state = TEA_GEN_DONE;
+      return false;
+    }
+    if (value->type == TEA_V_UNDEF) {
+      gen->state = TEA_GEN_DONE;
+    }
+    return true;
+  }
+  if (gen->state == TEA_GEN_RUNNING) {
+    tea_log_err("Runtime error: Generator '%s' resumed while it is running",
+                func->name->buf);
+    return false;
+  }
+
+  if (!tea_can_nest(ctx, func->name->buf, NULL)) {
+    return false;
+  }
+  tea_scope_t *outer_scp = tea_fn_outer_scope(ctx, func, scp);
+  if (func->ns && !outer_scp) {
+    return false;
+  }
+
+  tea_frame_t frame;
+  frame.prev = ctx->frame;
+  frame.fn = func;
+  frame.call = NULL;
+  frame.caller_scp = scp;
+  frame.scp_index = 0;
+  frame.gen = gen;
+  tea_scope_t *frame_scp = &frame.scps[0];
+  tea_scope_init(frame_scp, outer_scp);
+  tea_scope_init(&frame.tail_scp, outer_scp);
+  tea_list_splice_tail(&frame_scp->vars, &gen->vars);
+
+  ctx->frame = &frame;
+  ctx->depth++;
+  // The saved statements take their state back on the way down to the yield
+  ctx->resume = gen->point_count ? gen : NULL;
+  gen->state = TEA_GEN_RUNNING;
+
+  tea_exec_status_t status = TEA_EXEC_ERR;
+  if (tea_ctx_step(ctx)) {
+    status = tea_exec(ctx, frame_scp, func->body);
+  }
+
+  ctx->resume = NULL;
+  ctx->frame = frame.prev;
+  ctx->depth--;
+
+  switch (status) {
+  case TEA_EXEC_YIELD:
+    tea_list_splice_tail(&gen->vars, &frame_scp->vars);
+    gen->state = TEA_GEN_READY;
+    *value = gen->value;
+    return true;
+  case TEA_EXEC_OK:
+  case TEA_EXEC_RET:
+    tea_scope_cleanup(ctx, frame_scp);
+    tea_gen_finish(ctx, gen);
+    return true;
+  case TEA_EXEC_BREAK:
+  case TEA_EXEC_CONT:
+    tea_log_err(
+      "Runtime error: '%s' statement can only be used inside loops (function '%s')",
+      status == TEA_EXEC_BREAK ? "break" : "continue", func->name->buf);
+    break;
+  default:
+    break;
+  }
+
+  tea_scope_cleanup(ctx, frame_scp);
+  tea_gen_finish(ctx, gen);
+  return false;
+}
+
+tea_exec_status_t tea_gen_suspend(tea_ctx_t *ctx, tea_resume_t *point,
+                                  tea_scope_t *scp)
+{
+  tea_gen_t *gen = ctx->frame->gen;
+  if (gen->point_count == gen->point_capacity) {
+    const int capacity = gen->point_capacity ? gen->point_capacity * 2
+                                             : TEA_GEN_MIN_POINTS;
+    tea_resume_t *points = tea_malloc(capacity * sizeof(*points));
+    if (!points) {
+      tea_log_err("Memory error: Failed to suspend the generator '%s'",
+                  gen->fn->name->buf);
+      return TEA_EXEC_ERR;
+    }
+    if (gen->point_count) {
+      memcpy(points, gen->points, gen->point_count * sizeof(*points));
+    }
+    tea_free(gen->points);
+    gen->points = points;
+    gen->point_capacity = capacity;
+  }
+
+  point->var_count = 0;
+  if (scp) {
+    point->var_count = tea_list_length(&scp->vars);
+    tea_list_splice_tail(&gen->saved_vars, &scp->vars);
+  }
+
+  gen->points[gen->point_count++] = *point;
+  return TEA_EXEC_YIELD;
+}
+
+bool tea_gen_resume(tea_ctx_t *ctx, const tea_node_t *node, tea_scope_t *scp,
+                    tea_resume_t *point)
+{
+  tea_gen_t *gen = ctx->resume;
+  if (!gen->point_count || gen->points[gen->point_count - 1].node != node) {
+    tea_log_err("Internal error: Generator '%s' resumed at the wrong statement",
+                gen->fn->name->buf);
+    ctx->resume = NULL;
+    return false;
+  }
+
+  *point = gen->points[--gen->point_count];
+
+  // The statements saved last are resumed first, so their variables are at
+  // the back of the list
+  for (unsigned long i = 0; i < point->var_count; i++) {
+    tea_list_entry_t *entry = gen->saved_vars.prev;
+    tea_list_remove(entry);
+    tea_list_add_head(&scp->vars, entry);
+  }
+
+  return true;
+}
@@ -1,58 +1,66 @@
 #include "tea_interp.h"
 
+#include "tea_actor.h"
 #include "tea_fn.h"
+#include "tea_io.h"
+#include "tea_lines.h"
+#include "tea_memo.h"
+#include "tea_module.h"
 #include "tea_scope.h"
-#include "tea_struct.h"
 
+#include <limits.h>
+
+#include "tea_log.h"
 #include "tea_memory.h"
 
-void tea_interp_init(tea_ctx_t *ctx, const char *fname)
+void tea_interp_init(tea_ctx_t *ctx, const tea_program_t *prog)
 {
-  ctx->file_name = fname;
-  tea_list_init(&ctx->funcs);
-  tea_list_init(&ctx->native_funcs);
-  tea_list_init(&ctx->structs);
-
+  ctx->prog = prog;
   tea_list_init(&ctx->vars);
+  ctx->memos = NULL;
+  ctx->memo_count = 0;
+  ctx->ret_val = tea_val_undef();
+  ctx->frame = NULL;
+  ctx->ns = NULL;
+  tea_list_init(&ctx->modules);
+  ctx->resume = NULL;
+  ctx->io = NULL;
+  ctx->actors = NULL;
+  ctx->lines = NULL;
+  tea_out_init(&ctx->out, stdout, tea_out_default_mode(stdout));
+  ctx->depth = 0;
+  ctx->max_depth = TEA_MAX_CALL_DEPTH;
+  ctx->declared = ULONG_MAX;
+  ctx->is_budgeted = false;
+  ctx->step_budget = 0;
 }
 
-void tea_interp_cleanup(const tea_ctx_t *ctx)
+void tea_interp_cleanup(tea_ctx_t *ctx)
 {
   tea_list_entry_t *entry;
   tea_list_entry_t *safe;
 
-  tea_list_for_each_safe(entry, safe, &ctx->funcs)
-  {
-    tea_fn_t *function = tea_list_record(entry, tea_fn_t, link);
-    tea_list_remove(entry);
-    tea_free(function);
-  }
+  tea_out_cleanup(&ctx->out);
 
-  tea_list_for_each_safe(entry, safe, &ctx->native_funcs)
-  {
-    tea_native_fn_t *function = tea_list_record(entry, tea_native_fn_t, link);
-    tea_list_remove(entry);
-    tea_free(function);
-  }
+  // Actors and requests still in flight use values of the run
+  tea_actors_cleanup(ctx);
+  tea_io_cleanup(ctx);
+  tea_lines_cleanup(ctx);
 
-  tea_list_for_each_safe(entry, safe, &ctx->structs)
+  tea_list_for_each(entry, &ctx->prog->funcs)
   {
-    tea_struct_decl_t *struct_declaration =
-      tea_list_record(entry, tea_struct_decl_t, link);
-    tea_list_remove(entry);
-
-    tea_list_entry_t *function_entry;
-    tea_list_entry_t *function_entry_safe;
-    tea_list_for_each_safe(function_entry, function_entry_safe,
-                           &struct_declaration->funcs)
-    {
-      tea_fn_t *function = tea_list_record(function_entry, tea_fn_t, link);
-      tea_list_remove(function_entry);
-      tea_free(function);
+    const tea_fn_t *function = tea_list_record(entry, tea_fn_t, link);
+    tea_memo_t *memo = tea_ctx_find_memo(ctx, function);
+    if (memo) {
+      tea_log_dbg("Memo '%s': %lu hits, %lu misses, %lu evictions",
+                  function->name->buf, memo->hits, memo->misses,
+                  memo->evictions);
+      tea_memo_free(memo);
     }
-
-    tea_free(struct_declaration);
   }
+  tea_free(ctx->memos);
+
+  tea_module_scopes_cleanup(ctx);
 
   tea_list_for_each_safe(entry, safe, &ctx->vars)
   {
@@ -0,0 +1,813 @@
+#if defined(__linux__) && defined(TEA_HAVE_IO_URING)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#define TEA_IO_URING
+#endif
+
+#include "tea_io.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef TEA_IO_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "tea_fn.h"
+#include "tea_thread.h"
+
+#include "tea_log.h"
+#include "tea_memory.h"
+
+// Set before any program runs, read when a context starts its engine
+static tea_io_backend_t tea_io_backend = TEA_IO_AUTO;
+
+#ifdef TEA_IO_URING
+// Submission and completion queues shared with the kernel
+typedef struct {
+  int fd;
+  unsigned entries;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+  void *sq_map;
+  size_t sq_map_size;
+  void *cq_map;
+  size_t cq_map_size;
+  size_t sqes_size;
+  unsigned long in_flight; // requests submitted and not reaped yet
+  tea_future_t *flight; // the requests in flight, linked by next
+} tea_ring_t;
+#endif
+
+// File I/O of one context. The ring is only touched by the thread running
+// the context, the rest is shared with the pool threads under the lock
+typedef struct tea_io_t {
+  tea_mutex_t lock;
+  tea_cond_t work; // signaled when a request is queued or on stop
+  tea_cond_t done; // signaled when a future is resolved
+  tea_future_t *queue_head;
+  tea_future_t *queue_tail;
+  unsigned long pending; // futures not resolved yet
+  bool stop;
+  tea_thread_t threads[TEA_IO_THREADS];
+  int thread_count;
+#ifdef TEA_IO_URING
+  bool has_ring;
+  tea_ring_t ring;
+#endif
+} tea_io_t;
+
+void tea_io_set_backend(const tea_io_backend_t backend)
+{
+  tea_io_backend = backend;
+}
+
+static void tea_future_settle(tea_future_t *future, const int error)
+{
+  tea_io_t *io = future->io;
+  tea_mutex_lock(&io->lock);
+  future->error = error;
+  future->state = error ? TEA_FUTURE_FAILED : TEA_FUTURE_DONE;
+  io->pending--;
+  tea_cond_broadcast(&io->done);
+  tea_mutex_unlock(&io->lock);
+}
+
+// Sets the result of a finished request, the text read is a string of the
+// bytes transferred
+static void tea_io_finish(tea_future_t *future, const int error)
+{
+  if (!error) {
+    if (future->op == TEA_IO_READ) {
+      future->data->size = future->done;
+      future->data->buf[future->done] = 0;
+      future->result.type = TEA_V_INST;
+      future->result.obj = future->data;
+    } else {
+      future->result.type = TEA_V_I64;
+      future->result.i64 = (int64_t)future->done;
+    }
+  }
+
+  tea_future_settle(future, error);
+}
+
+static tea_inst_t *tea_io_alloc_str(const unsigned long size)
+{
+  tea_inst_t *object = tea_malloc(sizeof(tea_inst_t) + size + 1);
+  if (!object) {
+    return NULL;
+  }
+
+  object->type = "string";
+  object->decl = NULL;
+  object->size = size;
+  object->flags = 0;
+  object->buf[0] = 0;
+  return object;
+}
+
+// Runs the request at once on the calling thread
+static int tea_io_run(tea_future_t *future)
+{
+  FILE *file = fopen(future->path, future->op == TEA_IO_READ ? "rb" : "wb");
+  if (!file) {
+    return errno ? errno : EIO;
+  }
+
+  int error = 0;
+  if (future->op == TEA_IO_WRITE) {
+    future->done = fwrite(future->data->buf, 1, future->size, file);
+    if (future->done < future->size) {
+      error = errno ? errno : EIO;
+    }
+    if (fclose(file) != 0 && !error) {
+      error = errno ? errno : EIO;
+    }
+    return error;
+  }
+
+  long size = -1;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    size = ftell(file);
+  }
+  if (size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+    fclose(file);
+    return errno ? errno : EIO;
+  }
+
+  future->size = (unsigned long)size;
+  future->data = tea_io_alloc_str(future->size);
+  if (!future->data) {
+    fclose(file);
+    return ENOMEM;
+  }
+
+  future->done = fread(future->data->buf, 1, future->size, file);
+  if (ferror(file)) {
+    error = errno ? errno : EIO;
+  }
+  fclose(file);
+  return error;
+}
+
+static void tea_io_worker(void *arg)
+{
+  tea_io_t *io = arg;
+  for (;;) {
+    tea_mutex_lock(&io->lock);
+    while (!io->queue_head && !io->stop) {
+      tea_cond_wait(&io->work, &io->lock);
+    }
+    tea_future_t *future = io->queue_head;
+    if (!future) {
+      // Stopped with nothing left to do
+      tea_mutex_unlock(&io->lock);
+      return;
+    }
+    io->queue_head = future->next;
+    if (!io->queue_head) {
+      io->queue_tail = NULL;
+    }
+    tea_mutex_unlock(&io->lock);
+
+    tea_io_finish(future, tea_io_run(future));
+  }
+}
+
+// Queues the request for the pool, the threads start with the first one
+static bool tea_io_queue(tea_io_t *io, tea_future_t *future)
+{
+  tea_mutex_lock(&io->lock);
+  if (io->thread_count == 0) {
+    for (int i = 0; i < TEA_IO_THREADS; i++) {
+      if (!tea_thread_start(&io->threads[i], tea_io_worker, io)) {
+        break;
+      }
+      io->thread_count++;
+    }
+    if (io->thread_count == 0) {
+      tea_mutex_unlock(&io->lock);
+      tea_log_err("Runtime error: Failed to start the threads of file I/O");
+      tea_future_settle(future, EAGAIN);
+      return false;
+    }
+  }
+
+  future->next = NULL;
+  if (io->queue_tail) {
+    io->queue_tail->next = future;
+  } else {
+    io->queue_head = future;
+  }
+  io->queue_tail = future;
+  tea_cond_broadcast(&io->work);
+  tea_mutex_unlock(&io->lock);
+  return true;
+}
+
+#ifdef TEA_IO_URING
+static bool tea_ring_init(tea_ring_t *ring)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring->fd = (int)syscall(__NR_io_uring_setup, TEA_IO_QUEUE_DEPTH, &params);
+  if (ring->fd < 0) {
+    return false;
+  }
+
+  // Kernels before 5.6 have the ring but not the plain read and write
+  const unsigned probe_ops = 256;
+  const size_t probe_size = sizeof(struct io_uring_probe) +
+                            probe_ops * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe *probe = tea_malloc(probe_size);
+  bool has_ops = false;
+  if (probe) {
+    memset(probe, 0, probe_size);
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe,
+                probe_ops) == 0) {
+      has_ops = probe->ops_len > IORING_OP_WRITE &&
+                (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+                (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    }
+    tea_free(probe);
+  }
+  if (!has_ops) {
+    close(ring->fd);
+    return false;
+  }
+
+  ring->entries = params.sq_entries;
+  ring->sq_map_size =
+    params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_map_size =
+    params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_map && ring->cq_map_size > ring->sq_map_size) {
+    ring->sq_map_size = ring->cq_map_size;
+  }
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+  ring->cq_map = single_map ? ring->sq_map
+                            : mmap(NULL, ring->cq_map_size,
+                                   PROT_READ | PROT_WRITE, MAP_SHARED,
+                                   ring->fd, IORING_OFF_CQ_RING);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    ring->fd, IORING_OFF_SQES);
+  if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED ||
+      ring->sqes == MAP_FAILED) {
+    if (ring->sqes != MAP_FAILED) {
+      munmap(ring->sqes, ring->sqes_size);
+    }
+    if (!single_map && ring->cq_map != MAP_FAILED) {
+      munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map != MAP_FAILED) {
+      munmap(ring->sq_map, ring->sq_map_size);
+    }
+    close(ring->fd);
+    return false;
+  }
+
+  char *sq = ring->sq_map;
+  ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  char *cq = ring->cq_map;
+  ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  ring->in_flight = 0;
+  ring->flight = NULL;
+  return true;
+}
+
+static void tea_ring_cleanup(tea_ring_t *ring)
+{
+  munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_map != ring->sq_map) {
+    munmap(ring->cq_map, ring->cq_map_size);
+  }
+  munmap(ring->sq_map, ring->sq_map_size);
+  close(ring->fd);
+}
+
+static int tea_ring_enter(const tea_ring_t *ring, const unsigned submit,
+                          const unsigned wait)
+{
+  for (;;) {
+    const long ret =
+      syscall(__NR_io_uring_enter, ring->fd, submit, wait,
+              wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (ret >= 0) {
+      return 0;
+    }
+    if (errno != EINTR) {
+      return errno;
+    }
+  }
+}
+
+// Submits the rest of the transfer, from the bytes done so far
+static int tea_ring_push(tea_ring_t *ring, tea_future_t *future)
+{
+  const unsigned tail = *ring->sq_tail;
+  const unsigned index = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+
+  unsigned long len = future->size - future->done;
+  if (len > 1UL << 30) {
+    len = 1UL << 30;
+  }
+
+  sqe->opcode = future->op == TEA_IO_READ ? IORING_OP_READ : IORING_OP_WRITE;
+  sqe->fd = future->fd;
+  sqe->addr = (uint64_t)(uintptr_t)(future->data->buf + future->done);
+  sqe->len = (uint32_t)len;
+  sqe->off = future->done;
+  sqe->user_data = (uint64_t)(uintptr_t)future;
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  return tea_ring_enter(ring, 1, 0);
+}
+
+static void tea_ring_finish(tea_ring_t *ring, tea_future_t *future,
+                            const int error)
+{
+  tea_future_t **link = &ring->flight;
+  while (*link != future) {
+    link = &(*link)->next;
+  }
+  *link = future->next;
+  future->next = NULL;
+
+  close(future->fd);
+  ring->in_flight--;
+  tea_io_finish(future, error);
+}
+
+// Fails the requests still in flight once the queue can't be reaped
+// anymore. The buffers are not freed with the futures, so the kernel can
+// still finish writing to them until the ring is closed
+static void tea_ring_abandon(tea_ring_t *ring, const int error)
+{
+  while (ring->flight) {
+    tea_ring_finish(ring, ring->flight, error);
+  }
+}
+
+static void tea_ring_complete(tea_ring_t *ring, tea_future_t *future,
+                              const int res)
+{
+  if (res == -EINTR || res == -EAGAIN) {
+    const int error = tea_ring_push(ring, future);
+    if (error) {
+      tea_ring_finish(ring, future, error);
+    }
+    return;
+  }
+
+  if (res < 0) {
+    tea_ring_finish(ring, future, -res);
+    return;
+  }
+
+  // Transfers can be short, a read of 0 bytes means the file got shorter
+  future->done += (unsigned long)res;
+  if (res > 0 && future->done < future->size) {
+    const int error = tea_ring_push(ring, future);
+    if (error) {
+      tea_ring_finish(ring, future, error);
+    }
+    return;
+  }
+
+  tea_ring_finish(ring, future, 0);
+}
+
+// Handles the completions on the queue, waits for one first if asked to
+static bool tea_ring_reap(tea_ring_t *ring, const bool wait)
+{
+  unsigned head = *ring->cq_head;
+  if (wait && head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    const int error = tea_ring_enter(ring, 0, 1);
+    if (error) {
+      tea_log_err("Runtime error: Failed to wait for file I/O: %s",
+                  strerror(error));
+      return false;
+    }
+  }
+
+  while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    tea_future_t *future = (tea_future_t *)(uintptr_t)cqe->user_data;
+    const int res = cqe->res;
+    head++;
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    tea_ring_complete(ring, future, res);
+  }
+
+  return true;
+}
+
+// Opens the file and submits the request, errors of the open fail the
+// future rather than the call
+static bool tea_ring_submit(tea_ring_t *ring, tea_future_t *future)
+{
+  const int flags = future->op == TEA_IO_READ
+                      ? O_RDONLY | O_CLOEXEC
+                      : O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  future->fd = open(future->path, flags, 0644);
+  if (future->fd < 0) {
+    tea_io_finish(future, errno);
+    return true;
+  }
+
+  if (future->op == TEA_IO_READ) {
+    struct stat st;
+    if (fstat(future->fd, &st) != 0) {
+      const int error = errno;
+      close(future->fd);
+      tea_io_finish(future, error);
+      return true;
+    }
+    future->size = (unsigned long)st.st_size;
+    future->data = tea_io_alloc_str(future->size);
+    if (!future->data) {
+      close(future->fd);
+      tea_io_finish(future, ENOMEM);
+      return true;
+    }
+  }
+
+  if (future->size == 0) {
+    close(future->fd);
+    tea_io_finish(future, 0);
+    return true;
+  }
+
+  // Each request takes a slot of the queue until it is reaped
+  while (ring->in_flight >= ring->entries) {
+    if (!tea_ring_reap(ring, true)) {
+      close(future->fd);
+      tea_io_finish(future, EIO);
+      return false;
+    }
+  }
+
+  ring->in_flight++;
+  future->next = ring->flight;
+  ring->flight = future;
+  const int error = tea_ring_push(ring, future);
+  if (error) {
+    tea_ring_finish(ring, future, error);
+  }
+  return true;
+}
+#endif
+
+static tea_io_t *tea_io_create(void)
+{
+  tea_io_t *io = tea_malloc(sizeof(tea_io_t));
+  if (!io) {
+    return NULL;
+  }
+
+  if (!tea_mutex_init(&io->lock)) {
+    tea_free(io);
+    return NULL;
+  }
+  if (!tea_cond_init(&io->work)) {
+    tea_mutex_destroy(&io->lock);
+    tea_free(io);
+    return NULL;
+  }
+  if (!tea_cond_init(&io->done)) {
+    tea_cond_destroy(&io->work);
+    tea_mutex_destroy(&io->lock);
+    tea_free(io);
+    return NULL;
+  }
+
+  io->queue_head = NULL;
+  io->queue_tail = NULL;
+  io->pending = 0;
+  io->stop = false;
+  io->thread_count = 0;
+#ifdef TEA_IO_URING
+  io->has_ring = tea_io_backend == TEA_IO_AUTO && tea_ring_init(&io->ring);
+  tea_log_dbg("File I/O on %s", io->has_ring ? "io_uring" : "a thread pool");
+#endif
+  return io;
+}
+
+// Allocates a pending future of the context, the engine starts with the
+// first one
+static tea_future_t *tea_future_alloc(tea_ctx_t *ctx, const char *path,
+                                      tea_val_t *value)
+{
+  *value = tea_val_undef();
+  if (!ctx->io) {
+    ctx->io = tea_io_create();
+    if (!ctx->io) {
+      tea_log_err("Memory error: Failed to start the file I/O engine");
+      return NULL;
+    }
+  }
+
+  const size_t path_size = path ? strlen(path) + 1 : 1;
+  tea_inst_t *object =
+    tea_malloc(sizeof(tea_inst_t) + sizeof(tea_future_t) + path_size);
+  if (!object) {
+    tea_log_err("Memory error: Failed to allocate a future");
+    return NULL;
+  }
+
+  object->type = TEA_FUTURE_TYPE;
+  object->decl = NULL;
+  object->size = sizeof(tea_future_t) + path_size;
+  object->flags = 0;
+
+  tea_future_t *future = (tea_future_t *)object->buf;
+  future->io = ctx->io;
+  future->next = NULL;
+  future->op = TEA_IO_NONE;
+  future->state = TEA_FUTURE_PENDING;
+  future->on_ring = 0;
+  future->error = 0;
+  future->fd = -1;
+  future->data = NULL;
+  future->size = 0;
+  future->done = 0;
+  future->result = tea_val_null();
+  memcpy(future->path, path ? path : "", path_size);
+
+  tea_mutex_lock(&ctx->io->lock);
+  ctx->io->pending++;
+  tea_mutex_unlock(&ctx->io->lock);
+
+  value->type = TEA_V_INST;
+  value->obj = object;
+  return future;
+}
+
+tea_val_t tea_future_create(tea_ctx_t *ctx, tea_future_t **future)
+{
+  tea_val_t value;
+  *future = tea_future_alloc(ctx, NULL, &value);
+  return value;
+}
+
+void tea_future_resolve(tea_future_t *future, const tea_val_t value)
+{
+  future->result = value;
+  tea_future_settle(future, value.type == TEA_V_NULL ? EIO : 0);
+}
+
+tea_future_t *tea_val_future(const tea_val_t *value)
+{
+  if (value->type != TEA_V_INST ||
+      strcmp(value->obj->type, TEA_FUTURE_TYPE) != 0) {
+    return NULL;
+  }
+
+  return (tea_future_t *)value->obj->buf;
+}
+
+// Starts the request on the ring of the context or queues it for the pool
+static bool tea_io_start(tea_future_t *future)
+{
+#ifdef TEA_IO_URING
+  if (future->io->has_ring) {
+    future->on_ring = 1;
+    return tea_ring_submit(&future->io->ring, future);
+  }
+#endif
+  return tea_io_queue(future->io, future);
+}
+
+static tea_future_state_t tea_future_state(tea_future_t *future)
+{
+  tea_io_t *io = future->io;
+  tea_mutex_lock(&io->lock);
+  const tea_future_state_t state = future->state;
+  tea_mutex_unlock(&io->lock);
+  return state;
+}
+
+bool tea_future_ready(tea_ctx_t *ctx, tea_future_t *future)
+{
+  (void)ctx;
+#ifdef TEA_IO_URING
+  if (future->on_ring && future->state == TEA_FUTURE_PENDING) {
+    tea_ring_reap(&future->io->ring, false);
+  }
+#endif
+  return tea_future_state(future) != TEA_FUTURE_PENDING;
+}
+
+bool tea_future_await(tea_ctx_t *ctx, tea_future_t *future, tea_val_t *result)
+{
+  *result = tea_val_undef();
+  tea_io_t *io = future->io;
+  if (io != ctx->io) {
+    tea_log_err(
+      "Runtime error: A future can only be awaited by the run that created it");
+    return false;
+  }
+
+#ifdef TEA_IO_URING
+  // Requests on the ring complete only when this thread reaps them
+  while (future->on_ring && future->state == TEA_FUTURE_PENDING) {
+    if (!tea_ring_reap(&io->ring, true)) {
+      return false;
+    }
+  }
+#endif
+
+  tea_mutex_lock(&io->lock);
+  while (future->state == TEA_FUTURE_PENDING) {
+    tea_cond_wait(&io->done, &io->lock);
+  }
+  tea_mutex_unlock(&io->lock);
+
+  if (future->state == TEA_FUTURE_FAILED) {
+    if (future->op != TEA_IO_NONE) {
+      tea_log_wrn("Failed to %s '%s': %s",
+                  future->op == TEA_IO_READ ? "read" : "write", future->path,
+                  strerror(future->error));
+    }
+    *result = tea_val_null();
+    return true;
+  }
+
+  *result = future->result;
+  return true;
+}
+
+void tea_io_cleanup(const tea_ctx_t *ctx)
+{
+  tea_io_t *io = ctx->io;
+  if (!io) {
+    return;
+  }
+
+#ifdef TEA_IO_URING
+  // The kernel may still write to the buffers of requests not awaited. If
+  // the queue fails, the rest are failed too, so the wait below ends
+  if (io->has_ring) {
+    while (io->ring.in_flight) {
+      if (!tea_ring_reap(&io->ring, true)) {
+        tea_ring_abandon(&io->ring, EIO);
+      }
+    }
+  }
+#endif
+
+  tea_mutex_lock(&io->lock);
+  while (io->pending) {
+    tea_cond_wait(&io->done, &io->lock);
+  }
+  io->stop = true;
+  tea_cond_broadcast(&io->work);
+  tea_mutex_unlock(&io->lock);
+
+  for (int i = 0; i < io->thread_count; i++) {
+    tea_thread_join(&io->threads[i]);
+  }
+
+#ifdef TEA_IO_URING
+  if (io->has_ring) {
+    tea_ring_cleanup(&io->ring);
+  }
+#endif
+  tea_cond_destroy(&io->done);
+  tea_cond_destroy(&io->work);
+  tea_mutex_destroy(&io->lock);
+  tea_free(io);
+}
+
+static bool tea_io_path(const char *native_name, const tea_val_t *path)
+{
+  if (path->type != TEA_V_INST || strcmp(path->obj->type, "string") != 0) {
+    tea_log_err("Runtime error: '%s' expects a path as a string", native_name);
+    return false;
+  }
+
+  return true;
+}
+
+static tea_val_t tea_read_file_async(tea_ctx_t *ctx, const tea_val_t *args,
+                                     const int argc)
+{
+  (void)argc;
+  if (!tea_io_path("read_file_async", &args[0])) {
+    return tea_val_undef();
+  }
+
+  tea_val_t result;
+  tea_future_t *future = tea_future_alloc(ctx, args[0].obj->buf, &result);
+  if (!future) {
+    return tea_val_undef();
+  }
+
+  future->op = TEA_IO_READ;
+  return tea_io_start(future) ? result : tea_val_undef();
+}
+
+static tea_val_t tea_write_file_async(tea_ctx_t *ctx, const tea_val_t *args,
+                                      const int argc)
+{
+  (void)argc;
+  if (!tea_io_path("write_file_async", &args[0])) {
+    return tea_val_undef();
+  }
+
+  // Strings are never freed, so the text stays valid while it is written. A
+  // line of lines() comes as a copy of its own
+  const tea_val_t *text = &args[1];
+  if (text->type != TEA_V_INST || strcmp(text->obj->type, "string") != 0) {
+    tea_log_err("Runtime error: 'write_file_async' expects the text as a "
+                "string");
+    return tea_val_undef();
+  }
+  tea_inst_t *data = text->obj;
+
+  tea_val_t result;
+  tea_future_t *future = tea_future_alloc(ctx, args[0].obj->buf, &result);
+  if (!future) {
+    return tea_val_undef();
+  }
+
+  future->op = TEA_IO_WRITE;
+  future->data = data;
+  future->size = strlen(data->buf);
+  return tea_io_start(future) ? result : tea_val_undef();
+}
+
+static tea_future_t *tea_io_arg_future(const char *native_name,
+                                       const tea_val_t *value)
+{
+  tea_future_t *future = tea_val_future(value);
+  if (!future) {
+    tea_log_err("Runtime error: '%s' expects a future, got %s", native_name,
+                tea_val_type_str(value->type));
+  }
+  return future;
+}
+
+static tea_val_t tea_await(tea_ctx_t *ctx, const tea_val_t *args,
+                           const int argc)
+{
+  (void)argc;
+  tea_future_t *future = tea_io_arg_future("await", &args[0]);
+  tea_val_t result = tea_val_undef();
+  if (future && !tea_future_await(ctx, future, &result)) {
+    return tea_val_undef();
+  }
+  return result;
+}
+
+static tea_val_t tea_ready(tea_ctx_t *ctx, const tea_val_t *args,
+                           const int argc)
+{
+  (void)argc;
+  tea_future_t *future = tea_io_arg_future("ready", &args[0]);
+  if (!future) {
+    return tea_val_undef();
+  }
+
+  const tea_val_t result = { .type = TEA_V_I32,
+                             .i32 = tea_future_ready(ctx, future) };
+  return result;
+}
+
+void tea_bind_io(tea_program_t *prog)
+{
+  tea_bind_native_sig(prog, NULL, "read_file_async", "any (string)",
+                      tea_read_file_async);
+  tea_bind_native_sig(prog, NULL, "write_file_async", "any (string, string)",
+                      tea_write_file_async);
+  tea_bind_native_sig(prog, NULL, "await", "any (any)", tea_await);
+  tea_bind_native_sig(prog, NULL, "ready", "i32 (any)", tea_ready);
+}
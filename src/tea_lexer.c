@@ -1,9 +1,11 @@
 #include "tea_lexer.h"
 
+#include "tea_dict.h"
 #include "tea_grammar.h"
 #include "tea_token.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -37,15 +39,18 @@ void tea_lexer_cleanup(const tea_lexer_t *self)
   }
 }
 
-static void create_token(tea_lexer_t *self, const int token_type,
-                         const char *buffer, const int buffer_size)
+static tea_tok_t *create_token(tea_lexer_t *self, const int token_type,
+                               const char *buffer, const int buffer_size)
 {
-  int token_size = sizeof(tea_tok_t);
-  if (buffer_size > 0) {
-    token_size += buffer_size + 1;
-  }
+  // The buffer is always terminated, even an empty string is read as one
+  const int token_size = sizeof(tea_tok_t) + buffer_size + 1;
 
   tea_tok_t *token = tea_malloc(token_size);
+  if (!token) {
+    tea_log_err("Critical error: Failed to allocate memory for token");
+    return NULL;
+  }
+
   token->type = token_type;
   token->line = self->line;
   token->col = self->col;
@@ -56,8 +61,15 @@ static void create_token(tea_lexer_t *self, const int token_type,
     memcpy(token->buf, buffer, buffer_size);
   }
 
-  if (buffer_size > 0) {
-    token->buf[buffer_size] = EOS;
+  token->buf[buffer_size] = EOS;
+
+  // Identifiers and strings are used as dictionary keys, so the hash is
+  // computed and the text interned once here instead of on every lookup
+  token->hash = 0;
+  token->str = NULL;
+  if (token_type == TEA_TOKEN_IDENT || token_type == TEA_TOKEN_STRING) {
+    token->hash = tea_dict_hash_str(token->buf, buffer_size);
+    token->str = tea_dict_intern(token->buf, buffer_size, token->hash);
   }
 
   if (token_type == TEA_TOKEN_STRING) {
@@ -65,18 +77,35 @@ static void create_token(tea_lexer_t *self, const int token_type,
   } else if (token_type == TEA_TOKEN_IDENT) {
     tea_log_dbg("Token: %.*s (line: %d, col: %d)", buffer_size, buffer,
                 token->line, token->col);
-  } else if (token_type == TEA_TOKEN_INTEGER_NUMBER) {
-    tea_log_dbg("Token: %d (line: %d, col: %d)", *(int *)buffer, token->line,
-                token->col);
-  } else if (token_type == TEA_TOKEN_FLOAT_NUMBER) {
-    tea_log_dbg("Token: %f (line: %d, col: %d)", *(float *)buffer, token->line,
-                token->col);
+  } else if (token_type == TEA_TOKEN_INTEGER_NUMBER ||
+             token_type == TEA_TOKEN_I64_NUMBER) {
+    tea_log_dbg("Token: %lld (line: %d, col: %d)",
+                (long long)tea_tok_int(token), token->line, token->col);
+  } else if (token_type == TEA_TOKEN_FLOAT_NUMBER ||
+             token_type == TEA_TOKEN_F64_NUMBER) {
+    tea_log_dbg("Token: %f (line: %d, col: %d)", tea_tok_float(token),
+                token->line, token->col);
   } else {
     tea_log_dbg("Token: <%s> (line: %d, col: %d)", tea_tok_name(token_type),
                 token->line, token->col);
   }
 
   tea_list_add_tail(&self->toks, &token->link);
+  return token;
+}
+
+tea_tok_t *tea_lexer_add_tok(tea_lexer_t *lex, const int type,
+                             const char *buf, const int size,
+                             const tea_tok_t *origin)
+{
+  tea_tok_t *token = create_token(lex, type, buf, size);
+  if (token && origin) {
+    token->line = origin->line;
+    token->col = origin->col;
+    token->pos = origin->pos;
+  }
+
+  return token;
 }
 
 static void skip_whitespaces(tea_lexer_t *self, const char *input)
@@ -189,15 +218,35 @@ static bool scan_operator(tea_lexer_t *self, const char *input)
       token_length = 2;
       break;
     }
+    if (input[self->pos + 1] == '=') {
+      token_type = TEA_TOKEN_MINUS_ASSIGN;
+      token_length = 2;
+      break;
+    }
     token_type = TEA_TOKEN_MINUS;
     break;
   case '+':
+    if (input[self->pos + 1] == '=') {
+      token_type = TEA_TOKEN_PLUS_ASSIGN;
+      token_length = 2;
+      break;
+    }
     token_type = TEA_TOKEN_PLUS;
     break;
   case '*':
+    if (input[self->pos + 1] == '=') {
+      token_type = TEA_TOKEN_STAR_ASSIGN;
+      token_length = 2;
+      break;
+    }
     token_type = TEA_TOKEN_STAR;
     break;
   case '/':
+    if (input[self->pos + 1] == '=') {
+      token_type = TEA_TOKEN_SLASH_ASSIGN;
+      token_length = 2;
+      break;
+    }
     token_type = TEA_TOKEN_SLASH;
     break;
   case '(':
@@ -249,6 +298,11 @@ static bool scan_operator(tea_lexer_t *self, const char *input)
     token_type = TEA_TOKEN_LT;
     break;
   case '.':
+    if (input[self->pos + 1] == '.') {
+      token_type = TEA_TOKEN_DOTDOT;
+      token_length = 2;
+      break;
+    }
     token_type = TEA_TOKEN_DOT;
     break;
   case '?':
@@ -303,6 +357,35 @@ static bool scan_number(tea_lexer_t *self, const char *input)
     const int length = current_position - start_position;
     const char *buffer = &input[start_position];
 
+    // Optional type suffix, for example 42i64 or 0.1f64
+    int token_type =
+      is_float ? TEA_TOKEN_FLOAT_NUMBER : TEA_TOKEN_INTEGER_NUMBER;
+    int suffix_length = 0;
+    const char suffix = input[current_position];
+    if ((suffix == 'i' || suffix == 'f') &&
+        ((input[current_position + 1] == '3' &&
+          input[current_position + 2] == '2') ||
+         (input[current_position + 1] == '6' &&
+          input[current_position + 2] == '4')) &&
+        !isalnum((unsigned char)input[current_position + 3]) &&
+        input[current_position + 3] != '_') {
+      const bool is_wide = input[current_position + 1] == '6';
+      if (suffix == 'i') {
+        if (is_float) {
+          tea_log_err(
+            "Lexer error: Integer suffix on float literal at line %d, column %d",
+            self->line, self->col);
+          return false;
+        }
+        token_type =
+          is_wide ? TEA_TOKEN_I64_NUMBER : TEA_TOKEN_INTEGER_NUMBER;
+      } else {
+        is_float = true;
+        token_type = is_wide ? TEA_TOKEN_F64_NUMBER : TEA_TOKEN_FLOAT_NUMBER;
+      }
+      suffix_length = 3;
+    }
+
     char tmp_buffer[32] = { 0 };
     if (length < 32) {
       strncpy(tmp_buffer, buffer, length);
@@ -315,10 +398,9 @@ static bool scan_number(tea_lexer_t *self, const char *input)
 
     char *end;
     if (is_float) {
-      float value = strtof(tmp_buffer, &end);
+      double value = strtod(tmp_buffer, &end);
       if (*end == 0) {
-        create_token(self, TEA_TOKEN_FLOAT_NUMBER, (char *)&value,
-                     sizeof(value));
+        create_token(self, token_type, (char *)&value, sizeof(value));
       } else {
         tea_log_err(
           "Lexer error: Invalid float literal '%s' at line %d, column %d",
@@ -326,10 +408,16 @@ static bool scan_number(tea_lexer_t *self, const char *input)
         return false;
       }
     } else {
-      int value = (int)strtol(tmp_buffer, &end, 10);
-      if (*end == 0) {
-        create_token(self, TEA_TOKEN_INTEGER_NUMBER, (char *)&value,
-                     sizeof(value));
+      errno = 0;
+      int64_t value = strtoll(tmp_buffer, &end, 10);
+      // Like in C an unsuffixed literal that does not fit into i32 is i64
+      if (suffix_length == 0 && (value < INT32_MIN || value > INT32_MAX)) {
+        token_type = TEA_TOKEN_I64_NUMBER;
+      }
+      if (*end == 0 && errno != ERANGE &&
+          (token_type == TEA_TOKEN_I64_NUMBER ||
+           (value >= INT32_MIN && value <= INT32_MAX))) {
+        create_token(self, token_type, (char *)&value, sizeof(value));
       } else {
         tea_log_err(
           "Lexer error: Invalid integer literal '%s' at line %d, column %d",
@@ -338,8 +426,8 @@ static bool scan_number(tea_lexer_t *self, const char *input)
       }
     }
 
-    self->col += length;
-    self->pos = current_position;
+    self->col += length + suffix_length;
+    self->pos = current_position + suffix_length;
 
     return true;
   }
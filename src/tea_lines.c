@@ -0,0 +1,253 @@
+#include "tea_lines.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tea_fn.h"
+#include "tea_gen.h"
+
+#include "tea_log.h"
+#include "tea_memory.h"
+
+// File mapped by a call of lines(), kept in a list of its context until
+// its loop ends or the run does
+typedef struct tea_lines_t {
+  struct tea_lines_t *next;
+  tea_ctx_t *ctx; // the context whose list it is in
+  const char *data; // NULL once unmapped
+  size_t size;
+  size_t offset; // start of the next line
+  size_t dropped; // pages before this were given back to the system
+  tea_inst_t *view; // the line, moved by each step of the loop
+} tea_lines_t;
+
+// A view kept after the loop is made empty rather than left pointing into
+// the unmapped file
+static void tea_lines_unmap(tea_lines_t *lines)
+{
+  ((tea_view_t *)lines->view->buf)->data = "";
+  lines->view->size = 0;
+  if (lines->data) {
+#ifdef _WIN32
+    UnmapViewOfFile(lines->data);
+#else
+    munmap((void *)lines->data, lines->size);
+#endif
+    lines->data = NULL;
+  }
+}
+
+// Unmaps the file of a loop that ended and takes it out of the list of its
+// context. The view is left to the script like any other value, it may
+// still be held by a variable
+static void tea_lines_release(tea_lines_t *lines)
+{
+  tea_lines_unmap(lines);
+
+  tea_lines_t **link = &lines->ctx->lines;
+  while (*link != lines) {
+    link = &(*link)->next;
+  }
+  *link = lines->next;
+  tea_free(lines);
+}
+
+static void tea_lines_close(tea_ctx_t *ctx, void *data)
+{
+  (void)ctx;
+  tea_lines_release(data);
+}
+
+// Maps the whole file for reading, an empty file maps to nothing
+static bool tea_lines_map(tea_lines_t *lines, const char *path)
+{
+  lines->data = NULL;
+  lines->size = 0;
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    tea_log_err("Runtime error: 'lines' can't open '%s' (error %lu)", path,
+                GetLastError());
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  bool is_ok = GetFileSizeEx(file, &size);
+  if (is_ok && size.QuadPart > 0) {
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void *data =
+      mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (mapping) {
+      CloseHandle(mapping);
+    }
+    is_ok = data != NULL;
+    lines->data = data;
+    lines->size = (size_t)size.QuadPart;
+  }
+  if (!is_ok) {
+    tea_log_err("Runtime error: 'lines' can't map '%s' (error %lu)", path,
+                GetLastError());
+  }
+  CloseHandle(file);
+  return is_ok;
+#else
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    tea_log_err("Runtime error: 'lines' can't open '%s': %s", path,
+                strerror(errno));
+    return false;
+  }
+
+  struct stat info;
+  bool is_ok = fstat(fd, &info) == 0;
+  if (is_ok && info.st_size > 0) {
+    void *data =
+      mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    is_ok = data != MAP_FAILED;
+    if (is_ok) {
+      // Read ahead of the loop, and drop pages behind it early
+      madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+      lines->data = data;
+      lines->size = (size_t)info.st_size;
+    }
+  }
+  if (!is_ok) {
+    tea_log_err("Runtime error: 'lines' can't map '%s': %s", path,
+                strerror(errno));
+  }
+  close(fd);
+  return is_ok;
+#endif
+}
+
+// Gives back the pages the loop has gone past, so a file larger than the
+// memory doesn't fill it
+static void tea_lines_drop(tea_lines_t *lines)
+{
+#ifdef _WIN32
+  (void)lines;
+#else
+  static size_t page_size = 0;
+  if (!page_size) {
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+  }
+
+  const size_t end = lines->offset - lines->offset % page_size;
+  madvise((void *)(lines->data + lines->dropped), end - lines->dropped,
+          MADV_DONTNEED);
+  lines->dropped = end;
+#endif
+}
+
+static bool tea_lines_next(tea_ctx_t *ctx, void *data, tea_val_t *value)
+{
+  (void)ctx;
+  tea_lines_t *lines = data;
+  tea_view_t *view = (tea_view_t *)lines->view->buf;
+
+  if (lines->offset >= lines->size) {
+    tea_lines_release(lines);
+    *value = tea_val_undef();
+    return true;
+  }
+
+  // Only the bytes before the current line can be given back, a view
+  // points to that one
+  if (lines->offset - lines->dropped >= TEA_LINES_WINDOW) {
+    tea_lines_drop(lines);
+  }
+
+  const char *start = lines->data + lines->offset;
+  const size_t left = lines->size - lines->offset;
+  // memchr of the C library compares a vector of bytes at a time
+  const char *newline = memchr(start, '\n', left);
+  size_t size = newline ? (size_t)(newline - start) : left;
+  lines->offset += newline ? size + 1 : size;
+  if (size > 0 && start[size - 1] == '\r') {
+    size--;
+  }
+
+  view->data = start;
+  lines->view->size = size;
+  value->type = TEA_V_INST;
+  value->obj = lines->view;
+  return true;
+}
+
+static tea_val_t tea_lines(tea_ctx_t *ctx, const tea_val_t *args,
+                           const int argc)
+{
+  (void)argc;
+  const tea_val_t *path = &args[0];
+  if (path->type != TEA_V_INST || strcmp(path->obj->type, "string") != 0) {
+    tea_log_err("Runtime error: 'lines' expects a path as a string");
+    return tea_val_undef();
+  }
+
+  tea_lines_t *lines = tea_malloc(sizeof(tea_lines_t));
+  tea_inst_t *view = tea_malloc(sizeof(tea_inst_t) + sizeof(tea_view_t));
+  if (!lines || !view) {
+    tea_log_err("Memory error: Failed to allocate the lines of '%s'",
+                path->obj->buf);
+    tea_free(lines);
+    tea_free(view);
+    return tea_val_undef();
+  }
+
+  view->type = TEA_VIEW_TYPE;
+  view->decl = NULL;
+  view->size = 0;
+  view->flags = 0;
+  ((tea_view_t *)view->buf)->data = "";
+  lines->view = view;
+  lines->offset = 0;
+  lines->dropped = 0;
+  if (!tea_lines_map(lines, path->obj->buf)) {
+    tea_free(lines);
+    tea_free(view);
+    return tea_val_undef();
+  }
+
+  const tea_val_t gen =
+    tea_gen_create_native(tea_lines_next, tea_lines_close, lines);
+  if (gen.type == TEA_V_UNDEF) {
+    tea_lines_unmap(lines);
+    tea_free(lines);
+    tea_free(view);
+    return gen;
+  }
+
+  lines->ctx = ctx;
+  lines->next = ctx->lines;
+  ctx->lines = lines;
+  return gen;
+}
+
+void tea_lines_cleanup(tea_ctx_t *ctx)
+{
+  tea_lines_t *lines = ctx->lines;
+  while (lines) {
+    tea_lines_t *next = lines->next;
+    tea_lines_unmap(lines);
+    tea_free(lines->view);
+    tea_free(lines);
+    lines = next;
+  }
+  ctx->lines = NULL;
+}
+
+void tea_bind_lines(tea_program_t *prog)
+{
+  tea_bind_native_sig(prog, NULL, "lines", "any (string)", tea_lines);
+}
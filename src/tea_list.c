@@ -63,6 +63,21 @@ void tea_list_remove(const tea_list_entry_t *entry)
   _tea_list_remove(entry->prev, entry->next);
 }
 
+void tea_list_splice_tail(tea_list_entry_t *head, tea_list_entry_t *list)
+{
+  if (tea_list_empty(list)) {
+    return;
+  }
+
+  tea_list_entry_t *first = list->next;
+  tea_list_entry_t *last = list->prev;
+  first->prev = head->prev;
+  head->prev->next = first;
+  last->next = head;
+  head->prev = last;
+  tea_list_init(list);
+}
+
 tea_list_entry_t *tea_list_first(const tea_list_entry_t *head)
 {
   if (tea_list_empty(head)) {
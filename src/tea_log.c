@@ -0,0 +1,300 @@
+#include "tea_log.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+
+int tea_log_level = TEA_LOG_INF;
+int tea_log_async = 0;
+
+// Message of a thread, formatted into text when it is written, the rest of
+// the line is made by the formatter
+typedef struct {
+  int level;
+  unsigned line;
+  const char *file; // literals of the call site, valid until the exit
+  const char *func;
+  time_t time;
+  char text[TEA_LOG_TEXT];
+} tea_log_record_t;
+
+// Ring of one thread, which writes the head while the formatter reads the
+// tail. Both count up to twice the number of slots, so a full ring and an
+// empty one are told apart
+typedef struct tea_log_ring_t {
+  struct tea_log_ring_t *next; // set before the ring is in the list
+  volatile long owned; // a thread writes to it
+  volatile long head;
+  volatile long tail;
+  volatile long dropped; // written by the owner only
+  tea_log_record_t records[TEA_LOG_RING_SLOTS];
+} tea_log_ring_t;
+
+#define TEA_LOG_INDEX_MASK (2 * TEA_LOG_RING_SLOTS - 1)
+
+static struct {
+  tea_mutex_t lock;
+  tea_cond_t wake;
+  tea_thread_t thread;
+  tea_log_ring_t *volatile rings; // only added to while the sink runs
+  volatile long idle; // the formatter waits for a producer to wake it
+  bool running;
+} tea_log_sink;
+
+// Rings of an earlier run of the sink are freed, a thread that still points
+// to one claims a new ring
+static long tea_log_generation = 0;
+static TEA_THREAD_LOCAL tea_log_ring_t *tea_log_ring = NULL;
+static TEA_THREAD_LOCAL long tea_log_ring_generation = 0;
+
+static tea_log_ring_t *tea_log_claim_ring(void)
+{
+  tea_log_ring_t *ring =
+    tea_atomic_load_ptr((void *volatile *)&tea_log_sink.rings);
+  for (; ring; ring = ring->next) {
+    if (tea_atomic_cas_long(&ring->owned, 0, 1)) {
+      return ring;
+    }
+  }
+
+  // Not with tea_malloc, which logs
+  ring = malloc(sizeof(*ring));
+  if (!ring) {
+    return NULL;
+  }
+  ring->owned = 1;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->dropped = 0;
+
+  tea_mutex_lock(&tea_log_sink.lock);
+  ring->next = tea_log_sink.rings;
+  tea_atomic_store_ptr((void *volatile *)&tea_log_sink.rings, ring);
+  tea_mutex_unlock(&tea_log_sink.lock);
+  return ring;
+}
+
+void tea_log_write(const int level, const char *file, const unsigned line,
+                   const char *func, const char *fmt, ...)
+{
+  if (!tea_log_ring || tea_log_ring_generation != tea_log_generation) {
+    tea_log_ring = tea_log_claim_ring();
+    tea_log_ring_generation = tea_log_generation;
+    if (!tea_log_ring) {
+      return;
+    }
+  }
+
+  tea_log_ring_t *ring = tea_log_ring;
+  const long head = tea_atomic_load_long(&ring->head);
+  const long tail = tea_atomic_load_long(&ring->tail);
+  if (((head - tail) & TEA_LOG_INDEX_MASK) == TEA_LOG_RING_SLOTS) {
+    tea_atomic_store_long(&ring->dropped, ring->dropped + 1);
+    return;
+  }
+
+  tea_log_record_t *record = &ring->records[head % TEA_LOG_RING_SLOTS];
+  record->level = level;
+  record->line = line;
+  record->file = file;
+  record->func = func;
+  record->time = time(NULL);
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(record->text, sizeof(record->text), fmt, args);
+  va_end(args);
+  tea_atomic_store_long(&ring->head, (head + 1) & TEA_LOG_INDEX_MASK);
+
+  // Only the first message after the formatter went idle takes the lock
+  if (tea_atomic_cas_long(&tea_log_sink.idle, 1, 0)) {
+    tea_mutex_lock(&tea_log_sink.lock);
+    tea_cond_signal(&tea_log_sink.wake);
+    tea_mutex_unlock(&tea_log_sink.lock);
+  }
+}
+
+void tea_log_thread_exit(void)
+{
+  if (tea_log_ring && tea_log_ring_generation == tea_log_generation) {
+    // The formatter still writes what is left in it
+    tea_atomic_store_long(&tea_log_ring->owned, 0);
+    tea_log_ring = NULL;
+  }
+}
+
+long tea_log_dropped(void)
+{
+  long dropped = 0;
+  const tea_log_ring_t *ring =
+    tea_atomic_load_ptr((void *volatile *)&tea_log_sink.rings);
+  for (; ring; ring = ring->next) {
+    dropped += tea_atomic_load_long((volatile long *)&ring->dropped);
+  }
+
+  return dropped;
+}
+
+static bool tea_log_is_empty(void)
+{
+  tea_log_ring_t *ring =
+    tea_atomic_load_ptr((void *volatile *)&tea_log_sink.rings);
+  for (; ring; ring = ring->next) {
+    if (tea_atomic_load_long(&ring->head) != ring->tail) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Time stamp of the last record, localtime runs once per second of records
+typedef struct {
+  time_t time;
+  char text[16];
+} tea_log_stamp_t;
+
+static const char *tea_log_stamp(tea_log_stamp_t *stamp, const time_t now)
+{
+  if (now != stamp->time || !stamp->text[0]) {
+    struct tm tm_info;
+#ifdef _WIN32
+    localtime_s(&tm_info, &now);
+#else
+    localtime_r(&now, &tm_info);
+#endif
+    strftime(stamp->text, sizeof(stamp->text), "%H:%M:%S", &tm_info);
+    stamp->time = now;
+  }
+
+  return stamp->text;
+}
+
+// Writes the records of all the rings, returns false if there were none
+static bool tea_log_drain(tea_log_stamp_t *stamp, long *reported)
+{
+  static const char *colors[] = { TEA_COLOR_RED, TEA_COLOR_RED,
+                                  TEA_COLOR_YELLOW, TEA_COLOR_GREEN,
+                                  TEA_COLOR_WHITE };
+  static const char *names[] = { "ERR", "ERR", "WRN", "DBG", "INF" };
+
+  bool is_written = false;
+  tea_log_ring_t *ring =
+    tea_atomic_load_ptr((void *volatile *)&tea_log_sink.rings);
+  for (; ring; ring = ring->next) {
+    const long head = tea_atomic_load_long(&ring->head);
+    for (long tail = ring->tail; tail != head;
+         tail = (tail + 1) & TEA_LOG_INDEX_MASK) {
+      const tea_log_record_t *record =
+        &ring->records[tail % TEA_LOG_RING_SLOTS];
+      const int level = record->level >= TEA_LOG_ERR &&
+                            record->level <= TEA_LOG_INF
+                          ? record->level
+                          : TEA_LOG_ERR;
+      fprintf(stdout, "%s" TEA_LOG_FORMAT "%s%s\n", colors[level],
+              names[level], tea_log_stamp(stamp, record->time), record->file,
+              record->line, record->func, TEA_COLOR_RESET, record->text);
+      tea_atomic_store_long(&ring->tail, (tail + 1) & TEA_LOG_INDEX_MASK);
+      is_written = true;
+    }
+  }
+
+  const long dropped = tea_log_dropped();
+  if (dropped != *reported) {
+    fprintf(stdout, "%s" TEA_LOG_FORMAT "%sDropped %ld log message(s)\n",
+            TEA_COLOR_YELLOW, "WRN", tea_log_stamp(stamp, time(NULL)),
+            TEA_FILENAME, __LINE__, __FUNCTION__, TEA_COLOR_RESET,
+            dropped - *reported);
+    *reported = dropped;
+    is_written = true;
+  }
+
+  if (is_written) {
+    fflush(stdout);
+  }
+  return is_written;
+}
+
+static void tea_log_format(void *arg)
+{
+  (void)arg;
+
+  tea_log_stamp_t stamp = { 0, { 0 } };
+  long reported = 0;
+  tea_mutex_lock(&tea_log_sink.lock);
+  for (;;) {
+    tea_mutex_unlock(&tea_log_sink.lock);
+    const bool is_written = tea_log_drain(&stamp, &reported);
+    tea_mutex_lock(&tea_log_sink.lock);
+    if (is_written) {
+      continue;
+    }
+    if (!tea_log_sink.running) {
+      break;
+    }
+
+    // Producers see the flag after they publish a record, or the check
+    // below sees the record
+    tea_atomic_store_long(&tea_log_sink.idle, 1);
+    if (!tea_log_is_empty()) {
+      tea_atomic_store_long(&tea_log_sink.idle, 0);
+      continue;
+    }
+    while (tea_log_sink.running &&
+           tea_atomic_load_long(&tea_log_sink.idle)) {
+      tea_cond_wait(&tea_log_sink.wake, &tea_log_sink.lock);
+    }
+    tea_atomic_store_long(&tea_log_sink.idle, 0);
+  }
+  tea_mutex_unlock(&tea_log_sink.lock);
+}
+
+bool tea_log_start(void)
+{
+  if (tea_log_async) {
+    return true;
+  }
+
+  if (!tea_mutex_init(&tea_log_sink.lock)) {
+    return false;
+  }
+  if (!tea_cond_init(&tea_log_sink.wake)) {
+    tea_mutex_destroy(&tea_log_sink.lock);
+    return false;
+  }
+  tea_log_sink.rings = NULL;
+  tea_log_sink.idle = 0;
+  tea_log_sink.running = true;
+  if (!tea_thread_start(&tea_log_sink.thread, tea_log_format, NULL)) {
+    tea_cond_destroy(&tea_log_sink.wake);
+    tea_mutex_destroy(&tea_log_sink.lock);
+    return false;
+  }
+
+  tea_log_async = 1;
+  return true;
+}
+
+void tea_log_stop(void)
+{
+  if (!tea_log_async) {
+    return;
+  }
+
+  // Messages from now on are written by the threads themselves
+  tea_log_async = 0;
+  tea_mutex_lock(&tea_log_sink.lock);
+  tea_log_sink.running = false;
+  tea_cond_signal(&tea_log_sink.wake);
+  tea_mutex_unlock(&tea_log_sink.lock);
+  tea_thread_join(&tea_log_sink.thread);
+
+  tea_log_ring_t *ring = tea_log_sink.rings;
+  while (ring) {
+    tea_log_ring_t *next = ring->next;
+    free(ring);
+    ring = next;
+  }
+  tea_log_sink.rings = NULL;
+  tea_log_generation++;
+  tea_cond_destroy(&tea_log_sink.wake);
+  tea_mutex_destroy(&tea_log_sink.lock);
+}
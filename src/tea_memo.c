@@ -0,0 +1,232 @@
+#include "tea_memo.h"
+
+#include <string.h>
+
+#include "tea_dict.h"
+#include "tea_memory.h"
+
+static bool tea_memo_is_str(const tea_val_t *value)
+{
+  return value->type == TEA_V_INST && !strcmp(value->obj->type, "string");
+}
+
+bool tea_memo_is_cacheable(const tea_val_t *value)
+{
+  switch (value->type) {
+  case TEA_V_NULL:
+  case TEA_V_I32:
+  case TEA_V_I64:
+  case TEA_V_F32:
+  case TEA_V_F64:
+    return true;
+  case TEA_V_INST:
+    return tea_memo_is_str(value);
+  default:
+    return false;
+  }
+}
+
+static uint32_t tea_memo_mix(uint32_t hash, const void *data, size_t size)
+{
+  // FNV-1a
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static uint32_t tea_memo_hash(const tea_val_t *args, const int argc)
+{
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < argc; i++) {
+    const tea_val_t *arg = &args[i];
+    const unsigned char type = (unsigned char)arg->type;
+    hash = tea_memo_mix(hash, &type, sizeof(type));
+    switch (arg->type) {
+    case TEA_V_I32:
+      hash = tea_memo_mix(hash, &arg->i32, sizeof(arg->i32));
+      break;
+    case TEA_V_I64:
+      hash = tea_memo_mix(hash, &arg->i64, sizeof(arg->i64));
+      break;
+    case TEA_V_F32:
+      hash = tea_memo_mix(hash, &arg->f32, sizeof(arg->f32));
+      break;
+    case TEA_V_F64:
+      hash = tea_memo_mix(hash, &arg->f64, sizeof(arg->f64));
+      break;
+    case TEA_V_INST: {
+      const char *str = (const char *)arg->obj->buf;
+      const uint32_t str_hash = tea_dict_hash_str(str, (int)strlen(str));
+      hash = tea_memo_mix(hash, &str_hash, sizeof(str_hash));
+    } break;
+    default:
+      break;
+    }
+  }
+
+  return hash;
+}
+
+static bool tea_memo_val_equal(const tea_val_t *lhs, const tea_val_t *rhs)
+{
+  if (lhs->type != rhs->type) {
+    return false;
+  }
+
+  // Floats are compared by their bits, so -0.0 and NaN are keys too
+  switch (lhs->type) {
+  case TEA_V_NULL:
+    return true;
+  case TEA_V_I32:
+    return lhs->i32 == rhs->i32;
+  case TEA_V_I64:
+    return lhs->i64 == rhs->i64;
+  case TEA_V_F32:
+    return !memcmp(&lhs->f32, &rhs->f32, sizeof(lhs->f32));
+  case TEA_V_F64:
+    return !memcmp(&lhs->f64, &rhs->f64, sizeof(lhs->f64));
+  case TEA_V_INST:
+    return lhs->obj == rhs->obj || !strcmp((const char *)lhs->obj->buf,
+                                           (const char *)rhs->obj->buf);
+  default:
+    return false;
+  }
+}
+
+tea_memo_t *tea_memo_create(const unsigned long capacity)
+{
+  tea_memo_t *memo = tea_malloc(sizeof(*memo));
+  if (!memo) {
+    return NULL;
+  }
+
+  // Twice as many buckets as entries keeps the chains short
+  unsigned long bucket_count = 16;
+  while (bucket_count < capacity * 2) {
+    bucket_count *= 2;
+  }
+
+  memo->buckets = tea_malloc(bucket_count * sizeof(*memo->buckets));
+  if (!memo->buckets) {
+    tea_free(memo);
+    return NULL;
+  }
+  memset(memo->buckets, 0, bucket_count * sizeof(*memo->buckets));
+
+  memo->state = TEA_MEMO_UNCHECKED;
+  tea_list_init(&memo->entries);
+  memo->bucket_mask = bucket_count - 1;
+  memo->size = 0;
+  memo->capacity = capacity;
+  memo->hits = 0;
+  memo->misses = 0;
+  memo->evictions = 0;
+
+  return memo;
+}
+
+void tea_memo_free(tea_memo_t *memo)
+{
+  if (!memo) {
+    return;
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_entry_t *safe;
+  tea_list_for_each_safe(entry, safe, &memo->entries)
+  {
+    tea_memo_entry_t *memo_entry = tea_list_record(entry, tea_memo_entry_t, link);
+    tea_list_remove(entry);
+    tea_free(memo_entry);
+  }
+
+  tea_free(memo->buckets);
+  tea_free(memo);
+}
+
+static bool tea_memo_entry_matches(const tea_memo_entry_t *entry,
+                                   const uint32_t hash, const tea_val_t *args,
+                                   const int argc)
+{
+  if (entry->hash != hash || entry->argc != argc) {
+    return false;
+  }
+
+  for (int i = 0; i < argc; i++) {
+    if (!tea_memo_val_equal(&entry->args[i], &args[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+const tea_val_t *tea_memo_find(tea_memo_t *memo, const tea_val_t *args,
+                               const int argc)
+{
+  const uint32_t hash = tea_memo_hash(args, argc);
+  for (tea_memo_entry_t *entry = memo->buckets[hash & memo->bucket_mask];
+       entry; entry = entry->next) {
+    if (tea_memo_entry_matches(entry, hash, args, argc)) {
+      // Move to the front of the recency list
+      tea_list_remove(&entry->link);
+      tea_list_add_head(&memo->entries, &entry->link);
+      memo->hits++;
+      return &entry->result;
+    }
+  }
+
+  memo->misses++;
+  return NULL;
+}
+
+static void tea_memo_unlink(tea_memo_t *memo, const tea_memo_entry_t *entry)
+{
+  tea_memo_entry_t **position = &memo->buckets[entry->hash & memo->bucket_mask];
+  while (*position && *position != entry) {
+    position = &(*position)->next;
+  }
+
+  if (*position) {
+    *position = entry->next;
+  }
+}
+
+bool tea_memo_store(tea_memo_t *memo, const tea_val_t *args, const int argc,
+                    const tea_val_t result)
+{
+  if (argc > TEA_MEMO_MAX_ARGS || !memo->capacity) {
+    return true;
+  }
+
+  tea_memo_entry_t *entry;
+  if (memo->size < memo->capacity) {
+    entry = tea_malloc(sizeof(*entry));
+    if (!entry) {
+      return false;
+    }
+    memo->size++;
+  } else {
+    // The least recently used entry is at the tail and gets reused
+    entry = tea_list_record(memo->entries.prev, tea_memo_entry_t, link);
+    tea_list_remove(&entry->link);
+    tea_memo_unlink(memo, entry);
+    memo->evictions++;
+  }
+
+  entry->hash = tea_memo_hash(args, argc);
+  entry->result = result;
+  entry->argc = argc;
+  memcpy(entry->args, args, argc * sizeof(*args));
+
+  tea_memo_entry_t **bucket = &memo->buckets[entry->hash & memo->bucket_mask];
+  entry->next = *bucket;
+  *bucket = entry;
+  tea_list_add_head(&memo->entries, &entry->link);
+
+  return true;
+}
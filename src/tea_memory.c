@@ -6,6 +6,7 @@
 
 #ifdef TEA_DEBUG_BUILD
 #include "tea_log.h"
+#include "tea_thread.h"
 #endif
 
 #ifdef TEA_DEBUG_BUILD
@@ -14,6 +15,12 @@
  * @brief Head of the linked list used to track memory allocations in debug builds.
  */
 static tea_list_entry_t tea_memory_allocations;
+
+/**
+ * @internal
+ * @brief Guards the allocation list, contexts on other threads allocate too.
+ */
+static tea_mutex_t tea_memory_lock;
 #endif
 
 /**
@@ -36,7 +43,9 @@ static void default_free_wrapper(void *ptr)
 
 /**
  * @internal
- * @brief Global function pointers for custom memory allocators.
+ * @brief Global function pointers for custom memory allocators. They are set
+ *        once by tea_memory_init() and only read afterwards, so the allocators
+ *        themselves must be thread-safe if contexts run on several threads.
  */
 static tea_malloc_func_t g_malloc_func = NULL;
 static tea_free_func_t g_free_func = NULL;
@@ -57,7 +66,9 @@ void *_tea_malloc(const char *file, unsigned long line, unsigned long size)
   header->source_location.file = file;
   header->source_location.line = line;
   header->size = size;
+  tea_mutex_lock(&tea_memory_lock);
   tea_list_add_tail(&tea_memory_allocations, &header->link);
+  tea_mutex_unlock(&tea_memory_lock);
   // Mark the memory with 0x77 to be able to debug uninitialized memory
   memset(&data[sizeof(tea_memory_header_t)], 0x77, size);
   // Return only the needed piece and hide the header
@@ -93,7 +104,9 @@ void tea_free(void *data)
   // Find the header with meta information
   tea_memory_header_t *header =
     (tea_memory_header_t *)((char *)data - sizeof(tea_memory_header_t));
+  tea_mutex_lock(&tea_memory_lock);
   tea_list_remove(&header->link);
+  tea_mutex_unlock(&tea_memory_lock);
   // Now we can free the real allocated piece
   g_free_func(header);
 #else
@@ -109,6 +122,7 @@ void tea_memory_init(tea_malloc_func_t malloc_func, tea_free_func_t free_func)
 
 #ifdef TEA_DEBUG_BUILD
   tea_list_init(&tea_memory_allocations);
+  tea_mutex_init(&tea_memory_lock);
 #endif
 }
 
@@ -127,5 +141,7 @@ void tea_memory_cleanup()
     tea_list_remove(&header->link);
     g_free_func(header);
   }
+
+  tea_mutex_destroy(&tea_memory_lock);
 #endif
 }
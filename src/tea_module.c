@@ -0,0 +1,495 @@
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "tea_module.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tea_fn.h"
+#include "tea_parser.h"
+#include "tea_pool.h"
+#include "tea_thread.h"
+
+#include "tea_log.h"
+#include "tea_memory.h"
+
+#ifndef TEA_MODULE_PATH_MAX
+#define TEA_MODULE_PATH_MAX 4096
+#endif
+
+// Modules of the process, by path. Programs on several threads can import
+// at the same time, the first one to need a module parses it
+static struct {
+  tea_mutex_t lock;
+  tea_cond_t changed; // a module was parsed
+  tea_list_entry_t modules;
+  int parsing; // modules being parsed, they can add more to parse
+} tea_modules;
+
+void tea_modules_init(void)
+{
+  tea_mutex_init(&tea_modules.lock);
+  tea_cond_init(&tea_modules.changed);
+  tea_list_init(&tea_modules.modules);
+  tea_modules.parsing = 0;
+}
+
+void tea_modules_cleanup(void)
+{
+  tea_list_entry_t *entry;
+  tea_list_entry_t *safe;
+  tea_list_for_each_safe(entry, safe, &tea_modules.modules)
+  {
+    tea_module_t *module = tea_list_record(entry, tea_module_t, link);
+    tea_list_remove(entry);
+    if (module->ast) {
+      tea_node_free(module->ast);
+    }
+    tea_lexer_cleanup(&module->lexer);
+    tea_free(module->imports);
+    tea_free(module);
+  }
+
+  tea_cond_destroy(&tea_modules.changed);
+  tea_mutex_destroy(&tea_modules.lock);
+}
+
+static bool tea_is_path_sep(const char c)
+{
+#ifdef _WIN32
+  return c == '/' || c == '\\';
+#else
+  return c == '/';
+#endif
+}
+
+// Resolves the path of an import relative to the directory of the file
+// that imports it. The result is allocated with malloc, NULL if the file
+// doesn't exist
+static char *tea_module_resolve(const char *importer, const char *path)
+{
+  const char *dir_end = NULL;
+  for (const char *c = importer; *c; c++) {
+    if (tea_is_path_sep(*c)) {
+      dir_end = c;
+    }
+  }
+
+  bool is_absolute = tea_is_path_sep(path[0]);
+#ifdef _WIN32
+  is_absolute = is_absolute || (path[0] && path[1] == ':');
+#endif
+
+  char joined[TEA_MODULE_PATH_MAX];
+  if (is_absolute || !dir_end) {
+    snprintf(joined, sizeof(joined), "%s", path);
+  } else {
+    snprintf(joined, sizeof(joined), "%.*s/%s", (int)(dir_end - importer),
+             importer, path);
+  }
+
+#ifdef _WIN32
+  FILE *file = fopen(joined, "r");
+  if (!file) {
+    return NULL;
+  }
+  fclose(file);
+  return _fullpath(NULL, joined, 0);
+#else
+  return realpath(joined, NULL);
+#endif
+}
+
+// Returns the module of the path, added to the cache to be parsed if it
+// isn't there yet. Called with the lock of the cache held
+static tea_module_t *tea_module_get(const char *importer,
+                                    const tea_tok_t *path_tok)
+{
+  char *path = tea_module_resolve(importer, path_tok->buf);
+  if (!path) {
+    tea_log_err("Import error: Cannot find module '%s' imported by '%s' at line %d, column %d",
+                path_tok->buf, importer, path_tok->line, path_tok->col);
+    return NULL;
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &tea_modules.modules)
+  {
+    tea_module_t *module = tea_list_record(entry, tea_module_t, link);
+    if (!strcmp(module->path, path)) {
+      free(path);
+      return module;
+    }
+  }
+
+  // The namespace is the file name up to its extension
+  const char *name = path;
+  for (const char *c = path; *c; c++) {
+    if (tea_is_path_sep(*c)) {
+      name = c + 1;
+    }
+  }
+  const char *dot = strchr(name, '.');
+  const size_t name_size = dot ? (size_t)(dot - name) : strlen(name);
+  bool is_ident = name_size > 0 && !isdigit((unsigned char)name[0]);
+  for (size_t i = 0; i < name_size; i++) {
+    is_ident = is_ident && (isalnum((unsigned char)name[i]) || name[i] == '_');
+  }
+  if (!is_ident) {
+    tea_log_err("Import error: The name of module '%s' is not an identifier",
+                path);
+    free(path);
+    return NULL;
+  }
+
+  const size_t path_size = strlen(path);
+  tea_module_t *module =
+    tea_malloc(sizeof(*module) + path_size + 1 + name_size + 1);
+  if (!module) {
+    tea_log_err("Memory error: Failed to allocate module '%s'", path);
+    free(path);
+    return NULL;
+  }
+
+  char *strings = (char *)(module + 1);
+  memcpy(strings, path, path_size + 1);
+  memcpy(strings + path_size + 1, name, name_size);
+  strings[path_size + 1 + name_size] = 0;
+  free(path);
+
+  module->path = strings;
+  module->name = strings + path_size + 1;
+  module->state = TEA_MODULE_PENDING;
+  tea_lexer_init(&module->lexer);
+  module->ast = NULL;
+  module->imports = NULL;
+  module->import_count = 0;
+  tea_list_add_tail(&tea_modules.modules, &module->link);
+  return module;
+}
+
+static unsigned long tea_count_imports(const tea_node_t *ast)
+{
+  unsigned long count = 0;
+  if (ast) {
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &ast->children)
+    {
+      const tea_node_t *node = tea_list_record(entry, tea_node_t, link);
+      count += node->type == TEA_N_IMPORT;
+    }
+  }
+
+  return count;
+}
+
+// Resolves the imports of the AST into the array, which has room for all of
+// them. Called with the lock of the cache held
+static bool tea_resolve_imports(const char *importer, const tea_node_t *ast,
+                                tea_module_t **imports)
+{
+  if (!ast) {
+    return true;
+  }
+
+  bool is_ok = true;
+  unsigned long count = 0;
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &ast->children)
+  {
+    const tea_node_t *node = tea_list_record(entry, tea_node_t, link);
+    if (node->type == TEA_N_IMPORT) {
+      imports[count] = tea_module_get(importer, node->tok);
+      is_ok = is_ok && imports[count];
+      count++;
+    }
+  }
+
+  return is_ok;
+}
+
+// Parses the modules waiting in the cache until none is left or being
+// parsed, so it also waits for the modules parsed by other threads. Each
+// worker of the pool runs it as its single chunk
+static bool tea_modules_work(void *data, const int worker, const long chunk)
+{
+  (void)data;
+  (void)worker;
+  (void)chunk;
+
+  tea_mutex_lock(&tea_modules.lock);
+  for (;;) {
+    tea_module_t *module = NULL;
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &tea_modules.modules)
+    {
+      tea_module_t *candidate = tea_list_record(entry, tea_module_t, link);
+      if (candidate->state == TEA_MODULE_PENDING) {
+        module = candidate;
+        break;
+      }
+    }
+
+    if (!module) {
+      if (tea_modules.parsing == 0) {
+        break;
+      }
+      tea_cond_wait(&tea_modules.changed, &tea_modules.lock);
+      continue;
+    }
+
+    module->state = TEA_MODULE_PARSING;
+    tea_modules.parsing++;
+    tea_mutex_unlock(&tea_modules.lock);
+
+    tea_log_dbg("Parsing module '%s'", module->path);
+    module->ast = tea_parse_file(&module->lexer, module->path);
+    module->import_count = tea_count_imports(module->ast);
+    bool is_ok = true;
+    if (module->import_count) {
+      module->imports =
+        tea_malloc(module->import_count * sizeof(*module->imports));
+      is_ok = module->imports != NULL;
+    }
+
+    tea_mutex_lock(&tea_modules.lock);
+    if (is_ok) {
+      // The modules it imports are parsed by the next free thread
+      is_ok = tea_resolve_imports(module->path, module->ast, module->imports);
+    }
+    module->state = is_ok ? TEA_MODULE_PARSED : TEA_MODULE_FAILED;
+    tea_modules.parsing--;
+    tea_cond_broadcast(&tea_modules.changed);
+  }
+  tea_mutex_unlock(&tea_modules.lock);
+  return true;
+}
+
+static const tea_import_t *tea_find_import(const tea_program_t *prog,
+                                           const tea_node_t *node)
+{
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &prog->imports)
+  {
+    const tea_import_t *import = tea_list_record(entry, tea_import_t, link);
+    if (import->node == node) {
+      return import;
+    }
+  }
+
+  return NULL;
+}
+
+// Declares the module in the program on its first import, after the
+// modules it imports
+static bool tea_import_module(tea_program_t *prog, const tea_node_t *node,
+                              tea_module_t *module)
+{
+  if (module->state != TEA_MODULE_PARSED) {
+    tea_log_err("Import error: Module '%s' failed to load", module->path);
+    return false;
+  }
+
+  tea_import_t *import = tea_malloc(sizeof(*import));
+  if (!import) {
+    tea_log_err("Memory error: Failed to allocate the import of '%s'",
+                module->path);
+    return false;
+  }
+  import->node = node;
+  import->module = module;
+  import->runs = true;
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &prog->imports)
+  {
+    const tea_import_t *other = tea_list_record(entry, tea_import_t, link);
+    if (other->module == module) {
+      import->runs = false;
+      break;
+    }
+    if (!strcmp(other->module->name, module->name)) {
+      tea_log_err("Import error: Modules '%s' and '%s' have the same name",
+                  other->module->path, module->path);
+      tea_free(import);
+      return false;
+    }
+  }
+
+  // Added before its own imports are, so an import cycle stops here
+  tea_list_add_tail(&prog->imports, &import->link);
+  if (!import->runs || !module->ast) {
+    return true;
+  }
+
+  unsigned long index = 0;
+  tea_list_for_each(entry, &module->ast->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    if (child->type == TEA_N_IMPORT &&
+        !tea_import_module(prog, child, module->imports[index++])) {
+      return false;
+    }
+  }
+
+  tea_log_dbg("Declaring module '%s' as '%s'", module->path, module->name);
+  return tea_program_decl(prog, module->ast, module->name);
+}
+
+bool tea_program_import(tea_program_t *prog)
+{
+  const unsigned long count = tea_count_imports(prog->ast);
+  if (count == 0) {
+    return true;
+  }
+
+  tea_module_t **imports = tea_malloc(count * sizeof(*imports));
+  if (!imports) {
+    tea_log_err("Memory error: Failed to allocate %lu imports", count);
+    return false;
+  }
+
+  tea_mutex_lock(&tea_modules.lock);
+  bool is_ok = tea_resolve_imports(prog->file_name, prog->ast, imports);
+  int pending = 0;
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &tea_modules.modules)
+  {
+    const tea_module_t *module = tea_list_record(entry, tea_module_t, link);
+    pending += module->state == TEA_MODULE_PENDING;
+  }
+  tea_mutex_unlock(&tea_modules.lock);
+
+  // Modules are parsed on the pool, by a worker per processor at most, the
+  // calling thread being one of them. It also waits for the modules other
+  // programs are parsing, so it runs even if none is pending
+  int worker_count = tea_cpu_count();
+  if (worker_count > pending) {
+    worker_count = pending > 0 ? pending : 1;
+  }
+  tea_pool_run(worker_count, worker_count, tea_modules_work, NULL);
+
+  unsigned long index = 0;
+  tea_list_for_each(entry, &prog->ast->children)
+  {
+    const tea_node_t *node = tea_list_record(entry, tea_node_t, link);
+    if (is_ok && node->type == TEA_N_IMPORT) {
+      is_ok = tea_import_module(prog, node, imports[index++]);
+    }
+  }
+
+  tea_free(imports);
+  return is_ok;
+}
+
+tea_exec_status_t tea_exec_import(tea_ctx_t *ctx, const tea_node_t *node)
+{
+  const tea_import_t *import = tea_find_import(ctx->prog, node);
+  if (!import) {
+    tea_log_err("Internal error: Import of '%s' was not resolved",
+                node->tok->buf);
+    return TEA_EXEC_ERR;
+  }
+  if (!import->runs || !import->module->ast) {
+    return TEA_EXEC_OK;
+  }
+
+  tea_module_scope_t *module = tea_malloc(sizeof(*module));
+  if (!module) {
+    tea_log_err("Memory error: Failed to allocate the variables of '%s'",
+                import->module->path);
+    return TEA_EXEC_ERR;
+  }
+  // Its variables are seen by its functions for the rest of the run, not by
+  // the importing file
+  module->ns = import->module->name;
+  tea_scope_init(&module->scp, NULL);
+  tea_list_add_tail(&ctx->modules, &module->link);
+
+  // Names called by its statements resolve in the module
+  const char *ns = ctx->ns;
+  ctx->ns = import->module->name;
+  const tea_exec_status_t status =
+    tea_exec(ctx, &module->scp, import->module->ast);
+  ctx->ns = ns;
+  return status;
+}
+
+tea_scope_t *tea_fn_outer_scope(const tea_ctx_t *ctx, const tea_fn_t *fn,
+                                tea_scope_t *caller_scp)
+{
+  if (!fn->ns) {
+    return caller_scp;
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &ctx->modules)
+  {
+    tea_module_scope_t *module =
+      tea_list_record(entry, tea_module_scope_t, link);
+    if (module->ns == fn->ns) {
+      return &module->scp;
+    }
+  }
+
+  tea_log_err(
+    "Runtime error: Module '%s' of function '%s' did not run in this context",
+    fn->ns, fn->name->buf);
+  return NULL;
+}
+
+bool tea_module_scopes_copy(tea_ctx_t *ctx, const tea_ctx_t *from)
+{
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &from->modules)
+  {
+    const tea_module_scope_t *source =
+      tea_list_record(entry, tea_module_scope_t, link);
+    tea_module_scope_t *module = tea_malloc(sizeof(*module));
+    if (!module) {
+      tea_log_err("Memory error: Failed to allocate the variables of '%s'",
+                  source->ns);
+      return false;
+    }
+    module->ns = source->ns;
+    tea_scope_init(&module->scp, NULL);
+    tea_list_add_tail(&ctx->modules, &module->link);
+
+    tea_list_entry_t *var_entry;
+    tea_list_for_each(var_entry, &source->scp.vars)
+    {
+      const tea_var_t *source_var =
+        tea_list_record(var_entry, tea_var_t, link);
+      tea_var_t *variable = tea_alloc_var(ctx);
+      if (!variable) {
+        tea_log_err("Memory error: Failed to allocate memory for variable '%s'",
+                    source_var->name);
+        return false;
+      }
+      variable->name = source_var->name;
+      variable->flags = source_var->flags;
+      variable->val = source_var->val;
+      tea_list_add_tail(&module->scp.vars, &variable->link);
+    }
+  }
+
+  return true;
+}
+
+void tea_module_scopes_cleanup(tea_ctx_t *ctx)
+{
+  tea_list_entry_t *entry;
+  tea_list_entry_t *safe;
+  tea_list_for_each_safe(entry, safe, &ctx->modules)
+  {
+    tea_module_scope_t *module =
+      tea_list_record(entry, tea_module_scope_t, link);
+    tea_list_remove(entry);
+    tea_scope_cleanup(ctx, &module->scp);
+    tea_free(module);
+  }
+}
@@ -0,0 +1,1019 @@
+#include "tea_opt.h"
+
+#include <string.h>
+
+#include "tea_expr.h"
+#include "tea_fn.h"
+#include "tea_grammar.h"
+#include "tea_interp.h"
+#include "tea_log.h"
+#include "tea_memory.h"
+
+// Inlining into a function can make it small enough to be inlined in turn,
+// the passes stop as soon as nothing changes
+#define TEA_INLINE_MAX_PASSES 4
+#define TEA_INLINE_MAX_ARGS 8
+
+// A variable visible at some point of the program, the type is known only
+// for the immutable variables initialized with a new instance
+typedef struct tea_binding_t {
+  struct tea_binding_t *prev;
+  const char *name;
+  const char *type;
+} tea_binding_t;
+
+typedef struct {
+  const tea_program_t *program;
+  const tea_node_t *prog;
+  // The top level statement or function being inlined into
+  const tea_node_t *site;
+  tea_binding_t *bindings;
+  unsigned long count;
+  bool failed;
+} tea_inliner_t;
+
+typedef struct {
+  const tea_node_t *owner;
+  const tea_node_t *params;
+  const tea_node_t *ret_type;
+  const tea_node_t *body;
+  bool has_attrs;
+} tea_fn_parts_t;
+
+typedef struct {
+  const char *names[TEA_INLINE_MAX_ARGS + 1];
+  const tea_node_t *values[TEA_INLINE_MAX_ARGS + 1];
+  int count;
+} tea_subst_t;
+
+static void tea_get_fn_parts(const tea_node_t *fn, tea_fn_parts_t *parts)
+{
+  memset(parts, 0, sizeof(*parts));
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &fn->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    switch (child->type) {
+    case TEA_N_OWNER:
+      parts->owner = child;
+      break;
+    case TEA_N_PARAM:
+      parts->params = child;
+      break;
+    case TEA_N_RET_TYPE:
+      parts->ret_type = child;
+      break;
+    case TEA_N_STMT:
+      parts->body = child;
+      break;
+    case TEA_N_ATTR:
+      parts->has_attrs = true;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+static bool tea_push_binding(tea_inliner_t *inl, const char *name,
+                             const char *type)
+{
+  tea_binding_t *binding = tea_malloc(sizeof(*binding));
+  if (!binding) {
+    // Without the binding an outer one could be found instead
+    inl->failed = true;
+    return false;
+  }
+
+  binding->prev = inl->bindings;
+  binding->name = name;
+  binding->type = type;
+  inl->bindings = binding;
+
+  return true;
+}
+
+static void tea_pop_bindings(tea_inliner_t *inl, tea_binding_t *until)
+{
+  while (inl->bindings && inl->bindings != until) {
+    tea_binding_t *binding = inl->bindings;
+    inl->bindings = binding->prev;
+    tea_free(binding);
+  }
+}
+
+static const char *tea_lookup_type(const tea_inliner_t *inl, const char *name)
+{
+  for (const tea_binding_t *binding = inl->bindings; binding;
+       binding = binding->prev) {
+    if (!strcmp(binding->name, name)) {
+      return binding->type;
+    }
+  }
+
+  return NULL;
+}
+
+static const tea_node_t *tea_find_fn_node(const tea_inliner_t *inl,
+                                          const char *owner, const char *name)
+{
+  // The first declaration wins like in the function lookup, and only the
+  // functions declared before the call site are known there
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &inl->prog->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    if (child == inl->site) {
+      break;
+    }
+    if (child->type != TEA_N_FN || !child->tok ||
+        strcmp(child->tok->buf, name) != 0) {
+      continue;
+    }
+
+    tea_fn_parts_t parts;
+    tea_get_fn_parts(child, &parts);
+    if (!owner && !parts.owner) {
+      return child;
+    }
+    if (owner && parts.owner && !strcmp(parts.owner->tok->buf, owner)) {
+      return child;
+    }
+  }
+
+  return NULL;
+}
+
+static bool tea_is_struct_declared(const tea_inliner_t *inl, const char *name)
+{
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &inl->prog->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    if (child->type == TEA_N_STRUCT && child->tok &&
+        !strcmp(child->tok->buf, name)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Counts the nodes of an expression without calls, returns 0 if the
+// expression can't be inlined
+static unsigned long tea_count_simple(const tea_node_t *node)
+{
+  if (!node) {
+    return 0;
+  }
+
+  switch (node->type) {
+  case TEA_N_INT:
+  case TEA_N_FLOAT:
+  case TEA_N_STR:
+  case TEA_N_NULL:
+  case TEA_N_IDENT:
+    return 1;
+  case TEA_N_FIELD_ACC:
+    // Fields are read only from named objects
+    if (!node->field_acc.obj || node->field_acc.obj->type != TEA_N_IDENT) {
+      return 0;
+    }
+    return 2;
+  case TEA_N_BINOP: {
+    const unsigned long lhs = tea_count_simple(node->binop.lhs);
+    const unsigned long rhs = tea_count_simple(node->binop.rhs);
+    if (!lhs || !rhs) {
+      return 0;
+    }
+    return 1 + lhs + rhs;
+  }
+  case TEA_N_UNARY: {
+    unsigned long count = 1;
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      const unsigned long child_count = tea_count_simple(child);
+      if (!child_count) {
+        return 0;
+      }
+      count += child_count;
+    }
+    return count;
+  }
+  default:
+    return 0;
+  }
+}
+
+// An argument which is cheap enough to be evaluated more than once
+static bool tea_is_trivial(const tea_node_t *node)
+{
+  switch (node->type) {
+  case TEA_N_INT:
+  case TEA_N_FLOAT:
+  case TEA_N_NULL:
+  case TEA_N_IDENT:
+  case TEA_N_FIELD_ACC:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool tea_is_literal(const tea_node_t *node)
+{
+  switch (node->type) {
+  case TEA_N_INT:
+  case TEA_N_FLOAT:
+  case TEA_N_STR:
+  case TEA_N_NULL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Returns the expression that replaces the calls of the function, NULL if
+// the function can't be inlined
+static const tea_node_t *tea_inline_body(const tea_node_t *fn)
+{
+  tea_fn_parts_t parts;
+  tea_get_fn_parts(fn, &parts);
+
+  // Attributes change how the function is called
+  if (!parts.body || parts.has_attrs) {
+    return NULL;
+  }
+
+  if (tea_list_length(&parts.body->children) != 1) {
+    return NULL;
+  }
+
+  const tea_list_entry_t *first = tea_list_first(&parts.body->children);
+  const tea_node_t *ret = tea_list_record(first, tea_node_t, link);
+  if (ret->type != TEA_N_RET) {
+    return NULL;
+  }
+
+  const tea_list_entry_t *ret_entry = tea_list_first(&ret->children);
+  if (!ret_entry) {
+    return NULL;
+  }
+
+  const tea_node_t *expr = tea_list_record(ret_entry, tea_node_t, link);
+  const unsigned long count = tea_count_simple(expr);
+  if (!count || count > TEA_INLINE_MAX_NODES) {
+    return NULL;
+  }
+
+  // The parameters and the result of wide types are converted by the call,
+  // the inlined expression would keep the type of the argument
+  if (parts.ret_type) {
+    const tea_val_type_t type = tea_decl_val_type(parts.ret_type);
+    if (type == TEA_V_I64 || type == TEA_V_F64) {
+      return NULL;
+    }
+  }
+
+  if (parts.params) {
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &parts.params->children)
+    {
+      const tea_node_t *param = tea_list_record(entry, tea_node_t, link);
+      const tea_val_type_t type = tea_decl_val_type(param);
+      if (type == TEA_V_I64 || type == TEA_V_F64) {
+        return NULL;
+      }
+    }
+  }
+
+  return expr;
+}
+
+static void tea_count_uses(const tea_node_t *node, const char *name,
+                           int *uses, bool *as_object)
+{
+  switch (node->type) {
+  case TEA_N_IDENT:
+    if (!strcmp(node->tok->buf, name)) {
+      (*uses)++;
+    }
+    break;
+  case TEA_N_FIELD_ACC:
+    if (!strcmp(node->field_acc.obj->tok->buf, name)) {
+      (*uses)++;
+      *as_object = true;
+    }
+    break;
+  case TEA_N_BINOP:
+    tea_count_uses(node->binop.lhs, name, uses, as_object);
+    tea_count_uses(node->binop.rhs, name, uses, as_object);
+    break;
+  default: {
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      tea_count_uses(child, name, uses, as_object);
+    }
+  } break;
+  }
+}
+
+// All the names are replaced at once, so an argument that mentions another
+// parameter name isn't substituted again
+static bool tea_substitute(tea_node_t *node, const tea_subst_t *subst)
+{
+  switch (node->type) {
+  case TEA_N_IDENT:
+    for (int i = 0; i < subst->count; i++) {
+      if (!strcmp(node->tok->buf, subst->names[i])) {
+        tea_node_t *value = tea_node_clone(subst->values[i]);
+        if (!value) {
+          return false;
+        }
+        tea_node_replace(node, value);
+        break;
+      }
+    }
+    return true;
+  case TEA_N_FIELD_ACC:
+    return tea_substitute(node->field_acc.obj, subst);
+  case TEA_N_BINOP:
+    return tea_substitute(node->binop.lhs, subst) &&
+           tea_substitute(node->binop.rhs, subst);
+  default: {
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      if (!tea_substitute(child, subst)) {
+        return false;
+      }
+    }
+  } break;
+  }
+
+  return true;
+}
+
+static bool tea_inline_call(tea_inliner_t *inl, tea_node_t *call)
+{
+  const tea_node_t *field_access = NULL;
+  const tea_node_t *args = NULL;
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &call->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    switch (child->type) {
+    case TEA_N_FIELD_ACC:
+      field_access = child;
+      break;
+    case TEA_N_FN_ARGS:
+      args = child;
+      break;
+    default:
+      break;
+    }
+  }
+
+  const char *owner = NULL;
+  const char *name = NULL;
+  const tea_node_t *receiver = NULL;
+  if (call->tok) {
+    name = call->tok->buf;
+  } else if (field_access) {
+    receiver = field_access->field_acc.obj;
+    if (!receiver || receiver->type != TEA_N_IDENT) {
+      return false;
+    }
+    owner = tea_lookup_type(inl, receiver->tok->buf);
+    if (!owner || !tea_is_struct_declared(inl, owner)) {
+      return false;
+    }
+    name = field_access->field_acc.field->tok->buf;
+  } else {
+    return false;
+  }
+
+  // Native functions take precedence over the declared ones
+  if (tea_ctx_find_native_fn(&inl->program->native_funcs, owner, name)) {
+    return false;
+  }
+
+  const tea_node_t *fn = tea_find_fn_node(inl, owner, name);
+  if (!fn) {
+    return false;
+  }
+
+  const tea_node_t *expr = tea_inline_body(fn);
+  if (!expr) {
+    return false;
+  }
+
+  tea_fn_parts_t parts;
+  tea_get_fn_parts(fn, &parts);
+
+  tea_subst_t subst;
+  subst.count = 0;
+
+  const tea_list_entry_t *param_entry =
+    parts.params ? tea_list_first(&parts.params->children) : NULL;
+  const tea_list_entry_t *arg_entry =
+    args ? tea_list_first(&args->children) : NULL;
+  while (param_entry || arg_entry) {
+    // The call fails when the number of arguments doesn't match
+    if (!param_entry || !arg_entry || subst.count == TEA_INLINE_MAX_ARGS) {
+      return false;
+    }
+
+    const tea_node_t *param = tea_list_record(param_entry, tea_node_t, link);
+    const tea_node_t *arg = tea_list_record(arg_entry, tea_node_t, link);
+
+    // Evaluating the argument in the body must not change the result, so
+    // there can be no calls in it
+    if (!tea_count_simple(arg)) {
+      return false;
+    }
+
+    int uses = 0;
+    bool as_object = false;
+    tea_count_uses(expr, param->tok->buf, &uses, &as_object);
+    if (as_object && arg->type != TEA_N_IDENT) {
+      return false;
+    }
+    if (uses > 1 && !tea_is_trivial(arg)) {
+      return false;
+    }
+    // The call evaluates every argument once, even the unused ones, only
+    // a literal can be dropped without losing an error
+    if (!uses && !tea_is_literal(arg)) {
+      return false;
+    }
+
+    subst.names[subst.count] = param->tok->buf;
+    subst.values[subst.count] = arg;
+    subst.count++;
+
+    param_entry = tea_list_next(param_entry, &parts.params->children);
+    arg_entry = tea_list_next(arg_entry, &args->children);
+  }
+
+  if (receiver) {
+    subst.names[subst.count] = "self";
+    subst.values[subst.count] = receiver;
+    subst.count++;
+  }
+
+  tea_node_t *inlined = tea_node_clone(expr);
+  if (!inlined) {
+    inl->failed = true;
+    return false;
+  }
+
+  if (!tea_substitute(inlined, &subst)) {
+    tea_node_free(inlined);
+    inl->failed = true;
+    return false;
+  }
+
+  if (call->tok) {
+    tea_log_dbg("Inline function '%s' at line %d", name, call->tok->line);
+  } else {
+    tea_log_dbg("Inline method '%s.%s' at line %d", owner, name,
+                field_access->field_acc.field->tok->line);
+  }
+
+  tea_node_replace(call, inlined);
+  inl->count++;
+
+  return true;
+}
+
+static void tea_inline_calls(tea_inliner_t *inl, tea_node_t *node)
+{
+  if (!node || inl->failed) {
+    return;
+  }
+
+  switch (node->type) {
+  case TEA_N_BINOP:
+  case TEA_N_ASSIGN:
+    tea_inline_calls(inl, node->binop.lhs);
+    tea_inline_calls(inl, node->binop.rhs);
+    return;
+  case TEA_N_FIELD_ACC:
+    tea_inline_calls(inl, node->field_acc.obj);
+    return;
+  default:
+    break;
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    tea_inline_calls(inl, child);
+  }
+
+  // The arguments go first, inlined they may allow inlining the call itself
+  if (node->type == TEA_N_FN_CALL) {
+    tea_inline_call(inl, node);
+  }
+}
+
+static void tea_inline_stmt(tea_inliner_t *inl, tea_node_t *node);
+
+static void tea_inline_block(tea_inliner_t *inl, const tea_node_t *node)
+{
+  tea_binding_t *bindings = inl->bindings;
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    tea_inline_stmt(inl, child);
+  }
+
+  tea_pop_bindings(inl, bindings);
+}
+
+static void tea_inline_let(tea_inliner_t *inl, tea_node_t *node)
+{
+  bool is_mutable = false;
+  const char *type = NULL;
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    switch (child->type) {
+    case TEA_N_MUT:
+      is_mutable = true;
+      break;
+    case TEA_N_TYPE_ANNOT:
+      break;
+    default:
+      tea_inline_calls(inl, child);
+      if (child->type == TEA_N_STRUCT_INST && child->tok) {
+        type = child->tok->buf;
+      }
+      break;
+    }
+  }
+
+  // A mutable variable can hold a different instance at the call
+  tea_push_binding(inl, node->tok->buf, is_mutable ? NULL : type);
+}
+
+static void tea_inline_stmt(tea_inliner_t *inl, tea_node_t *node)
+{
+  if (!node || inl->failed) {
+    return;
+  }
+
+  switch (node->type) {
+  case TEA_N_LET:
+    tea_inline_let(inl, node);
+    break;
+  case TEA_N_IF: {
+    // The first child is the condition, the branches follow
+    tea_binding_t *bindings = inl->bindings;
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      if (entry == tea_list_first(&node->children)) {
+        tea_inline_calls(inl, child);
+      } else {
+        tea_inline_stmt(inl, child);
+      }
+    }
+    tea_pop_bindings(inl, bindings);
+  } break;
+  case TEA_N_STMT:
+  case TEA_N_THEN:
+  case TEA_N_ELSE:
+  case TEA_N_WHILE:
+  case TEA_N_WHILE_BODY:
+  case TEA_N_FOR_BODY:
+    tea_inline_block(inl, node);
+    break;
+  case TEA_N_FOR: {
+    tea_binding_t *bindings = inl->bindings;
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      if (child->type == TEA_N_FOR_BODY) {
+        tea_push_binding(inl, node->tok->buf, NULL);
+        tea_inline_stmt(inl, child);
+      } else {
+        tea_inline_calls(inl, child);
+      }
+    }
+    tea_pop_bindings(inl, bindings);
+  } break;
+  case TEA_N_FN_CALL: {
+    // The result of a call statement is dropped, there is nothing to inline
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      tea_inline_calls(inl, child);
+    }
+  } break;
+  case TEA_N_FN:
+  case TEA_N_STRUCT:
+  case TEA_N_IMPORT:
+    break;
+  default:
+    // Conditions, assignments and return values
+    tea_inline_calls(inl, node);
+    break;
+  }
+}
+
+static bool tea_assigns_self(const tea_node_t *node)
+{
+  if (!node) {
+    return false;
+  }
+
+  switch (node->type) {
+  case TEA_N_ASSIGN:
+    return node->binop.lhs && node->binop.lhs->type == TEA_N_IDENT &&
+           !strcmp(node->binop.lhs->tok->buf, "self");
+  case TEA_N_BINOP:
+  case TEA_N_FIELD_ACC:
+    return false;
+  default:
+    break;
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    if (tea_assigns_self(child)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void tea_inline_fn(tea_inliner_t *inl, const tea_node_t *fn)
+{
+  tea_fn_parts_t parts;
+  tea_get_fn_parts(fn, &parts);
+  if (!parts.body) {
+    return;
+  }
+
+  // The scope of a call is the scope of the caller, only the variables
+  // declared in the function are known here
+  tea_binding_t *bindings = inl->bindings;
+  inl->bindings = NULL;
+
+  if (parts.owner && !tea_assigns_self(parts.body)) {
+    tea_push_binding(inl, "self", parts.owner->tok->buf);
+  }
+
+  tea_inline_block(inl, parts.body);
+
+  tea_pop_bindings(inl, NULL);
+  inl->bindings = bindings;
+}
+
+unsigned long tea_inline(tea_program_t *program)
+{
+  tea_node_t *prog = program->ast;
+  tea_inliner_t inl;
+  inl.program = program;
+  inl.prog = prog;
+  inl.site = NULL;
+  inl.bindings = NULL;
+  inl.count = 0;
+  inl.failed = false;
+
+  for (int pass = 0; pass < TEA_INLINE_MAX_PASSES && !inl.failed; pass++) {
+    const unsigned long count = inl.count;
+
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &prog->children)
+    {
+      tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      inl.site = child;
+      if (child->type == TEA_N_FN) {
+        tea_inline_fn(&inl, child);
+      } else {
+        tea_inline_stmt(&inl, child);
+      }
+    }
+
+    tea_pop_bindings(&inl, NULL);
+
+    if (inl.count == count) {
+      break;
+    }
+  }
+
+  tea_log_dbg("Inlined %lu call(s)", inl.count);
+
+  return inl.count;
+}
+
+typedef struct {
+  // Declares the functions met so far and evaluates the calls
+  tea_program_t sandbox_prog;
+  tea_ctx_t sandbox;
+  tea_lexer_t *lex;
+  unsigned long count;
+} tea_folder_t;
+
+static bool tea_is_const_arg(const tea_node_t *node)
+{
+  switch (node->type) {
+  case TEA_N_INT:
+  case TEA_N_FLOAT:
+  case TEA_N_NULL:
+    return true;
+  case TEA_N_UNARY: {
+    if (node->tok->type != TEA_TOKEN_MINUS) {
+      return false;
+    }
+    const tea_list_entry_t *entry = tea_list_first(&node->children);
+    const tea_node_t *operand = tea_list_record(entry, tea_node_t, link);
+    return operand->type == TEA_N_INT || operand->type == TEA_N_FLOAT;
+  }
+  default:
+    return false;
+  }
+}
+
+// Creates the literal node of a value, the literal evaluates to the same
+// value and type
+static tea_node_t *tea_fold_literal(const tea_folder_t *folder,
+                                    const tea_val_t *value,
+                                    const tea_tok_t *origin)
+{
+  int token_type;
+  int64_t int_value = 0;
+  double float_value = 0.0;
+
+  switch (value->type) {
+  case TEA_V_NULL:
+    return tea_node_create(TEA_N_NULL, NULL);
+  case TEA_V_I32:
+    token_type = TEA_TOKEN_INTEGER_NUMBER;
+    int_value = value->i32;
+    break;
+  case TEA_V_I64:
+    token_type = TEA_TOKEN_I64_NUMBER;
+    int_value = value->i64;
+    break;
+  case TEA_V_F32:
+    token_type = TEA_TOKEN_FLOAT_NUMBER;
+    float_value = value->f32;
+    break;
+  case TEA_V_F64:
+    token_type = TEA_TOKEN_F64_NUMBER;
+    float_value = value->f64;
+    break;
+  default:
+    return NULL;
+  }
+
+  const bool is_float =
+    token_type == TEA_TOKEN_FLOAT_NUMBER || token_type == TEA_TOKEN_F64_NUMBER;
+  tea_tok_t *token =
+    is_float ? tea_lexer_add_tok(folder->lex, token_type,
+                                 (const char *)&float_value,
+                                 sizeof(float_value), origin)
+             : tea_lexer_add_tok(folder->lex, token_type,
+                                 (const char *)&int_value, sizeof(int_value),
+                                 origin);
+  if (!token) {
+    return NULL;
+  }
+
+  return tea_node_create(is_float ? TEA_N_FLOAT : TEA_N_INT, token);
+}
+
+static void tea_fold_call(tea_folder_t *folder, tea_node_t *call)
+{
+  const tea_tok_t *name = call->tok;
+  if (!name) {
+    // Methods need an instance, which is an allocation
+    return;
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &call->children)
+  {
+    const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    if (child->type != TEA_N_FN_ARGS) {
+      continue;
+    }
+
+    tea_list_entry_t *arg_entry;
+    tea_list_for_each(arg_entry, &child->children)
+    {
+      const tea_node_t *arg = tea_list_record(arg_entry, tea_node_t, link);
+      if (!tea_is_const_arg(arg)) {
+        return;
+      }
+    }
+  }
+
+  tea_ctx_t *sandbox = &folder->sandbox;
+  if (tea_ctx_find_native_fn(&folder->sandbox_prog.native_funcs, NULL,
+                             name->buf)) {
+    return;
+  }
+
+  const tea_fn_t *fn = tea_ctx_find_fn(&folder->sandbox_prog.funcs, name->buf);
+  if (!fn || !tea_is_pure_fn(sandbox, fn,
+                             TEA_PURE_QUIET | TEA_PURE_NO_NATIVES |
+                               TEA_PURE_NO_ALLOC)) {
+    return;
+  }
+
+  // The call may still fail or run too long, then it is left to fail or
+  // finish at run time
+  tea_scope_t scp;
+  tea_scope_init(&scp, NULL);
+  tea_ctx_set_budget(sandbox, TEA_FOLD_STEP_BUDGET);
+
+  tea_val_t result;
+  tea_log_muted++;
+  const bool is_ok = tea_call_fn(sandbox, &scp, call, &result);
+  tea_scope_cleanup(sandbox, &scp);
+  tea_log_muted--;
+
+  if (!is_ok) {
+    return;
+  }
+
+  tea_node_t *literal = tea_fold_literal(folder, &result, name);
+  if (!literal) {
+    return;
+  }
+
+  tea_log_dbg("Fold call of '%s' at line %d", name->buf, name->line);
+  tea_node_replace(call, literal);
+  folder->count++;
+}
+
+static void tea_fold_expr(tea_folder_t *folder, tea_node_t *node)
+{
+  if (!node) {
+    return;
+  }
+
+  switch (node->type) {
+  case TEA_N_BINOP:
+  case TEA_N_ASSIGN:
+    tea_fold_expr(folder, node->binop.lhs);
+    tea_fold_expr(folder, node->binop.rhs);
+    return;
+  case TEA_N_FIELD_ACC:
+    tea_fold_expr(folder, node->field_acc.obj);
+    return;
+  default:
+    break;
+  }
+
+  // Folded arguments can make the call itself constant
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    tea_fold_expr(folder, child);
+  }
+
+  if (node->type == TEA_N_FN_CALL) {
+    tea_fold_call(folder, node);
+  }
+}
+
+static void tea_fold_stmt(tea_folder_t *folder, tea_node_t *node)
+{
+  if (!node) {
+    return;
+  }
+
+  switch (node->type) {
+  case TEA_N_FN_CALL: {
+    // The result of a call statement is dropped, only the arguments count
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      tea_fold_expr(folder, child);
+    }
+  } break;
+  case TEA_N_IF: {
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      if (entry == tea_list_first(&node->children)) {
+        tea_fold_expr(folder, child);
+      } else {
+        tea_fold_stmt(folder, child);
+      }
+    }
+  } break;
+  case TEA_N_STMT:
+  case TEA_N_THEN:
+  case TEA_N_ELSE:
+  case TEA_N_WHILE:
+  case TEA_N_WHILE_BODY:
+  case TEA_N_FOR:
+  case TEA_N_FOR_BODY: {
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &node->children)
+    {
+      tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+      tea_fold_stmt(folder, child);
+    }
+  } break;
+  case TEA_N_FN:
+  case TEA_N_STRUCT:
+  case TEA_N_IMPORT:
+    break;
+  default:
+    tea_fold_expr(folder, node);
+    break;
+  }
+}
+
+static bool tea_is_method(const tea_node_t *fn)
+{
+  tea_fn_parts_t parts;
+  tea_get_fn_parts(fn, &parts);
+  return parts.owner != NULL;
+}
+
+unsigned long tea_fold_calls(tea_program_t *program, const int max_depth)
+{
+  tea_node_t *prog = program->ast;
+  tea_folder_t folder;
+  folder.lex = &program->lexer;
+  folder.count = 0;
+
+  tea_program_init(&folder.sandbox_prog, program->file_name);
+  tea_interp_init(&folder.sandbox, &folder.sandbox_prog);
+  folder.sandbox.max_depth = max_depth;
+
+  // Natives take precedence over the declared functions in the sandbox too,
+  // but they are never called there
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &program->native_funcs)
+  {
+    const tea_native_fn_t *native_func =
+      tea_list_record(entry, tea_native_fn_t, link);
+    tea_bind_native_fn(&folder.sandbox_prog, native_func->owner_name,
+                       native_func->fn_name, native_func->cb);
+  }
+
+  // A call can only be folded after its function is declared, so the
+  // program is walked in the order it runs
+  tea_list_for_each(entry, &prog->children)
+  {
+    tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    if (child->type != TEA_N_FN) {
+      tea_fold_stmt(&folder, child);
+      continue;
+    }
+
+    if (tea_is_method(child)) {
+      continue;
+    }
+
+    tea_log_muted++;
+    const bool is_declared = tea_decl_fn(&folder.sandbox_prog, child, NULL);
+    tea_log_muted--;
+
+    tea_fn_parts_t parts;
+    tea_get_fn_parts(child, &parts);
+    if (is_declared && parts.body) {
+      tea_fold_stmt(&folder, (tea_node_t *)parts.body);
+    }
+  }
+
+  tea_log_muted++;
+  tea_interp_cleanup(&folder.sandbox);
+  tea_program_cleanup(&folder.sandbox_prog);
+  tea_log_muted--;
+
+  tea_log_dbg("Folded %lu call(s)", folder.count);
+
+  return folder.count;
+}
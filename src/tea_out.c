@@ -0,0 +1,204 @@
+#include "tea_out.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "tea_dict.h"
+#include "tea_lines.h"
+
+#include "tea_log.h"
+#include "tea_memory.h"
+
+void tea_out_init(tea_out_t *out, FILE *file, const tea_out_mode_t mode)
+{
+  out->file = file;
+  out->mode = mode;
+  out->precision = TEA_FMT_SHORTEST;
+  out->data = NULL;
+  out->size = 0;
+  out->capacity = 0;
+}
+
+void tea_out_cleanup(tea_out_t *out)
+{
+  tea_out_flush(out);
+  tea_free(out->data);
+  out->data = NULL;
+  out->capacity = 0;
+}
+
+tea_out_mode_t tea_out_default_mode(FILE *file)
+{
+#ifdef _WIN32
+  const bool is_terminal = _isatty(_fileno(file));
+#else
+  const bool is_terminal = isatty(fileno(file));
+#endif
+
+  return is_terminal ? TEA_OUT_LINE : TEA_OUT_FULL;
+}
+
+static bool tea_out_drain(tea_out_t *out)
+{
+  const size_t size = out->size;
+  out->size = 0;
+  return size == 0 || fwrite(out->data, 1, size, out->file) == size;
+}
+
+bool tea_out_flush(tea_out_t *out)
+{
+  const bool is_ok = tea_out_drain(out);
+  return fflush(out->file) == 0 && is_ok;
+}
+
+void tea_log_flush_out(FILE *file)
+{
+  tea_out_t *out = tea_log_out;
+  if (out->file != file || out->size == 0) {
+    return;
+  }
+
+  // Not again for a message the write itself may log
+  tea_log_out = NULL;
+  tea_out_flush(out);
+  tea_log_out = out;
+}
+
+bool tea_out_set_file(tea_out_t *out, FILE *file)
+{
+  const bool is_ok = tea_out_flush(out);
+  out->file = file;
+  return is_ok;
+}
+
+// Makes room for size more bytes, by writing the buffer to the stream or by
+// growing it in exit mode
+static bool tea_out_reserve(tea_out_t *out, const size_t size)
+{
+  if (!out->data) {
+    out->data = tea_malloc(TEA_OUT_SIZE);
+    if (!out->data) {
+      tea_log_err("Memory error: Failed to allocate the output buffer");
+      return false;
+    }
+    out->capacity = TEA_OUT_SIZE;
+  }
+
+  if (out->mode != TEA_OUT_EXIT) {
+    return tea_out_drain(out);
+  }
+
+  size_t capacity = out->capacity;
+  while (capacity - out->size < size) {
+    capacity *= 2;
+  }
+  char *data = tea_malloc(capacity);
+  if (!data) {
+    // Keep what fits, the rest goes to the stream
+    return tea_out_drain(out);
+  }
+  memcpy(data, out->data, out->size);
+  tea_free(out->data);
+  out->data = data;
+  out->capacity = capacity;
+  return true;
+}
+
+bool tea_out_write(tea_out_t *out, const char *data, const size_t size)
+{
+  if (out->capacity - out->size < size) {
+    if (!tea_out_reserve(out, size)) {
+      return false;
+    }
+    if (out->capacity - out->size < size) {
+      // Larger than the buffer, it goes to the stream as it is
+      return fwrite(data, 1, size, out->file) == size;
+    }
+  }
+
+  memcpy(out->data + out->size, data, size);
+  out->size += size;
+  if (out->mode == TEA_OUT_LINE && memchr(data, '\n', size)) {
+    return tea_out_flush(out);
+  }
+  return true;
+}
+
+bool tea_out_str(tea_out_t *out, const char *str)
+{
+  return tea_out_write(out, str, strlen(str));
+}
+
+bool tea_out_i64(tea_out_t *out, const long long value)
+{
+  char text[TEA_FMT_SIZE];
+  return tea_out_write(out, text, tea_fmt_i64(text, value));
+}
+
+bool tea_out_f64(tea_out_t *out, const double value)
+{
+  char text[TEA_FMT_SIZE];
+  return tea_out_write(out, text, tea_fmt_f64(text, value, out->precision));
+}
+
+bool tea_out_f32(tea_out_t *out, const float value)
+{
+  char text[TEA_FMT_SIZE];
+  return tea_out_write(out, text, tea_fmt_f32(text, value, out->precision));
+}
+
+bool tea_out_val(tea_out_t *out, const tea_val_t *value)
+{
+  switch (value->type) {
+  case TEA_V_NULL:
+    return tea_out_write(out, "null", 4);
+  case TEA_V_I32:
+    return tea_out_i64(out, value->i32);
+  case TEA_V_I64:
+    return tea_out_i64(out, value->i64);
+  case TEA_V_F32:
+    return tea_out_f32(out, value->f32);
+  case TEA_V_F64:
+    return tea_out_f64(out, value->f64);
+  case TEA_V_INST:
+    if (!strcmp(value->obj->type, "string")) {
+      return tea_out_str(out, (const char *)value->obj->buf);
+    }
+    if (!strcmp(value->obj->type, TEA_VIEW_TYPE)) {
+      const tea_view_t *view = (const tea_view_t *)value->obj->buf;
+      return tea_out_write(out, view->data, value->obj->size);
+    }
+    return true;
+  case TEA_V_DICT: {
+    // Entries are printed in insertion order
+    unsigned long it = 0;
+    bool is_ok = tea_out_write(out, "{", 1);
+    for (bool is_first = true;; is_first = false) {
+      const tea_dict_entry_t *entry = tea_dict_next(value->dict, &it);
+      if (!entry) {
+        break;
+      }
+      if (!is_first) {
+        is_ok = tea_out_write(out, ", ", 2) && is_ok;
+      }
+      if (entry->key.type == TEA_KEY_INT) {
+        is_ok = tea_out_i64(out, entry->key.i64) && is_ok;
+      } else {
+        is_ok = tea_out_str(out, entry->key.str) && is_ok;
+      }
+      is_ok = tea_out_write(out, ": ", 2) && is_ok;
+      is_ok = tea_out_val(out, &entry->val) && is_ok;
+    }
+    return tea_out_write(out, "}", 1) && is_ok;
+  }
+  case TEA_V_UNDEF:
+    break;
+  }
+
+  return true;
+}
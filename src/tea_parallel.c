@@ -0,0 +1,335 @@
+#include "tea_parallel.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tea_dict.h"
+#include "tea_fn.h"
+#include "tea_interp.h"
+#include "tea_module.h"
+#include "tea_pool.h"
+#include "tea_thread.h"
+
+#include "tea_log.h"
+#include "tea_memory.h"
+
+// Set before any program runs, read by the natives
+static int tea_parallel_workers = 0;
+
+typedef struct {
+  const tea_fn_t *fn;
+  const tea_fn_t *combine; // NULL for parallel_for
+  tea_val_type_t index_type;
+  int64_t start;
+  long count;
+  long chunk_size;
+  tea_ctx_t *ctxs;
+  tea_scope_t *scps;
+  // The result of each item for parallel_for, of each chunk for
+  // parallel_reduce
+  tea_val_t *results;
+} tea_parallel_job_t;
+
+void tea_parallel_set_workers(const int count)
+{
+  tea_parallel_workers = count > 0 ? count : 0;
+}
+
+static const tea_fn_t *tea_parallel_find_fn(const tea_ctx_t *ctx,
+                                            const char *native_name,
+                                            const tea_val_t *name)
+{
+  if (name->type != TEA_V_INST || strcmp(name->obj->type, "string") != 0) {
+    tea_log_err("Runtime error: '%s' expects a function name as a string",
+                native_name);
+    return NULL;
+  }
+
+  const char *fn_name = name->obj->buf;
+  const tea_fn_t *fn = tea_ctx_find_fn(&ctx->prog->funcs, fn_name);
+  if (!fn || !tea_ctx_sees(ctx, fn)) {
+    tea_log_err("Runtime error: Function '%s' passed to '%s' not found",
+                fn_name, native_name);
+    return NULL;
+  }
+
+  if (fn->mut) {
+    tea_log_err(
+      "Runtime error: Mutable function '%s' cannot be called by '%s'",
+      fn_name, native_name);
+    return NULL;
+  }
+
+  return fn;
+}
+
+// Reads the bounds of the range, the indices are i64 if one of the bounds
+// is, as for the loops over a range
+static bool tea_parallel_range(const char *native_name, const tea_val_t *args,
+                               tea_parallel_job_t *job)
+{
+  int64_t bounds[2];
+  job->index_type = TEA_V_I32;
+  for (int i = 0; i < 2; i++) {
+    if (args[i].type == TEA_V_I32) {
+      bounds[i] = args[i].i32;
+    } else if (args[i].type == TEA_V_I64) {
+      bounds[i] = args[i].i64;
+      job->index_type = TEA_V_I64;
+    } else {
+      tea_log_err("Runtime error: '%s' expects integer bounds, got %s",
+                  native_name, tea_val_type_str(args[i].type));
+      return false;
+    }
+  }
+
+  // The difference of the bounds may not fit i64, it always fits unsigned
+  const uint64_t count =
+    bounds[1] > bounds[0] ? (uint64_t)bounds[1] - (uint64_t)bounds[0] : 0;
+  if (count > TEA_PARALLEL_MAX_ITEMS ||
+      count > SIZE_MAX / sizeof(*job->results)) {
+    tea_log_err(
+      "Runtime error: '%s' range of %llu items is larger than the maximum of %ld",
+      native_name, (unsigned long long)count, TEA_PARALLEL_MAX_ITEMS);
+    return false;
+  }
+
+  job->start = bounds[0];
+  job->count = (long)count;
+  job->chunk_size =
+    (job->count + TEA_PARALLEL_CHUNKS - 1) / TEA_PARALLEL_CHUNKS;
+  return true;
+}
+
+static bool tea_parallel_call(tea_ctx_t *ctx, tea_scope_t *scp,
+                              const tea_fn_t *fn, const tea_val_t *args,
+                              const int argc, tea_val_t *result)
+{
+  if (!tea_call_fn_vals(ctx, scp, fn, args, argc, result)) {
+    return false;
+  }
+
+  if (result->type == TEA_V_UNDEF) {
+    tea_log_err("Runtime error: Function '%s' returned no value",
+                fn->name->buf);
+    return false;
+  }
+
+  return true;
+}
+
+static bool tea_parallel_run_chunk(const tea_parallel_job_t *job,
+                                   const int worker, const long chunk)
+{
+  tea_ctx_t *ctx = &job->ctxs[worker];
+  tea_scope_t *scp = &job->scps[worker];
+
+  const long first = chunk * job->chunk_size;
+  long last = first + job->chunk_size;
+  if (last > job->count) {
+    last = job->count;
+  }
+
+  tea_val_t acc = tea_val_undef();
+  for (long i = first; i < last; i++) {
+    tea_val_t index;
+    index.type = job->index_type;
+    if (index.type == TEA_V_I64) {
+      index.i64 = job->start + i;
+    } else {
+      index.i32 = (int32_t)(job->start + i);
+    }
+
+    tea_val_t value;
+    if (!job->combine) {
+      // Functions without a result leave no entry
+      if (!tea_call_fn_vals(ctx, scp, job->fn, &index, 1, &value)) {
+        return false;
+      }
+      job->results[i] = value;
+      continue;
+    }
+
+    if (!tea_parallel_call(ctx, scp, job->fn, &index, 1, &value)) {
+      return false;
+    }
+
+    if (i == first) {
+      acc = value;
+    } else {
+      const tea_val_t pair[2] = { acc, value };
+      if (!tea_parallel_call(ctx, scp, job->combine, pair, 2, &acc)) {
+        return false;
+      }
+    }
+  }
+
+  if (job->combine) {
+    job->results[chunk] = acc;
+  }
+
+  return true;
+}
+
+static bool tea_parallel_chunk(void *data, const int worker, const long chunk)
+{
+  const tea_parallel_job_t *job = data;
+  struct tea_out_t *const log_out = tea_log_out;
+  tea_log_out = &job->ctxs[worker].out;
+  const bool is_ok = tea_parallel_run_chunk(job, worker, chunk);
+  tea_log_out = log_out;
+  return is_ok;
+}
+
+// Runs the chunks of the job on the workers, each in a context of its own
+static bool tea_parallel_run(tea_ctx_t *ctx, tea_parallel_job_t *job)
+{
+  if (job->count == 0) {
+    return true;
+  }
+
+  const long chunk_count = (job->count + job->chunk_size - 1) / job->chunk_size;
+  int worker_count =
+    tea_parallel_workers ? tea_parallel_workers : tea_cpu_count();
+  if (worker_count > TEA_POOL_MAX_WORKERS) {
+    worker_count = TEA_POOL_MAX_WORKERS;
+  }
+  if (worker_count > chunk_count) {
+    worker_count = (int)chunk_count;
+  }
+
+  const long result_count = job->combine ? chunk_count : job->count;
+  job->results = tea_malloc(result_count * sizeof(*job->results));
+  job->ctxs = tea_malloc(worker_count * sizeof(*job->ctxs));
+  job->scps = tea_malloc(worker_count * sizeof(*job->scps));
+  if (!job->results || !job->ctxs || !job->scps) {
+    tea_log_err("Memory error: Failed to allocate %d parallel workers",
+                worker_count);
+    tea_free(job->results);
+    tea_free(job->ctxs);
+    tea_free(job->scps);
+    return false;
+  }
+
+  // The workers print after what the caller printed so far, each one when
+  // its buffer fills or the job ends
+  tea_out_flush(&ctx->out);
+  bool is_ok = true;
+  for (int i = 0; i < worker_count; i++) {
+    tea_interp_init(&job->ctxs[i], ctx->prog);
+    job->ctxs[i].max_depth = ctx->max_depth;
+    job->ctxs[i].declared = ctx->declared;
+    tea_out_init(&job->ctxs[i].out, ctx->out.file, ctx->out.mode);
+    job->ctxs[i].out.precision = ctx->out.precision;
+    tea_scope_init(&job->scps[i], NULL);
+    // Module functions called by the workers see the module variables
+    is_ok = is_ok && tea_module_scopes_copy(&job->ctxs[i], ctx);
+  }
+
+  is_ok = is_ok &&
+          tea_pool_run(worker_count, chunk_count, tea_parallel_chunk, job);
+
+  for (int i = 0; i < worker_count; i++) {
+    tea_scope_cleanup(&job->ctxs[i], &job->scps[i]);
+    tea_interp_cleanup(&job->ctxs[i]);
+  }
+  tea_free(job->ctxs);
+  tea_free(job->scps);
+
+  if (!is_ok) {
+    tea_free(job->results);
+    job->results = NULL;
+  }
+
+  return is_ok;
+}
+
+static tea_val_t tea_parallel_for(tea_ctx_t *ctx, const tea_val_t *args,
+                                  const int argc)
+{
+  (void)argc;
+  tea_parallel_job_t job;
+  job.combine = NULL;
+  job.results = NULL;
+  job.fn = tea_parallel_find_fn(ctx, "parallel_for", &args[2]);
+  if (!job.fn || !tea_parallel_range("parallel_for", args, &job)) {
+    return tea_val_undef();
+  }
+
+  tea_dict_t *dict = tea_dict_create(job.count);
+  if (!dict) {
+    tea_log_err("Memory error: Failed to allocate the results of %ld items",
+                job.count);
+    return tea_val_undef();
+  }
+
+  if (!tea_parallel_run(ctx, &job)) {
+    tea_dict_free(dict);
+    return tea_val_undef();
+  }
+
+  // The results are merged in the order of the indices, whichever worker
+  // computed them
+  for (long i = 0; i < job.count; i++) {
+    if (job.results[i].type == TEA_V_UNDEF) {
+      continue;
+    }
+    const tea_dict_key_t key = tea_dict_key_int(job.start + i);
+    if (!tea_dict_set(dict, &key, job.results[i])) {
+      tea_log_err("Memory error: Failed to store the result of item %ld", i);
+      tea_free(job.results);
+      tea_dict_free(dict);
+      return tea_val_undef();
+    }
+  }
+  tea_free(job.results);
+
+  const tea_val_t result = { .type = TEA_V_DICT, .dict = dict };
+  return result;
+}
+
+static tea_val_t tea_parallel_reduce(tea_ctx_t *ctx, const tea_val_t *args,
+                                     const int argc)
+{
+  (void)argc;
+  tea_parallel_job_t job;
+  job.results = NULL;
+  job.fn = tea_parallel_find_fn(ctx, "parallel_reduce", &args[2]);
+  job.combine = tea_parallel_find_fn(ctx, "parallel_reduce", &args[3]);
+  if (!job.fn || !job.combine ||
+      !tea_parallel_range("parallel_reduce", args, &job)) {
+    return tea_val_undef();
+  }
+
+  if (!tea_parallel_run(ctx, &job)) {
+    return tea_val_undef();
+  }
+
+  // The chunks are fixed by the range, so folding them in order gives the
+  // same result for any number of workers
+  tea_val_t acc = args[4];
+  const long chunk_count =
+    job.count ? (job.count + job.chunk_size - 1) / job.chunk_size : 0;
+  tea_scope_t scope;
+  tea_scope_init(&scope, NULL);
+  for (long i = 0; i < chunk_count; i++) {
+    const tea_val_t pair[2] = { acc, job.results[i] };
+    if (!tea_parallel_call(ctx, &scope, job.combine, pair, 2, &acc)) {
+      acc = tea_val_undef();
+      break;
+    }
+  }
+  tea_scope_cleanup(ctx, &scope);
+  tea_free(job.results);
+
+  return acc;
+}
+
+void tea_bind_parallel(tea_program_t *prog)
+{
+  tea_bind_native_sig(prog, NULL, "parallel_for", "dict (any, any, string)",
+                      tea_parallel_for);
+  tea_bind_native_sig(prog, NULL, "parallel_reduce",
+                      "any (any, any, string, string, any)",
+                      tea_parallel_reduce);
+}
@@ -0,0 +1,267 @@
+#include "tea_pool.h"
+
+#include "tea_thread.h"
+
+#include <stdint.h>
+
+#include "tea_log.h"
+
+/**
+ * @internal
+ * @brief Chunks [next, end) not taken yet, packed into one word so the
+ *        owner can take from the front and the thieves from the back with a
+ *        compare and swap. Padded to a cache line of its own.
+ */
+typedef struct {
+  volatile int64_t range; // end in the high half, next in the low half
+  char pad[64 - sizeof(int64_t)];
+} tea_pool_queue_t;
+
+typedef struct {
+  tea_pool_queue_t *queues;
+  int worker_count;
+  tea_pool_task_fn_t fn;
+  void *data;
+  FILE *log_file; // tea_log_file of the caller, the workers log there too
+  volatile long failed;
+} tea_pool_job_t;
+
+/**
+ * @internal
+ * @brief Workers of the process, started by the first run that needs them
+ *        and parked on the condition between runs.
+ */
+static struct {
+  tea_mutex_t lock;
+  tea_cond_t wake; // parked workers wait for the next job
+  tea_cond_t done; // the running job waits for its workers
+  tea_thread_t threads[TEA_POOL_MAX_WORKERS]; // 0 is the calling thread
+  unsigned long seen[TEA_POOL_MAX_WORKERS]; // last job of a new worker
+  int started; // workers [1, started] are running
+  unsigned long generation; // number of jobs handed out
+  tea_pool_job_t *job;
+  int active; // workers still on the job
+  bool busy;
+  bool stopping;
+} tea_pool;
+
+static int64_t tea_pool_range(const long next, const long end)
+{
+  return (int64_t)(((uint64_t)end << 32) | (uint32_t)next);
+}
+
+static bool tea_pool_take(tea_pool_queue_t *queue, const bool from_back,
+                          long *chunk)
+{
+  int64_t range = tea_atomic_load_i64(&queue->range);
+  for (;;) {
+    const long next = (long)(uint32_t)range;
+    const long end = (long)((uint64_t)range >> 32);
+    if (next >= end) {
+      return false;
+    }
+
+    const int64_t rest = from_back ? tea_pool_range(next, end - 1)
+                                   : tea_pool_range(next + 1, end);
+    if (tea_atomic_cas_i64(&queue->range, range, rest)) {
+      *chunk = from_back ? end - 1 : next;
+      return true;
+    }
+    range = tea_atomic_load_i64(&queue->range);
+  }
+}
+
+static void tea_pool_work(tea_pool_job_t *job, const int index)
+{
+  for (;;) {
+    long chunk;
+    bool is_taken = tea_pool_take(&job->queues[index], false, &chunk);
+
+    // No chunks are added while the job runs, so a worker that finds all
+    // the queues empty is done
+    for (int i = 1; !is_taken && i < job->worker_count; i++) {
+      const int victim = (index + i) % job->worker_count;
+      is_taken = tea_pool_take(&job->queues[victim], true, &chunk);
+    }
+
+    if (!is_taken || tea_atomic_load_long(&job->failed)) {
+      return;
+    }
+
+    if (!job->fn(job->data, index, chunk)) {
+      tea_atomic_store_long(&job->failed, 1);
+      return;
+    }
+  }
+}
+
+static void tea_pool_worker_main(void *arg)
+{
+  const int index = (int)(intptr_t)arg;
+
+  tea_mutex_lock(&tea_pool.lock);
+  unsigned long seen = tea_pool.seen[index];
+  for (;;) {
+    while (!tea_pool.stopping && tea_pool.generation == seen) {
+      tea_cond_wait(&tea_pool.wake, &tea_pool.lock);
+    }
+    if (tea_pool.stopping) {
+      break;
+    }
+
+    seen = tea_pool.generation;
+    tea_pool_job_t *job = tea_pool.job;
+    if (index >= job->worker_count) {
+      continue;
+    }
+
+    tea_mutex_unlock(&tea_pool.lock);
+    tea_log_file = job->log_file;
+    tea_pool_work(job, index);
+    tea_mutex_lock(&tea_pool.lock);
+
+    if (--tea_pool.active == 0) {
+      tea_cond_signal(&tea_pool.done);
+    }
+  }
+  tea_mutex_unlock(&tea_pool.lock);
+}
+
+#ifndef _WIN32
+// The threads are not copied into a forked child, it starts its own
+static void tea_pool_after_fork(void)
+{
+  tea_mutex_init(&tea_pool.lock);
+  tea_cond_init(&tea_pool.wake);
+  tea_cond_init(&tea_pool.done);
+  tea_pool.started = 0;
+  tea_pool.job = NULL;
+  tea_pool.active = 0;
+  tea_pool.busy = false;
+}
+#endif
+
+void tea_pool_init(void)
+{
+  tea_mutex_init(&tea_pool.lock);
+  tea_cond_init(&tea_pool.wake);
+  tea_cond_init(&tea_pool.done);
+  tea_pool.started = 0;
+  tea_pool.generation = 0;
+  tea_pool.job = NULL;
+  tea_pool.active = 0;
+  tea_pool.busy = false;
+  tea_pool.stopping = false;
+
+#ifndef _WIN32
+  static bool is_registered = false;
+  if (!is_registered) {
+    pthread_atfork(NULL, NULL, tea_pool_after_fork);
+    is_registered = true;
+  }
+#endif
+}
+
+void tea_pool_cleanup(void)
+{
+  tea_mutex_lock(&tea_pool.lock);
+  tea_pool.stopping = true;
+  tea_cond_broadcast(&tea_pool.wake);
+  tea_mutex_unlock(&tea_pool.lock);
+
+  for (int i = 1; i <= tea_pool.started; i++) {
+    tea_thread_join(&tea_pool.threads[i]);
+  }
+  tea_pool.started = 0;
+
+  tea_cond_destroy(&tea_pool.done);
+  tea_cond_destroy(&tea_pool.wake);
+  tea_mutex_destroy(&tea_pool.lock);
+}
+
+bool tea_pool_run(int worker_count, const long chunk_count,
+                  const tea_pool_task_fn_t fn, void *data)
+{
+  if (chunk_count <= 0) {
+    return true;
+  }
+  if (chunk_count > TEA_POOL_MAX_CHUNKS) {
+    tea_log_err("Runtime error: %ld chunks are more than a pool can run",
+                chunk_count);
+    return false;
+  }
+
+  if (worker_count > TEA_POOL_MAX_WORKERS) {
+    worker_count = TEA_POOL_MAX_WORKERS;
+  }
+  if (worker_count > chunk_count) {
+    worker_count = (int)chunk_count;
+  }
+  if (worker_count < 1) {
+    worker_count = 1;
+  }
+
+  tea_pool_queue_t queues[TEA_POOL_MAX_WORKERS];
+  tea_pool_job_t job;
+  job.queues = queues;
+  job.fn = fn;
+  job.data = data;
+  job.log_file = tea_log_file;
+  job.failed = 0;
+
+  // A job started while another one has the workers, for example by one
+  // of its chunks, runs on the calling thread alone
+  bool has_workers = false;
+  if (worker_count > 1) {
+    tea_mutex_lock(&tea_pool.lock);
+    has_workers = !tea_pool.busy;
+    if (has_workers) {
+      tea_pool.busy = true;
+      while (tea_pool.started < worker_count - 1) {
+        const int index = tea_pool.started + 1;
+        tea_pool.seen[index] = tea_pool.generation;
+        if (!tea_thread_start(&tea_pool.threads[index], tea_pool_worker_main,
+                              (void *)(intptr_t)index)) {
+          tea_log_wrn("Failed to start pool worker %d", index);
+          break;
+        }
+        tea_pool.started = index;
+      }
+      if (worker_count > tea_pool.started + 1) {
+        worker_count = tea_pool.started + 1;
+      }
+    } else {
+      tea_mutex_unlock(&tea_pool.lock);
+      worker_count = 1;
+    }
+  }
+
+  job.worker_count = worker_count;
+  for (int i = 0; i < worker_count; i++) {
+    const int64_t next = (int64_t)chunk_count * i / worker_count;
+    const int64_t end = (int64_t)chunk_count * (i + 1) / worker_count;
+    queues[i].range = tea_pool_range((long)next, (long)end);
+  }
+
+  if (has_workers) {
+    tea_pool.job = &job;
+    tea_pool.active = worker_count - 1;
+    tea_pool.generation++;
+    tea_cond_broadcast(&tea_pool.wake);
+    tea_mutex_unlock(&tea_pool.lock);
+  }
+
+  tea_pool_work(&job, 0);
+
+  if (has_workers) {
+    tea_mutex_lock(&tea_pool.lock);
+    while (tea_pool.active > 0) {
+      tea_cond_wait(&tea_pool.done, &tea_pool.lock);
+    }
+    tea_pool.job = NULL;
+    tea_pool.busy = false;
+    tea_mutex_unlock(&tea_pool.lock);
+  }
+
+  return !job.failed;
+}
@@ -0,0 +1,141 @@
+#include "tea_program.h"
+
+#include "tea_dict.h"
+#include "tea_fn.h"
+#include "tea_module.h"
+#include "tea_parser.h"
+#include "tea_struct.h"
+
+#include "tea_log.h"
+#include "tea_memory.h"
+
+void tea_program_init(tea_program_t *prog, const char *file_name)
+{
+  prog->file_name = file_name;
+  tea_lexer_init(&prog->lexer);
+  prog->ast = NULL;
+  tea_list_init(&prog->funcs);
+  tea_list_init(&prog->native_funcs);
+  tea_list_init(&prog->structs);
+  tea_list_init(&prog->imports);
+  prog->slots = NULL;
+  prog->slot_count = 0;
+  prog->decl_order = 0;
+  prog->memo_count = 0;
+}
+
+bool tea_program_parse(tea_program_t *prog)
+{
+  prog->ast = tea_parse_file(&prog->lexer, prog->file_name);
+  return prog->ast != NULL;
+}
+
+bool tea_program_decl(tea_program_t *prog, const tea_node_t *ast,
+                      const char *ns)
+{
+  // Functions and types can only be declared at the top level
+  unsigned long order = 0;
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &ast->children)
+  {
+    const tea_node_t *node = tea_list_record(entry, tea_node_t, link);
+    if (node->type == TEA_N_FN || node->type == TEA_N_STRUCT) {
+      prog->decl_order = ns ? 0 : ++order;
+    }
+
+    bool is_declared = true;
+    if (node->type == TEA_N_FN) {
+      is_declared = tea_decl_fn(prog, node, ns);
+    } else if (node->type == TEA_N_STRUCT) {
+      is_declared = tea_decl_struct(prog, node, ns);
+    }
+    if (!is_declared) {
+      return false;
+    }
+  }
+
+  prog->decl_order = 0;
+
+  return true;
+}
+
+bool tea_program_load(tea_program_t *prog)
+{
+  // A file without statements has nothing to declare
+  if (!prog->ast) {
+    return true;
+  }
+
+  // Imported types and functions come first, so the file can use them
+  if (!tea_program_import(prog) ||
+      !tea_program_decl(prog, prog->ast, NULL)) {
+    return false;
+  }
+
+  // The calls of the program file are resolved, the modules are shared with
+  // other programs which may number the slots differently
+  tea_resolve_slots(prog, prog->ast);
+
+  tea_log_dbg("Loaded program '%s': %lu functions, %lu types, %lu slots",
+              prog->file_name, tea_list_length(&prog->funcs),
+              tea_list_length(&prog->structs), prog->slot_count);
+
+  return true;
+}
+
+void tea_program_cleanup(tea_program_t *prog)
+{
+  tea_list_entry_t *entry;
+  tea_list_entry_t *safe;
+
+  tea_list_for_each_safe(entry, safe, &prog->funcs)
+  {
+    tea_fn_t *function = tea_list_record(entry, tea_fn_t, link);
+    tea_list_remove(entry);
+    tea_free(function);
+  }
+
+  tea_list_for_each_safe(entry, safe, &prog->native_funcs)
+  {
+    tea_native_fn_t *function = tea_list_record(entry, tea_native_fn_t, link);
+    tea_list_remove(entry);
+    tea_free(function);
+  }
+
+  tea_list_for_each_safe(entry, safe, &prog->structs)
+  {
+    tea_struct_decl_t *struct_declaration =
+      tea_list_record(entry, tea_struct_decl_t, link);
+    tea_list_remove(entry);
+
+    tea_list_entry_t *function_entry;
+    tea_list_entry_t *function_entry_safe;
+    tea_list_for_each_safe(function_entry, function_entry_safe,
+                           &struct_declaration->funcs)
+    {
+      tea_fn_t *function = tea_list_record(function_entry, tea_fn_t, link);
+      tea_list_remove(function_entry);
+      tea_free(function);
+    }
+
+    tea_free(struct_declaration->methods);
+    tea_free(struct_declaration);
+  }
+
+  tea_list_for_each_safe(entry, safe, &prog->imports)
+  {
+    tea_import_t *import = tea_list_record(entry, tea_import_t, link);
+    tea_list_remove(entry);
+    tea_free(import);
+  }
+
+  tea_dict_free(prog->slots);
+  prog->slots = NULL;
+
+  if (prog->ast) {
+    tea_node_free(prog->ast);
+    prog->ast = NULL;
+  }
+
+  tea_lexer_cleanup(&prog->lexer);
+}
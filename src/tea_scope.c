@@ -36,6 +36,23 @@ void tea_free_var(tea_ctx_t *ctx, tea_var_t *variable)
 #endif
 }
 
+void tea_ctx_set_budget(tea_ctx_t *ctx, const long steps)
+{
+  ctx->is_budgeted = true;
+  ctx->step_budget = steps;
+}
+
+bool tea_ctx_use_step(tea_ctx_t *ctx)
+{
+  if (ctx->step_budget == 0) {
+    tea_log_err("Runtime error: Step budget exceeded");
+    return false;
+  }
+
+  ctx->step_budget--;
+  return true;
+}
+
 void tea_scope_init(tea_scope_t *scp, tea_scope_t *parent)
 {
   scp->parent = parent;
@@ -110,13 +127,10 @@ bool tea_decl_var(tea_ctx_t *ctx, tea_scope_t *scp, const char *name,
 
   variable->name = name;
   variable->flags = flags;
-  tea_val_t value = tea_eval_expr(ctx, scp, initial_value);
-  if (value.type == TEA_V_UNDEF) {
-    tea_free_var(ctx, variable);
-    return false;
-  }
+
+  tea_val_type_t predefined_type = TEA_V_UNDEF;
   if (type) {
-    const tea_val_type_t predefined_type = tea_val_type_by_str(type);
+    predefined_type = tea_val_type_by_str(type);
     if (predefined_type == TEA_V_UNDEF) {
       tea_log_err(
         "Runtime error: Unknown type '%s' specified in variable declaration",
@@ -124,6 +138,17 @@ bool tea_decl_var(tea_ctx_t *ctx, tea_scope_t *scp, const char *name,
       tea_free_var(ctx, variable);
       return false;
     }
+  }
+
+  tea_val_t value = type
+                      ? tea_eval_expr_as(ctx, scp, initial_value,
+                                         predefined_type)
+                      : tea_eval_expr(ctx, scp, initial_value);
+  if (value.type == TEA_V_UNDEF) {
+    tea_free_var(ctx, variable);
+    return false;
+  }
+  if (type) {
     if (value.type == TEA_V_NULL) {
       value.null_type = predefined_type;
     } else if (value.type != predefined_type) {
@@ -140,10 +165,19 @@ bool tea_decl_var(tea_ctx_t *ctx, tea_scope_t *scp, const char *name,
     tea_log_dbg("Declare variable %s : %s = %d", name,
                 tea_val_type_str(variable->val.type), variable->val.i32);
     break;
+  case TEA_V_I64:
+    tea_log_dbg("Declare variable %s : %s = %lld", name,
+                tea_val_type_str(variable->val.type),
+                (long long)variable->val.i64);
+    break;
   case TEA_V_F32:
     tea_log_dbg("Declare variable %s : %s = %f", name,
                 tea_val_type_str(variable->val.type), variable->val.f32);
     break;
+  case TEA_V_F64:
+    tea_log_dbg("Declare variable %s : %s = %f", name,
+                tea_val_type_str(variable->val.type), variable->val.f64);
+    break;
   case TEA_V_NULL:
     tea_log_dbg("Declare variable %s : %s = null", name,
                 tea_val_type_str(variable->val.type));
@@ -0,0 +1,1067 @@
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "tea_serve.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "tea_fn.h"
+#include "tea_interp.h"
+#include "tea_stmt.h"
+
+#include "tea_log.h"
+#include "tea_memory.h"
+
+#ifdef _WIN32
+
+int tea_serve(const tea_program_t *program, const tea_serve_options_t *options)
+{
+  (void)program;
+  (void)options;
+  tea_log_err("Error: Serving needs fork, which this platform doesn't have");
+  return 1;
+}
+
+#else
+
+// Clients connected at once, more are refused
+#ifndef TEA_SERVE_CLIENTS
+#define TEA_SERVE_CLIENTS 256
+#endif
+
+// Reply bytes a client may leave unread before its next requests wait
+#ifndef TEA_SERVE_PENDING
+#define TEA_SERVE_PENDING (1024 * 1024)
+#endif
+
+typedef enum {
+  TEA_CLIENT_FREE,
+  TEA_CLIENT_READING, // waiting for a full request line
+  TEA_CLIENT_QUEUED, // waiting for an idle worker
+  TEA_CLIENT_RUNNING,
+} tea_client_state_t;
+
+typedef struct {
+  int fd;
+  tea_client_state_t state;
+  unsigned long queued; // order of the request in the queue
+  long long start_us; // when the request line was complete
+  bool is_eof; // the client sends no more requests
+  bool is_broken; // the connection failed, nothing more is sent
+  char *out; // replies not sent yet, from out_sent to out_size
+  size_t out_sent;
+  size_t out_size;
+  size_t out_capacity;
+  size_t size; // bytes in the line buffer
+  char line[TEA_SERVE_LINE];
+} tea_serve_client_t;
+
+typedef struct {
+  pid_t pid;
+  int fd; // socket to the worker, -1 while there is no worker
+  int client; // client of the request in flight, -1 while idle
+  long handled;
+  long long deadline_us; // the worker is killed past it, 0 for none
+  char *reply; // reply read so far
+  size_t reply_size;
+  size_t reply_capacity;
+} tea_serve_worker_t;
+
+typedef struct {
+  const tea_program_t *program;
+  const tea_serve_options_t *options;
+  int listen_fd;
+  tea_serve_worker_t *workers;
+  tea_serve_client_t *clients;
+  unsigned long next_queued;
+  unsigned long requests;
+  unsigned long errors;
+  unsigned long timeouts;
+  unsigned long respawns;
+  long long max_us;
+  unsigned long buckets[TEA_SERVE_BUCKETS];
+} tea_server_t;
+
+static volatile sig_atomic_t tea_serve_stop = 0;
+
+static void tea_serve_on_signal(const int signal)
+{
+  (void)signal;
+  tea_serve_stop = 1;
+}
+
+static long long tea_serve_now_us(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static bool tea_serve_write(const int fd, const char *data, size_t size)
+{
+  while (size > 0) {
+    const ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= (size_t)written;
+  }
+
+  return true;
+}
+
+// Sends what the client's socket takes now, the rest waits for POLLOUT
+static void tea_serve_flush(tea_serve_client_t *client)
+{
+  while (client->out_sent < client->out_size) {
+    const ssize_t written =
+      send(client->fd, client->out + client->out_sent,
+           client->out_size - client->out_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        client->is_broken = true;
+      }
+      break;
+    }
+    client->out_sent += (size_t)written;
+  }
+
+  if (client->is_broken || client->out_sent == client->out_size) {
+    client->out_sent = 0;
+    client->out_size = 0;
+  }
+}
+
+static bool tea_serve_append(tea_serve_client_t *client, const char *data,
+                             const size_t size)
+{
+  if (client->out_sent) {
+    client->out_size -= client->out_sent;
+    memmove(client->out, client->out + client->out_sent, client->out_size);
+    client->out_sent = 0;
+  }
+
+  if (client->out_capacity - client->out_size < size) {
+    size_t capacity = client->out_capacity ? client->out_capacity * 2 : 4096;
+    while (capacity - client->out_size < size) {
+      capacity *= 2;
+    }
+    char *out = tea_malloc(capacity);
+    if (!out) {
+      tea_log_err("Memory error: Failed to allocate a reply of %zu bytes",
+                  capacity);
+      return false;
+    }
+    if (client->out_size) {
+      memcpy(out, client->out, client->out_size);
+    }
+    tea_free(client->out);
+    client->out = out;
+    client->out_capacity = capacity;
+  }
+
+  memcpy(client->out + client->out_size, data, size);
+  client->out_size += size;
+  return true;
+}
+
+// Queues the reply for the client, a client that can't get it is dropped
+static void tea_serve_reply(tea_serve_client_t *client, const char *status,
+                            const char *body, const size_t size)
+{
+  if (client->is_broken) {
+    return;
+  }
+
+  char header[32];
+  const int length = snprintf(header, sizeof(header), "%s %zu\n", status, size);
+  if (!tea_serve_append(client, header, (size_t)length) ||
+      !tea_serve_append(client, body, size)) {
+    client->is_broken = true;
+    return;
+  }
+  tea_serve_flush(client);
+}
+
+// Parses the next argument of a request, set to undefined at the end of
+// the line
+static bool tea_serve_parse_arg(char **cursor, tea_val_t *value)
+{
+  char *text = *cursor;
+  while (*text == ' ' || *text == '\t') {
+    text++;
+  }
+
+  *value = tea_val_undef();
+  if (*text == 0) {
+    *cursor = text;
+    return true;
+  }
+
+  if (*text == '\'') {
+    // Escapes are copied over the text itself, which only gets shorter
+    char *start = ++text;
+    char *end = start;
+    while (*text && *text != '\'') {
+      if (*text == '\\' && text[1]) {
+        text++;
+        *end++ = *text == 'n' ? '\n' : *text == 't' ? '\t' : *text;
+      } else {
+        *end++ = *text;
+      }
+      text++;
+    }
+    if (*text != '\'') {
+      tea_log_err("Request error: Unterminated string argument");
+      return false;
+    }
+    *cursor = text + 1;
+
+    const size_t size = (size_t)(end - start);
+    tea_inst_t *object = tea_malloc(sizeof(tea_inst_t) + size + 1);
+    if (!object) {
+      tea_log_err("Memory error: Failed to allocate a string argument");
+      return false;
+    }
+    object->type = "string";
+    object->decl = NULL;
+    object->size = size;
+    object->flags = 0;
+    memcpy(object->buf, start, size);
+    object->buf[size] = 0;
+    value->type = TEA_V_INST;
+    value->obj = object;
+    return true;
+  }
+
+  char *start = text;
+  while (*text && *text != ' ' && *text != '\t') {
+    text++;
+  }
+  if (*text) {
+    *text++ = 0;
+  }
+  *cursor = text;
+
+  if (!strcmp(start, "null")) {
+    *value = tea_val_null();
+    return true;
+  }
+
+  char *end;
+  errno = 0;
+  const long long integer = strtoll(start, &end, 10);
+  if (*end == 0 && errno == 0) {
+    if (integer >= INT32_MIN && integer <= INT32_MAX) {
+      value->type = TEA_V_I32;
+      value->i32 = (int32_t)integer;
+    } else {
+      value->type = TEA_V_I64;
+      value->i64 = integer;
+    }
+    return true;
+  }
+
+  const double real = strtod(start, &end);
+  if (*end == 0) {
+    value->type = TEA_V_F64;
+    value->f64 = real;
+    return true;
+  }
+
+  tea_log_err("Request error: Invalid argument '%s'", start);
+  return false;
+}
+
+// Calls the function named by the request line, what it prints and its
+// result go to the body of the reply
+static bool tea_serve_call(tea_ctx_t *ctx, tea_scope_t *scp, char *line)
+{
+  char *cursor = line;
+  while (*cursor == ' ' || *cursor == '\t') {
+    cursor++;
+  }
+  const char *name = cursor;
+  while (*cursor && *cursor != ' ' && *cursor != '\t') {
+    cursor++;
+  }
+  if (*cursor) {
+    *cursor++ = 0;
+  }
+
+  const tea_fn_t *fn = tea_ctx_find_fn(&ctx->prog->funcs, name);
+  if (!fn) {
+    tea_log_err("Request error: Unknown function '%s'", name);
+    return false;
+  }
+
+  tea_val_t args[TEA_SERVE_MAX_ARGS];
+  int argc = 0;
+  for (;;) {
+    tea_val_t value;
+    if (!tea_serve_parse_arg(&cursor, &value)) {
+      return false;
+    }
+    if (value.type == TEA_V_UNDEF) {
+      break;
+    }
+    if (argc == TEA_SERVE_MAX_ARGS) {
+      tea_log_err("Request error: More than %d arguments",
+                  TEA_SERVE_MAX_ARGS);
+      return false;
+    }
+    args[argc++] = value;
+  }
+
+  tea_val_t result;
+  if (!tea_call_fn_vals(ctx, scp, fn, args, argc, &result)) {
+    return false;
+  }
+
+  return tea_out_val(&ctx->out, &result);
+}
+
+static void tea_serve_handle(tea_ctx_t *ctx, tea_scope_t *scp, char *line,
+                             FILE *out)
+{
+  size_t size = strlen(line);
+  while (size > 0 && (line[size - 1] == '\n' || line[size - 1] == '\r')) {
+    line[--size] = 0;
+  }
+
+  // The memory streams allocate with malloc, so they are freed with free
+  char *body_text = NULL;
+  size_t body_size = 0;
+  char *log_text = NULL;
+  size_t log_size = 0;
+  FILE *body = open_memstream(&body_text, &body_size);
+  FILE *log = open_memstream(&log_text, &log_size);
+  if (!body || !log) {
+    static const char message[] = "Failed to capture the output";
+    fprintf(out, "err %zu\n%s", sizeof(message) - 1, message);
+    if (body) {
+      fclose(body);
+      free(body_text);
+    }
+    if (log) {
+      fclose(log);
+      free(log_text);
+    }
+    return;
+  }
+
+  FILE *const ctx_out = ctx->out.file;
+  tea_out_set_file(&ctx->out, body);
+  tea_log_file = log;
+  const bool is_ok = tea_serve_call(ctx, scp, line);
+  tea_log_file = NULL;
+  tea_out_set_file(&ctx->out, ctx_out);
+  fclose(body);
+  fclose(log);
+
+  if (is_ok) {
+    fprintf(out, "ok %zu\n", body_size);
+    fwrite(body_text, 1, body_size, out);
+  } else {
+    fprintf(out, "err %zu\n", log_size);
+    fwrite(log_text, 1, log_size, out);
+  }
+  fflush(out);
+
+  free(body_text);
+  free(log_text);
+}
+
+// Body of a forked worker, runs the top-level statements once and then
+// handles requests until the server closes its socket
+static int tea_serve_worker_main(const tea_program_t *program,
+                                 const tea_serve_options_t *options,
+                                 const int fd)
+{
+  FILE *in = fdopen(fd, "r");
+  FILE *out = fdopen(dup(fd), "w");
+  if (!in || !out) {
+    tea_log_err("Error: Failed to open the socket of worker %d", getpid());
+    return 1;
+  }
+
+  tea_ctx_t context;
+  tea_interp_init(&context, program);
+  context.max_depth = options->max_call_depth;
+  context.out.precision = options->precision;
+
+  tea_scope_t global_scope;
+  tea_scope_init(&global_scope, NULL);
+  int ret_code = 0;
+  tea_log_out = &context.out;
+  context.declared = 0;
+  if (program->ast &&
+      tea_exec(&context, &global_scope, program->ast) != TEA_EXEC_OK) {
+    tea_log_err("Error: Worker %d failed to run the program", getpid());
+    ret_code = 1;
+  }
+  tea_out_flush(&context.out);
+
+  // The server forwards lines of up to TEA_SERVE_LINE bytes with the line
+  // break, fgets needs one more for the terminator
+  char line[TEA_SERVE_LINE + 1];
+  while (ret_code == 0 && fgets(line, sizeof(line), in)) {
+    tea_serve_handle(&context, &global_scope, line, out);
+  }
+
+  tea_scope_cleanup(&context, &global_scope);
+  tea_interp_cleanup(&context);
+  tea_log_out = NULL;
+  fclose(in);
+  fclose(out);
+  return ret_code;
+}
+
+static bool tea_serve_spawn(tea_server_t *server, const int index)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    tea_log_err("Error: Failed to create the socket of worker %d", index);
+    return false;
+  }
+
+  // Buffered output would be printed again by the child
+  fflush(stdout);
+  fflush(stderr);
+
+  const pid_t pid = fork();
+  if (pid < 0) {
+    tea_log_err("Error: Failed to fork worker %d", index);
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    // The child keeps only its end of its own socket
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_DFL);
+    close(fds[0]);
+    close(server->listen_fd);
+    for (int i = 0; i < server->options->worker_count; i++) {
+      if (server->workers[i].fd >= 0) {
+        close(server->workers[i].fd);
+      }
+    }
+    for (int i = 0; i < TEA_SERVE_CLIENTS; i++) {
+      if (server->clients[i].state != TEA_CLIENT_FREE) {
+        close(server->clients[i].fd);
+      }
+    }
+    _exit(tea_serve_worker_main(server->program, server->options, fds[1]));
+  }
+
+  close(fds[1]);
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  tea_serve_worker_t *worker = &server->workers[index];
+  worker->pid = pid;
+  worker->fd = fds[0];
+  worker->client = -1;
+  worker->handled = 0;
+  worker->deadline_us = 0;
+  worker->reply_size = 0;
+  return true;
+}
+
+static void tea_serve_close_client(tea_server_t *server, const int index)
+{
+  tea_serve_client_t *client = &server->clients[index];
+  close(client->fd);
+  client->fd = -1;
+  client->state = TEA_CLIENT_FREE;
+}
+
+static void tea_serve_take_line(tea_server_t *server, int index);
+
+// Takes the next request of a client waiting for one, and closes the client
+// once it is broken, or done with all its replies sent
+static void tea_serve_update_client(tea_server_t *server, const int index)
+{
+  tea_serve_client_t *client = &server->clients[index];
+  if (client->state != TEA_CLIENT_READING) {
+    return;
+  }
+
+  if (!client->is_broken) {
+    tea_serve_take_line(server, index);
+  }
+  if (client->state == TEA_CLIENT_READING &&
+      (client->is_broken || (client->is_eof && client->out_size == 0))) {
+    tea_serve_close_client(server, index);
+  }
+}
+
+static void tea_serve_record(tea_server_t *server, const long long start_us)
+{
+  long long elapsed = tea_serve_now_us() - start_us;
+  if (elapsed < 0) {
+    elapsed = 0;
+  }
+  if (elapsed > server->max_us) {
+    server->max_us = elapsed;
+  }
+
+  int bucket = 0;
+  while (bucket < TEA_SERVE_BUCKETS - 1 && elapsed >= 1LL << bucket) {
+    bucket++;
+  }
+  server->buckets[bucket]++;
+  server->requests++;
+}
+
+// Sends the reply to the client and makes the client ready for its next
+// request, which may already be in its buffer
+static void tea_serve_finish(tea_server_t *server, const int index,
+                             const char *status, const char *body,
+                             const size_t size)
+{
+  tea_serve_client_t *client = &server->clients[index];
+  tea_serve_record(server, client->start_us);
+  if (strcmp(status, "ok") != 0) {
+    server->errors++;
+  }
+
+  tea_serve_reply(client, status, body, size);
+  client->state = TEA_CLIENT_READING;
+  tea_serve_update_client(server, index);
+}
+
+// Stops the worker, failing its request, and forks a new one in its place
+static bool tea_serve_replace(tea_server_t *server, const int index,
+                              const char *reason, const bool kill_it)
+{
+  tea_serve_worker_t *worker = &server->workers[index];
+  if (kill_it) {
+    kill(worker->pid, SIGKILL);
+  }
+  close(worker->fd);
+  worker->fd = -1;
+
+  // The process is collected by tea_serve_reap, the server doesn't wait for
+  // it to exit
+  if (worker->client >= 0) {
+    tea_serve_finish(server, worker->client, "err", reason, strlen(reason));
+    worker->client = -1;
+  } else if (!kill_it && worker->handled == 0) {
+    // Workers only exit on their own when they fail, and one that can't even
+    // start would fail again in a loop
+    tea_log_err("Error: Worker %d failed before its first request",
+                worker->pid);
+    return false;
+  }
+
+  if (tea_serve_stop) {
+    return true;
+  }
+  server->respawns++;
+  return tea_serve_spawn(server, index);
+}
+
+// Collects the workers that exited, without waiting for the others
+static void tea_serve_reap(void)
+{
+  while (waitpid(-1, NULL, WNOHANG) > 0) {
+  }
+}
+
+// Reads what the worker sent, relays the reply once it is complete
+static bool tea_serve_read_worker(tea_server_t *server, const int index)
+{
+  tea_serve_worker_t *worker = &server->workers[index];
+  if (worker->reply_capacity - worker->reply_size < 4096) {
+    const size_t capacity =
+      worker->reply_capacity ? worker->reply_capacity * 2 : 8192;
+    char *reply = tea_malloc(capacity);
+    if (!reply) {
+      tea_log_err("Memory error: Failed to allocate a reply of %zu bytes",
+                  capacity);
+      return tea_serve_replace(server, index, "Reply too large", true);
+    }
+    if (worker->reply_size) {
+      memcpy(reply, worker->reply, worker->reply_size);
+    }
+    tea_free(worker->reply);
+    worker->reply = reply;
+    worker->reply_capacity = capacity;
+  }
+
+  const ssize_t count =
+    read(worker->fd, worker->reply + worker->reply_size,
+         worker->reply_capacity - worker->reply_size);
+  if (count < 0 && errno == EINTR) {
+    return true;
+  }
+  if (count <= 0) {
+    return tea_serve_replace(server, index, "Worker exited", false);
+  }
+  worker->reply_size += (size_t)count;
+
+  // The reply is "<status> <size>\n" and the body
+  const char *newline = memchr(worker->reply, '\n', worker->reply_size);
+  if (!newline) {
+    return true;
+  }
+  const size_t header = (size_t)(newline - worker->reply) + 1;
+  char *space = memchr(worker->reply, ' ', header);
+  if (!space || worker->client < 0) {
+    return tea_serve_replace(server, index, "Invalid reply", true);
+  }
+  const size_t size = strtoul(space + 1, NULL, 10);
+  if (worker->reply_size < header + size) {
+    return true;
+  }
+
+  *space = 0;
+  tea_serve_finish(server, worker->client, worker->reply,
+                   worker->reply + header, size);
+  worker->client = -1;
+  worker->deadline_us = 0;
+  worker->reply_size = 0;
+  worker->handled++;
+
+  const long max_requests = server->options->max_requests;
+  if (max_requests > 0 && worker->handled >= max_requests) {
+    // Retired, closing its socket lets it exit on its own
+    return tea_serve_replace(server, index, "Worker retired", false);
+  }
+  return true;
+}
+
+static long long tea_serve_percentile(const tea_server_t *server,
+                                      const unsigned long percent)
+{
+  const unsigned long rank = (server->requests * percent + 99) / 100;
+  unsigned long seen = 0;
+  for (int i = 0; i < TEA_SERVE_BUCKETS; i++) {
+    seen += server->buckets[i];
+    if (seen >= rank && seen > 0) {
+      return 1LL << i;
+    }
+  }
+
+  return 0;
+}
+
+// Prints the counters and the latency histogram of the server
+static void tea_serve_print_stats(const tea_server_t *server, FILE *out)
+{
+  fprintf(out, "requests %lu\nerrors %lu\ntimeouts %lu\nrespawns %lu\n",
+          server->requests, server->errors, server->timeouts,
+          server->respawns);
+  fprintf(out, "p50 <%lldus\np90 <%lldus\np99 <%lldus\nmax %lldus\n",
+          tea_serve_percentile(server, 50), tea_serve_percentile(server, 90),
+          tea_serve_percentile(server, 99), server->max_us);
+  for (int i = 0; i < TEA_SERVE_BUCKETS; i++) {
+    if (server->buckets[i]) {
+      fprintf(out, "<%lldus %lu\n", 1LL << i, server->buckets[i]);
+    }
+  }
+}
+
+static void tea_serve_send_stats(tea_server_t *server, const int index)
+{
+  char *text = NULL;
+  size_t size = 0;
+  FILE *out = open_memstream(&text, &size);
+  if (out) {
+    tea_serve_print_stats(server, out);
+    fclose(out);
+  }
+
+  tea_serve_reply(&server->clients[index], "ok", text ? text : "",
+                  text ? size : 0);
+  free(text);
+}
+
+// Takes the next complete line of the client, queues it for a worker
+static void tea_serve_take_line(tea_server_t *server, const int index)
+{
+  tea_serve_client_t *client = &server->clients[index];
+  for (;;) {
+    // A client that doesn't read its replies gets no more of them
+    if (client->out_size - client->out_sent > TEA_SERVE_PENDING) {
+      return;
+    }
+
+    char *newline = memchr(client->line, '\n', client->size);
+    if (!newline) {
+      if (client->size == sizeof(client->line)) {
+        static const char message[] = "Request line too long";
+        tea_serve_reply(client, "err", message, sizeof(message) - 1);
+        client->size = 0;
+        client->is_eof = true;
+      } else if (client->is_eof) {
+        // A last line without a line break is not a request
+        client->size = 0;
+      }
+      return;
+    }
+
+    if (newline - client->line >= 6 && !memcmp(client->line, ":stats", 6)) {
+      const size_t used = (size_t)(newline - client->line) + 1;
+      memmove(client->line, client->line + used, client->size - used);
+      client->size -= used;
+      tea_serve_send_stats(server, index);
+      if (client->is_broken) {
+        return;
+      }
+      continue;
+    }
+
+    client->state = TEA_CLIENT_QUEUED;
+    client->queued = server->next_queued++;
+    client->start_us = tea_serve_now_us();
+    return;
+  }
+}
+
+static void tea_serve_read_client(tea_server_t *server, const int index)
+{
+  tea_serve_client_t *client = &server->clients[index];
+  const ssize_t count = read(client->fd, client->line + client->size,
+                             sizeof(client->line) - client->size);
+  if (count < 0) {
+    if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+      client->is_broken = true;
+    }
+  } else if (count == 0) {
+    client->is_eof = true;
+  } else {
+    client->size += (size_t)count;
+  }
+  tea_serve_update_client(server, index);
+}
+
+// Hands the oldest queued requests to the idle workers
+static void tea_serve_dispatch(tea_server_t *server)
+{
+  const long long timeout_us = server->options->timeout_ms * 1000;
+  for (int i = 0; i < server->options->worker_count; i++) {
+    tea_serve_worker_t *worker = &server->workers[i];
+    if (worker->fd < 0 || worker->client >= 0) {
+      continue;
+    }
+
+    int oldest = -1;
+    for (int j = 0; j < TEA_SERVE_CLIENTS; j++) {
+      const tea_serve_client_t *client = &server->clients[j];
+      if (client->state == TEA_CLIENT_QUEUED &&
+          (oldest < 0 || client->queued < server->clients[oldest].queued)) {
+        oldest = j;
+      }
+    }
+    if (oldest < 0) {
+      return;
+    }
+
+    tea_serve_client_t *client = &server->clients[oldest];
+    const size_t used =
+      (size_t)((char *)memchr(client->line, '\n', client->size) -
+               client->line) + 1;
+    client->state = TEA_CLIENT_RUNNING;
+    worker->client = oldest;
+    worker->deadline_us = timeout_us > 0 ? tea_serve_now_us() + timeout_us : 0;
+    const bool is_sent = tea_serve_write(worker->fd, client->line, used);
+    memmove(client->line, client->line + used, client->size - used);
+    client->size -= used;
+    if (!is_sent) {
+      // The worker is gone, its socket reports it on the next poll
+      worker->deadline_us = tea_serve_now_us();
+    }
+  }
+}
+
+static void tea_serve_accept(tea_server_t *server)
+{
+  const int fd = accept(server->listen_fd, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  // A client that doesn't read its replies must not block the server
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  for (int i = 0; i < TEA_SERVE_CLIENTS; i++) {
+    tea_serve_client_t *client = &server->clients[i];
+    if (client->state == TEA_CLIENT_FREE) {
+      client->fd = fd;
+      client->state = TEA_CLIENT_READING;
+      client->is_eof = false;
+      client->is_broken = false;
+      client->out_sent = 0;
+      client->out_size = 0;
+      client->size = 0;
+      return;
+    }
+  }
+
+  // Best effort, the refused client is not waited for
+  static const char message[] = "err 16\nToo many clients";
+  send(fd, message, sizeof(message) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+  close(fd);
+}
+
+// Kills the workers past their deadline, returns the milliseconds until
+// the next deadline, -1 if there is none
+static int tea_serve_check_deadlines(tea_server_t *server, bool *is_ok)
+{
+  const long long now = tea_serve_now_us();
+  long long next = -1;
+  for (int i = 0; i < server->options->worker_count; i++) {
+    const tea_serve_worker_t *worker = &server->workers[i];
+    if (worker->fd < 0 || worker->deadline_us == 0) {
+      continue;
+    }
+    if (worker->deadline_us <= now) {
+      server->timeouts++;
+      if (!tea_serve_replace(server, i, "Request timed out", true)) {
+        *is_ok = false;
+      }
+      continue;
+    }
+    if (next < 0 || worker->deadline_us - now < next) {
+      next = worker->deadline_us - now;
+    }
+  }
+
+  return next < 0 ? -1 : (int)((next + 999) / 1000);
+}
+
+static bool tea_serve_listen(tea_server_t *server)
+{
+  const char *path = server->options->socket_path;
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    tea_log_err("Error: Socket path '%s' is too long", path);
+    return false;
+  }
+  strcpy(address.sun_path, path);
+
+  server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server->listen_fd < 0) {
+    tea_log_err("Error: Failed to create a socket");
+    return false;
+  }
+  fcntl(server->listen_fd, F_SETFD, FD_CLOEXEC);
+
+  // A socket left by a server that didn't stop cleanly
+  unlink(path);
+  if (bind(server->listen_fd, (struct sockaddr *)&address,
+           sizeof(address)) != 0 ||
+      listen(server->listen_fd, SOMAXCONN) != 0) {
+    tea_log_err("Error: Failed to listen on '%s': %s", path, strerror(errno));
+    close(server->listen_fd);
+    server->listen_fd = -1;
+    return false;
+  }
+
+  return true;
+}
+
+static int tea_serve_loop(tea_server_t *server)
+{
+  const int worker_count = server->options->worker_count;
+  struct pollfd *fds =
+    tea_malloc((1 + worker_count + TEA_SERVE_CLIENTS) * sizeof(*fds));
+  int *owners = tea_malloc((worker_count + TEA_SERVE_CLIENTS) * sizeof(int));
+  if (!fds || !owners) {
+    tea_log_err("Memory error: Failed to allocate the poll set");
+    tea_free(fds);
+    tea_free(owners);
+    return 1;
+  }
+
+  bool is_ok = true;
+  while (is_ok && !tea_serve_stop) {
+    tea_serve_reap();
+    tea_serve_dispatch(server);
+    const int timeout = tea_serve_check_deadlines(server, &is_ok);
+    if (!is_ok) {
+      break;
+    }
+    tea_serve_dispatch(server);
+
+    // Workers first, then the clients that may send a request or have
+    // replies to take
+    nfds_t count = 0;
+    fds[count].fd = server->listen_fd;
+    fds[count++].events = POLLIN;
+    for (int i = 0; i < worker_count; i++) {
+      if (server->workers[i].fd >= 0) {
+        owners[count - 1] = i;
+        fds[count].fd = server->workers[i].fd;
+        fds[count++].events = POLLIN;
+      }
+    }
+    const nfds_t client_start = count;
+    for (int i = 0; i < TEA_SERVE_CLIENTS; i++) {
+      const tea_serve_client_t *client = &server->clients[i];
+      if (client->state == TEA_CLIENT_FREE) {
+        continue;
+      }
+
+      const size_t pending = client->out_size - client->out_sent;
+      short events = 0;
+      if (client->state == TEA_CLIENT_READING && !client->is_eof &&
+          pending <= TEA_SERVE_PENDING && client->size < sizeof(client->line)) {
+        events |= POLLIN;
+      }
+      if (pending > 0) {
+        events |= POLLOUT;
+      }
+      if (events) {
+        owners[count - 1] = i;
+        fds[count].fd = client->fd;
+        fds[count++].events = events;
+      }
+    }
+
+    if (poll(fds, count, timeout) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      tea_log_err("Error: Failed to poll: %s", strerror(errno));
+      is_ok = false;
+      break;
+    }
+
+    for (nfds_t i = 1; is_ok && i < client_start; i++) {
+      // A replaced worker has a new socket, its old events are stale
+      const int index = owners[i - 1];
+      if (fds[i].revents && fds[i].fd == server->workers[index].fd) {
+        is_ok = tea_serve_read_worker(server, index);
+      }
+    }
+    for (nfds_t i = client_start; i < count; i++) {
+      const int index = owners[i - 1];
+      tea_serve_client_t *client = &server->clients[index];
+      if (!fds[i].revents || client->state == TEA_CLIENT_FREE ||
+          fds[i].fd != client->fd) {
+        continue;
+      }
+
+      if (fds[i].revents & (POLLOUT | POLLHUP | POLLERR)) {
+        tea_serve_flush(client);
+      }
+      if (client->state == TEA_CLIENT_READING && !client->is_eof &&
+          (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+        tea_serve_read_client(server, index);
+      } else {
+        tea_serve_update_client(server, index);
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      tea_serve_accept(server);
+    }
+  }
+
+  tea_free(fds);
+  tea_free(owners);
+  return is_ok ? 0 : 1;
+}
+
+int tea_serve(const tea_program_t *program, const tea_serve_options_t *options)
+{
+  tea_server_t server;
+  memset(&server, 0, sizeof(server));
+  server.program = program;
+  server.options = options;
+  server.listen_fd = -1;
+  server.workers = tea_malloc(options->worker_count * sizeof(*server.workers));
+  server.clients = tea_malloc(TEA_SERVE_CLIENTS * sizeof(*server.clients));
+  if (!server.workers || !server.clients) {
+    tea_log_err("Memory error: Failed to allocate %d workers",
+                options->worker_count);
+    tea_free(server.workers);
+    tea_free(server.clients);
+    return 1;
+  }
+  for (int i = 0; i < options->worker_count; i++) {
+    memset(&server.workers[i], 0, sizeof(server.workers[i]));
+    server.workers[i].fd = -1;
+    server.workers[i].client = -1;
+  }
+  for (int i = 0; i < TEA_SERVE_CLIENTS; i++) {
+    memset(&server.clients[i], 0, sizeof(server.clients[i]));
+    server.clients[i].fd = -1;
+    server.clients[i].state = TEA_CLIENT_FREE;
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = tea_serve_on_signal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+  tea_serve_stop = 0;
+
+  int ret_code = 1;
+  if (tea_serve_listen(&server)) {
+    bool is_ok = true;
+    for (int i = 0; is_ok && i < options->worker_count; i++) {
+      is_ok = tea_serve_spawn(&server, i);
+    }
+    if (is_ok) {
+      tea_log_inf("Serving on '%s' with %d workers", options->socket_path,
+                  options->worker_count);
+      ret_code = tea_serve_loop(&server);
+    }
+  }
+
+  for (int i = 0; i < options->worker_count; i++) {
+    tea_serve_worker_t *worker = &server.workers[i];
+    if (worker->fd >= 0) {
+      kill(worker->pid, SIGTERM);
+      close(worker->fd);
+      while (waitpid(worker->pid, NULL, 0) < 0 && errno == EINTR) {
+      }
+    }
+    tea_free(worker->reply);
+  }
+  for (int i = 0; i < TEA_SERVE_CLIENTS; i++) {
+    if (server.clients[i].state != TEA_CLIENT_FREE) {
+      close(server.clients[i].fd);
+    }
+    tea_free(server.clients[i].out);
+  }
+  if (server.listen_fd >= 0) {
+    close(server.listen_fd);
+    unlink(options->socket_path);
+  }
+
+  tea_serve_print_stats(&server, stderr);
+  tea_free(server.workers);
+  tea_free(server.clients);
+  return ret_code;
+}
+
+#endif
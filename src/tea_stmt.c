@@ -1,6 +1,9 @@
 #include "tea_stmt.h"
+#include "tea_dict.h"
 #include "tea_expr.h"
 #include "tea_fn.h"
+#include "tea_gen.h"
+#include "tea_module.h"
 #include "tea_struct.h"
 
 #include <stdlib.h>
@@ -8,19 +11,30 @@
 #include "tea.h"
 #include "tea_log.h"
 
-bool tea_exec_stmt(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
-                   tea_ret_ctx_t *ret_ctx, tea_loop_ctx_t *loop_ctx)
+tea_exec_status_t tea_exec_stmt(tea_ctx_t *ctx, tea_scope_t *scp,
+                                const tea_node_t *node)
 {
-  tea_list_entry_t *entry;
-  tea_list_for_each(entry, &node->children)
-  {
+  // A resumed block goes on with the statement it was left in
+  tea_resume_t point;
+  tea_list_entry_t *entry = node->children.next;
+  if (ctx->resume && tea_gen_resume(ctx, node, NULL, &point)) {
+    entry = (tea_list_entry_t *)&point.child->link;
+  }
+
+  for (; entry != &node->children; entry = entry->next) {
     const tea_node_t *child = tea_list_record(entry, tea_node_t, link);
-    if (!tea_exec(ctx, scp, child, ret_ctx, loop_ctx)) {
-      return false;
+    const tea_exec_status_t status = tea_exec(ctx, scp, child);
+    if (status == TEA_EXEC_YIELD) {
+      point.node = node;
+      point.child = child;
+      return tea_gen_suspend(ctx, &point, NULL);
+    }
+    if (status != TEA_EXEC_OK) {
+      return status;
     }
   }
 
-  return true;
+  return TEA_EXEC_OK;
 }
 
 static void tea_extract_type_info(const tea_node_t *type_annot,
@@ -85,41 +99,53 @@ bool tea_exec_let(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node)
   return tea_decl_var(ctx, scp, name->buf, flags, type_name, expr);
 }
 
-static bool tea_check_field_mutability(const tea_scope_t *scp,
-                                       const tea_node_t *object_node)
+static tea_var_t *tea_check_field_mutability(const tea_scope_t *scp,
+                                             const tea_node_t *object_node)
 {
   if (!object_node || !object_node->tok) {
     tea_log_err(
       "Internal error: Field access expression missing object component in AST");
-    return false;
+    return NULL;
   }
 
   const tea_tok_t *object_name = object_node->tok;
-  const tea_var_t *variable = tea_scope_find(scp, object_name->buf);
+  tea_var_t *variable = tea_scope_find(scp, object_name->buf);
   if (!variable) {
     tea_log_err(
       "Runtime error: Variable '%s' not found in current scope when checking field mutability, "
       "line: %d, column: %d",
       object_name->buf, object_name->line, object_name->col);
-    return false;
+    return NULL;
   }
 
   if (!(variable->flags & TEA_VAR_MUT)) {
     tea_log_err(
       "Runtime error: Cannot modify field of immutable variable '%s' at line %d, column %d",
       object_name->buf, object_name->line, object_name->col);
-    return false;
+    return NULL;
   }
 
-  return true;
+  if (variable->val.type == TEA_V_INST &&
+      variable->val.obj->flags & TEA_INST_FROZEN) {
+    tea_log_err(
+      "Runtime error: Cannot modify field of frozen instance '%s' at line %d, column %d",
+      object_name->buf, object_name->line, object_name->col);
+    return NULL;
+  }
+
+  return variable;
 }
 
 static bool tea_perform_assignment(tea_val_t *target_value,
-                                   const tea_val_t new_value,
-                                   const bool is_optional,
+                                   tea_val_t new_value, const bool is_optional,
                                    const char *target_name,
                                    const tea_tok_t *error_token)
 {
+  // Narrower numbers are widened to the type of the target
+  tea_val_widen(&new_value, target_value->type == TEA_V_NULL
+                              ? target_value->null_type
+                              : target_value->type);
+
   const bool new_is_null = new_value.type == TEA_V_NULL;
   const bool types_match = new_value.type == target_value->type;
   const bool null_type_match = target_value->type == TEA_V_NULL &&
@@ -148,10 +174,19 @@ static bool tea_perform_assignment(tea_val_t *target_value,
     tea_log_dbg("New value for %s : %s = %d", target_name,
                 tea_val_type_str(target_value->type), target_value->i32);
     break;
+  case TEA_V_I64:
+    tea_log_dbg("New value for %s : %s = %lld", target_name,
+                tea_val_type_str(target_value->type),
+                (long long)target_value->i64);
+    break;
   case TEA_V_F32:
     tea_log_dbg("New value for %s : %s = %f", target_name,
                 tea_val_type_str(target_value->type), target_value->f32);
     break;
+  case TEA_V_F64:
+    tea_log_dbg("New value for %s : %s = %f", target_name,
+                tea_val_type_str(target_value->type), target_value->f64);
+    break;
   default:
     break;
   }
@@ -159,23 +194,91 @@ static bool tea_perform_assignment(tea_val_t *target_value,
   return true;
 }
 
-bool tea_exec_assign(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node)
+static bool tea_exec_compound_assign(tea_ctx_t *ctx, tea_scope_t *scp,
+                                     const tea_node_t *node)
 {
   const tea_node_t *lhs = node->binop.lhs;
   const tea_node_t *rhs = node->binop.rhs;
 
-  const tea_val_t new_value = tea_eval_expr(ctx, scp, rhs);
-  if (new_value.type == TEA_V_UNDEF) {
+  // The target is resolved once and modified in place
+  tea_val_t *target;
+  tea_val_t value;
+  if (lhs->type == TEA_N_IDENT) {
+    const tea_tok_t *name = lhs->tok;
+    tea_var_t *variable = tea_scope_find(scp, name->buf);
+    if (!variable) {
+      tea_log_err(
+        "Runtime error: Undefined variable '%s' used in assignment at line %d, column %d",
+        name->buf, name->line, name->col);
+      return false;
+    }
+
+    if (!(variable->flags & TEA_VAR_MUT)) {
+      tea_log_err(
+        "Runtime error: Cannot modify immutable variable '%s' at line %d, column %d",
+        name->buf, name->line, name->col);
+      return false;
+    }
+
+    target = &variable->val;
+    value = tea_eval_expr_as(ctx, scp, rhs, target->type);
+  } else {
+    // Like for the plain assignment the right-hand side goes first, it may
+    // insert into the dictionary that holds the target
+    value = tea_eval_expr(ctx, scp, rhs);
+
+    const tea_node_t *object_node = lhs->field_acc.obj;
+    const tea_var_t *object = tea_check_field_mutability(scp, object_node);
+    if (!object) {
+      return false;
+    }
+
+    target = tea_val_field_ptr(ctx, &object->val, object_node->tok,
+                               lhs->field_acc.field->tok);
+    if (!target) {
+      return false;
+    }
+  }
+
+  if (value.type == TEA_V_UNDEF) {
     tea_log_err(
       "Runtime error: Failed to evaluate right-hand side expression in assignment");
     return false;
   }
 
+  return tea_val_compound(target, value, node->tok);
+}
+
+bool tea_exec_assign(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node)
+{
+  if (node->tok) {
+    return tea_exec_compound_assign(ctx, scp, node);
+  }
+
+  const tea_node_t *lhs = node->binop.lhs;
+  const tea_node_t *rhs = node->binop.rhs;
+
   if (lhs->type != TEA_N_IDENT) {
-    if (!tea_check_field_mutability(scp, lhs->field_acc.obj)) {
+    const tea_val_t new_value = tea_eval_expr(ctx, scp, rhs);
+    if (new_value.type == TEA_V_UNDEF) {
+      tea_log_err(
+        "Runtime error: Failed to evaluate right-hand side expression in assignment");
       return false;
     }
 
+    const tea_var_t *object =
+      tea_check_field_mutability(scp, lhs->field_acc.obj);
+    if (!object) {
+      return false;
+    }
+
+    if (object->val.type == TEA_V_DICT) {
+      // Dictionaries are heterogeneous, so the assignment just inserts or
+      // replaces the entry
+      const tea_dict_key_t key = tea_dict_key_tok(lhs->field_acc.field->tok);
+      return tea_dict_set(object->val.dict, &key, new_value) != NULL;
+    }
+
     tea_val_t *field_value = tea_get_field_ptr(ctx, scp, lhs);
     if (!field_value) {
       return false;
@@ -205,13 +308,25 @@ bool tea_exec_assign(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node)
     return false;
   }
 
+  // The variable is known before the right-hand side is evaluated, so
+  // number literals can take its type
+  const tea_val_type_t target_type = variable->val.type == TEA_V_NULL
+                                       ? variable->val.null_type
+                                       : variable->val.type;
+  const tea_val_t new_value = tea_eval_expr_as(ctx, scp, rhs, target_type);
+  if (new_value.type == TEA_V_UNDEF) {
+    tea_log_err(
+      "Runtime error: Failed to evaluate right-hand side expression in assignment");
+    return false;
+  }
+
   const bool is_optional = variable->flags & TEA_VAR_OPT;
   return tea_perform_assignment(&variable->val, new_value, is_optional,
                                 name->buf, name);
 }
 
-bool tea_exec_if(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
-                 tea_ret_ctx_t *ret_ctx, tea_loop_ctx_t *loop_ctx)
+tea_exec_status_t tea_exec_if(tea_ctx_t *ctx, tea_scope_t *scp,
+                              const tea_node_t *node)
 {
   const tea_node_t *condition = NULL;
   const tea_node_t *then_node = NULL;
@@ -237,25 +352,36 @@ bool tea_exec_if(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
   tea_scope_t inner_scope;
   tea_scope_init(&inner_scope, scp);
 
-  const tea_val_t cond_val = tea_eval_expr(ctx, &inner_scope, condition);
-  if (cond_val.type == TEA_V_UNDEF) {
-    tea_scope_cleanup(ctx, &inner_scope);
-    return false;
+  // A resumed if goes on with the branch it was left in
+  tea_resume_t point;
+  const tea_node_t *branch = NULL;
+  if (ctx->resume && tea_gen_resume(ctx, node, &inner_scope, &point)) {
+    branch = point.child;
+  } else {
+    bool is_true;
+    if (!tea_eval_cond(ctx, &inner_scope, condition, &is_true)) {
+      tea_scope_cleanup(ctx, &inner_scope);
+      return TEA_EXEC_ERR;
+    }
+    branch = is_true ? then_node : else_node;
   }
 
-  bool result = true;
-  if (cond_val.i32 != 0) {
-    result = tea_exec(ctx, &inner_scope, then_node, ret_ctx, loop_ctx);
-  } else if (else_node) {
-    result = tea_exec(ctx, &inner_scope, else_node, ret_ctx, loop_ctx);
+  tea_exec_status_t status = TEA_EXEC_OK;
+  if (branch) {
+    status = tea_exec(ctx, &inner_scope, branch);
+  }
+  if (status == TEA_EXEC_YIELD) {
+    point.node = node;
+    point.child = branch;
+    status = tea_gen_suspend(ctx, &point, &inner_scope);
   }
 
   tea_scope_cleanup(ctx, &inner_scope);
-  return result;
+  return status;
 }
 
-bool tea_exec_while(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
-                    tea_ret_ctx_t *ret_ctx)
+tea_exec_status_t tea_exec_while(tea_ctx_t *ctx, tea_scope_t *scp,
+                                 const tea_node_t *node)
 {
   const tea_node_t *cond = NULL;
   const tea_node_t *body = NULL;
@@ -278,128 +404,503 @@ bool tea_exec_while(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
   }
 
   if (!cond) {
-    return false;
+    return TEA_EXEC_ERR;
   }
 
-  tea_loop_ctx_t loop_ctx;
-  loop_ctx.is_break_set = false;
+  // The body scope is reused by all iterations, a resumed loop goes on with
+  // the iteration it was left in
+  tea_resume_t point;
+  tea_scope_t inner_scope;
+  tea_scope_init(&inner_scope, scp);
+  bool is_resumed =
+    ctx->resume && tea_gen_resume(ctx, node, &inner_scope, &point);
 
   while (true) {
-    const tea_val_t cond_val = tea_eval_expr(ctx, scp, cond);
-    if (cond_val.type == TEA_V_UNDEF) {
-      return false;
+    if (!is_resumed) {
+      bool is_true;
+      if (!tea_ctx_step(ctx) || !tea_eval_cond(ctx, scp, cond, &is_true)) {
+        return TEA_EXEC_ERR;
+      }
+      if (!is_true) {
+        break;
+      }
+    }
+    is_resumed = false;
+
+    tea_exec_status_t status = tea_exec(ctx, &inner_scope, body);
+    if (status == TEA_EXEC_YIELD) {
+      point.node = node;
+      point.child = body;
+      status = tea_gen_suspend(ctx, &point, &inner_scope);
     }
-    if (cond_val.i32 == 0) {
+    tea_scope_cleanup(ctx, &inner_scope);
+
+    // Continue just ends the body early, errors and returns go further up
+    if (status == TEA_EXEC_BREAK) {
       break;
     }
+    if (status != TEA_EXEC_OK && status != TEA_EXEC_CONT) {
+      return status;
+    }
+  }
 
-    // Reset continue flag at the beginning of each iteration
-    loop_ctx.is_cont_set = false;
+  return TEA_EXEC_OK;
+}
 
-    tea_scope_t inner_scope;
-    tea_scope_init(&inner_scope, scp);
-    const bool result = tea_exec(ctx, &inner_scope, body, ret_ctx, &loop_ctx);
-    tea_scope_cleanup(ctx, &inner_scope);
+static bool tea_eval_range_bound(tea_ctx_t *ctx, tea_scope_t *scp,
+                                 const tea_node_t *node, int64_t *bound,
+                                 bool *is_wide)
+{
+  const tea_val_t value = tea_eval_expr(ctx, scp, node);
+  switch (value.type) {
+  case TEA_V_I32:
+    *bound = value.i32;
+    return true;
+  case TEA_V_I64:
+    *bound = value.i64;
+    *is_wide = true;
+    return true;
+  case TEA_V_UNDEF:
+    return false;
+  default:
+    tea_log_err(
+      "Runtime error: For loop range bounds must be i32 or i64, got %s at line %d, column %d",
+      tea_val_type_str(value.type), node->tok ? node->tok->line : 0,
+      node->tok ? node->tok->col : 0);
+    return false;
+  }
+}
 
-    if (!result) {
-      return false;
+// The loop variable is declared once in its own scope and is immutable for
+// the body, so the loop is the only writer
+static tea_var_t *tea_decl_loop_var(tea_ctx_t *ctx, tea_scope_t *loop_scp,
+                                    const tea_node_t *node)
+{
+  tea_var_t *variable = tea_alloc_var(ctx);
+  if (!variable) {
+    tea_log_err("Memory error: Failed to allocate memory for variable '%s'",
+                node->tok->buf);
+    return NULL;
+  }
+
+  variable->name = node->tok->buf;
+  variable->flags = 0;
+  variable->val = tea_val_undef();
+  tea_list_add_tail(&loop_scp->vars, &variable->link);
+  return variable;
+}
+
+static tea_exec_status_t tea_exec_for_range(tea_ctx_t *ctx, tea_scope_t *scp,
+                                            const tea_node_t *node,
+                                            const tea_node_t *range,
+                                            const tea_node_t *body)
+{
+  // The body scope is reused by all iterations, only the variables declared
+  // by the body are released after each one
+  tea_scope_t loop_scope;
+  tea_scope_init(&loop_scope, scp);
+  tea_scope_t body_scope;
+  tea_scope_init(&body_scope, &loop_scope);
+
+  // A resumed loop goes on with the iteration it was left in, the bounds
+  // aren't evaluated again
+  tea_resume_t point;
+  bool is_resumed =
+    ctx->resume && tea_gen_resume(ctx, node, &body_scope, &point);
+  if (!is_resumed) {
+    // The bounds and the step are evaluated only once, before the first
+    // iteration, the counter is i64 if any of them is
+    int64_t bounds[3] = { 0, 0, 1 };
+    int bound_count = 0;
+    bool is_wide = false;
+    tea_list_entry_t *bound_entry;
+    tea_list_for_each(bound_entry, &range->children)
+    {
+      const tea_node_t *bound = tea_list_record(bound_entry, tea_node_t, link);
+      if (!tea_eval_range_bound(ctx, scp, bound, &bounds[bound_count++],
+                                &is_wide)) {
+        return TEA_EXEC_ERR;
+      }
+    }
+
+    if (bounds[2] == 0) {
+      tea_log_err("Runtime error: For loop step cannot be zero at line %d",
+                  node->tok->line);
+      return TEA_EXEC_ERR;
+    }
+
+    point.range.next = bounds[0];
+    point.range.end = bounds[1];
+    point.range.step = bounds[2];
+    point.range.is_wide = is_wide;
+  }
+
+  tea_var_t *counter = tea_decl_loop_var(ctx, &loop_scope, node);
+  if (!counter) {
+    tea_scope_cleanup(ctx, &body_scope);
+    return TEA_EXEC_ERR;
+  }
+
+  const int64_t end = point.range.end;
+  const int64_t step = point.range.step;
+  const bool is_wide = point.range.is_wide;
+  counter->val.type = is_wide ? TEA_V_I64 : TEA_V_I32;
+
+  // The counter only advances if the end is more than a step away, so it
+  // can't overflow near the limits of i64. Both distances are unsigned, they
+  // don't fit i64 for the widest ranges
+  const uint64_t stride = step > 0 ? (uint64_t)step : 0 - (uint64_t)step;
+
+  tea_exec_status_t status = TEA_EXEC_OK;
+  for (int64_t i = point.range.next; step > 0 ? i < end : i > end;) {
+    // The resumed iteration was counted before the generator yielded
+    if (!is_resumed && !tea_ctx_step(ctx)) {
+      status = TEA_EXEC_ERR;
+      break;
     }
+    is_resumed = false;
 
-    if (ret_ctx && ret_ctx->is_set) {
+    if (is_wide) {
+      counter->val.i64 = i;
+    } else {
+      counter->val.i32 = (int32_t)i;
+    }
+
+    status = tea_exec(ctx, &body_scope, body);
+    if (status == TEA_EXEC_YIELD) {
+      point.node = node;
+      point.child = body;
+      point.range.next = i;
+      status = tea_gen_suspend(ctx, &point, &body_scope);
+    }
+    tea_scope_cleanup(ctx, &body_scope);
+
+    if (status == TEA_EXEC_BREAK) {
+      status = TEA_EXEC_OK;
+      break;
+    }
+    if (status == TEA_EXEC_CONT) {
+      status = TEA_EXEC_OK;
+    } else if (status != TEA_EXEC_OK) {
       break;
     }
 
-    if (loop_ctx.is_break_set) {
+    const uint64_t left =
+      step > 0 ? (uint64_t)end - (uint64_t)i : (uint64_t)i - (uint64_t)end;
+    if (left <= stride) {
       break;
     }
+    i += step;
   }
 
-  return true;
+  tea_scope_cleanup(ctx, &loop_scope);
+  return status;
 }
 
-bool tea_exec_return(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
-                     tea_ret_ctx_t *ret_ctx)
+static tea_exec_status_t tea_exec_for_iter(tea_ctx_t *ctx, tea_scope_t *scp,
+                                           const tea_node_t *node,
+                                           const tea_node_t *iter,
+                                           const tea_node_t *body)
 {
-  tea_list_entry_t *first_entry = tea_list_first(&node->children);
-  if (first_entry) {
-    const tea_node_t *expr = tea_list_record(first_entry, tea_node_t, link);
-    if (expr && ret_ctx) {
-      ret_ctx->ret_val = tea_eval_expr(ctx, scp, expr);
-      if (ret_ctx->ret_val.type == TEA_V_UNDEF) {
-        return false;
+  tea_scope_t loop_scope;
+  tea_scope_init(&loop_scope, scp);
+  tea_scope_t body_scope;
+  tea_scope_init(&body_scope, &loop_scope);
+
+  // A resumed loop goes on with the value it was left at
+  tea_resume_t point;
+  bool is_resumed =
+    ctx->resume && tea_gen_resume(ctx, node, &body_scope, &point);
+  if (!is_resumed) {
+    const tea_node_t *expr =
+      tea_list_record(tea_list_first(&iter->children), tea_node_t, link);
+    const tea_val_t value = tea_eval_expr(ctx, scp, expr);
+    if (value.type == TEA_V_UNDEF) {
+      return TEA_EXEC_ERR;
+    }
+
+    point.iter.gen = tea_val_gen(&value);
+    if (!point.iter.gen) {
+      tea_log_err(
+        "Runtime error: For loop over a %s value at line %d, column %d, only generators can be iterated",
+        tea_val_type_str(value.type), node->tok->line, node->tok->col);
+      return TEA_EXEC_ERR;
+    }
+  }
+
+  tea_var_t *item = tea_decl_loop_var(ctx, &loop_scope, node);
+  if (!item) {
+    tea_scope_cleanup(ctx, &body_scope);
+    return TEA_EXEC_ERR;
+  }
+  if (is_resumed) {
+    item->val = point.iter.item;
+  }
+
+  tea_exec_status_t status = TEA_EXEC_OK;
+  bool is_done = false;
+  for (;;) {
+    // The generator runs in the scope of the loop, as a call from there
+    if (!is_resumed) {
+      if (!tea_ctx_step(ctx) ||
+          !tea_gen_next(ctx, scp, point.iter.gen, &item->val)) {
+        status = TEA_EXEC_ERR;
+        break;
       }
-      ret_ctx->is_set = true;
+      if (item->val.type == TEA_V_UNDEF) {
+        is_done = true;
+        break;
+      }
+    }
+    is_resumed = false;
+
+    status = tea_exec(ctx, &body_scope, body);
+    if (status == TEA_EXEC_YIELD) {
+      point.node = node;
+      point.child = body;
+      point.iter.item = item->val;
+      status = tea_gen_suspend(ctx, &point, &body_scope);
+    }
+    tea_scope_cleanup(ctx, &body_scope);
+
+    if (status == TEA_EXEC_BREAK) {
+      status = TEA_EXEC_OK;
+      break;
+    }
+    if (status == TEA_EXEC_CONT) {
+      status = TEA_EXEC_OK;
+    } else if (status != TEA_EXEC_OK) {
+      break;
     }
   }
 
-  return true;
+  // A native generator left before it is done releases what it holds, a
+  // loop suspended by a yield goes on with it later
+  if (!is_done && status != TEA_EXEC_YIELD) {
+    tea_gen_close(ctx, point.iter.gen);
+  }
+
+  tea_scope_cleanup(ctx, &loop_scope);
+  return status;
 }
 
-bool tea_exec_break(tea_loop_ctx_t *loop_ctx)
+tea_exec_status_t tea_exec_for(tea_ctx_t *ctx, tea_scope_t *scp,
+                               const tea_node_t *node)
 {
-  if (loop_ctx) {
-    loop_ctx->is_break_set = true;
-    return true;
+  const tea_node_t *range = NULL;
+  const tea_node_t *iter = NULL;
+  const tea_node_t *body = NULL;
+
+  tea_list_entry_t *child_entry;
+  tea_list_for_each(child_entry, &node->children)
+  {
+    const tea_node_t *child = tea_list_record(child_entry, tea_node_t, link);
+    switch (child->type) {
+    case TEA_N_FOR_RANGE:
+      range = child;
+      break;
+    case TEA_N_FOR_ITER:
+      iter = child;
+      break;
+    case TEA_N_FOR_BODY:
+      body = child;
+      break;
+    default:
+      break;
+    }
   }
 
-  tea_log_err("Runtime error: 'break' statement can only be used inside loops");
-  return false;
+  if (!body) {
+    return TEA_EXEC_ERR;
+  }
+  if (range) {
+    return tea_exec_for_range(ctx, scp, node, range, body);
+  }
+  if (iter) {
+    return tea_exec_for_iter(ctx, scp, node, iter, body);
+  }
+
+  return TEA_EXEC_ERR;
 }
 
-bool tea_exec_continue(tea_loop_ctx_t *loop_ctx)
+// Moves the variables from scp up to the scope of the frame in front of the
+// ones kept by earlier tail calls of the frame, inner ones first. A variable
+// behind one of the same name can't be found anymore and is released, so
+// the kept ones don't grow with the number of tail calls
+static void tea_keep_tail_vars(tea_ctx_t *ctx, tea_frame_t *frame,
+                               tea_scope_t *scp)
 {
-  if (loop_ctx) {
-    loop_ctx->is_cont_set = true;
-    return true;
+  const tea_scope_t *frame_scp = &frame->scps[frame->scp_index];
+  const tea_scope_t *current = scp;
+  while (current && current != frame_scp) {
+    current = current->parent;
+  }
+  if (!current) {
+    return;
   }
 
-  tea_log_err(
-    "Runtime error: 'continue' statement can only be used inside loops");
-  return false;
+  tea_list_entry_t vars;
+  tea_list_init(&vars);
+  for (tea_scope_t *inner = scp;; inner = inner->parent) {
+    tea_list_splice_tail(&vars, &inner->vars);
+    if (inner == frame_scp) {
+      break;
+    }
+  }
+  tea_list_splice_tail(&vars, &frame->tail_scp.vars);
+
+  tea_list_entry_t *entry;
+  tea_list_entry_t *safe;
+  tea_list_for_each_safe(entry, safe, &vars)
+  {
+    tea_var_t *variable = tea_list_record(entry, tea_var_t, link);
+    tea_list_remove(entry);
+    if (tea_scope_find_local(&frame->tail_scp, variable->name)) {
+      tea_free_var(ctx, variable);
+    } else {
+      tea_list_add_tail(&frame->tail_scp.vars, entry);
+    }
+  }
 }
 
-bool tea_exec(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
-              tea_ret_ctx_t *ret_ctx, tea_loop_ctx_t *loop_ctx)
+static tea_exec_status_t tea_exec_tail_call(tea_ctx_t *ctx, tea_scope_t *scp,
+                                            const tea_node_t *node)
 {
-  if (ret_ctx && ret_ctx->is_set) {
-    return true;
+  // The callee replaces the current function in its frame. The variables
+  // this function sees are kept in the frame, so the callee sees them as
+  // it would from a nested call
+  tea_frame_t *frame = ctx->frame;
+  tea_scope_t *next_scp = &frame->scps[!frame->scp_index];
+  tea_scope_init(next_scp, &frame->tail_scp);
+
+  const tea_fn_t *fn = NULL;
+  switch (tea_bind_call(ctx, scp, node, next_scp, &fn, &ctx->ret_val)) {
+  case TEA_CALL_FN:
+    if (fn->gen || fn->memo_index >= 0) {
+      // Generators are created and @memo results cached by a nested call,
+      // the frame would run the body of either right away
+      const bool is_ok =
+        tea_call_bound_fn(ctx, scp, fn, node, next_scp, &ctx->ret_val);
+      tea_scope_cleanup(ctx, next_scp);
+      return is_ok ? TEA_EXEC_RET : TEA_EXEC_ERR;
+    }
+    if (fn->ns) {
+      // A module function sees the variables of its module, not those of
+      // the function it replaces
+      next_scp->parent = tea_fn_outer_scope(ctx, fn, NULL);
+      if (!next_scp->parent) {
+        tea_scope_cleanup(ctx, next_scp);
+        return TEA_EXEC_ERR;
+      }
+    }
+    tea_keep_tail_vars(ctx, frame, scp);
+    frame->fn = fn;
+    frame->call = node;
+    return TEA_EXEC_TAIL;
+  case TEA_CALL_NATIVE:
+    tea_scope_cleanup(ctx, next_scp);
+    return ctx->ret_val.type == TEA_V_UNDEF ? TEA_EXEC_ERR : TEA_EXEC_RET;
+  default:
+    tea_scope_cleanup(ctx, next_scp);
+    return TEA_EXEC_ERR;
   }
+}
 
-  if (loop_ctx && loop_ctx->is_break_set) {
-    return true;
+tea_exec_status_t tea_exec_return(tea_ctx_t *ctx, tea_scope_t *scp,
+                                  const tea_node_t *node)
+{
+  ctx->ret_val = tea_val_undef();
+
+  tea_list_entry_t *first_entry = tea_list_first(&node->children);
+  if (first_entry) {
+    const tea_node_t *expr = tea_list_record(first_entry, tea_node_t, link);
+    if (expr && ctx->frame && ctx->frame->gen) {
+      tea_log_err(
+        "Runtime error: Generator '%s' can only return without a value",
+        ctx->frame->fn->name->buf);
+      return TEA_EXEC_ERR;
+    }
+    if (expr && expr->type == TEA_N_FN_CALL && ctx->frame) {
+      return tea_exec_tail_call(ctx, scp, expr);
+    }
+    if (expr) {
+      ctx->ret_val = tea_eval_expr(ctx, scp, expr);
+      if (ctx->ret_val.type == TEA_V_UNDEF) {
+        return TEA_EXEC_ERR;
+      }
+    }
   }
 
-  if (loop_ctx && loop_ctx->is_cont_set) {
-    return true;
+  return TEA_EXEC_RET;
+}
+
+tea_exec_status_t tea_exec_yield(tea_ctx_t *ctx, tea_scope_t *scp,
+                                 const tea_node_t *node)
+{
+  // A resumed generator goes on after the yield it was left at
+  if (ctx->resume) {
+    ctx->resume = NULL;
+    return TEA_EXEC_OK;
   }
 
+  tea_gen_t *gen = ctx->frame ? ctx->frame->gen : NULL;
+  if (!gen) {
+    tea_log_err("Runtime error: 'yield' statement outside of a function");
+    return TEA_EXEC_ERR;
+  }
+
+  const tea_node_t *expr =
+    tea_list_record(tea_list_first(&node->children), tea_node_t, link);
+  gen->value = tea_eval_expr(ctx, scp, expr);
+  if (gen->value.type == TEA_V_UNDEF) {
+    return TEA_EXEC_ERR;
+  }
+
+  return TEA_EXEC_YIELD;
+}
+
+tea_exec_status_t tea_exec(tea_ctx_t *ctx, tea_scope_t *scp,
+                           const tea_node_t *node)
+{
   if (!node) {
     tea_log_err("Node is null");
-    return true;
+    return TEA_EXEC_OK;
   }
 
   switch (node->type) {
   case TEA_N_LET:
-    return tea_exec_let(ctx, scp, node);
+    return tea_exec_let(ctx, scp, node) ? TEA_EXEC_OK : TEA_EXEC_ERR;
   case TEA_N_ASSIGN:
-    return tea_exec_assign(ctx, scp, node);
+    return tea_exec_assign(ctx, scp, node) ? TEA_EXEC_OK : TEA_EXEC_ERR;
   case TEA_N_IF:
-    return tea_exec_if(ctx, scp, node, ret_ctx, loop_ctx);
+    return tea_exec_if(ctx, scp, node);
   case TEA_N_WHILE:
-    return tea_exec_while(ctx, scp, node, ret_ctx);
+    return tea_exec_while(ctx, scp, node);
+  case TEA_N_FOR:
+    return tea_exec_for(ctx, scp, node);
   case TEA_N_FN:
-    return tea_exec_fn_decl(ctx, node);
+  case TEA_N_STRUCT:
+    // Declared when the program is loaded, the run sees it from here on
+    if (!ctx->ns && !ctx->frame) {
+      ctx->declared++;
+    }
+    return TEA_EXEC_OK;
+  case TEA_N_IMPORT:
+    return tea_exec_import(ctx, node);
   case TEA_N_RET:
-    return tea_exec_return(ctx, scp, node, ret_ctx);
+    return tea_exec_return(ctx, scp, node);
+  case TEA_N_YIELD:
+    return tea_exec_yield(ctx, scp, node);
   case TEA_N_BREAK:
-    return tea_exec_break(loop_ctx);
+    // Loops stop on this status, outside of them it's reported by the
+    // function call or the program
+    return TEA_EXEC_BREAK;
   case TEA_N_CONT:
-    return tea_exec_continue(loop_ctx);
-  case TEA_N_FN_CALL:
-    tea_eval_fn_call(ctx, scp, node);
-    return true;
-  case TEA_N_STRUCT:
-    return tea_exec_struct_decl(ctx, node);
+    return TEA_EXEC_CONT;
+  case TEA_N_FN_CALL: {
+    tea_val_t result;
+    return tea_call_fn(ctx, scp, node, &result) ? TEA_EXEC_OK : TEA_EXEC_ERR;
+  }
   case TEA_N_PROG:
   case TEA_N_STMT:
   case TEA_N_FN_ARGS:
@@ -407,23 +908,24 @@ bool tea_exec(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node,
   case TEA_N_ELSE:
   case TEA_N_WHILE_COND:
   case TEA_N_WHILE_BODY:
-    return tea_exec_stmt(ctx, scp, node, ret_ctx, loop_ctx);
+  case TEA_N_FOR_BODY:
+    return tea_exec_stmt(ctx, scp, node);
   default: {
     const tea_tok_t *token = node->tok;
     if (token) {
       tea_log_err(
         "Interpreter error: Unimplemented statement type <%s> in file %s, token: <%s> '%.*s' "
         "(line %d, col %d)",
-        tea_node_type_name(node->type), ctx->file_name,
+        tea_node_type_name(node->type), ctx->prog->file_name,
         tea_tok_name(token->type), token->size, token->buf, token->line,
         token->col);
     } else {
       tea_log_err(
         "Interpreter error: Unimplemented statement type <%s> in file %s",
-        tea_node_type_name(node->type), ctx->file_name);
+        tea_node_type_name(node->type), ctx->prog->file_name);
     }
   } break;
   }
 
-  return false;
+  return TEA_EXEC_ERR;
 }
@@ -1,5 +1,6 @@
 #include "tea_struct.h"
 
+#include "tea_dict.h"
 #include "tea_expr.h"
 
 #include <stdlib.h>
@@ -8,7 +9,8 @@
 #include "tea_log.h"
 #include "tea_memory.h"
 
-bool tea_exec_struct_decl(tea_ctx_t *ctx, const tea_node_t *node)
+bool tea_decl_struct(tea_program_t *prog, const tea_node_t *node,
+                     const char *ns)
 {
   tea_struct_decl_t *struct_declaration =
     tea_malloc(sizeof(*struct_declaration));
@@ -17,20 +19,170 @@ bool tea_exec_struct_decl(tea_ctx_t *ctx, const tea_node_t *node)
   }
 
   struct_declaration->node = node;
+  struct_declaration->ns = ns;
+  struct_declaration->order = prog->decl_order;
   struct_declaration->field_count = tea_list_length(&node->children);
   tea_list_init(&struct_declaration->funcs);
-  tea_list_add_tail(&ctx->structs, &struct_declaration->link);
+  struct_declaration->methods = NULL;
+  struct_declaration->method_count = 0;
+  tea_list_add_tail(&prog->structs, &struct_declaration->link);
 
   tea_tok_t *name = node->tok;
   tea_log_dbg("Declare type '%s'", name ? name->buf : "");
 
+  // Native methods are usually bound before the type is declared, they are
+  // bound to the types of the program file
+  if (name && !ns) {
+    tea_list_entry_t *entry;
+    tea_list_for_each(entry, &prog->native_funcs)
+    {
+      const tea_native_fn_t *native_func =
+        tea_list_record(entry, tea_native_fn_t, link);
+      if (native_func->owner_name &&
+          !strcmp(native_func->owner_name, name->buf) &&
+          !tea_struct_add_method(prog, struct_declaration,
+                                 native_func->fn_name, NULL, native_func)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+long tea_method_slot(tea_program_t *prog, const char *name)
+{
+  if (!prog->slots) {
+    prog->slots = tea_dict_create(0);
+    if (!prog->slots) {
+      return -1;
+    }
+  }
+
+  const tea_dict_key_t key = tea_dict_key_str(name, (int)strlen(name));
+  const tea_val_t *slot = tea_dict_find(prog->slots, &key);
+  if (slot) {
+    return (long)slot->i64;
+  }
+
+  tea_val_t new_slot;
+  new_slot.type = TEA_V_I64;
+  new_slot.i64 = (int64_t)prog->slot_count;
+  if (!tea_dict_set(prog->slots, &key, new_slot)) {
+    return -1;
+  }
+
+  return (long)prog->slot_count++;
+}
+
+bool tea_struct_add_method(tea_program_t *prog, tea_struct_decl_t *decl,
+                           const char *name, const tea_fn_t *fn,
+                           const tea_native_fn_t *native)
+{
+  const long slot = tea_method_slot(prog, name);
+  if (slot < 0) {
+    tea_log_err("Memory error: Failed to allocate a slot for method '%s'",
+                name);
+    return false;
+  }
+
+  // The table covers the slots up to the highest one the type uses
+  if ((unsigned long)slot >= decl->method_count) {
+    const unsigned long method_count = (unsigned long)slot + 1;
+    tea_method_t *methods = tea_malloc(method_count * sizeof(*methods));
+    if (!methods) {
+      tea_log_err("Memory error: Failed to grow the method table for '%s'",
+                  name);
+      return false;
+    }
+    memset(methods, 0, method_count * sizeof(*methods));
+    if (decl->methods) {
+      memcpy(methods, decl->methods, decl->method_count * sizeof(*methods));
+      tea_free(decl->methods);
+    }
+    decl->methods = methods;
+    decl->method_count = method_count;
+  }
+
+  tea_method_t *method = &decl->methods[slot];
+  if (native) {
+    method->native = native;
+  } else if (!method->fn) {
+    method->fn = fn;
+  }
+
+  tea_log_dbg("Method '%s' of type '%s' in slot %ld", name,
+              decl->node->tok->buf, slot);
+
   return true;
 }
 
-tea_struct_decl_t *tea_find_struct_decl(const tea_ctx_t *ctx, const char *name)
+static long tea_find_slot(const tea_program_t *prog, const tea_tok_t *name)
+{
+  if (!prog->slots) {
+    return TEA_SLOT_NONE;
+  }
+
+  const tea_dict_key_t key = tea_dict_key_tok(name);
+  const tea_val_t *slot = tea_dict_find(prog->slots, &key);
+  return slot ? (long)slot->i64 : TEA_SLOT_NONE;
+}
+
+const tea_method_t *tea_struct_find_method(const tea_program_t *prog,
+                                           const tea_struct_decl_t *decl,
+                                           const tea_node_t *call,
+                                           const tea_tok_t *name)
+{
+  // Calls in modules and in the programs the optimizer runs aren't resolved
+  long slot = call->slot;
+  if (slot == TEA_SLOT_UNRESOLVED) {
+    slot = tea_find_slot(prog, name);
+  }
+  if (slot < 0 || (unsigned long)slot >= decl->method_count) {
+    return NULL;
+  }
+
+  const tea_method_t *method = &decl->methods[slot];
+  if (!method->fn && !method->native) {
+    return NULL;
+  }
+
+  return method;
+}
+
+void tea_resolve_slots(const tea_program_t *prog, tea_node_t *node)
+{
+  if (!node) {
+    return;
+  }
+
+  // binop and field_acc share the layout
+  if (node->type == TEA_N_BINOP || node->type == TEA_N_ASSIGN ||
+      node->type == TEA_N_FIELD_ACC) {
+    tea_resolve_slots(prog, node->binop.lhs);
+    tea_resolve_slots(prog, node->binop.rhs);
+    return;
+  }
+
+  tea_list_entry_t *entry;
+  tea_list_for_each(entry, &node->children)
+  {
+    tea_node_t *child = tea_list_record(entry, tea_node_t, link);
+    tea_resolve_slots(prog, child);
+
+    // A method call has the field access of the receiver and the name
+    if (node->type == TEA_N_FN_CALL && child->type == TEA_N_FIELD_ACC &&
+        child->field_acc.field && child->field_acc.field->tok) {
+      node->slot = tea_find_slot(prog, child->field_acc.field->tok);
+    }
+  }
+}
+
+tea_struct_decl_t *tea_find_struct_decl(const tea_program_t *prog,
+                                        const char *ns, const char *name)
 {
   tea_list_entry_t *struct_entry;
-  tea_list_for_each(struct_entry, &ctx->structs)
+  tea_list_for_each(struct_entry, &prog->structs)
   {
     tea_struct_decl_t *decl =
       tea_list_record(struct_entry, tea_struct_decl_t, link);
@@ -43,7 +195,9 @@ tea_struct_decl_t *tea_find_struct_decl(const tea_ctx_t *ctx, const char *name)
       continue;
     }
     const tea_tok_t *decl_token = decl->node->tok;
-    if (decl_token) {
+    const bool is_in_ns =
+      ns ? decl->ns && !strcmp(decl->ns, ns) : !decl->ns;
+    if (decl_token && is_in_ns) {
       if (!strcmp(decl_token->buf, name)) {
         return decl;
       }
@@ -61,8 +215,16 @@ tea_val_t tea_eval_new(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node)
     return tea_val_undef();
   }
 
+  // Type names without a module name stay in the module of the code, as
+  // function names do
+  const char *ns = ctx->frame ? ctx->frame->fn->ns : ctx->ns;
   const tea_struct_decl_t *struct_declr =
-    tea_find_struct_decl(ctx, struct_name->buf);
+    tea_find_struct_decl(ctx->prog, ns, struct_name->buf);
+  if (!struct_declr || !tea_ctx_sees(ctx, struct_declr)) {
+    tea_log_err("Runtime error: Undefined type '%s' at line %d, column %d",
+                struct_name->buf, struct_name->line, struct_name->col);
+    return tea_val_undef();
+  }
 
   tea_inst_t *object = tea_malloc(
     sizeof(tea_inst_t) + struct_declr->field_count * sizeof(tea_val_t));
@@ -129,7 +291,9 @@ tea_val_t tea_eval_new(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node)
       return tea_val_undef();
     }
 
-    tea_val_t value_expr = tea_eval_expr(ctx, scp, value_node);
+    // Number fields accept narrower values, for example an i32 for an i64
+    tea_val_t value_expr = tea_eval_expr_as(ctx, scp, value_node,
+                                            tea_decl_val_type(field_node));
     if (value_expr.type == TEA_V_UNDEF) {
       tea_free(object);
       return tea_val_undef();
@@ -141,6 +305,9 @@ tea_val_t tea_eval_new(tea_ctx_t *ctx, tea_scope_t *scp, const tea_node_t *node)
   }
 
   object->type = struct_name->buf;
+  object->decl = struct_declr;
+  object->size = struct_declr->field_count * sizeof(tea_val_t);
+  object->flags = 0;
 
   const tea_val_t result = { .type = TEA_V_INST, .obj = object };
   return result;
@@ -187,19 +354,36 @@ tea_val_t *tea_get_field_ptr(const tea_ctx_t *ctx, const tea_scope_t *scp,
     return NULL;
   }
 
-  if (variable->val.type != TEA_V_INST) {
+  return tea_val_field_ptr(ctx, &variable->val, object_name, field_name);
+}
+
+tea_val_t *tea_val_field_ptr(const tea_ctx_t *ctx, const tea_val_t *value,
+                             const tea_tok_t *object_name,
+                             const tea_tok_t *field_name)
+{
+  if (value->type == TEA_V_DICT) {
+    const tea_dict_key_t key = tea_dict_key_tok(field_name);
+    tea_val_t *entry = tea_dict_find(value->dict, &key);
+    if (!entry) {
+      tea_log_err(
+        "Runtime error: Key '%s' not found in dictionary '%s' (line %d, col %d)",
+        field_name->buf, object_name->buf, field_name->line, field_name->col);
+    }
+    return entry;
+  }
+
+  if (value->type != TEA_V_INST) {
     tea_log_err(
       "Runtime error: Variable '%s' has type '%s' but field access requires an object instance "
       "(line %d, col %d)",
-      object_name->buf, tea_val_type_str(variable->val.type), object_name->line,
+      object_name->buf, tea_val_type_str(value->type), object_name->line,
       object_name->col);
     return NULL;
   }
-  const tea_inst_t *object = variable->val.obj;
+  const tea_inst_t *object = value->obj;
 
-  // Find the type declaration for this object type
-  const tea_struct_decl_t *struct_declr =
-    tea_find_struct_decl(ctx, object->type);
+  // Built-in objects have no declaration
+  const tea_struct_decl_t *struct_declr = object->decl;
   if (!struct_declr) {
     tea_log_err(
       "Runtime error: Cannot find type declaration for type '%s' when accessing field '%s' (line "
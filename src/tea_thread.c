@@ -0,0 +1,198 @@
+#include "tea_thread.h"
+#include "tea_log.h"
+
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Start and size of the native stack of the thread, see tea_stack_left
+static TEA_THREAD_LOCAL const char *tea_stack_base = NULL;
+static TEA_THREAD_LOCAL size_t tea_stack_size = 0;
+
+bool tea_mutex_init(tea_mutex_t *mutex)
+{
+#ifdef _WIN32
+  InitializeCriticalSection(&mutex->section);
+  return true;
+#else
+  return pthread_mutex_init(&mutex->mutex, NULL) == 0;
+#endif
+}
+
+void tea_mutex_destroy(tea_mutex_t *mutex)
+{
+#ifdef _WIN32
+  DeleteCriticalSection(&mutex->section);
+#else
+  pthread_mutex_destroy(&mutex->mutex);
+#endif
+}
+
+void tea_mutex_lock(tea_mutex_t *mutex)
+{
+#ifdef _WIN32
+  EnterCriticalSection(&mutex->section);
+#else
+  pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+void tea_mutex_unlock(tea_mutex_t *mutex)
+{
+#ifdef _WIN32
+  LeaveCriticalSection(&mutex->section);
+#else
+  pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+bool tea_cond_init(tea_cond_t *cond)
+{
+#ifdef _WIN32
+  InitializeConditionVariable(&cond->cond);
+  return true;
+#else
+  return pthread_cond_init(&cond->cond, NULL) == 0;
+#endif
+}
+
+void tea_cond_destroy(tea_cond_t *cond)
+{
+#ifdef _WIN32
+  (void)cond;
+#else
+  pthread_cond_destroy(&cond->cond);
+#endif
+}
+
+void tea_cond_wait(tea_cond_t *cond, tea_mutex_t *mutex)
+{
+#ifdef _WIN32
+  SleepConditionVariableCS(&cond->cond, &mutex->section, INFINITE);
+#else
+  pthread_cond_wait(&cond->cond, &mutex->mutex);
+#endif
+}
+
+void tea_cond_broadcast(tea_cond_t *cond)
+{
+#ifdef _WIN32
+  WakeAllConditionVariable(&cond->cond);
+#else
+  pthread_cond_broadcast(&cond->cond);
+#endif
+}
+
+void tea_cond_signal(tea_cond_t *cond)
+{
+#ifdef _WIN32
+  WakeConditionVariable(&cond->cond);
+#else
+  pthread_cond_signal(&cond->cond);
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI tea_thread_main(LPVOID arg)
+{
+  const tea_thread_t *thread = arg;
+  const char base = 0;
+  tea_stack_base = &base;
+  tea_stack_size = TEA_THREAD_STACK_SIZE;
+  tea_log_file = thread->log_file;
+  thread->fn(thread->arg);
+  tea_log_thread_exit();
+  return 0;
+}
+#else
+static void *tea_thread_main(void *arg)
+{
+  const tea_thread_t *thread = arg;
+  const char base = 0;
+  tea_stack_base = &base;
+  tea_stack_size = TEA_THREAD_STACK_SIZE;
+  tea_log_file = thread->log_file;
+  thread->fn(thread->arg);
+  tea_log_thread_exit();
+  return NULL;
+}
+#endif
+
+bool tea_thread_start(tea_thread_t *thread, const tea_thread_fn_t fn,
+                      void *arg)
+{
+  thread->fn = fn;
+  thread->arg = arg;
+  thread->log_file = tea_log_file;
+
+#ifdef _WIN32
+  thread->handle =
+    CreateThread(NULL, TEA_THREAD_STACK_SIZE, tea_thread_main, thread,
+                 STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
+  return thread->handle != NULL;
+#else
+  // Set, since the default differs between C libraries
+  pthread_attr_t attr;
+  if (pthread_attr_init(&attr) != 0) {
+    return false;
+  }
+  pthread_attr_setstacksize(&attr, TEA_THREAD_STACK_SIZE);
+  const bool is_started =
+    pthread_create(&thread->handle, &attr, tea_thread_main, thread) == 0;
+  pthread_attr_destroy(&attr);
+  return is_started;
+#endif
+}
+
+void tea_thread_join(tea_thread_t *thread)
+{
+#ifdef _WIN32
+  WaitForSingleObject(thread->handle, INFINITE);
+  CloseHandle(thread->handle);
+#else
+  pthread_join(thread->handle, NULL);
+#endif
+}
+
+size_t tea_stack_left(void)
+{
+  const char marker = 0;
+  if (!tea_stack_base) {
+    tea_stack_base = &marker;
+#ifdef _WIN32
+    // The size the linker gives the main thread
+    tea_stack_size = 1024 * 1024;
+#else
+    struct rlimit limit;
+    tea_stack_size = TEA_THREAD_STACK_SIZE;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY) {
+      tea_stack_size = (size_t)limit.rlim_cur;
+    }
+#endif
+  }
+
+  // Stacks grow down on the platforms Tea runs on. A thread that asked deep
+  // in its stack first has its start moved up
+  if ((uintptr_t)&marker > (uintptr_t)tea_stack_base) {
+    tea_stack_base = &marker;
+  }
+  const size_t used = (size_t)((uintptr_t)tea_stack_base - (uintptr_t)&marker);
+  return used < tea_stack_size ? tea_stack_size - used : 0;
+}
+
+int tea_cpu_count(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  const long count = (long)info.dwNumberOfProcessors;
+#else
+  const long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+  return count > 0 ? (int)count : 1;
+}
@@ -10,13 +10,18 @@ static const tea_kw_entry_t tea_keywords[] = { { "fn", TEA_TOKEN_FN },
                                                { "if", TEA_TOKEN_IF },
                                                { "else", TEA_TOKEN_ELSE },
                                                { "while", TEA_TOKEN_WHILE },
+                                               { "for", TEA_TOKEN_FOR },
+                                               { "in", TEA_TOKEN_IN },
+                                               { "step", TEA_TOKEN_STEP },
                                                { "break", TEA_TOKEN_BREAK },
                                                { "continue",
                                                  TEA_TOKEN_CONTINUE },
                                                { "typedef", TEA_TOKEN_TYPEDEF },
                                                { "return", TEA_TOKEN_RETURN },
+                                               { "yield", TEA_TOKEN_YIELD },
                                                { "new", TEA_TOKEN_NEW },
                                                { "null", TEA_TOKEN_NULL },
+                                               { "import", TEA_TOKEN_IMPORT },
                                                { NULL, 0 } };
 
 static bool equals(const char *a, const char *b, const int n)
@@ -58,6 +63,14 @@ const char *tea_tok_name(const int token_type)
     return "ELSE";
   case TEA_TOKEN_WHILE:
     return "WHILE";
+  case TEA_TOKEN_FOR:
+    return "FOR";
+  case TEA_TOKEN_IN:
+    return "IN";
+  case TEA_TOKEN_STEP:
+    return "STEP";
+  case TEA_TOKEN_YIELD:
+    return "YIELD";
   case TEA_TOKEN_BREAK:
     return "BREAK";
   case TEA_TOKEN_CONTINUE:
@@ -68,6 +81,8 @@ const char *tea_tok_name(const int token_type)
     return "RETURN";
   case TEA_TOKEN_NEW:
     return "NEW";
+  case TEA_TOKEN_IMPORT:
+    return "IMPORT";
   case TEA_TOKEN_IDENT:
     return "IDENT";
   case TEA_TOKEN_LPAREN:
@@ -88,6 +103,14 @@ const char *tea_tok_name(const int token_type)
     return "SEMICOLON";
   case TEA_TOKEN_ASSIGN:
     return "ASSIGN";
+  case TEA_TOKEN_PLUS_ASSIGN:
+    return "PLUS_ASSIGN";
+  case TEA_TOKEN_MINUS_ASSIGN:
+    return "MINUS_ASSIGN";
+  case TEA_TOKEN_STAR_ASSIGN:
+    return "STAR_ASSIGN";
+  case TEA_TOKEN_SLASH_ASSIGN:
+    return "SLASH_ASSIGN";
   case TEA_TOKEN_MINUS:
     return "MINUS";
   case TEA_TOKEN_PLUS:
@@ -118,13 +141,33 @@ const char *tea_tok_name(const int token_type)
     return "INTEGER";
   case TEA_TOKEN_FLOAT_NUMBER:
     return "FLOAT";
+  case TEA_TOKEN_I64_NUMBER:
+    return "I64";
+  case TEA_TOKEN_F64_NUMBER:
+    return "F64";
   case TEA_TOKEN_STRING:
     return "STRING";
   case TEA_TOKEN_DOT:
     return "DOT";
+  case TEA_TOKEN_DOTDOT:
+    return "DOTDOT";
   case TEA_TOKEN_QUESTION_MARK:
     return "QUESTION_MARK";
   default:
     return NULL;
   }
 }
+
+int64_t tea_tok_int(const tea_tok_t *tok)
+{
+  int64_t value;
+  memcpy(&value, tok->buf, sizeof(value));
+  return value;
+}
+
+double tea_tok_float(const tea_tok_t *tok)
+{
+  double value;
+  memcpy(&value, tok->buf, sizeof(value));
+  return value;
+}
@@ -15,10 +15,16 @@ const char *tea_val_type_str(const tea_val_type_t type)
     return "unset";
   case TEA_V_I32:
     return "i32";
+  case TEA_V_I64:
+    return "i64";
   case TEA_V_F32:
     return "f32";
+  case TEA_V_F64:
+    return "f64";
   case TEA_V_INST:
     return "object";
+  case TEA_V_DICT:
+    return "dict";
   case TEA_V_NULL:
     return "null";
   }
@@ -33,9 +39,12 @@ typedef struct {
 
 tea_val_type_t tea_val_type_by_str(const char *name)
 {
-  static tea_type_string_id ids[] = { { "i32", TEA_V_I32 },
+  static const tea_type_string_id ids[] = { { "i32", TEA_V_I32 },
+                                      { "i64", TEA_V_I64 },
                                       { "f32", TEA_V_F32 },
+                                      { "f64", TEA_V_F64 },
                                       { "string", TEA_V_INST },
+                                      { "dict", TEA_V_DICT },
                                       { NULL, TEA_V_UNDEF } };
 
   for (int i = 0; ids[i].name; ++i) {
@@ -49,100 +58,275 @@ tea_val_type_t tea_val_type_by_str(const char *name)
 
 tea_val_t tea_val_undef()
 {
-  static tea_val_t result = { .type = TEA_V_UNDEF };
+  const tea_val_t result = { .type = TEA_V_UNDEF };
   return result;
 }
 
 tea_val_t tea_val_null()
 {
   // For the keyword 'null' we don't know the exact type, so let it be just null
-  static tea_val_t result = { .type = TEA_V_NULL, .null_type = TEA_V_NULL };
+  const tea_val_t result = { .type = TEA_V_NULL, .null_type = TEA_V_NULL };
   return result;
 }
 
-#define TEA_APPLY_BINOP(a, b, op, result)                                      \
+static int tea_val_rank(const tea_val_type_t type)
+{
+  switch (type) {
+  case TEA_V_I32:
+    return 0;
+  case TEA_V_I64:
+    return 1;
+  case TEA_V_F32:
+    return 2;
+  case TEA_V_F64:
+    return 3;
+  default:
+    return -1;
+  }
+}
+
+tea_val_type_t tea_val_common_type(const tea_val_type_t lhs,
+                                   const tea_val_type_t rhs)
+{
+  const int lhs_rank = tea_val_rank(lhs);
+  const int rhs_rank = tea_val_rank(rhs);
+  if (lhs_rank < 0 || rhs_rank < 0) {
+    return TEA_V_UNDEF;
+  }
+
+  // f32 cannot hold every i64 value, so mixing them goes to f64
+  if ((lhs == TEA_V_I64 || rhs == TEA_V_I64) &&
+      (lhs == TEA_V_F32 || rhs == TEA_V_F32)) {
+    return TEA_V_F64;
+  }
+
+  return lhs_rank > rhs_rank ? lhs : rhs;
+}
+
+static void tea_val_convert(tea_val_t *value, const tea_val_type_t type)
+{
+  if (value->type == type) {
+    return;
+  }
+
+  switch (type) {
+  case TEA_V_I64:
+    value->i64 = value->i32;
+    break;
+  case TEA_V_F32:
+    value->f32 =
+      value->type == TEA_V_I32 ? (float)value->i32 : (float)value->i64;
+    break;
+  case TEA_V_F64:
+    switch (value->type) {
+    case TEA_V_I32:
+      value->f64 = value->i32;
+      break;
+    case TEA_V_I64:
+      value->f64 = (double)value->i64;
+      break;
+    default:
+      value->f64 = value->f32;
+      break;
+    }
+    break;
+  default:
+    break;
+  }
+
+  value->type = type;
+}
+
+bool tea_val_widen(tea_val_t *value, const tea_val_type_t type)
+{
+  if (value->type == type) {
+    return true;
+  }
+
+  const bool is_widening =
+    (value->type == TEA_V_I32 && (type == TEA_V_I64 || type == TEA_V_F64)) ||
+    (value->type == TEA_V_F32 && type == TEA_V_F64);
+  if (!is_widening) {
+    return false;
+  }
+
+  tea_val_convert(value, type);
+  return true;
+}
+
+#define TEA_APPLY_BINOP(a, b, op, result, field)                               \
   do {                                                                         \
     switch (op->type) {                                                        \
     case TEA_TOKEN_PLUS:                                                       \
-      result = a + b;                                                          \
-      break;                                                                   \
+      result.field = a + b;                                                    \
+      return result;                                                           \
     case TEA_TOKEN_MINUS:                                                      \
-      result = a - b;                                                          \
-      break;                                                                   \
+      result.field = a - b;                                                    \
+      return result;                                                           \
     case TEA_TOKEN_STAR:                                                       \
-      result = a * b;                                                          \
-      break;                                                                   \
+      result.field = a * b;                                                    \
+      return result;                                                           \
     case TEA_TOKEN_SLASH:                                                      \
       if (b == 0) {                                                            \
         tea_log_err("Runtime error: Division by zero at line %d, column %d",   \
                     op->line, op->col);                                        \
         return tea_val_undef();                                                \
       }                                                                        \
-      result = a / b;                                                          \
+      result.field = a / b;                                                    \
+      return result;                                                           \
+    default:                                                                   \
       break;                                                                   \
+    }                                                                          \
+  } while (0)
+
+#define TEA_APPLY_CMP(a, b, op, result)                                        \
+  do {                                                                         \
+    switch (op->type) {                                                        \
     case TEA_TOKEN_EQ:                                                         \
-      result = a == b;                                                         \
-      break;                                                                   \
+      *result = a == b;                                                        \
+      return true;                                                             \
     case TEA_TOKEN_NE:                                                         \
-      result = a != b;                                                         \
-      break;                                                                   \
+      *result = a != b;                                                        \
+      return true;                                                             \
     case TEA_TOKEN_GT:                                                         \
-      result = a > b;                                                          \
-      break;                                                                   \
+      *result = a > b;                                                         \
+      return true;                                                             \
     case TEA_TOKEN_GE:                                                         \
-      result = a >= b;                                                         \
-      break;                                                                   \
+      *result = a >= b;                                                        \
+      return true;                                                             \
     case TEA_TOKEN_LT:                                                         \
-      result = a < b;                                                          \
-      break;                                                                   \
+      *result = a < b;                                                         \
+      return true;                                                             \
     case TEA_TOKEN_LE:                                                         \
-      result = a <= b;                                                         \
+      *result = a <= b;                                                        \
+      return true;                                                             \
+    default:                                                                   \
       break;                                                                   \
     }                                                                          \
   } while (0)
 
+bool tea_val_cmp(const tea_val_t lhs_val, const tea_val_t rhs_val,
+                 const tea_tok_t *op, bool *result)
+{
+  tea_val_t lhs = lhs_val;
+  tea_val_t rhs = rhs_val;
+
+  if (lhs.type != rhs.type) {
+    const tea_val_type_t type = tea_val_common_type(lhs.type, rhs.type);
+    if (type != TEA_V_UNDEF) {
+      tea_val_convert(&lhs, type);
+      tea_val_convert(&rhs, type);
+    }
+  }
+
+  if (lhs.type == rhs.type) {
+    switch (lhs.type) {
+    case TEA_V_I32:
+      TEA_APPLY_CMP(lhs.i32, rhs.i32, op, result);
+      break;
+    case TEA_V_I64:
+      TEA_APPLY_CMP(lhs.i64, rhs.i64, op, result);
+      break;
+    case TEA_V_F32:
+      TEA_APPLY_CMP(lhs.f32, rhs.f32, op, result);
+      break;
+    case TEA_V_F64:
+      TEA_APPLY_CMP(lhs.f64, rhs.f64, op, result);
+      break;
+    default:
+      break;
+    }
+  }
+
+  tea_log_err(
+    "Runtime error: Unsupported comparison '%s' between types %s and %s at line %d, column %d",
+    tea_tok_name(op->type), tea_val_type_str(lhs_val.type),
+    tea_val_type_str(rhs_val.type), op->line, op->col);
+  return false;
+}
+
+bool tea_val_truthy(const tea_val_t value)
+{
+  switch (value.type) {
+  case TEA_V_I32:
+    return value.i32 != 0;
+  case TEA_V_I64:
+    return value.i64 != 0;
+  case TEA_V_F32:
+    return value.f32 != 0;
+  case TEA_V_F64:
+    return value.f64 != 0;
+  case TEA_V_INST:
+  case TEA_V_DICT:
+    return true;
+  default:
+    return false;
+  }
+}
+
 tea_val_t tea_val_binop(const tea_val_t lhs_val, const tea_val_t rhs_val,
                         const tea_tok_t *op)
 {
   tea_val_t result;
 
-  // By-default it's i32 for boolean ops
-  result.type = TEA_V_I32;
-
   switch (op->type) {
+  case TEA_TOKEN_EQ:
+  case TEA_TOKEN_NE:
+  case TEA_TOKEN_GT:
+  case TEA_TOKEN_GE:
+  case TEA_TOKEN_LT:
+  case TEA_TOKEN_LE: {
+    // Comparisons always produce an i32
+    bool is_true;
+    if (!tea_val_cmp(lhs_val, rhs_val, op, &is_true)) {
+      return tea_val_undef();
+    }
+    result.type = TEA_V_I32;
+    result.i32 = is_true;
+    return result;
+  }
   case TEA_TOKEN_OR:
-    result.i32 = lhs_val.i32 || rhs_val.i32;
+    result.type = TEA_V_I32;
+    result.i32 = tea_val_truthy(lhs_val) || tea_val_truthy(rhs_val);
     return result;
   case TEA_TOKEN_AND:
-    result.i32 = lhs_val.i32 && rhs_val.i32;
+    result.type = TEA_V_I32;
+    result.i32 = tea_val_truthy(lhs_val) && tea_val_truthy(rhs_val);
     return result;
   default:
     break;
   }
 
-  if (lhs_val.type == TEA_V_I32) {
-    if (rhs_val.type == TEA_V_I32) {
-      result.type = TEA_V_I32;
-      TEA_APPLY_BINOP(lhs_val.i32, rhs_val.i32, op, result.i32);
-      return result;
-    }
-    if (rhs_val.type == TEA_V_F32) {
-      result.type = TEA_V_F32;
-      TEA_APPLY_BINOP(lhs_val.i32, rhs_val.f32, op, result.f32);
-      return result;
+  tea_val_t lhs = lhs_val;
+  tea_val_t rhs = rhs_val;
+
+  // Operands of the same type take the direct path, mixed ones are converted
+  // to the wider type first
+  if (lhs.type != rhs.type) {
+    const tea_val_type_t type = tea_val_common_type(lhs.type, rhs.type);
+    if (type != TEA_V_UNDEF) {
+      tea_val_convert(&lhs, type);
+      tea_val_convert(&rhs, type);
     }
   }
 
-  if (lhs_val.type == TEA_V_F32) {
-    if (rhs_val.type == TEA_V_I32) {
-      result.type = TEA_V_F32;
-      TEA_APPLY_BINOP(lhs_val.f32, rhs_val.i32, op, result.f32);
-      return result;
-    }
-    if (rhs_val.type == TEA_V_F32) {
-      result.type = TEA_V_F32;
-      TEA_APPLY_BINOP(lhs_val.f32, rhs_val.f32, op, result.f32);
-      return result;
+  if (lhs.type == rhs.type) {
+    result.type = lhs.type;
+    switch (lhs.type) {
+    case TEA_V_I32:
+      TEA_APPLY_BINOP(lhs.i32, rhs.i32, op, result, i32);
+      break;
+    case TEA_V_I64:
+      TEA_APPLY_BINOP(lhs.i64, rhs.i64, op, result, i64);
+      break;
+    case TEA_V_F32:
+      TEA_APPLY_BINOP(lhs.f32, rhs.f32, op, result, f32);
+      break;
+    case TEA_V_F64:
+      TEA_APPLY_BINOP(lhs.f64, rhs.f64, op, result, f64);
+      break;
+    default:
+      break;
     }
   }
 
@@ -154,4 +338,66 @@ tea_val_t tea_val_binop(const tea_val_t lhs_val, const tea_val_t rhs_val,
   return tea_val_undef();
 }
 
+#undef TEA_APPLY_CMP
 #undef TEA_APPLY_BINOP
+
+#define TEA_APPLY_COMPOUND(target, value, op)                                  \
+  do {                                                                         \
+    switch (op->type) {                                                        \
+    case TEA_TOKEN_PLUS_ASSIGN:                                                \
+      target += value;                                                         \
+      break;                                                                   \
+    case TEA_TOKEN_MINUS_ASSIGN:                                               \
+      target -= value;                                                         \
+      break;                                                                   \
+    case TEA_TOKEN_STAR_ASSIGN:                                                \
+      target *= value;                                                         \
+      break;                                                                   \
+    case TEA_TOKEN_SLASH_ASSIGN:                                               \
+      if (value == 0) {                                                        \
+        tea_log_err("Runtime error: Division by zero at line %d, column %d",   \
+                    op->line, op->col);                                        \
+        return false;                                                          \
+      }                                                                        \
+      target /= value;                                                         \
+      break;                                                                   \
+    default:                                                                   \
+      return false;                                                            \
+    }                                                                          \
+  } while (0)
+
+bool tea_val_compound(tea_val_t *target, const tea_val_t rhs,
+                      const tea_tok_t *op)
+{
+  // The target keeps its type, so only the operand types that do not
+  // promote the result are accepted
+  if (tea_val_common_type(target->type, rhs.type) == target->type) {
+    tea_val_t value = rhs;
+    tea_val_convert(&value, target->type);
+
+    switch (target->type) {
+    case TEA_V_I32:
+      TEA_APPLY_COMPOUND(target->i32, value.i32, op);
+      return true;
+    case TEA_V_I64:
+      TEA_APPLY_COMPOUND(target->i64, value.i64, op);
+      return true;
+    case TEA_V_F32:
+      TEA_APPLY_COMPOUND(target->f32, value.f32, op);
+      return true;
+    case TEA_V_F64:
+      TEA_APPLY_COMPOUND(target->f64, value.f64, op);
+      return true;
+    default:
+      break;
+    }
+  }
+
+  tea_log_err(
+    "Runtime error: Unsupported compound assignment '%s' of %s to %s target at line %d, column %d",
+    tea_tok_name(op->type), tea_val_type_str(rhs.type),
+    tea_val_type_str(target->type), op->line, op->col);
+  return false;
+}
+
+#undef TEA_APPLY_COMPOUND
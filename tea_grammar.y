@@ -15,19 +15,22 @@
 %token FN IDENT LPAREN RPAREN LBRACE RBRACE LBRACKET RBRACKET.
 %token AT COLON COMMA.
 %token LET MUT SEMICOLON ASSIGN.
-%token RETURN.
+%token PLUS_ASSIGN MINUS_ASSIGN STAR_ASSIGN SLASH_ASSIGN.
+%token RETURN YIELD.
 %token MINUS PLUS STAR SLASH.
 %token GT LT EQ NE GE LE.
 %token AND OR.
-%token INTEGER_NUMBER FLOAT_NUMBER.
+%token INTEGER_NUMBER FLOAT_NUMBER I64_NUMBER F64_NUMBER.
 %token STRING.
 %token ARROW.
 %token IF ELSE WHILE BREAK CONTINUE.
+%token FOR IN STEP DOTDOT.
 %token TYPEDEF.
 %token NEW.
 %token DOT.
 %token EXCLAMATION_MARK QUESTION_MARK.
 %token NULL.
+%token IMPORT.
 
 %left ASSIGN.
 %left PLUS MINUS.
@@ -65,6 +68,9 @@ item(item_node) ::= attr_list(attrs) function(func). {
 item(item_node) ::= function(func). { item_node = func; }
 item(item_node) ::= statement(stmt). { item_node = stmt; }
 item(item_node) ::= struct_definition(struct_def). { item_node = struct_def; }
+item(item_node) ::= IMPORT STRING(module_path) SEMICOLON. {
+    item_node = tea_node_create(TEA_N_IMPORT, module_path);
+}
 
 attr_list(attr_list_node) ::= attr_list(existing_attrs) attribute(new_attr). {
     attr_list_node = existing_attrs ? existing_attrs : tea_node_create(TEA_N_ATTR, NULL);
@@ -231,10 +237,12 @@ stmt_list(stmt_list_node) ::= statement(single_stmt). {
 statement(stmt_node) ::= let_stmt(let_stmt_node). { stmt_node = let_stmt_node; }
 statement(stmt_node) ::= assign_stmt(assign_stmt_node). { stmt_node = assign_stmt_node; }
 statement(stmt_node) ::= return_stmt(return_stmt_node). { stmt_node = return_stmt_node; }
+statement(stmt_node) ::= yield_stmt(yield_stmt_node). { stmt_node = yield_stmt_node; }
 statement(stmt_node) ::= break_stmt(break_stmt_node). { stmt_node = break_stmt_node; }
 statement(stmt_node) ::= continue_stmt(continue_stmt_node). { stmt_node = continue_stmt_node; }
 statement(stmt_node) ::= if_stmt(if_stmt_node). { stmt_node = if_stmt_node; }
 statement(stmt_node) ::= while_stmt(while_stmt_node). { stmt_node = while_stmt_node; }
+statement(stmt_node) ::= for_stmt(for_stmt_node). { stmt_node = for_stmt_node; }
 statement(stmt_node) ::= expression(expr_node) SEMICOLON. { stmt_node = expr_node; }
 
 let_stmt(let_stmt_node) ::= LET mut_opt(mut) IDENT(var_name) type_annotation_opt(type_annot) ASSIGN expression(init_expr) SEMICOLON. {
@@ -255,6 +263,18 @@ assign_stmt(assign_stmt_node) ::= field_access(lhs) ASSIGN expression(rhs) SEMIC
     tea_node_set_binop(assign_stmt_node, lhs, rhs);
 }
 
+assign_stmt(assign_stmt_node) ::= IDENT(ident) PLUS_ASSIGN|MINUS_ASSIGN|STAR_ASSIGN|SLASH_ASSIGN(op) expression(rhs) SEMICOLON. {
+    // Compound assignments keep the operator token, plain ones have none
+    assign_stmt_node = tea_node_create(TEA_N_ASSIGN, op);
+    tea_node_t* lhs = tea_node_create(TEA_N_IDENT, ident);
+    tea_node_set_binop(assign_stmt_node, lhs, rhs);
+}
+
+assign_stmt(assign_stmt_node) ::= field_access(lhs) PLUS_ASSIGN|MINUS_ASSIGN|STAR_ASSIGN|SLASH_ASSIGN(op) expression(rhs) SEMICOLON. {
+    assign_stmt_node = tea_node_create(TEA_N_ASSIGN, op);
+    tea_node_set_binop(assign_stmt_node, lhs, rhs);
+}
+
 return_stmt(return_stmt_node) ::= RETURN SEMICOLON. {
     return_stmt_node = tea_node_create(TEA_N_RET, NULL);
 }
@@ -264,6 +284,11 @@ return_stmt(return_stmt_node) ::= RETURN expression(return_expr) SEMICOLON. {
     tea_node_add_child(return_stmt_node, return_expr);
 }
 
+yield_stmt(yield_stmt_node) ::= YIELD expression(yield_expr) SEMICOLON. {
+    yield_stmt_node = tea_node_create(TEA_N_YIELD, NULL);
+    tea_node_add_child(yield_stmt_node, yield_expr);
+}
+
 break_stmt(break_stmt_node) ::= BREAK SEMICOLON. {
     break_stmt_node = tea_node_create(TEA_N_BREAK, NULL);
 }
@@ -297,6 +322,36 @@ while_stmt(while_stmt_node) ::= WHILE expression(condition) LBRACE stmt_list_opt
     tea_node_add_child(while_stmt_node, body_node);
 }
 
+for_stmt(for_stmt_node) ::= FOR IDENT(var_name) IN expression(range_start) DOTDOT expression(range_end) step_opt(range_step) LBRACE stmt_list_opt(loop_body) RBRACE. {
+    for_stmt_node = tea_node_create(TEA_N_FOR, var_name);
+
+    tea_node_t *range_node = tea_node_create(TEA_N_FOR_RANGE, NULL);
+    tea_node_add_child(range_node, range_start);
+    tea_node_add_child(range_node, range_end);
+    tea_node_add_child(range_node, range_step);
+
+    tea_node_add_child(for_stmt_node, range_node);
+
+    tea_node_t *body_node = tea_node_create(TEA_N_FOR_BODY, NULL);
+    tea_node_add_child(body_node, loop_body);
+
+    tea_node_add_child(for_stmt_node, body_node);
+}
+
+for_stmt(for_stmt_node) ::= FOR IDENT(var_name) IN expression(iterable) LBRACE stmt_list_opt(loop_body) RBRACE. {
+    // Iterates over the values of a generator
+    for_stmt_node = tea_node_create(TEA_N_FOR, var_name);
+    tea_node_t *iter_node = tea_node_create(TEA_N_FOR_ITER, NULL);
+    tea_node_add_child(iter_node, iterable);
+    tea_node_add_child(for_stmt_node, iter_node);
+    tea_node_t *body_node = tea_node_create(TEA_N_FOR_BODY, NULL);
+    tea_node_add_child(body_node, loop_body);
+    tea_node_add_child(for_stmt_node, body_node);
+}
+
+step_opt(step_node) ::= STEP expression(step_expr). { step_node = step_expr; }
+step_opt(step_node) ::= . { step_node = NULL; }
+
 expression(expr_node) ::= logical_expr(logical_expr_node). { expr_node = logical_expr_node; }
 
 logical_expr(logical_expr_node) ::= logical_expr(left_expr) AND|OR(op) comp_expr(right_expr). {
@@ -355,6 +410,14 @@ primary_expr(primary_expr_node) ::= FLOAT_NUMBER(number_value). {
     primary_expr_node = tea_node_create(TEA_N_FLOAT, number_value);
 }
 
+primary_expr(primary_expr_node) ::= I64_NUMBER(number_value). {
+    primary_expr_node = tea_node_create(TEA_N_INT, number_value);
+}
+
+primary_expr(primary_expr_node) ::= F64_NUMBER(number_value). {
+    primary_expr_node = tea_node_create(TEA_N_FLOAT, number_value);
+}
+
 primary_expr(primary_expr_node) ::= NEW IDENT(struct_type) LBRACE struct_field_init_list_opt(field_inits) RBRACE. {
     primary_expr_node = tea_node_create(TEA_N_STRUCT_INST, struct_type);
     if (field_inits) {
@@ -0,0 +1,222 @@
+// Starts tea --serve on examples/038_serve.tea and checks its replies: a
+// client that doesn't read its replies doesn't hold up another one, a
+// request past --timeout fails, a worker past --max-requests is replaced and
+// a request line of the longest size the server takes is handled whole.
+// Run as tea_serve_test <tea> <script> <socket>
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEA_TEST_WAIT_MS 10000
+#define TEA_TEST_STALLED 100 // requests of the client that doesn't read
+#define TEA_TEST_NAME 3000 // bytes of the name each of them sends
+#define TEA_TEST_LINE 4096 // TEA_SERVE_LINE, the line break included
+
+static int tea_test_connect(const char *path)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+  // The server may still be starting
+  for (int i = 0; i < 100; i++) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+      return fd;
+    }
+    close(fd);
+    const struct timespec pause = { 0, 50 * 1000 * 1000 };
+    nanosleep(&pause, NULL);
+  }
+
+  return -1;
+}
+
+static bool tea_test_send(const int fd, const char *data, size_t size)
+{
+  while (size > 0) {
+    const ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= (size_t)written;
+  }
+
+  return true;
+}
+
+static bool tea_test_read(const int fd, char *data, const size_t size)
+{
+  size_t done = 0;
+  while (done < size) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, TEA_TEST_WAIT_MS) <= 0) {
+      fprintf(stderr, "No reply from the server\n");
+      return false;
+    }
+    const ssize_t count = read(fd, data + done, size - done);
+    if (count <= 0) {
+      fprintf(stderr, "The server closed the connection\n");
+      return false;
+    }
+    done += (size_t)count;
+  }
+
+  return true;
+}
+
+// Sends the request and reads its reply, "<status> <size>\n" and the body
+static bool tea_test_call(const int fd, const char *request, char *status,
+                          char *body, const size_t capacity)
+{
+  if (!tea_test_send(fd, request, strlen(request))) {
+    fprintf(stderr, "Failed to send '%s'\n", request);
+    return false;
+  }
+
+  char header[64];
+  size_t length = 0;
+  do {
+    if (length == sizeof(header) - 1 ||
+        !tea_test_read(fd, header + length, 1)) {
+      return false;
+    }
+  } while (header[length++] != '\n');
+  header[length] = 0;
+
+  size_t size = 0;
+  if (sscanf(header, "%15s %zu", status, &size) != 2 || size >= capacity) {
+    fprintf(stderr, "Invalid reply header '%s'\n", header);
+    return false;
+  }
+  if (!tea_test_read(fd, body, size)) {
+    return false;
+  }
+  body[size] = 0;
+  return true;
+}
+
+static bool tea_test_expect(const int fd, const char *request,
+                            const char *status, const char *text)
+{
+  char got_status[16];
+  static char body[65536];
+  if (!tea_test_call(fd, request, got_status, body, sizeof(body))) {
+    return false;
+  }
+  if (strcmp(got_status, status) != 0 || !strstr(body, text)) {
+    fprintf(stderr, "'%s' got '%s' '%s', expected '%s' '%s'\n", request,
+            got_status, body, status, text);
+    return false;
+  }
+
+  return true;
+}
+
+static bool tea_test_run(const char *socket_path)
+{
+  // Replies pile up on this one, more than its socket holds
+  const int stalled = tea_test_connect(socket_path);
+  const int client = tea_test_connect(socket_path);
+  if (stalled < 0 || client < 0) {
+    fprintf(stderr, "Failed to connect to '%s'\n", socket_path);
+    return false;
+  }
+
+  char request[TEA_TEST_NAME + 16];
+  strcpy(request, "greet '");
+  memset(request + 7, 'x', TEA_TEST_NAME);
+  strcpy(request + 7 + TEA_TEST_NAME, "'\n");
+  for (int i = 0; i < TEA_TEST_STALLED; i++) {
+    if (!tea_test_send(stalled, request, strlen(request))) {
+      fprintf(stderr, "Failed to send to the stalled client\n");
+      return false;
+    }
+  }
+
+  // greet 'x...x' and the line break fill the longest line
+  static char longest[TEA_TEST_LINE + 1];
+  const size_t name_size = TEA_TEST_LINE - 9;
+  strcpy(longest, "greet '");
+  memset(longest + 7, 'x', name_size);
+  strcpy(longest + 7 + name_size, "'\n");
+
+  const bool is_ok =
+    tea_test_expect(client, "add 2 3\n", "ok", "5") &&
+    tea_test_expect(client, longest, "ok", "xxx\n") &&
+    tea_test_expect(client, "spin 1\n", "err", "Request timed out") &&
+    tea_test_expect(client, "add 40 2\n", "ok", "42") &&
+    tea_test_expect(client, ":stats\n", "ok", "timeouts 1\n");
+
+  // The stalled requests and the three above retire the worker at least
+  // once, besides the replacement of the one that timed out
+  char status[16];
+  static char body[65536];
+  bool has_respawns = false;
+  if (is_ok && tea_test_call(client, ":stats\n", status, body, sizeof(body))) {
+    const char *respawns = strstr(body, "respawns ");
+    has_respawns = respawns && atol(respawns + 9) >= 2;
+    if (!has_respawns) {
+      fprintf(stderr, "Workers were not retired:\n%s", body);
+    }
+  }
+
+  close(stalled);
+  close(client);
+  return is_ok && has_respawns;
+}
+
+int main(const int argc, char **argv)
+{
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s <tea> <script> <socket>\n", argv[0]);
+    return 2;
+  }
+
+  const pid_t server = fork();
+  if (server < 0) {
+    fprintf(stderr, "Failed to fork the server\n");
+    return 1;
+  }
+  if (server == 0) {
+    // What the workers print when they start is not part of the test
+    freopen("/dev/null", "w", stdout);
+    execl(argv[1], argv[1], "--serve", "--workers", "1", "--timeout", "500",
+          "--max-requests", "40", "--socket", argv[3], argv[2], (char *)NULL);
+    _exit(127);
+  }
+
+  const bool is_ok = tea_test_run(argv[3]);
+
+  kill(server, SIGTERM);
+  int status = 0;
+  while (waitpid(server, &status, 0) < 0 && errno == EINTR) {
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "The server didn't stop cleanly\n");
+    return 1;
+  }
+
+  printf("%s\n", is_ok ? "ok" : "failed");
+  return is_ok ? 0 : 1;
+}